@@ -11,9 +11,11 @@
 * level, a Windows physical drive.
 *
 * The diagnostic maintains two buffers, one for reads and one for writes, which
-* hold a large number of sectors (currently 256, but configurable). The idea is
+* hold a large number of sectors (256 at startup, set with bufsize). The idea is
 * that you can set up patterns in the write buffer to be written out to disc,
 * then read sectors into the read buffer for check, comparision or examination.
+* Both are slots of a small pool, and bufsel or swap can point either at another
+* slot, so data read can be patched and written back in place.
 *
 * The diagnostic is CLI oriented, and is "minimally scriptable". This means
 * it supports multiple commands on a line, loops, variables, and other 
@@ -29,20 +31,114 @@
 *
 * w, write [lba][num]         - Read sector(s) at LBA, default read 0 1.
 *
+* qd [num]                    - Set queue depth, default is print current.
+*
+* rq, readq [lba][num]        - Queue read of sector(s) at LBA, default 0 1.
+*
+* wq, writeq [lba][num]       - Queue write of sector(s) at LBA, default 0 1.
+*
+* rv, readv [lba num]...      - Read a batch of transfers together, default is
+*                               the LBA list.
+*
+* wrv, writev [lba num]...    - Write a batch of transfers together, default is
+*                               the LBA list.
+*
+* lbalist [clear|add lba num...|rand count [num]] - Fill the LBA list, default
+*                               is print its size.
+*
+* qwait                       - Wait for all queued reads and writes to finish.
+*
+* wv, verify [lba [num [pat [val]]]] - Write pattern to sector(s) from LBA, read
+*                               back and compare, default is lba to drive end.
+*
+* workload [keyword val]... [rand|seq] - Run a queued mix of reads and writes,
+*                               keywords read, bs, bsmax, lba, num, qd, time,
+*                               ios.
+*
+* rate [num [iops|mbps] | off] - Pace reads, writes and workload to a rate,
+*                               default is print current.
+*
+* runfor [secs|off]           - Stop the run after secs, as a break does,
+*                               default is print time left.
+*
+* trim [lba [num]]            - Discard sector(s) from LBA, default is 1 sector.
+*
+* zero [lba [num]]            - Set sector(s) from LBA to zero, default is 1
+*                               sector.
+*
+* precondition [passes]       - Trim the whole drive, then fill it from the write
+*                               buffer at full queue depth, default is 1 pass.
+*
+* verifyall                   - Read back everything written, and check the
+*                               signatures of what was written with sig.
+*
+* direct [on|off]             - Set direct (uncached) drive access, default is
+*                               print current.
+*
+* bufsize [num]               - Set read and write buffer size in sectors,
+*                               default is print current.
+*
+* bufsel [w slot] [r slot]    - Point writes or reads at a buffer slot, 0 to 7,
+*                               default is print current.
+*
+* swap                        - Swap the read and write buffers.
+*
+* bufcopy [off [num [src [dst]]]] - Copy sectors between buffer slots, default
+*                               is all of the read buffer to the write buffer.
+*
+* align [on|off]              - Set lbarnd to physical sector starts, default is
+*                               print current.
+*
+* dist [kind [val...]]        - Set lbarnd distribution, uniform, zipf theta,
+*                               hotspot iopct spanpct or normal centre dev,
+*                               default is print current.
+*
+* affinity [cpu|off]          - Pin thread to a CPU, default is print current.
+*
+* numa [node|auto|off]        - Run thread and take its buffers on a NUMA node,
+*                               auto is the drive's, default is print current.
+*
+* spawn label drive [val]...  - Run procedure on drive in a new worker.
+*
+* join                        - Wait for all workers and print their totals.
+*
+* lat [clear]                 - Print read and write latency percentiles, or
+*                               clear them.
+*
+* interval [secs [file [csv|json]] | off] - Sample statistics every secs while
+*                               running, default is print current.
+*
+* report [json|csv [file] | off] - Write a record of each line, procedure and
+*                               worker, default is print current.
+*
+* bench [ms]                  - Time the diagnostic's own fills, compares,
+*                               random numbers, expressions and dispatch, ms
+*                               for each, default 200.
+*
 * dw, dumpwrite [num]         - Dump sector(s) from write buffer, default 1.   
 *
 * dr, dumpread [num]          - Dump sector(s) from read buffer, default 1.   
 *
-* pt, pattn [pat [val [cnt]]] - Set write buffer to pattern, default is count.  
+* pt, pattn [pat [val [cnt [off]]]] - Set write buffer to pattern, from sector
+*                               off, default is count.
 *
 * c, comp [pat [val [cnt]]]   - Compare read buffer to pattern, default is count. 
 * 
+* csig [lba [cnt [gen]]]      - Check sector signatures in read buffer, default
+*                               is lba 0 and the whole buffer.
+*
+* map [on|off|clear|save file|load file] - Show, turn on or off, clear, save
+*                               or load the map of what was written, default is
+*                               show.
+*
 * cm, compmode mode           - Set miscompare handling mode.
 *
-* drive [num]                 - Set current physical drive, default is print current. 
+* drive [num|path]            - Set current physical drive, default is print current. 
 *
 * listdrives, ld              - List available physical drives. 
 *
+* devopt [name [val]]         - Set device option, default is list them.
+*
 * unprot                      - Unprotect current drive. 
 *
 * echo [text]                 - Echo the parameter area with next line. 
@@ -126,12 +222,157 @@
 *         writes the first dword of each sector, use another pattern
 *         to fill the background.
 *
+* sig   - Each sector gets a signature: its LBA, starting at [val], the write
+*         generation, the random seed and the time, then data made from
+*         those, and a CRC32C over it all. csig checks it, a sector at a
+*         time, without knowing how it was written.
+*
 * buffs - Compare the read and write buffers to each other. This allows
 *         complex patterns to be built up in the write buffer.
 * 
 * All write operations are from the write buffer.
 *
 * All read operations are from the read buffer.
+*
+* Queued reads and writes (rq and wq) are sent to the drive without waiting
+* for them to finish, so that up to the queue depth set by qd are in flight at
+* once. When the queue is full, the next queued command waits for the oldest
+* to finish. Plain reads and writes, changing drives and the end of each
+* command line all wait for the queue to empty. Since queued reads all land in
+* the read buffer, its contents are only meaningful with a queue depth of 1.
+*
+* Normally the operating system caches the drive, so reading a sector again
+* may not touch the drive at all. "direct on" bypasses the cache so that the
+* statistics measure the drive itself.
+* 
+* LBAs, transfers and buffers count in the drive's own (logical) sector size,
+* given by secsiz, which is 512 or 4096. Many drives with 512 byte sectors
+* write 4096 bytes at a time (psecsiz), and a write that covers only part of
+* that makes the drive read it first. "align on" keeps lbarnd to LBAs that start
+* a physical sector, so that random tests measure the fast path.
+* 
+* Real loads use some LBAs much more than others, which drive caches favour.
+* dist sets how lbarnd and random workloads pick LBAs: uniform, zipf with a
+* skew theta (0.99 is typical), hotspot with a percent of the I/O going to a
+* percent of the span at its start, or normal around a centre. The places in
+* the span used most are at its start, except for normal. srand restarts the
+* LBA sequence too.
+* 
+* wv writes a pattern over a span of sectors, reads it back and compares it, a
+* buffer's worth at a time, with the buffers kept in a ring (up to 16, limited
+* by the queue depth) so that the drive is busy with one chunk while the next is
+* patterned and the last is compared. The default pattern is lba, which marks
+* every sector with its own LBA, over the write buffer contents. Mismatches are
+* reported by LBA, with offsets within the sector, and end with an error.
+* 
+* spawn runs a procedure on its own thread, as a worker, against the given
+* drive. Each worker has its own drive, buffers, variables and statistics, so
+* several drives, or several parts of one drive, can be tested at once. The
+* worker starts with a copy of the buffers and the drive write locked. join
+* waits for all the workers to end, then prints the totals for each drive and
+* for all drives. The program can't be changed while workers are running.
+* 
+* Each read and write is timed, from the time it is sent to the drive until it
+* is seen done, and filed in a latency histogram for its direction. The
+* histogram doubles its range every 32 buckets, so any latency is held to
+* within about 3%, without keeping the samples themselves. lat prints the
+* percentiles so far. The histograms are cleared when the drive is changed,
+* and join prints them for each drive.
+* 
+* The statistics end with a line on where the time went, when any of it was
+* spent on the drive, making patterns or comparing: Dev is the time waiting on
+* the drive, in transfers and in queueing and reaping them, and CPU is the rest,
+* the diagnostic's own, split into patterns (Pat), compares (Comp), and Other,
+* which is parsing and running commands. When the IOPS are low and Dev is not
+* most of the time, the drive is not what holds the test back. With a rate
+* set, the time spent waiting for transfers to be due is taken out as Idle.
+* 
+* rate paces r, w, rq, wq, rv, wrv and workload to a number of transfers
+* (iops) or megabytes (mbps) a second, instead of running flat out, so the
+* latency can be measured at a load below what the drive can take. Running a
+* workload at 10%, 20% and so on of the rate it does flat out shows where the
+* latency turns up. Each transfer is due a fixed time after the last one was,
+* and its latency is counted from then. When the drive falls behind, the
+* transfers after go as soon as they can to catch up, and the time they were
+* held up counts in their latency, as it would for a program that needed them
+* then. Each worker runs at the rate on its own.
+* 
+* A break (ctrl-c) is taken between blocks compared, transfers and commands.
+* Queued transfers still in flight are cancelled where the system can, which
+* for most drives it can't, so they finish and are counted first. runfor
+* stops the run after so many seconds in the same way, to end a test at a
+* time without counting loops. Each worker spawned after it stops on its own
+* when the time is up. With exitonerror, the diagnostic then exits, as it does
+* on a break.
+* 
+* trim and zero send a span to the drive to be discarded or zeroed, without
+* sending data. They are counted apart from writes, and when there were any,
+* the statistics have a line more with their operations (IOTR, IOZ) and bytes
+* (BTR, BZ). precondition trims the whole drive and then fills it, to get an
+* SSD to the speed it settles to in use before it is measured.
+* 
+* rv and wrv send a batch of transfers to the drive together, as many at a
+* time as the queue depth, in one call where the system allows it, so a
+* batch of small random transfers pays for one command line and one system
+* call. The transfers are given on the line, or come from the LBA list, which
+* lbalist fills, with pairs or with random LBAs. They go end to end in the
+* buffer.
+* 
+* Each write is filed in a map of the extents written on the drive, with the
+* generation of the sig pattern it wrote, if it did. verifyall reads back only
+* those, joining extents that touch into long reads, and checks each sector's
+* signature, so a drive that was written in a few places verifies in the time
+* it takes to read those. Trims take sectors out of the map, and setting the
+* drive clears it. map save and map load keep it across runs. map off stops
+* the filing for runs that don't need it, and the map turns itself off past
+* a few million extents, so it never costs a run much time or memory.
+* 
+* Drives 0 to 9 are the system's first ten discs (sda to sdj on Linux). Any
+* NVMe namespaces found at start come next, then any path given to drive,
+* which gets the next free number and keeps it. A path starts with /, \, . or
+* a double quote, and can be a device or an image file, whose size is the
+* size of the file. A drive that can't be opened for writing is opened read
+* only.
+* 
+* affinity pins the thread to a CPU, and numa runs it on the CPUs of a NUMA
+* node and takes its buffers from the node's memory. numa auto uses the node
+* the current drive's controller is on, which Linux gives in sysfs, and
+* follows the drive when it changes. On a server with more than one socket
+* this keeps the thread and its buffers next to the drive, so bandwidth is the
+* same from run to run. Workers take both settings with them when spawned,
+* and a procedure can set its own.
+* 
+* The stub build runs against a simulated disc in memory. Only the parts
+* written use memory, so it can be set to any size. devopt sets its size in
+* sectors (size), sector sizes (lsec, psec), the nanoseconds to start a
+* transfer and for each byte (opns, bytens), failed transfers per million
+* (err, restarted by seed), and erases it (clear). Set the drive again after
+* changing the size or sector sizes. devopt alone lists the settings.
+* 
+* interval samples the statistics every so many seconds while commands run,
+* for the main thread and each worker, and writes what each did since the last
+* sample as a line of CSV or JSON: the operations, bytes, rates and latency
+* percentiles for the interval. This shows a long run change over time, as when
+* a drive's write cache fills. Samples are taken between commands and between
+* the transfers of wv and workload.
+* 
+* report writes a record, as a line of JSON or CSV, for each command line, each
+* procedure and each worker: the drive, its size and sector size, operations,
+* bytes, time, latency percentiles and result, and the failed transfers and
+* miscompares, with the LBAs of the first of them. Ending the report, or the
+* diagnostic, adds a summary record for each drive. Records are held in memory
+* and written when a line is done, so the file is not written mid-transfer.
+* 
+* bench times the diagnostic's own work, to show it is not what limits a test:
+* the pattern fills, compare, CRC32C, the random numbers, an expression run
+* from the cache and parsed afresh, dispatching a command, and with a drive
+* set, a one sector read. Each is given in nanoseconds per operation and GB/s,
+* except the lba fill, which writes only 4 bytes of each sector, so it is
+* counted in sectors and millions of sectors a second (Ms/s). The read is timed
+* with the statistics clock, so it takes in the drive. The stub build
+* (cdiscdiag_stub) reads from memory, but its clock counts the simulated
+* transfer time, so set devopt opns 0 and bytens 0 first to see the cost of a
+* transfer with no drive at all.
 * 
 * All drives start write locked, and are relocked when the drive is changed.
 * 
@@ -146,12 +387,31 @@
 * rand   - Gives a random number.
 *
 * lbarnd - Gives a random LBA for the current drive, ie., a random number
-*          that fits into 0..drvsiz-1.
+*          that fits into 0..drvsiz-1, picked by dist.
+*
+* secsiz - Size of sector in bytes (512 or 4096).
 *
-* secsiz - Size of sector in bytes (always 512).
+* psecsiz - Size of physical sector in bytes, what the drive writes at once.
 *
 * bufsiz - Size of read and write buffers in sectors.
 *
+* latp50r, latp99r, latp999r, latmaxr - Read latency at the 50th, 99th and
+*          99.9th percentiles, and the longest, in nanoseconds.
+*
+* latp50w, latp99w, latp999w, latmaxw - The same for writes.
+*
+* siggen - Write generation of the last sig pattern made.
+*
+* devns, cpuns - Nanoseconds waiting on the drive, and in the diagnostic, since
+*          the line started.
+*
+* patns, compns - Nanoseconds of cpuns making patterns, and comparing.
+*
+* devpct - Percent of the time since the line started waiting on the drive.
+*
+* idlens - Nanoseconds since the line started waiting for paced transfers to
+*          be due, which is not in cpuns.
+*
 * The compare modes are:
 * 
 * all - Show all mismatches.
@@ -261,10 +521,44 @@
 #include <ctype.h>
 #include <signal.h>
 #include <time.h>
+#include <math.h>
 #include "discio.h"
 
 #include <time.h>
 
+/*
+ * Vector units used for pattern fills, where the compiler has them.
+ */
+#if defined(__AVX2__)
+#define PATAVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#define PATSSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#define PATNEON
+#include <arm_neon.h>
+#endif
+
+/*
+ * CRC32C instructions used for sector signatures, where the compiler has them.
+ */
+#if defined(__SSE4_2__) && (defined(__x86_64__) || defined(_M_X64))
+#define CRCSSE42
+#include <nmmintrin.h>
+#elif defined(__ARM_FEATURE_CRC32) && defined(__aarch64__)
+#define CRCARM
+#include <arm_acle.h>
+#endif
+
+/*
+ * Older Microsoft compilers have the 64 bit string to number conversion under
+ * another name.
+ */
+#if defined(_MSC_VER) && _MSC_VER < 1800
+#define strtoull _strtoui64
+#endif
+
 /**
  *
  * Number of lines on screen (used to pause output)
@@ -276,28 +570,111 @@
  *
  * Break flag
  *
- * Indicates ctl-c was hit on the console.
+ * Indicates ctl-c was hit on the console. It is all the signal handler
+ * touches, and it is only looked at between blocks, transfers and commands,
+ * never in the loops over the data. Workers look at it too, so it and
+ * workbreak are only read and set with FLAGGET and FLAGSET.
+ *
+ */
+static volatile sig_atomic_t breakflag;
+
+/**
+ *
+ * Run time limit
+ *
+ * Time set with runfor that the run stops at, as if a break was hit, or 0 if
+ * there is none. Each worker has its own, taken from the thread that spawned
+ * it.
  *
  */
-static int breakflag;
+THREAD long long deadline;
 
 /**
  *
  * Sector write data buffer
  *
- * Writes take their data from here.
+ * Writes take their data from here. Allocated from the I/O module at startup,
+ * so that it is aligned for direct transfers.
  *
  */
-unsigned char writebuffer[SECSIZE*NOSECS];
+THREAD unsigned char *writebuffer;
 
 /**
  *
  * Sector read data buffer
  *
- * Reads and writes put their data here.
+ * Reads and writes put their data here. Allocated from the I/O module at
+ * startup, so that it is aligned for direct transfers.
+ *
+ */
+THREAD unsigned char *readbuffer;
+
+/**
+ *
+ * Buffer pool
+ *
+ * The read and write buffers are two slots of a pool, slot 0 for writes and
+ * slot 1 for reads at startup. bufsel and swap point either role at any other
+ * slot, so what was read can be patched and written back without copying it.
+ * Slots past the first two are allocated when first selected, and all of them
+ * are the buffer size. Each slot keeps the signature it held when it was last
+ * the write buffer, until it is read into.
+ *
+ */
+#define BUFSLOTS 8
+
+THREAD unsigned char *bufpool[BUFSLOTS];
+THREAD long long slotsig[BUFSLOTS];
+THREAD long long slotsiglba[BUFSLOTS];
+THREAD int wrslot;
+THREAD int rdslot;
+
+/**
+ *
+ * Buffer size
+ *
+ * The size of both the read and write buffers in sectors. This starts at
+ * NOSECS and is changed with the bufsize command.
+ *
+ */
+THREAD long long bufsecs;
+
+/**
+ *
+ * Sector sizes
+ *
+ * The logical sector size of the current drive, in bytes, which LBAs, transfers
+ * and buffers are counted in, and the physical sector size the drive writes
+ * in. Both are SECSIZE until a drive says otherwise.
  *
  */
-unsigned char readbuffer[SECSIZE*NOSECS];
+/** Logical sector size */  THREAD int secsize = SECSIZE;
+/** Physical sector size */ THREAD int physecsize = SECSIZE;
+
+/**
+ *
+ * Align random LBAs
+ *
+ * When set, lbarnd only gives LBAs that start a physical sector, so random
+ * transfers don't make the drive read, modify and write partial sectors.
+ *
+ */
+THREAD int alignlba;
+
+/**
+ *
+ * Thread placement
+ *
+ * The CPU this thread is pinned to, and the NUMA node it runs on and takes its
+ * buffers from, or -1 for none. The node can also be NUMAAUTO, to follow the
+ * current drive. Set with the affinity and numa commands, and passed on to
+ * workers when they are spawned.
+ *
+ */
+#define NUMAAUTO -2
+/** CPU pinned to */  THREAD int cpupin = -1;
+/** Node setting */   THREAD int numaset = -1;
+/** Node in use */    THREAD int curnode = -1;
 
 /**
  *
@@ -307,7 +684,7 @@ unsigned char readbuffer[SECSIZE*NOSECS];
  * set.
  *
  */
-int currentdrive;
+THREAD int currentdrive;
 
 /**
  *
@@ -317,7 +694,7 @@ int currentdrive;
  * that it is not that easy to wipe the active drive.
  *
  */
-int writeprot;
+THREAD int writeprot;
 
 /**
  *
@@ -330,7 +707,7 @@ int writeprot;
  *
  */
 
-long long drivesize;
+THREAD long long drivesize;
 
 /**
  *
@@ -340,7 +717,7 @@ long long drivesize;
  *
  */
 
-double iopwrite;
+THREAD double iopwrite;
 
 /**
  *
@@ -350,7 +727,7 @@ double iopwrite;
  *
  */
 
-double iopread;
+THREAD double iopread;
 
 /**
  *
@@ -360,7 +737,7 @@ double iopread;
  *
  */
 
-double bcwrite;
+THREAD double bcwrite;
 
 /**
  *
@@ -370,7 +747,232 @@ double bcwrite;
  *
  */
 
-double bcread;
+THREAD double bcread;
+
+/**
+ *
+ * Total trim and zero operations
+ *
+ * Tallies trims and zeroes apart from writes, since no data is sent for them,
+ * and the drive can take them much faster.
+ *
+ */
+
+THREAD double ioptrim;
+THREAD double iopzero;
+
+/**
+ *
+ * Total bytes trimmed and zeroed
+ *
+ */
+
+THREAD double bctrim;
+THREAD double bczero;
+
+/**
+ *
+ * Time breakdown
+ *
+ * The nanoseconds spent waiting on the drive, in transfers and in submitting
+ * and reaping queued ones, the nanoseconds spent making patterns and
+ * comparing, and the nanoseconds spent waiting for paced transfers to be due,
+ * since the statistics started at marktime. What is left of the time since
+ * marktime is the diagnostic itself, parsing and running commands.
+ *
+ */
+
+/** Start of statistics */  THREAD long long marktime;
+/** Device time */          THREAD long long devns;
+/** Pattern time */         THREAD long long patns;
+/** Compare time */         THREAD long long compns;
+/** Pacing time */          THREAD long long idlens;
+
+/**
+ *
+ * Transfer rate
+ *
+ * With a rate set, reads and writes are paced to it instead of going as fast
+ * as the drive takes them. Each transfer is due a fixed time after the one
+ * before, 1/iops seconds, or its size over the bytes per second. The times
+ * run on from when the pacing started, not from when each transfer went, so
+ * one the drive held up doesn't push back the ones after it, and its latency
+ * is counted from when it was due, with setissue. The pacing starts again with
+ * each command line, each workload, and when the rate is set.
+ *
+ */
+
+/** Transfers per second, 0 is none */       THREAD long long rateiops;
+/** Bytes per second, 0 is none */           THREAD long long ratebps;
+/** Time next transfer is due, 0 is start */ THREAD long long ratenext;
+
+/**
+ *
+ * Longest pacing wait
+ *
+ * A wait for a paced transfer to be due is made in pieces of at most this many
+ * nanoseconds, so a break is seen.
+ *
+ */
+#define PACEPOLL 100000000LL
+
+/**
+ *
+ * Sector signature layout
+ *
+ * Byte offsets of the fields at the start of each sector of the sig pattern.
+ * The CRC covers the sector from the LBA on.
+ *
+ */
+
+#define SIGMARK 0  /* mark, SIGMAGIC */
+#define SIGCRC  4  /* CRC32C */
+#define SIGLBA  8  /* LBA written to */
+#define SIGGEN  16 /* write generation */
+#define SIGSEED 24 /* seed */
+#define SIGTIME 32 /* time written in nanoseconds */
+#define SIGHDR  40 /* length of header */
+
+/** Signature mark, "DSIG" */
+#define SIGMAGIC 0x44534947UL
+
+/** CRC32C polynomial, reversed */
+#define CRCPOLY 0x82f63b78UL
+
+/** CRC32C tables */ unsigned long crctbl[8][256];
+
+/**
+ *
+ * Signature write generation
+ *
+ * Counts up each time a sig pattern is made, so that a sector still holding
+ * an older one shows its write was lost.
+ *
+ */
+
+THREAD long long siggen;
+
+/**
+ *
+ * Signature in write buffer
+ *
+ * The generation of the sig pattern the write buffer holds, or 0 if it holds
+ * another pattern, and the LBA its first sector is signed for.
+ *
+ */
+
+THREAD long long sigbuf;
+THREAD long long siglba;
+
+/**
+ *
+ * LBA list
+ *
+ * A list of transfers, each an LBA and a number of sectors, for rv and wrv to
+ * send in batches.
+ *
+ */
+typedef struct _lbaent {
+
+    /** LBA */               long long lba;
+    /** Number of sectors */ long long num;
+
+} lbaent;
+
+typedef struct _lbalist {
+
+    /** Transfers */              lbaent *ent;
+    /** Transfers in use */       long long cnt;
+    /** Transfers there is room for */ long long max;
+
+} lbalist;
+
+/** The LBA list scripts fill */ THREAD lbalist lbalst;
+
+/** Transfers the LBA list starts with room for */
+#define LBAINIT 1024
+
+/** Most extents the written map holds, it is turned off past that */
+#ifdef __LARGE__
+#define MAPMAX 1000 // dos
+#else
+#define MAPMAX 4000000 // windows/linux (about 160mb)
+#endif
+
+/**
+ *
+ * Written extent
+ *
+ * A span of sectors that was written, and the generation of the sig pattern
+ * written to it, or 0 if it was written with another pattern.
+ *
+ */
+typedef struct _extent {
+
+    /** First LBA */             long long lba;
+    /** Number of sectors */     long long num;
+    /** Signature generation */  long long gen;
+    /** Extents before */        struct _extent *left;
+    /** Extents after */         struct _extent *right;
+
+} extent;
+
+/**
+ *
+ * Written map
+ *
+ * The extents written on the current drive, not overlapping, so verifyall can
+ * read back just those. A later write replaces what it covers, and extents
+ * that touch with the same generation are joined, so the map stays as small
+ * as the writes allow. It is cleared when a drive is set.
+ *
+ * The extents are a tree in LBA order, kept balanced as a treap, with each
+ * extent's priority a hash of its LBA, so filing a write takes time in the log
+ * of the extents, not in their number. map off stops the filing, and the map
+ * turns itself off if it grows past MAPMAX extents.
+ *
+ */
+
+/** Root of extent tree */   THREAD extent *extroot;
+/** Extents in use */        THREAD long long extcnt;
+/** Map is turned off */     THREAD int mapoff;
+
+/** Number of bits of each latency kept, sets buckets per octave */
+#define LATBITS 5
+/** Buckets in each octave of the latency histogram */
+#define LATSUB (1 << LATBITS)
+/** Total latency buckets, enough for any 63 bit latency */
+#define LATBUCKETS ((64-LATBITS)*LATSUB)
+
+/**
+ *
+ * Latency histogram
+ *
+ * Latencies below 2*LATSUB ns get a bucket each. Above that, each doubling of
+ * the latency is split into LATSUB buckets, so the bucket a latency lands in
+ * gives it to within 1/LATSUB. This keeps any number of samples in fixed
+ * memory.
+ *
+ */
+typedef struct _lathist {
+
+    /** Samples in each bucket */  long long count[LATBUCKETS];
+    /** Total samples */           long long total;
+    /** Shortest latency */        long long min;
+    /** Longest latency */         long long max;
+    /** Sum of latencies */        double sum;
+
+} lathist;
+
+/**
+ *
+ * Read and write latency histograms
+ *
+ * Tally the latency of each read and write on the current drive.
+ *
+ */
+
+THREAD lathist latread, latwrite;
 
 /**
  *
@@ -403,14 +1005,56 @@ typedef enum {
 
 } compmode;
 
-/** Compare mode */                                        compmode curmode;
-/** First miscompare flag */                               int first;
-/** Repeat compare value */                                unsigned char comp_a; 
-/** Repeat compare value */                                unsigned char comp_b; 
-/** Repeat count */                                         int repcnt; 
-/** Data that was set to compare values (comp_a, comp_b) */ int dataset; 
+/** Compare mode */                                        THREAD compmode curmode;
+/** First miscompare flag */                               THREAD int first;
+/** Repeat compare value */                                THREAD unsigned char comp_a; 
+/** Repeat compare value */                                THREAD unsigned char comp_b; 
+/** Repeat count */                                         THREAD int repcnt; 
+/** Data that was set to compare values (comp_a, comp_b) */ THREAD int dataset; 
+/** Blocks compblk has found different */                  THREAD long long compdiff;
+
+/** Size of the blocks the compare is done in, a multiple of sectors up to
+    4096 bytes, and one sector for bigger sectors */
+#define CMPBLK 4096
+
+/** Expected data for a compare block */ THREAD unsigned char cmpbuf[CMPBLK];
 /** Exit diagnostic on error */                             int exiterror; 
 
+/**
+ *
+ * Random LBA distributions
+ *
+ */
+typedef enum {
+
+    /** Even over the span */               dist_uniform,
+    /** Zipf, low LBAs most often */        dist_zipf,
+    /** Part of the I/O to part of the span */ dist_hotspot,
+    /** Normal around a centre */           dist_normal
+
+} distkind;
+
+/**
+ *
+ * Random LBA distribution
+ *
+ * Sets how lbarnd and random workloads pick LBAs. Places are given in percent
+ * of the span, so the same distribution fits any span.
+ *
+ */
+typedef struct _lbadist {
+
+    /** Kind of distribution */              distkind kind;
+    /** Zipf skew, 0 < theta < 1 */          double theta;
+    /** Hotspot percent of I/O */            long long hotio;
+    /** Hotspot percent of span */           long long hotspan;
+    /** Normal centre, percent of span */    long long centre;
+    /** Normal deviation, percent of span */ long long dev;
+
+} lbadist;
+
+/** LBA distribution */ THREAD lbadist curdist;
+
 /**
  *
  * Command result codes
@@ -456,13 +1100,46 @@ typedef struct _command {
 result command_help(char **line);
 result command_read(char **line);
 result command_write(char **line);
+result command_queuedepth(char **line);
+result command_readq(char **line);
+result command_writeq(char **line);
+result command_readv(char **line);
+result command_writev(char **line);
+result command_lbalist(char **line);
+result command_verify(char **line);
+result command_workload(char **line);
+result command_trim(char **line);
+result command_zero(char **line);
+result command_precondition(char **line);
+result command_verifyall(char **line);
+result command_qwait(char **line);
+result command_direct(char **line);
+result command_bufsize(char **line);
+result command_bufsel(char **line);
+result command_swap(char **line);
+result command_bufcopy(char **line);
+result command_align(char **line);
+result command_dist(char **line);
+result command_affinity(char **line);
+result command_numa(char **line);
+result command_rate(char **line);
+result command_runfor(char **line);
+result command_spawn(char **line);
+result command_join(char **line);
+result command_lat(char **line);
+result command_interval(char **line);
+result command_report(char **line);
+result command_bench(char **line);
 result command_dumpwrite(char **line);
 result command_dumpread(char **line);
 result command_pattn(char **line);
 result command_comp(char **line);
+result command_csig(char **line);
+result command_map(char **line);
 result command_compmode(char **line);
 result command_drive(char **line);
 result command_listdrives(char **line);
+result command_devopt(char **line);
 result command_unprot(char **line);
 result command_echo(char **line);
 result command_echon(char **line);
@@ -514,6 +1191,41 @@ command cmdtbl[] = {
                                      { "read",          command_read },
     /** Write sector         */      { "w",             command_write },
                                      { "write",         command_write },
+    /** Set queue depth      */      { "qd",            command_queuedepth },
+    /** Queue read sector    */      { "rq",            command_readq },
+                                     { "readq",         command_readq },
+    /** Queue write sector   */      { "wq",            command_writeq },
+                                     { "writeq",        command_writeq },
+    /** Batched read         */      { "rv",            command_readv },
+                                     { "readv",         command_readv },
+    /** Batched write        */      { "wrv",           command_writev },
+                                     { "writev",        command_writev },
+    /** Fill LBA list        */      { "lbalist",       command_lbalist },
+    /** Write and verify span */     { "wv",            command_verify },
+                                     { "verify",        command_verify },
+    /** Run workload         */      { "workload",      command_workload },
+    /** Discard sectors      */      { "trim",          command_trim },
+    /** Zero sectors         */      { "zero",          command_zero },
+    /** Trim and fill drive  */      { "precondition",  command_precondition },
+    /** Verify all written   */      { "verifyall",     command_verifyall },
+    /** Wait for queue empty */      { "qwait",         command_qwait },
+    /** Set direct access    */      { "direct",        command_direct },
+    /** Set buffer size      */      { "bufsize",       command_bufsize },
+    /** Select buffer slots  */      { "bufsel",        command_bufsel },
+    /** Swap read and write  */      { "swap",          command_swap },
+    /** Copy between buffers */      { "bufcopy",       command_bufcopy },
+    /** Set LBA alignment    */      { "align",         command_align },
+    /** Set LBA distribution */      { "dist",          command_dist },
+    /** Pin thread to CPU    */      { "affinity",      command_affinity },
+    /** Set NUMA node        */      { "numa",          command_numa },
+    /** Set transfer rate    */      { "rate",          command_rate },
+    /** Set run time limit   */      { "runfor",        command_runfor },
+    /** Start worker         */      { "spawn",         command_spawn },
+    /** Wait for workers     */      { "join",          command_join },
+    /** Print latencies      */      { "lat",           command_lat },
+    /** Sample statistics    */      { "interval",      command_interval },
+    /** Structured report    */      { "report",        command_report },
+    /** Benchmark diagnostic */      { "bench",         command_bench },
     /** Dump write sector    */      { "dw",            command_dumpwrite },
                                      { "dumpwrite",     command_dumpwrite },
     /** Dump read sector     */      { "dr",            command_dumpread },
@@ -522,11 +1234,14 @@ command cmdtbl[] = {
                                      { "pattn",         command_pattn },
     /** Compare pattern      */      { "c",             command_comp },
                                      { "comp",          command_comp },
+    /** Check signatures     */      { "csig",          command_csig },
+    /** Written map          */      { "map",           command_map },
     /** Set compare mismatch mode */ { "cm",            command_compmode },
                                      { "compmode",      command_compmode },
     /** Set phy drive        */      { "drive",         command_drive },
     /** List physical drives */      { "listdrives",    command_listdrives },
                                      { "ld",            command_listdrives },
+    /** Set device option    */      { "devopt",        command_devopt },
     /** Remove write protect */      { "unprot",        command_unprot },
     /** Echo text            */      { "echo",          command_echo },
     /** Echo text no newline */      { "echon",         command_echon },
@@ -582,7 +1297,23 @@ result variable_drvsiz(char **line, long long *ul);
 result variable_rand(char **line, long long *ul);
 result variable_lbarnd(char **line, long long *ul);
 result variable_secsiz(char **line, long long *ul);
+result variable_psecsiz(char **line, long long *ul);
 result variable_bufsiz(char **line, long long *ul);
+result variable_latp50r(char **line, long long *ul);
+result variable_latp99r(char **line, long long *ul);
+result variable_latp999r(char **line, long long *ul);
+result variable_latmaxr(char **line, long long *ul);
+result variable_latp50w(char **line, long long *ul);
+result variable_latp99w(char **line, long long *ul);
+result variable_latp999w(char **line, long long *ul);
+result variable_latmaxw(char **line, long long *ul);
+result variable_siggen(char **line, long long *ul);
+result variable_devns(char **line, long long *ul);
+result variable_cpuns(char **line, long long *ul);
+result variable_patns(char **line, long long *ul);
+result variable_compns(char **line, long long *ul);
+result variable_devpct(char **line, long long *ul);
+result variable_idlens(char **line, long long *ul);
 
 /**
  *
@@ -615,7 +1346,23 @@ variable vartbl[] = {
     /** Random number                         */ { "rand",   variable_rand },
     /** Random number limited to LBA form     */ { "lbarnd", variable_lbarnd },
     /** Sector size in bytes                  */ { "secsiz", variable_secsiz },
+    /** Physical sector size in bytes         */ { "psecsiz", variable_psecsiz },
     /** read and write buffer size in sectors */ { "bufsiz", variable_bufsiz },
+    /** Read latency 50th percentile in ns    */ { "latp50r", variable_latp50r },
+    /** Read latency 99th percentile in ns    */ { "latp99r", variable_latp99r },
+    /** Read latency 99.9th percentile in ns  */ { "latp999r", variable_latp999r },
+    /** Longest read latency in ns            */ { "latmaxr", variable_latmaxr },
+    /** Write latency 50th percentile in ns   */ { "latp50w", variable_latp50w },
+    /** Write latency 99th percentile in ns   */ { "latp99w", variable_latp99w },
+    /** Write latency 99.9th percentile in ns */ { "latp999w", variable_latp999w },
+    /** Longest write latency in ns           */ { "latmaxw", variable_latmaxw },
+    /** Generation of last signature pattern  */ { "siggen", variable_siggen },
+    /** Time waiting on the drive in ns       */ { "devns", variable_devns },
+    /** Time in the diagnostic in ns          */ { "cpuns", variable_cpuns },
+    /** Time making patterns in ns            */ { "patns", variable_patns },
+    /** Time comparing in ns                  */ { "compns", variable_compns },
+    /** Percent of time waiting on the drive  */ { "devpct", variable_devpct },
+    /** Time waiting to pace transfers in ns  */ { "idlens", variable_idlens },
 
     /** End marker for variable table */ { "", NULL }
 
@@ -628,54 +1375,184 @@ variable vartbl[] = {
  * User defined variables are just a name and a value. They can be both read and
  * written.
  *
+ * Variables live on the variables stack, where each one binds a symbol and
+ * hides any older variable of the same name. The same structure serves as a
+ * list of names for procedure parameters, using only the link and name.
+ *
  */
 
 typedef struct _uservar {
 
-    /** Link to next in list */ struct _uservar *next;
-    /** Variable name string */ char *varstr;
-    /** Variable value */       long long val;
+    /** Link to next in list */  struct _uservar *next;
+    /** Variable name string */  char *varstr;
+    /** Variable value */        long long val;
+    /** Symbol it binds */       struct _symbol *sym;
+    /** Variable it hides */     struct _uservar *shadow;
 
 } uservar;
 
-/** Root of user variables list */
-uservar *varroot;
-
 /**
  *
- * Loop count variable entry
+ * Symbol structure
+ *
+ * Every user variable name seen by a thread is kept once in a hash table, with
+ * the innermost variable of that name, so that finding a variable does not
+ * search the stack.
  *
  */
-typedef struct _loopcounter {
 
-    /** Link to next in list */               struct _loopcounter* next;
-    /** character position (for reference) */ char* pos;
-    /** Loop count value */                   int loopcount;
+typedef struct _symbol {
+
+    /** Link to next in hash chain */ struct _symbol *next;
+    /** Name string */                char *name;
+    /** Innermost variable, or NULL */ uservar *top;
+
+} symbol;
+
+/** Number of symbol hash chains, must be a power of 2 */
+#define SYMHASH 256
+
+/** Number of variables in a chunk of the variables stack */
+#define VARCHUNK 64
 
-} loopcounter;
-    
 /**
  *
- * Structure to hold stored text lines
+ * Variables stack chunk
+ *
+ * The stack grows by chunks that are kept when it shrinks again, so entries
+ * never move and pushing a variable does not usually allocate.
  *
  */
-typedef struct _linestr {
 
-    /** Link to next in list */    struct _linestr *next;
-    /** Label on line (if any) */  char *label;
-    /** parameter list (if any) */ uservar *params;
-    /** Text line */               char *line;
-    /** loop counter */            loopcounter *looplist;
+typedef struct _varchunk {
 
-} linestr;
+    /** Chunk below */    struct _varchunk *prev;
+    /** Chunk above */    struct _varchunk *next;
+    /** Variables */      uservar var[VARCHUNK];
 
-/** Root of stored execution text */
+} varchunk;
 
-linestr *editroot;
+/** Symbol hash table */                THREAD symbol *symtbl[SYMHASH];
+/** Top chunk of variables stack */     THREAD varchunk *vartop;
+/** Variables in use in top chunk */    THREAD int varfill;
+/** Number of variables on the stack */ THREAD long vardepth;
 
 /**
  *
- * Interpreter stack entries
+ * Loop count variable entry
+ *
+ */
+typedef struct _loopcounter {
+
+    /** Link to next in list */               struct _loopcounter* next;
+    /** character position (for reference) */ char* pos;
+    /** Loop count value */                   int loopcount;
+    /** Link in counter index */              struct _loopcounter* hash;
+
+} loopcounter;
+
+/**
+ *
+ * Root of loop counters
+ *
+ * Loop counters are kept per thread instead of on the program lines, so that
+ * workers running the same lines count their loops apart. They are also
+ * hashed by position, and released counters are kept for reuse.
+ *
+ */
+THREAD loopcounter *cntroot;
+
+/** Number of counter index chains, must be a power of 2 */
+#define CNTHASH 64
+
+/** Loop counter index */          THREAD loopcounter *cnthash[CNTHASH];
+/** Free loop counters */          THREAD loopcounter *cntfree;
+
+/** Default size of an arena block */
+#define ARENABLK 16384
+
+/**
+ *
+ * Arena block
+ *
+ * Arena space is handed out from the start of a block to the end without being
+ * freed. The space follows the header.
+ *
+ */
+typedef struct _arenablk {
+
+    /** Next block */          struct _arenablk *next;
+    /** Size of space */       size_t size;
+    /** Space handed out */    size_t used;
+
+} arenablk;
+
+/**
+ *
+ * Arena
+ *
+ * An arena holds things that are all freed together. Its blocks are kept when
+ * it is reset, and filled again from the first.
+ *
+ */
+typedef struct _arena {
+
+    /** First block */           arenablk *first;
+    /** Block being filled */    arenablk *cur;
+
+} arena;
+
+/**
+ *
+ * Program text arena
+ *
+ * Holds the program lines with their labels and parameters, which are kept
+ * until the program is cleared or loaded again.
+ *
+ */
+arena pgmarena;
+    
+/**
+ *
+ * Structure to hold stored text lines
+ *
+ */
+typedef struct _linestr {
+
+    /** Link to next in list */    struct _linestr *next;
+    /** Label on line (if any) */  char *label;
+    /** parameter list (if any) */ uservar *params;
+    /** Text line */               char *line;
+    /** Link in label index */     struct _linestr *hash;
+
+} linestr;
+
+/** Root of stored execution text */
+
+linestr *editroot;
+
+/** Number of label index chains, must be a power of 2 */
+#define PGMHASH 256
+
+/**
+ *
+ * Label index
+ *
+ * The labelled lines of the program, hashed by label. It is rebuilt when the
+ * first label is looked up after the program changes. The program only changes
+ * while no workers run, and spawn looks its procedure up before it starts any,
+ * so workers only ever read the index.
+ *
+ */
+
+linestr *pgmhash[PGMHASH];
+
+/** Program changed since index was built */
+int pgmdirty = 1;
+
+/**
+ *
+ * Interpreter stack entries
  *
  */
 typedef struct _intstk {
@@ -683,13 +1560,18 @@ typedef struct _intstk {
     /** next entry */                       struct _intstk *next;
     /** current line entry */               linestr *curlin;
     /** current character position there */ char *curchr;
-    /** locals marker */                    uservar *mark;
+    /** locals marker (stack depth) */      long mark;
+    /** report snapshot, if a procedure */  struct _rptsnap *snap;
 
 } intstk;
 
 /** Root of interpreter stack */
 
-intstk *introot;
+THREAD intstk *introot;
+
+/** Free interpreter stack entries, kept for reuse */
+
+THREAD intstk *intfree;
 
 /**
  *
@@ -725,7 +1607,175 @@ typedef struct _ctlstk {
 
 /** root of controls stack */
 
-ctlstk *ctlroot;
+THREAD ctlstk *ctlroot;
+
+/** Free control stack entries, kept for reuse */
+
+THREAD ctlstk *ctlfree;
+
+/**
+ *
+ * Structured report
+ *
+ * With a report set, each command line, each procedure and each worker leaves
+ * a record of what it did as one line of JSON or CSV: the drive, its size and
+ * sector size, the operations, bytes, time, latency percentiles and result,
+ * with the counts of failed transfers and miscompares, and the LBAs of the
+ * first RPTLBAS of those on the line. Ending the report adds a summary record
+ * for each drive used, from the lines and the joined workers.
+ *
+ * Records are made into a buffer for each thread, and only written out when a
+ * command line is done, a worker ends or the buffer fills, so making them costs
+ * a few formatted prints and the file is not touched while transfers run.
+ *
+ * A record is the difference from a snapshot taken when its line or procedure
+ * started. When the statistics are cleared, each snapshot is moved back by
+ * what was cleared, as with interval samples.
+ *
+ */
+#define RPTLBAS 32
+#define RPTBUF 16384
+
+/**
+ *
+ * Kinds of failure reported
+ *
+ */
+typedef enum {
+
+    /** Read failed */         bad_read,
+    /** Write failed */        bad_write,
+    /** Trim or zero failed */ bad_trim,
+    /** Data miscompared */    bad_comp,
+    /** Number of kinds */     bad_count
+
+} badkind;
+
+/**
+ *
+ * Report snapshot
+ *
+ * The statistics when a line or procedure started.
+ *
+ */
+typedef struct _rptsnap {
+
+    /** Next free snapshot */ struct _rptsnap *next;
+    /** Procedure name */     char name[100];
+    /** Time started */       long long start;
+    /** Write IOPs */         double iopw;
+    /** Read IOPs */          double iopr;
+    /** Bytes written */      double bcw;
+    /** Bytes read */         double bcr;
+    /** Trims */              double iopt;
+    /** Zeroes */             double iopz;
+    /** Bytes trimmed */      double bct;
+    /** Bytes zeroed */       double bcz;
+    /** Failures of each kind */ long long nbad[bad_count];
+    /** Failures listed */    int nlist;
+    /** Latencies taken */    int lat;
+    /** Read latencies */     lathist latr;
+    /** Write latencies */    lathist latw;
+
+} rptsnap;
+
+/**
+ *
+ * Report values
+ *
+ * What one record gives, the difference from a snapshot or the sum for a
+ * drive.
+ *
+ */
+typedef struct _rptval {
+
+    /** Drive size in sectors */ long long size;
+    /** Sector size */           int secsize;
+    /** Time in seconds */       double secs;
+    /** Write IOPs */            double iopw;
+    /** Read IOPs */             double iopr;
+    /** Bytes written */         double bcw;
+    /** Bytes read */            double bcr;
+    /** Trims */                 double iopt;
+    /** Zeroes */                double iopz;
+    /** Bytes trimmed */         double bct;
+    /** Bytes zeroed */          double bcz;
+    /** Failures of each kind */ long long nbad[bad_count];
+    /** Read latencies */        lathist latr;
+    /** Write latencies */       lathist latw;
+
+} rptval;
+
+/** File records go to, NULL is console */    FILE *rptfp;
+/** A report is set */                        int rpton;
+/** Records are JSON, not CSV */              int rptjson;
+/** Summary for each drive, or NULL */        rptval *rptdrv[MAXDRIVES];
+/** Records waiting to be written */          THREAD char rptbuf[RPTBUF];
+/** Length waiting */                         THREAD int rptlen;
+/** Snapshot of the line running */           THREAD rptsnap rptlin;
+/** Snapshots wait for their latencies */     THREAD int rptwait;
+/** Free snapshots, kept for reuse */         THREAD rptsnap *rptfree;
+/** Failures of each kind so far */           THREAD long long rptnbad[bad_count];
+/** LBAs of failures on the line */           THREAD long long rptlba[RPTLBAS];
+/** Kinds of failures on the line */          THREAD badkind rptkind[RPTLBAS];
+/** Failures listed on the line */            THREAD int rptnlist;
+/** Result procedures being unwound end with */ THREAD result rptres;
+
+/**
+ *
+ * Worker entry
+ *
+ * A worker runs a stored procedure on its own thread, with its own drive,
+ * buffers, variables and statistics. spawn fills in the entry and starts the
+ * thread, and the worker files its results back here when it finishes, where
+ * join picks them up.
+ *
+ */
+typedef struct _worker {
+
+    /** Procedure to run */       linestr *proc;
+    /** Drive to run it on */     int drive;
+    /** Parameter values */       long long *params;
+    /** Write buffer */           unsigned char *wbuf;
+    /** Read buffer */            unsigned char *rbuf;
+    /** Buffer size in sectors */ long long bufsecs;
+    /** Signature in write buffer */ long long sigbuf;
+    /** LBA signature starts at */ long long siglba;
+    /** Sector size of buffers */ int secsize;
+    /** Align random LBAs */      int alignlba;
+    /** LBA distribution */       lbadist dist;
+    /** Compare mode */           compmode mode;
+    /** Direct access mode */     int direct;
+    /** CPU pinned to */          int cpupin;
+    /** NUMA node setting */      int numaset;
+    /** Rate in transfers/sec */  long long rateiops;
+    /** Rate in bytes/sec */      long long ratebps;
+    /** Run time limit */         long long deadline;
+    /** Result of the run */      result r;
+    /** Run time in seconds */    double time;
+    /** Total IOPS write */       double iopwrite;
+    /** Total IOPS read */        double iopread;
+    /** Total bytes written */    double bcwrite;
+    /** Total bytes read */       double bcread;
+    /** Total trims */            double ioptrim;
+    /** Total zeroes */           double iopzero;
+    /** Total bytes trimmed */    double bctrim;
+    /** Total bytes zeroed */     double bczero;
+    /** Device time in ns */      long long devtime;
+    /** Pattern time in ns */     long long pattime;
+    /** Compare time in ns */     long long comptime;
+    /** Pacing time in ns */      long long idletime;
+    /** Read latencies */         lathist latread;
+    /** Write latencies */        lathist latwrite;
+    /** Drive size in sectors */  long long drvsize;
+    /** Failures of each kind */  long long nbad[bad_count];
+
+} worker;
+
+/** Worker table */                            worker workers[MAXWORKERS];
+/** Workers spawned and not yet joined */      int nworkers;
+/** Worker number of this thread, 0 is main */ THREAD int workerno;
+/** Break has been passed on to workers */     int workbreak;
 
 /*******************************************************************************
 
@@ -748,7 +1798,7 @@ void ctlchandler(int sig)
     signal(SIGINT, ctlchandler);
     signal(SIGABRT, ctlchandler);
 
-    breakflag = 1; // set break occurred
+    FLAGSET(breakflag, 1); // set break occurred
 
 }
 
@@ -756,60 +1806,62 @@ void ctlchandler(int sig)
  *
  * Check user break
  *
- * Check if a user break occurred. Returns true if so.
+ * Check if a user break occurred, or the run time set with runfor is up.
+ * Returns true if so. Queued transfers still in flight are cancelled where
+ * the system can.
+ *
+ * Only the main thread clears the break. Workers just look at it, so that
+ * every worker sees it, and if the main thread takes a break while workers are
+ * running, it passes it on to them. The run time is the same: the main thread
+ * clears its limit when it is up, and a worker keeps stopping once its own is.
  */
 int chkbrk(void)
 
 {
 
     int breakflags; // save for break flag
+    int timeup; // run time is up
 
-    breakflags = breakflag; // save contents of break flag
-
-    breakflag = 0; // clear any break
+    if (!FLAGGET(breakflag) && !FLAGGET(workbreak) && !deadline)
+        return 0; // nothing set, go fast
+    timeup = deadline && gettim() >= deadline;
+    if (workerno) // worker, look only
+        breakflags = FLAGGET(breakflag) || FLAGGET(workbreak) || timeup;
+    else {
 
-    return breakflags; // return state of user break
+        if (timeup) {
 
-}
+            printf("**** Info: Run time is up\n");
+            deadline = 0; // only once
 
-/**
- *
- * Get high resolution timer
- *
- * Get current setting on high resolution timer.
- *
- */
-long long gettim(void)
+        }
+        breakflags = FLAGGET(breakflag) || timeup; // save contents of break flag
 
-{
+        FLAGSET(breakflag, 0); // clear any break
 
-    long long time;
+        if (breakflags && nworkers) FLAGSET(workbreak, 1); // stop the workers too
 
-    time = clock();
+    }
+    if (breakflags) cancelq(); // stop what is in flight, where it can be
 
-    return time;
+    return breakflags; // return state of user break
 
 }
 
 /**
  *
- * Find elapsed time in seconds
+ * Look for user break
  *
- * Finds the elapsed time in seconds. Returns as a floating point value so that
- * fractional times can be represented.
+ * Returns true if a break is waiting to be taken by chkbrk, without taking it.
+ * The I/O module uses this to cancel what is in flight when a wait for it is
+ * interrupted.
  *
  */
-double elapsed(
-    /** reference time */ long long t
-)
+int brkpend(void)
 
 {
 
-    double etim;
-
-    etim = (gettim()-t*1.0)/CLOCKS_PER_SEC;
-
-    return etim;
+    return FLAGGET(breakflag) || FLAGGET(workbreak);
 
 }
 
@@ -863,7 +1915,7 @@ int readline(
 
 }
 
-/** Seed for random number generator */ unsigned long seed = 1; 
+/** Seed for random number generator */ THREAD unsigned long seed = 1; 
 
 /**
  *
@@ -907,6 +1959,89 @@ long long rand64() {
 
 }
 
+/**
+ *
+ * LBA random number generator
+ *
+ * LBAs are picked with xoshiro256** rather than rand32, which is faster and
+ * has a much longer period. rand32 stays with the rand pattern and variable,
+ * so that patterns written before still compare. Each worker seeds its own.
+ *
+ */
+/** LBA generator state */ THREAD unsigned long long lbastate[4];
+
+/**
+ *
+ * Seed LBA random numbers
+ *
+ * Fills the generator state from the seed with splitmix64, so that any seed,
+ * even 0, gives a good state.
+ *
+ */
+void lbaseed(
+    /** Seed */ unsigned long long s
+)
+
+{
+
+    unsigned long long z;
+    int i;
+
+    for (i = 0; i < 4; i++) {
+
+        s += 0x9e3779b97f4a7c15ULL;
+        z = s;
+        z = (z ^ (z >> 30))*0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27))*0x94d049bb133111ebULL;
+        lbastate[i] = z ^ (z >> 31);
+
+    }
+
+}
+
+/**
+ *
+ * Return the next 64 bit LBA random number
+ *
+ * \returns 64 bit random number, all bits random.
+ *
+ */
+unsigned long long lbanext(void)
+
+{
+
+    unsigned long long *x = lbastate;
+    unsigned long long r, t;
+
+    r = x[1]*5;
+    r = ((r << 7) | (r >> 57))*9;
+    t = x[1] << 17;
+    x[2] ^= x[0];
+    x[3] ^= x[1];
+    x[1] ^= x[2];
+    x[0] ^= x[3];
+    x[2] ^= t;
+    x[3] = (x[3] << 45) | (x[3] >> 19);
+
+    return r;
+
+}
+
+/**
+ *
+ * Return an LBA random fraction
+ *
+ * \returns Random number, 0 <= n < 1.
+ *
+ */
+double lbafrac(void)
+
+{
+
+    return (double) (lbanext() >> 11)*(1.0/9007199254740992.0);
+
+}
+
 /**
  *
  * Process screen pause
@@ -920,6 +2055,7 @@ void pause(void)
 
 {
 
+    if (workerno) return; // workers can't wait on the console
     linecounter++;
     if (linecounter > LINES-1) {
 
@@ -1053,1555 +2189,9215 @@ void printscpersec(
 
 /**
  *
- * Get word off command line
+ * Print statistics
  *
- * Retrieves the next space delimited word from the passed command line.
- * Can be used as a general purpose parameter parser.
+ * Prints the time, IOPS and bandwidth lines for the given totals.
  *
  */
-void getword(
-    /** Line to parse */      char **l,
-    /** Word output buffer */ char *w
+
+void printstats(
+    /** Time in seconds */     double time,
+    /** Total IOPS write */    double iopw,
+    /** Total IOPS read */     double iopr,
+    /** Total bytes written */ double bcw,
+    /** Total bytes read */    double bcr
 )
 
 {
 
-    while (**l == ' ') (*l)++; // skip any leading spaces
-    // copy non-space to buffer
-    while (**l && (isalnum(**l) || **l == '?' || **l == '.')) 
-        *w++ = *(*l)++;
-    *w = 0; // terminate buffer
+    printf("Time: %.2fs ", time);
+    printscpersec("IOW: ", iopw, time);
+    printscpersec("IOR: ", iopr, time);
+    printscpersec("IO: ", iopw+iopr, time);
+    printf("\n");
+    printscpersec("BW: ", bcw, time);
+    printscpersec("BR: ", bcr, time);
+    printscpersec("BT: ", bcw+bcr, time);
+    printf("\n");
 
-} 
+}
 
 /**
  *
- * List variables stack
+ * Print trim and zero statistics
  *
- * Dumps the contents of the variables stack in LI order. A diagnostic.
+ * Prints the trim and zero counts and rates, under those of printstats, but
+ * only if there were any.
  *
  */
-void listvar(void)
+
+void printdisc(
+    /** Time in seconds */     double time,
+    /** Total trims */         double iopt,
+    /** Total zeroes */        double iopz,
+    /** Total bytes trimmed */ double bct,
+    /** Total bytes zeroed */  double bcz
+)
 
 {
 
-    uservar *p;
+    if (!iopt && !iopz) return; // none
+    printscpersec("IOTR: ", iopt, time);
+    printscpersec("IOZ: ", iopz, time);
+    printscpersec("BTR: ", bct, time);
+    printscpersec("BZ: ", bcz, time);
+    printf("\n");
+
+}
 
-    // search the user variables list
-    p = varroot; // index root
-    while (p) {
+/**
+ *
+ * Clear latency histogram
+ *
+ */
 
-        printf("%s: var: %s val: %lld\n", __FUNCTION__, p->varstr, p->val);
-        p = p->next; // link next entry
+void clrlat(
+    /** Histogram */ lathist *hp
+)
 
-    }
+{
+
+    memset(hp, 0, sizeof(lathist));
 
 }
 
 /**
  *
- * Find user variable
- *
- * Searches for a user variable by name. Returns a pointer to the variable
- * entry or NULL if not found.
+ * Take report latencies
  *
- * \returns User variable entry.
+ * The histograms are big, so a snapshot only copies them when the first
+ * latency after it is about to be filed. Until then they are the same as
+ * now, and lines and procedures that do no transfers never copy them at all.
  *
  */
-uservar *fndvar(
-    /** Name of user variable */ char *name
-)
+
+void rpttake(void)
 
 {
 
-    uservar *puvar;
-    uservar *pufnd;
+    intstk *p;
 
-    /* search the user variables list */
-    puvar = varroot; // index root
-    pufnd = NULL; // set not found
-    while (puvar) {
+    rptwait = 0;
+    for (p = introot; p; p = p->next) if (p->snap && !p->snap->lat) {
 
-        if (!strcmp(name, puvar->varstr)) { // found
+        memcpy(&p->snap->latr, &latread, sizeof(lathist));
+        memcpy(&p->snap->latw, &latwrite, sizeof(lathist));
+        p->snap->lat = 1;
 
-            pufnd = puvar; // set found entry
-            puvar = NULL; // flag found
+    }
+    if (!rptlin.lat) {
 
-        } else puvar = puvar->next; // link next entry
+        memcpy(&rptlin.latr, &latread, sizeof(lathist));
+        memcpy(&rptlin.latw, &latwrite, sizeof(lathist));
+        rptlin.lat = 1;
 
     }
 
-    return pufnd; // return entry or NULL
-
 }
 
 /**
  *
- * Enter new user variable
+ * Record latency
  *
- * Creates and pushes a new variable on the variables stack with the given name
- * and value.
+ * Files a latency in nanoseconds in the histogram.
  *
- * \returns Standard discdiag error code.
- * 
  */
-result pushvar(
-    /** Name of variable */ char *name,
-    /** Value for variable */ long long val
+
+void addlat(
+    /** Histogram */ lathist *hp,
+    /** Latency */   long long lat
 )
 
 {
 
-    uservar *uvar; // pointer to user variable entry
-    int s;
-
-    // get a new entry
-    uvar = (uservar *) malloc(sizeof(uservar));
-    s = strlen(name); // find length of name
-    uvar->varstr = (char *) malloc(s+1);
-    if (!uvar || !name) {
+    int msb;
+    int i;
 
-        printf("*** Error: Cannot allocate space\n");
+    if (rptwait) rpttake(); // snapshots need the latencies before this
+    if (lat < 0) lat = 0; // clock went backwards
+    i = lat; // small latencies index directly
+    if (lat >= 2*LATSUB) {
 
-        return result_error;
+        // find the top bit, then keep LATBITS below it
+        msb = 0;
+        while (lat >> (msb+1)) msb++;
+        i = (msb-LATBITS)*LATSUB+(int)(lat >> (msb-LATBITS));
 
     }
-    strncpy(uvar->varstr, name, s+1); // place name in string
-    uvar->val = val; // place value
-    uvar->next = varroot; // push onto root list
-    varroot = uvar;
-
-    return result_ok;
+    hp->count[i]++;
+    if (!hp->total || lat < hp->min) hp->min = lat;
+    if (lat > hp->max) hp->max = lat;
+    hp->total++;
+    hp->sum += lat;
 
 }
 
 /**
  *
- * Get number off command line
+ * Merge latency histograms
  *
- * Gets a number off the command line. If no number is found, returns -1.
+ * Adds the samples of one histogram to another.
  *
- * \returns Standard discdiag error code.
- * 
  */
-result getval(
-    /** Line to parse */      char **l,
-    /** Number returned */    long long *n
+
+void mrglat(
+    /** Histogram to add to */ lathist *dp,
+    /** Histogram to add */    lathist *sp
 )
 
 {
 
-    char w[100]; // buffer for parameter
-    variable *var; // pointer to variable table
-    result r;
-    int found;
-    uservar *uvar;
+    int i;
 
-    getword(l, w); // get next word
-    if (isalpha(*w)) { // is variable
+    if (!sp->total) return; // nothing to add
+    for (i = 0; i < LATBUCKETS; i++) dp->count[i] += sp->count[i];
+    if (!dp->total || sp->min < dp->min) dp->min = sp->min;
+    if (sp->max > dp->max) dp->max = sp->max;
+    dp->total += sp->total;
+    dp->sum += sp->sum;
 
-        var = vartbl; // index start of variable table
-        found = 0; // set nothing found yet
-        while (var && var->var) { // traverse until end marker seen
-    
-            // If the variable matches, execute it
-            if (!strcmp(w, var->varstr)) {
-    
-                r = var->var(l, n); // execute variable
-                // check valid
-                if (r != result_ok) return r;
-                found = 1; // set variable was found
-                var = NULL; // flag found
-    
-            }
-            if (var) var++; // next command entry
-    
-        }
-        if (!found) {
-
-            /* try searching the user variables list */
-            uvar = fndvar(w);
-            if (!uvar) { // nothing found
-     
-                printf("*** Error: Variable \"%s\" invalid\n", w);
+}
 
-                return result_error; // bad value
+/**
+ *
+ * Find latency percentile
+ *
+ * Finds the latency that the given part of the samples are at or under. The
+ * part is in hundredths of a percent, so 9990 finds the 99.9th percentile.
+ * The top of the bucket found is returned, limited to the longest latency
+ * seen.
+ *
+ * \returns The latency in nanoseconds, or 0 if there are no samples.
+ *
+ */
 
-            }
-            *n = uvar->val; // return user variable  
-    
-        }
+long long pctlat(
+    /** Histogram */                   lathist *hp,
+    /** Percentile * 100 */            int pct
+)
 
-    } else if (isdigit(*w)) {
+{
 
-        // Note Microsoft does not support strtoull
-        *n = (long long)strtoul(w, NULL, 0); // return resulting number
+    long long rank, n, v;
+    int i;
 
-    } else {
-      
-        printf("*** Error: Invalid value\n", w);
+    if (!hp->total) return 0; // no samples
+    // find the number of samples to count, rounding up
+    rank = (hp->total*pct+9999)/10000;
+    if (rank < 1) rank = 1;
+    n = 0;
+    for (i = 0; i < LATBUCKETS; i++) {
 
-        return result_error; // bad value
+        n += hp->count[i];
+        if (n >= rank) break;
 
     }
+    if (i < 2*LATSUB) v = i; // exact buckets
+    else v = ((long long)(i%LATSUB+LATSUB+1) << (i/LATSUB-1))-1;
+    if (v > hp->max) v = hp->max;
+    if (v < hp->min) v = hp->min;
 
-    return result_ok;
-
-} 
+    return v;
 
-result getparam(char **l, long long *n);
+}
 
 /**
  *
- * Process factor
- *
- * Processes factor. The factors are:
- *
- * +a
- *
- * -a
+ * Print latency
  *
- * (a)
+ * Prints a latency in nanoseconds in the best fitting unit.
  *
- * \returns Standard discdiag error code.
- * 
  */
-result getfact(
-    /** Line to parse */   char **l,
-    /** Number returned */ long long *n
+
+void printlatval(
+    /** Label to print */        char labl[],
+    /** Latency in nanoseconds */ long long lat
 )
 
 {
 
-    long long v;
-    result r;
+    printf("%s", labl);
+    if (lat < 1000) printf("%lldns ", lat);
+    else if (lat < 1000000) printf("%.2fus ", lat/1e3);
+    else if (lat < 1000000000) printf("%.2fms ", lat/1e6);
+    else printf("%.2fs ", lat/1e9);
 
-    if (**l == '+') { // +a
+}
 
-        (*l)++; // skip 
-        r = getfact(l, &v); // get subexpression
-        if (r != result_ok) return r;
-        *n = +v; // find +a
+/**
+ *
+ * Print latency histogram
+ *
+ * Prints the sample count and percentiles of the given histogram, if it has
+ * any samples.
+ *
+ */
 
-    } else if (**l == '-') { // -a
+void printlat(
+    /** Label to print */ char labl[],
+    /** Histogram */      lathist *hp
+)
 
-        (*l)++; // skip -
-        r = getfact(l, &v); // get subexpression
-        if (r != result_ok) return r;
-        *n = -v; // find -a
+{
 
-    } else if (**l == '(') { // (a)
+    if (!hp->total) return; // nothing to show
+    printf("%s latency: %lld sample%s\n", labl, hp->total,
+           hp->total > 1 ? "s" : "");
+    printlatval("Min: ", hp->min);
+    printlatval("Avg: ", (long long)(hp->sum/hp->total));
+    printlatval("P50: ", pctlat(hp, 5000));
+    printlatval("P99: ", pctlat(hp, 9900));
+    printlatval("P99.9: ", pctlat(hp, 9990));
+    printlatval("Max: ", hp->max);
+    printf("\n");
 
-        (*l)++; // skip (
-        r = getparam(l, n); // get subexpression
-        if (r != result_ok) return r;
-        while (**l == ' ') (*l)++; // skip spaces
-        if (**l != ')') {
+}
 
-            printf("*** Error: ')' expected\n");
- 
-            return result_error;
+/**
+ *
+ * Print time breakdown
+ *
+ * Prints how the time went, under the statistics: waiting on the drive (Dev),
+ * waiting for paced transfers to be due (Idle), if any, and in the diagnostic
+ * itself (CPU), which is split into making patterns, comparing, and the rest,
+ * which is parsing and running commands. Only printed if any device, pacing,
+ * pattern or compare time was counted.
+ *
+ */
 
-        }
-        (*l)++; // skip )
+void printcpu(
+    /** Time in nanoseconds */  long long time,
+    /** Device time */          long long dev,
+    /** Pacing time */          long long idle,
+    /** Pattern time */         long long pat,
+    /** Compare time */         long long comp
+)
 
-    } else {
+{
 
-        r = getval(l, n); // get value
-        if (r != result_ok) return r;
+    if (dev <= 0 && idle <= 0 && pat <= 0 && comp <= 0) return; // none
+    if (time < dev+idle+pat+comp) time = dev+idle+pat+comp; // timer granularity
+    printlatval("Dev: ", dev);
+    printf("(%.0f%%) ", 100.0*dev/time);
+    if (idle > 0) {
 
-    }
+        printlatval("Idle: ", idle);
+        printf("(%.0f%%) ", 100.0*idle/time);
 
-    return result_ok; // exit good 
+    }
+    printlatval("CPU: ", time-dev-idle);
+    printf("(%.0f%%) ", 100.0*(time-dev-idle)/time);
+    printlatval("Pat: ", pat);
+    printlatval("Comp: ", comp);
+    printlatval("Other: ", time-dev-idle-pat-comp);
+    printf("\n");
 
 }
 
 /**
  *
- * Process multiply class operator
+ * Interval statistics
  *
- * Processes a multiply or divide. The expressions are:
+ * With an interval set, each thread samples its statistics every interval
+ * while commands run, and writes what was done since the last sample as one
+ * line of CSV or JSON, to a file or the console. This shows how a long run
+ * changes over time, where the totals at the end of a line don't.
  *
- * a * b
+ * Samples are taken between commands, and between transfers in commands that
+ * run many, so an interval can run over by as long as one command takes. Each
+ * line gives the actual length.
  *
- * a / b
+ * A sample is the difference from the last one. When the statistics are
+ * cleared, the last sample is moved back by what was cleared, so the work done
+ * before the clear still counts.
  *
- * a % b
+ */
+/** Interval in nanoseconds, 0 is off */     long long intlen;
+/** File samples go to, NULL is console */   FILE *intfp;
+/** Samples are JSON, not CSV */             int intjson;
+/** Time the interval was set */             long long intbase;
+/** Count of interval settings */            int intgen;
+/** Interval setting this thread is on */    THREAD int intmygen;
+/** Time of next sample */                   THREAD long long intnext;
+/** Time of last sample */                   THREAD long long intlast;
+/** Write IOPs at last sample */             THREAD double intiopw;
+/** Read IOPs at last sample */              THREAD double intiopr;
+/** Bytes written at last sample */          THREAD double intbcw;
+/** Bytes read at last sample */             THREAD double intbcr;
+/** Read latencies at last sample */         THREAD lathist intlatr;
+/** Write latencies at last sample */        THREAD lathist intlatw;
+/** Latencies in the interval */             THREAD lathist intdiff;
+
+/**
+ *
+ * Mark interval sample
+ *
+ * Makes the current statistics the last sample.
  *
- * \returns Standard discdiag error code.
- * 
  */
-result getmult(
-    /** Line to parse */   char **l,
-    /** Number returned */ long long *n
+
+void markint(
+    /** Time of sample */ long long now
 )
 
 {
 
-    long long v;
-    result r;
+    intiopw = iopwrite;
+    intiopr = iopread;
+    intbcw = bcwrite;
+    intbcr = bcread;
+    memcpy(&intlatr, &latread, sizeof(lathist));
+    memcpy(&intlatw, &latwrite, sizeof(lathist));
+    intlast = now;
 
-    /* get left side expression */
-    r = getfact(l, n);
-    if (r != result_ok) return r;
-    while (**l == '*' || **l == '/' || **l == '%') {
+}
 
-        if (**l == '*') { // *
-    
-            (*l)++; // skip *
-            r = getfact(l, &v); // get right
-            if (r != result_ok) return r;
-            *n = *n * v; // find a * b
-    
-        } else if (**l == '/') { // /
-    
-            (*l)++; // skip /
-            r = getfact(l, &v); // get right
-            if (r != result_ok) return r;
-            if (v == 0) { // check zero divide
+/**
+ *
+ * Carry report snapshot over clear
+ *
+ * Moves a snapshot back by the IOPs and byte counts, or the latencies, about
+ * to be cleared.
+ *
+ */
 
-                printf("*** Error: Zero divide\n");
+void carrysnap(
+    /** Snapshot */           rptsnap *sp,
+    /** Latencies, not ops */ int lat
+)
 
-                return result_error;
+{
 
-            }
-            *n = *n / v; // find a / b
-    
-        } else if (**l == '%') { // %
-    
-            (*l)++; // skip %
-            r = getfact(l, &v); // get right
-            if (r != result_ok) return r;
-            if (v == 0) { // check zero divide
+    int i;
 
-                printf("*** Error: Zero divide\n");
+    if (lat) {
 
-                return result_error;
+        if (!sp->lat) return; // not taken, nothing since to carry
+        for (i = 0; i < LATBUCKETS; i++) {
+
+            sp->latr.count[i] -= latread.count[i];
+            sp->latw.count[i] -= latwrite.count[i];
 
-            }
-            *n = *n % v; // find a % b
-    
         }
+        sp->latr.total -= latread.total;
+        sp->latr.sum -= latread.sum;
+        sp->latw.total -= latwrite.total;
+        sp->latw.sum -= latwrite.sum;
 
-    }
+    } else {
 
-    return result_ok; // exit good 
+        sp->iopw -= iopwrite;
+        sp->iopr -= iopread;
+        sp->bcw -= bcwrite;
+        sp->bcr -= bcread;
+        sp->iopt -= ioptrim;
+        sp->iopz -= iopzero;
+        sp->bct -= bctrim;
+        sp->bcz -= bczero;
+
+    }
 
 }
 
 /**
  *
- * Process add class operator
- *
- * Processes an add or subtract. The expressions are:
- *
- * a + b
+ * Carry report over clear
  *
- * a - b
+ * Carries the line's snapshot and those of the procedures running.
  *
- * \returns Standard discdiag error code.
- * 
  */
-result getadd(
-    /** Line to parse */   char **l,
-    /** Number returned */ long long *n
+
+void carryrpt(
+    /** Latencies, not ops */ int lat
 )
 
 {
 
-    long long v;
-    result r;
+    intstk *p;
 
-    /* get left side expression */
-    r = getmult(l, n);
-    if (r != result_ok) return r;
-    while (**l == '+' || **l == '/' || **l == '-') {
+    if (!rpton) return; // no report
+    carrysnap(&rptlin, lat);
+    for (p = introot; p; p = p->next) if (p->snap) carrysnap(p->snap, lat);
 
-        if (**l == '+') { // +
-       
-            (*l)++; // skip +
-            r = getmult(l, &v); // get right
-            if (r != result_ok) return r;
-            *n = *n + v; // find a + b
-       
-        } else if (**l == '-') { // -
-       
-            (*l)++; // skip -
-            r = getmult(l, &v); // get right
-            if (r != result_ok) return r;
-            *n = *n - v; // find a - b
-       
-        }
+}
 
-    }
+/**
+ *
+ * Carry statistics over clear
+ *
+ * Called just before the IOPs and byte counts are cleared, so that the next
+ * sample still has what was done since the last.
+ *
+ */
 
-    return result_ok; // exit good 
+void carryops(void)
+
+{
+
+    carryrpt(0);
+    if (!intlen) return; // no intervals
+    intiopw -= iopwrite;
+    intiopr -= iopread;
+    intbcw -= bcwrite;
+    intbcr -= bcread;
 
 }
 
 /**
  *
- * Process parameter
+ * Carry latencies over clear
  *
- * Processes parameter expressions. The expressions are:
+ * Called just before the latency histograms are cleared, as carryops.
  *
- * a > b
+ */
+
+void carrylat(void)
+
+{
+
+    int i;
+
+    carryrpt(1);
+    if (!intlen) return; // no intervals
+    for (i = 0; i < LATBUCKETS; i++) {
+
+        intlatr.count[i] -= latread.count[i];
+        intlatw.count[i] -= latwrite.count[i];
+
+    }
+    intlatr.total -= latread.total;
+    intlatr.sum -= latread.sum;
+    intlatw.total -= latwrite.total;
+    intlatw.sum -= latwrite.sum;
+
+}
+
+/**
  *
- * a < b
+ * Find interval latencies
  *
- * a = b
+ * Finds the latencies since the last sample, or a report snapshot. The longest
+ * is only known to within its bucket.
  *
- * a != b
+ */
+
+void difflat(
+    /** Latencies found */          lathist *dp,
+    /** Latencies now */            lathist *hp,
+    /** Latencies at last sample */ lathist *lp
+)
+
+{
+
+    int i;
+
+    for (i = 0; i < LATBUCKETS; i++) dp->count[i] = hp->count[i]-lp->count[i];
+    dp->total = hp->total-lp->total;
+    dp->sum = hp->sum-lp->sum;
+    dp->min = 0;
+    dp->max = hp->max;
+    dp->max = pctlat(dp, 10000);
+    dp->min = hp->min;
+
+}
+
+/**
  *
- * a >= b
+ * Write interval sample
  *
- * a <= b
+ * Writes the statistics since the last sample, and makes this the last. The
+ * line is written with one call, so lines from workers don't mix.
  *
- * \returns Standard discdiag error code.
- * 
  */
-result getparam(
-    /** Line to parse */      char **l,
-    /** Number returned */    long long *n
+
+void writeint(
+    /** Time of sample */ long long now
 )
 
 {
 
-    long long v;
-    result r;
+    char buf[600]; // sample line
+    char lat[2][160]; // read and write latencies
+    double secs, wiops, riops, wbytes, rbytes;
+    int i;
 
-    /* get left side expression */
-    r = getadd(l, n);
-    if (r != result_ok) return r;
-    if (**l == '>') { // > or >=
+    secs = (now-intlast)/1e9;
+    if (secs <= 0.0) secs = 1e-9;
+    wiops = iopwrite-intiopw;
+    riops = iopread-intiopr;
+    wbytes = bcwrite-intbcw;
+    rbytes = bcread-intbcr;
+    for (i = 0; i < 2; i++) {
+
+        if (i) difflat(&intdiff, &latwrite, &intlatw);
+        else difflat(&intdiff, &latread, &intlatr);
+        if (intjson) sprintf(lat[i],
+            "\"%clat50\":%lld,\"%clat99\":%lld,\"%clat999\":%lld,\"%clatmax\":%lld",
+            i ? 'w' : 'r', pctlat(&intdiff, 5000), i ? 'w' : 'r',
+            pctlat(&intdiff, 9900), i ? 'w' : 'r', pctlat(&intdiff, 9990),
+            i ? 'w' : 'r', intdiff.total ? intdiff.max : 0LL);
+        else sprintf(lat[i], "%lld,%lld,%lld,%lld", pctlat(&intdiff, 5000),
+                     pctlat(&intdiff, 9900), pctlat(&intdiff, 9990),
+                     intdiff.total ? intdiff.max : 0LL);
 
-        (*l)++; // skip >
-        if (**l == '=') { // >=
+    }
+    if (intjson) sprintf(buf,
+        "{\"time\":%.3f,\"worker\":%d,\"drive\":%d,\"secs\":%.3f,"
+        "\"rops\":%.0f,\"wops\":%.0f,\"rbytes\":%.0f,\"wbytes\":%.0f,"
+        "\"riops\":%.1f,\"wiops\":%.1f,\"rbw\":%.0f,\"wbw\":%.0f,%s,%s}\n",
+        (now-intbase)/1e9, workerno, currentdrive, secs, riops, wiops,
+        rbytes, wbytes, riops/secs, wiops/secs, rbytes/secs, wbytes/secs,
+        lat[0], lat[1]);
+    else sprintf(buf,
+        "%.3f,%d,%d,%.3f,%.0f,%.0f,%.0f,%.0f,%.1f,%.1f,%.0f,%.0f,%s,%s\n",
+        (now-intbase)/1e9, workerno, currentdrive, secs, riops, wiops,
+        rbytes, wbytes, riops/secs, wiops/secs, rbytes/secs, wbytes/secs,
+        lat[0], lat[1]);
+    if (intfp) {
+
+        fputs(buf, intfp);
+        fflush(intfp); // so it can be watched while it runs
+
+    } else printf("%s", buf);
+    markint(now);
 
-            (*l)++; // skip =
-            r = getadd(l, &v); // get right
-            if (r != result_ok) return r;
-            *n = *n >= v; // find a >= b
-
-        } else {
-
-            r = getadd(l, &v); // get right
-            if (r != result_ok) return r;
-            *n = *n > v; // find a > b
-
-        }
-
-    } else if (**l == '<') { // < or <=
-
-        (*l)++; // skip <
-        if (**l == '=') { // >=
+}
 
-            (*l)++; // skip =
-            r = getadd(l, &v); // get right
-            if (r != result_ok) return r;
-            *n = *n <= v; // find a <= b
+/**
+ *
+ * Check interval
+ *
+ * Writes a sample if the interval is up. A thread that hasn't seen this
+ * interval setting yet starts its first interval now.
+ *
+ */
 
-        } else {
+void chkint(void)
 
-            r = getadd(l, &v); // get right
-            if (r != result_ok) return r;
-            *n = *n < v; // find a < b
+{
 
-        }
+    long long now;
 
-    } else if (**l == '=') { // =
+    if (!intlen) return; // no intervals
+    now = gettim();
+    if (intmygen != intgen) { // new setting, start counting
 
-        (*l)++; // skip =
-        r = getadd(l, &v); // get right
-        if (r != result_ok) return r;
-        *n = *n == v; // find a = b
+        intmygen = intgen;
+        markint(now);
+        intnext = now+intlen;
+        return;
 
-    } else if (**l == '!') { // !=
+    }
+    if (now < intnext) return; // not yet
+    writeint(now);
+    intnext += intlen;
+    if (intnext <= now) intnext = now+intlen; // fell behind, skip ahead
 
-        (*l)++; // skip !
-        if (**l != '=') {
+}
 
-            // this could be a comment, we need to back out
-            (*l)--;
+/** Names of the kinds of failure */ char *badname[bad_count] = {
 
-        } else {
+    "read", "write", "trim", "comp"
 
-            (*l)++; // skip =
-            r = getadd(l, &v); // get right
-            if (r != result_ok) return r;
-            *n = *n != v; // find a != b
+};
 
-        }
+/** Names of the results */ char *resname[] = {
 
-    }
+    "ok", "exit", "error", "break", "continue", "stop", "restart"
 
-    return result_ok; // exit good 
+};
 
-}
+/** Values of the record being made */ THREAD rptval rptcur;
 
 /**
  *
- * Print comparision
+ * Report failure
  *
- * Accepts two byte values, and prints out if they miscompare.
+ * Counts a failed transfer or miscompare, and lists its LBA if it is known and
+ * the line's list has room.
  *
- * \returns Standard discdiag error code.
- * 
  */
-result printcomp(
-    /** Buffer address */      long addr,
-    /** New (read) byte */     unsigned char nb, 
-    /** Old (existing) byte */ unsigned char ob
+
+void rptbad(
+    /** Kind of failure */      badkind k,
+    /** LBA, or -1 if unknown */ long long lba
 )
 
 {
 
-    result r;
-    
-    r = result_ok; // set result code ok
-    if (nb != ob) {
+    rptnbad[k]++;
+    if (lba >= 0 && rptnlist < RPTLBAS) {
 
-        // check is first miscompare or mode is print all
-        if (first || curmode == compmode_all) {
+        rptlba[rptnlist] = lba;
+        rptkind[rptnlist] = k;
+        rptnlist++;
 
-            if (dataset && nb == comp_a && ob == comp_b) {
+    }
 
-                repcnt++; // just count
+}
 
-            } else {
+/**
+ *
+ * Take report snapshot
+ *
+ * The latencies are left to be taken by rpttake() when they next change.
+ *
+ */
 
-                // message if miscompares have accumulated
-                if (repcnt) {
+void rptmark(
+    /** Snapshot */ rptsnap *sp
+)
 
-                    printf("*** Info: There were %d occurrances of the above mismatch\n", repcnt);
-                    repcnt = 0; // reset counter
+{
 
-                }
-                printf("*** Error: Buffer miscompare: %8.8lx: %2.2x s/b %2.2x\n", 
-                       addr, nb, ob);
+    sp->start = gettim();
+    sp->iopw = iopwrite;
+    sp->iopr = iopread;
+    sp->bcw = bcwrite;
+    sp->bcr = bcread;
+    sp->iopt = ioptrim;
+    sp->iopz = iopzero;
+    sp->bct = bctrim;
+    sp->bcz = bczero;
+    memcpy(sp->nbad, rptnbad, sizeof(rptnbad));
+    sp->nlist = rptnlist;
+    sp->lat = 0;
+    if (rpton) rptwait = 1;
 
-            }
+}
 
-        }
+/**
+ *
+ * Start procedure record
+ *
+ * Takes a snapshot for a procedure starting, if a report is set. If there is
+ * no space, the procedure just goes without a record.
+ *
+ * \returns The snapshot, or NULL if none.
+ *
+ */
 
-        first = 0; // set no longer first compare
+rptsnap *rptnew(void)
 
-        // return fatal if mode is fail miscompare
-        if (curmode == compmode_fail) return result_error;
+{
 
-        // place last compare values
-        comp_a = nb;
-        comp_b = ob;
-        dataset = 1;
+    rptsnap *sp;
 
-    }
-    if (chkbrk()) {
-    
-        if (exiterror) r = result_exit; // exit diagnostic
-        else r = result_stop; // check break
-        
-    }
+    if (!rpton) return NULL; // no report
+    if (rptfree) { sp = rptfree; rptfree = sp->next; }
+    else sp = (rptsnap *) malloc(sizeof(rptsnap));
+    if (sp) rptmark(sp);
 
-    return r; // return result code
+    return sp;
 
 }
 
 /**
  *
- * Enter text line
+ * Free report snapshots
  *
- * Enters a line to the edit list. If the line has a number in front, that is
- * used to sequence the line. The line number will be stripped off and the line
- * will be placed at that position in the edit buffer. Otherwise, it will be
- * placed at the end of the edit list. Typically, the user will place the number
- * there, which both signals the line is to be stored, as well as where. In a
- * file, the lines are simply dumped into the edit store at the end. If there
- * are numbers in the loaded file, they will cause the lines to be ordered
- * according to number, which is unlikely what the user wanted, but is the
- * correct thing. In any case, a line with a leading number is not a valid
- * command.
+ * Frees the snapshots kept for reuse by this thread.
  *
- * \returns Standard discdiag error code.
- * 
  */
-result enterline(char *line)
+
+void rptclear(void)
 
 {
 
-    long long n;
-    linestr *p, *l, *p2;
-    int s;
-    result r;
-    char *lines;
-    char *label;
-    char cbuf[100];
-    uservar *params, *params2, *params3, *vp;
-    char w[100];
+    rptsnap *sp;
 
-    n = -1; // set impossible line
-    lines = line; // save line position
-    while (*line == ' ') line++; // skip spaces
-    // check leading number exists
-    if (isdigit(*line)) {
+    while (rptfree) {
 
-        r = getval(&line, &n); // get the number
-        if (r != result_ok) return r; // error
+        sp = rptfree;
+        rptfree = sp->next;
+        free(sp);
 
-    } else line = lines; // no line number, back up to start
-    // look ahead for label
-    label = NULL; // set no label
-    params = NULL;
-    lines = line; // save line position
-    while (*line == ' ') line++; // skip spaces
-    if (isalpha(*line)) { // if there is an alpha label
+    }
 
-        getword(&line, cbuf); // get the label
-        while (*line == ' ') line++; // skip spaces
-        if (*line == ':' || *line == '(') { // its a label
+}
 
-            // if the form is: "label:" at the start of line, its a label. We
-            // strip this off and set it to a special field in the text line
-            // tracking entry.
-            if (*line == '(') { // parameter list
+/**
+ *
+ * Write report records
+ *
+ * Writes out the records this thread has waiting, in one write, so records
+ * from workers don't mix.
+ *
+ */
 
-                line++; // skip '('
-                while (*line == ' ') line++; // skip spaces
-                while (*line && *line != ')' && *line != ':') {
+void rptflush(void)
 
-                    getword(&line, w); // get a parameter
-                    s = strlen(w); // get length
-                    if (!s) { // flag bad parameter
+{
 
-                        printf("*** Error: Bad parameter specification\n");
-                        return result_error;
+    if (!rptlen) return; // nothing waiting
+    fwrite(rptbuf, 1, (size_t) rptlen, rptfp ? rptfp : stdout);
+    fflush(rptfp ? rptfp : stdout);
+    rptlen = 0;
 
-                    }
-                    // get a new variable entry
-                    vp = (uservar *) malloc(sizeof(uservar));
-                    // push to parameters list
-                    vp->next = params;
-                    params = vp;
-                    // allocate parameter label
-                    vp->varstr = (char *) malloc(s+1);
-                    strncpy(vp->varstr, w, s+1); // place label
-                    vp->val = 0; // set initializer value
+}
 
-                }
-                // reverse the parameter list into order
-                params2 = NULL;
-                while (params != NULL) { // drain the list
+/**
+ *
+ * Add report record
+ *
+ * Adds a record to those waiting, writing them out first if it won't fit.
+ *
+ */
 
-                    params3 = params; // remove from source list
-                    params = params->next;
-                    params3->next = params2; // push to destination
-                    params2 = params3;
-                   
-                }
-                params = params2; // place final list
-                if (*line != ')') { // bad ending
+void rptout(
+    /** Record */ char *rec
+)
 
-                    printf("*** Error: ')' expected\n");
-                    return result_error;
+{
 
-                } else line++; // skip ')'
-                while (*line == ' ') line++; // skip spaces
-                if (*line != ':') { // no ':'
+    int n;
 
-                    printf("*** Error: ':' expected\n");
-                    return result_error;
+    n = (int) strlen(rec);
+    if (rptlen+n > RPTBUF) rptflush();
+    memcpy(rptbuf+rptlen, rec, (size_t) n);
+    rptlen += n;
 
-                }
-                
-            }
-            line++; // skip ':'
-            s = strlen(cbuf); // find length of label
-            label = (char *) malloc(s+1); // allocate plus zero
-            strncpy(label, cbuf, s+1); // place in label
+}
 
-        } else {
+/**
+ *
+ * Quote report string
+ *
+ * Copies a string as a JSON string or CSV field, quoted, with anything that
+ * needs it escaped. At most max characters are taken from the string.
+ *
+ */
 
-            // we failed to find a label, back out of the deal
-            line = lines;
+void rptstr(
+    /** Output */           char *d,
+    /** String */           const char *str,
+    /** Most to take */     int max
+)
 
-        }
+{
 
-    } else {
+    *d++ = '"';
+    while (*str && max--) {
 
-        // we failed to find a label, back out of the deal
-        line = lines;
+        if (*str == '"' && !rptjson) *d++ = '"'; // CSV doubles quotes
+        else if ((*str == '"' || *str == '\\') && rptjson) *d++ = '\\';
+        if (rptjson && (unsigned char) *str < ' ') {
 
-    }
+            sprintf(d, "\\u%4.4x", (unsigned char) *str);
+            d += 6;
 
-    p = editroot;
-    l = NULL;
-    while (--n && p) { l = p; p = p-> next; } // find line by numeric sequence 
-    // insert line to present position
-    p2 = (linestr *) malloc(sizeof(linestr)); // get new entry
-    if (!l) { p2->next = editroot; editroot = p2; } // list was empty or first
-    else { p2->next = l->next; l->next = p2; } // append/insert here
-    // Now fill in the entry
-    p2->label = label; // set label
-    p2->params = params; // set parameters
-    s = strlen(line); // find remaining length of line
-    p2->line = (char *) malloc(s+1); // allocate with trailing zero
-    strncpy(p2->line, line, s+1); // place text line
-    p2->looplist = NULL; // clear loop counter list
+        } else *d++ = *str;
+        str++;
 
-    return result_ok; 
+    }
+    *d++ = '"';
+    *d = 0;
 
 }
 
 /**
  *
- * Clear program
+ * Find record latencies
  *
- * Clear current program base and recycle all entries.
+ * Puts the percentiles of one latency histogram into a record.
  *
  */
 
-void clrpgm(void)
+void rptlat(
+    /** Output */           char *d,
+    /** Latencies */        lathist *hp,
+    /** Read or write */    char rw
+)
 
 {
 
-    linestr *p;
-
-    while (editroot) { // empty list
- 
-        p = editroot; // index top line
-        editroot = p->next; // gap out
-        if (p->label) free(p->label); // free label if exists
-        free(p->line); // free text line
-        free(p); // free the text header
-
-    }
+    if (rptjson) sprintf(d,
+        "\"%clat50\":%lld,\"%clat99\":%lld,\"%clat999\":%lld,\"%clatmax\":%lld",
+        rw, pctlat(hp, 5000), rw, pctlat(hp, 9900), rw, pctlat(hp, 9990),
+        rw, hp->total ? hp->max : 0LL);
+    else sprintf(d, "%lld,%lld,%lld,%lld", pctlat(hp, 5000), pctlat(hp, 9900),
+                 pctlat(hp, 9990), hp->total ? hp->max : 0LL);
 
 }
 
 /**
  *
- * Load program from file
- *
- * Loads a program from a given file. Returns 0 for success.
+ * Make report record
  *
- * \returns 0 if the file loaded, otherwise 1.
+ * Formats a record of the given values, with the failures listed on the line
+ * from the one given, and adds it to those waiting.
  *
  */
 
-int loadfile(
-    /** Filename to load */ char *fname
+void rptput(
+    /** Record type */                   char *type,
+    /** Line, procedure or drive name */ char *name,
+    /** Drive number */                  int drive,
+    /** Values */                        rptval *vp,
+    /** Result name */                   char *res,
+    /** First failure listed, -1 none */ int first
 )
 
 {
 
-    FILE *fp;
-    char buffer[250];
-    int r;
-
-    // start by clearing out and recycling the old progam
-    fp = fopen(fname, "r");
-    if (!fp) return 1; // couldn't open file    
-    clrpgm(); // clear existing program out
-    do { // read lines
-
-       r = readline(fp, buffer, sizeof(buffer)); // read a line 
-       // if not eof, enter the line
-       if (!r) enterline(buffer);
+    char rec[8192]; // the record
+    char nstr[1600], dstr[700]; // quoted names
+    char lat[2][160]; // read and write latencies
+    char *d;
+    const char *dev;
+    int i;
 
-    } while (!r); // until eof
-    fclose(fp);
+    rptstr(nstr, name, 250);
+    dev = drive >= 0 ? getdrvstr(drive) : NULL;
+    rptstr(dstr, dev ? dev : "", 100);
+    rptlat(lat[0], &vp->latr, 'r');
+    rptlat(lat[1], &vp->latw, 'w');
+    if (rptjson) sprintf(rec,
+        "{\"type\":\"%s\",\"name\":%s,\"worker\":%d,\"drive\":%d,\"dev\":%s,"
+        "\"size\":%lld,\"secsize\":%d,\"result\":\"%s\",\"secs\":%.6f,"
+        "\"rops\":%.0f,\"wops\":%.0f,\"rbytes\":%.0f,\"wbytes\":%.0f,"
+        "\"tops\":%.0f,\"zops\":%.0f,\"tbytes\":%.0f,\"zbytes\":%.0f,%s,%s,"
+        "\"rerrors\":%lld,\"werrors\":%lld,\"terrors\":%lld,"
+        "\"miscompares\":%lld,\"bad\":[",
+        type, nstr, workerno, drive, dstr, vp->size, vp->secsize, res,
+        vp->secs, vp->iopr, vp->iopw, vp->bcr, vp->bcw, vp->iopt, vp->iopz,
+        vp->bct, vp->bcz, lat[0], lat[1], vp->nbad[bad_read],
+        vp->nbad[bad_write], vp->nbad[bad_trim], vp->nbad[bad_comp]);
+    else sprintf(rec,
+        "%s,%s,%d,%d,%s,%lld,%d,%s,%.6f,%.0f,%.0f,%.0f,%.0f,%.0f,%.0f,%.0f,"
+        "%.0f,%s,%s,%lld,%lld,%lld,%lld,\"",
+        type, nstr, workerno, drive, dstr, vp->size, vp->secsize, res,
+        vp->secs, vp->iopr, vp->iopw, vp->bcr, vp->bcw, vp->iopt, vp->iopz,
+        vp->bct, vp->bcz, lat[0], lat[1], vp->nbad[bad_read],
+        vp->nbad[bad_write], vp->nbad[bad_trim], vp->nbad[bad_comp]);
+    d = rec+strlen(rec);
+    if (first >= 0) for (i = first; i < rptnlist; i++) {
+
+        if (rptjson) sprintf(d, "%s{\"kind\":\"%s\",\"lba\":%lld}",
+                             i > first ? "," : "", badname[rptkind[i]], rptlba[i]);
+        else sprintf(d, "%s%s:%lld", i > first ? " " : "", badname[rptkind[i]],
+                     rptlba[i]);
+        d += strlen(d);
 
-    return 0; // return result ok
+    }
+    strcpy(d, rptjson ? "]}\n" : "\"\n");
+    rptout(rec);
 
 }
 
 /**
  *
- * Push new interpreter level
+ * Find record values
  *
- * Adds a new level to the interpreter stack using the line buffer and character
- * position given.
+ * Finds what was done since a snapshot, on the current drive.
  *
  */
-void pushlvl(
-    /** Current line buffer */ linestr *line,
-    /** Current character position within buffer */ char *cpos
+
+void rptdiff(
+    /** Values found */ rptval *vp,
+    /** Snapshot */     rptsnap *sp
 )
 
 {
 
-    intstk *p;
+    int i;
+
+    vp->size = currentdrive >= 0 ? drivesize : 0;
+    vp->secsize = secsize;
+    vp->secs = (gettim()-sp->start)/1e9;
+    vp->iopw = iopwrite-sp->iopw;
+    vp->iopr = iopread-sp->iopr;
+    vp->bcw = bcwrite-sp->bcw;
+    vp->bcr = bcread-sp->bcr;
+    vp->iopt = ioptrim-sp->iopt;
+    vp->iopz = iopzero-sp->iopz;
+    vp->bct = bctrim-sp->bct;
+    vp->bcz = bczero-sp->bcz;
+    for (i = 0; i < bad_count; i++) vp->nbad[i] = rptnbad[i]-sp->nbad[i];
+    if (sp->lat) {
+
+        difflat(&vp->latr, &latread, &sp->latr);
+        difflat(&vp->latw, &latwrite, &sp->latw);
+
+    } else { // no latencies since, and no counts are looked at without them
+
+        vp->latr.total = vp->latw.total = 0;
+        vp->latr.sum = vp->latw.sum = 0.0;
+        vp->latr.min = vp->latw.min = 0;
+        vp->latr.max = vp->latw.max = 0;
+
+    }
 
-    p = (intstk *) malloc(sizeof(intstk)); // get a new stack entry
-    p->next = introot; // push onto stack
-    introot = p;
-    p->curlin = line; // set buffer
-    p->curchr = cpos; // set character position
-    p->mark = varroot; // mark locals
-   
 }
 
 /**
  *
- * Pop old interpreter level
+ * Add to drive summary
  *
- * Removes an interpreter level. Note that the interpreter stack should never
- * go dry.
+ * Adds a record's values to the summary for its drive. Only the main thread
+ * keeps summaries.
  *
  */
-void poplvl(void)
 
-{
+void rptsum(
+    /** Drive number */ int d,
+    /** Values */       rptval *vp
+)
 
-    intstk *p;
-    uservar *vp;
+{
 
-    if (!introot) {
+    rptval *sp;
+    int i;
 
-        printf("*** Error: System fault: Interpreter stack runs dry\n");
-        printf("***        Halting program\n");
+    if (d < 0 || d >= MAXDRIVES) return; // no drive
+    if (!rptdrv[d]) {
 
-        exit(1);
+        rptdrv[d] = (rptval *) calloc(1, sizeof(rptval));
+        if (!rptdrv[d]) return; // goes without
+        clrlat(&rptdrv[d]->latr);
+        clrlat(&rptdrv[d]->latw);
 
     }
-    // remove locals if present, and we are not in immediate mode
-    if (introot && introot->next && introot->mark) {
-
-        while (varroot && introot->mark != varroot) {
+    sp = rptdrv[d];
+    if (vp->size) { // last size seen
 
-            vp = varroot; // index top variable entry
-            varroot = vp->next; // gap out
-            if (vp->varstr) free(vp->varstr); // release label string
-            free(vp); // release entry
-
-        } 
+        sp->size = vp->size;
+        sp->secsize = vp->secsize;
 
     }
-    // remove stack entry
-    p = introot; // index top entry
-    introot = p->next; // gap out
-    free(p); // recycle entry
+    sp->secs += vp->secs;
+    sp->iopw += vp->iopw;
+    sp->iopr += vp->iopr;
+    sp->bcw += vp->bcw;
+    sp->bcr += vp->bcr;
+    sp->iopt += vp->iopt;
+    sp->iopz += vp->iopz;
+    sp->bct += vp->bct;
+    sp->bcz += vp->bcz;
+    for (i = 0; i < bad_count; i++) sp->nbad[i] += vp->nbad[i];
+    mrglat(&sp->latr, &vp->latr);
+    mrglat(&sp->latw, &vp->latw);
 
 }
 
 /**
  *
- * Find program label
- *
- * Searches for a label in the program store using the given name, and returns
- * that if found, otherwise NULL.
+ * End procedure record
  *
- * \returns The label string.
+ * Makes the record of a procedure from its snapshot, and frees the snapshot.
  *
  */
-linestr *fndpgm(
-    /** Name of user variable */ char *name
+
+void rptproc(
+    /** Snapshot */ rptsnap *sp,
+    /** Result */   result r
 )
 
 {
 
-    linestr *p, *pf;
-
-    /* search the user variables list */
-    p = editroot; // index root
-    pf = NULL; // set not found
-    while (p) {
-
-        if (p->label && !strcmp(name, p->label)) { // found
+    if (rpton) {
 
-            pf = p; // set found entry
-            p = NULL; // flag found
-
-        } else p = p->next; // link next entry
+        rptdiff(&rptcur, sp);
+        rptput("proc", sp->name, currentdrive, &rptcur, resname[r], sp->nlist);
 
     }
-
-    return pf; // return entry or NULL
+    sp->next = rptfree;
+    rptfree = sp;
 
 }
 
 /**
  *
- * Find line counter
- *
- * Given a line count list, either finds an existing line counter, or adds a new
- * one. The line count entry is identified by the line character position, which
- * is passed. That is, each loop command will have a unique place on the command
- * line, and the counter for it is filed using that position.
+ * Make line record
  *
- * \returns The loopcounter entry.
+ * Makes the record of the command line just done, adds it to the summary for
+ * the drive, and writes out the records waiting.
  *
  */
-loopcounter* fndcnt(
-    /** Root of counter list */       loopcounter** list,
-    /** Character position of loop */ char* pos)
-
-{
-
-    /* loopcounter list pointer */  loopcounter *p; 
-    /* loopcounter found pointer */ loopcounter *f; 
 
-    f = NULL; // set no entry found
-    p = *list; // index top of list
-    while (p != NULL) {
-
-        if (p->pos == pos) { // found
-
-            f = p; // set found entry
-            p = NULL; // stop search
-
-        } else // not found
-            p = p->next; // go next entry in list
-
-    }
-    if (f == NULL) { // no entry found
-
-        // create new line counter entry
-        f = (loopcounter*) malloc(sizeof(loopcounter));
-        f->next = *list; // push to top of target list
-        *list = f;
-        f->pos = pos; // set character position to match
-        f->loopcount = 0; // clear counter
+void rptline(
+    /** Line text */       char *text,
+    /** Time in seconds */ double time,
+    /** Result */          result r
+)
 
-    }
+{
 
-    return f; // return found/made entry
+    if (!rpton) return; // no report
+    rptdiff(&rptcur, &rptlin);
+    rptcur.secs = time;
+    rptput("line", text, currentdrive, &rptcur, resname[r], rptlin.nlist);
+    rptsum(currentdrive, &rptcur);
+    rptflush();
 
 }
 
 /**
  *
- * Reset line counters
+ * End report
  *
- * Resets all of the program line counters to zero
+ * Writes a summary record for each drive used, and closes the report.
  *
  */
 
-void rstlin(void)
+void rptend(void)
 
 {
 
-    linestr *p;
-    loopcounter* cp;
-
-    p = editroot; // index first line
-    while (p) { // traverse and print
-
-        cp = p->looplist; // index top of loopcounter list
-        while (cp != NULL) { // cross the list 
+    int d;
 
-            cp->loopcount = 0; // reset counter
-            cp = cp->next; // next entry
+    if (!rpton) return; // no report
+    for (d = 0; d < MAXDRIVES; d++) if (rptdrv[d]) {
 
-        }
-        p = p->next; // go next line in list
+        rptput("drive", "", d, rptdrv[d], "", -1);
+        free(rptdrv[d]);
+        rptdrv[d] = NULL;
 
     }
+    rptflush();
+    if (rptfp) fclose(rptfp);
+    rptfp = NULL;
+    rpton = 0;
 
 }
 
 /**
  *
- * Pop control level
+ * Get word off command line
  *
- * Removes and frees one control level
+ * Retrieves the next space delimited word from the passed command line.
+ * Can be used as a general purpose parameter parser.
  *
  */
-void popctl(void)
+void getword(
+    /** Line to parse */      char **l,
+    /** Word output buffer */ char *w
+)
 
 {
 
-    ctlstk *cp;
-
-    if (ctlroot) { // there is a level
-
-        cp = ctlroot; // index top entry 
-        ctlroot = cp->next; // gap out
-        free(cp); // free up
-
-    }
+    while (**l == ' ') (*l)++; // skip any leading spaces
+    // copy non-space to buffer
+    while (**l && (isalnum(**l) || **l == '?' || **l == '.')) 
+        *w++ = *(*l)++;
+    *w = 0; // terminate buffer
 
-}
+} 
 
 /**
  *
- * Skip commands
+ * Get file name off command line
  *
- * Skip commands until the recognized one is found. Takes a command verb,
- * and skips forward until that command verb is found. Expects to be at the
- * end of a command, which means that the next ';' command separator or end
- * of line is to be found, then the commands after that examined.
+ * Retrieves the next file name, which runs to the next space or command end,
+ * so it can hold a path. A name in double quotes runs to the closing quote,
+ * so it can hold spaces too. The buffer is 100 characters, and a longer name
+ * is an error rather than cut short, since a cut name is another file.
  *
  * \returns Standard discdiag error code.
- * 
+ *
  */
-result skipcmd(
-    /** Remaining command line */ char **line,
-    /** Command to skip */        char *cmd,
-    /** Command to skip 2 */      char *cmd2,
-    /** Command to skip 3 */      char *cmd3,
-    /** What label was found */   int  *fnd
+result getfile(
+    /** Line to parse */      char **l,
+    /** Name output buffer */ char *w
 )
 
 {
 
-    char w[100]; // word buffer
-    int whlcnt; // nested while counter
-    int repcnt; // nested repeat counter
-    int forcnt; // nested for counter
-    int selcnt; // nested select counter
-
-    whlcnt = 0; // clear nesting counts
-    repcnt = 0;
-    forcnt = 0;
-    selcnt = 0;
-    // skip the rest of the command/parameters
-    while (**line && **line != ';') (*line)++; // skip until ';' or end
-    if (**line == ';') (*line)++; // skip ';'
-    do { // skip lines in program
-
-        // skip commands on line
-        do {
-
-            while (**line && **line == ' ') (*line)++; // skip spaces
-            if (**line) { // line is not empty
+    int n;
 
-                getword(line, w); // find command verb
-                // update nesting counts
-                if (!strcmp(w, "while"))  whlcnt++;
-                if (!strcmp(w, "wend"))   { whlcnt--; if (whlcnt < 0) whlcnt = 0; }
-                if (!strcmp(w, "repeat")) repcnt++;
-                if (!strcmp(w, "until"))  { repcnt--; if (repcnt < 0) repcnt = 0; }
-                if (!strcmp(w, "for"))    forcnt++;
-                if (!strcmp(w, "fend"))   { forcnt--; if (forcnt < 0) forcnt = 0; }
-                if (!strcmp(w, "select")) selcnt++;
-                if (!strcmp(w, "send"))   { selcnt--; if (selcnt < 0) selcnt = 0; }
-                // lock out nested sections. We treat excesss ends as no-ops,
-                // but at that point the algorithim is suspect in any case.
-                // It means the source is playing games with the nesting.
-                if (!(whlcnt || repcnt || forcnt || selcnt)) {
+    while (**l == ' ') (*l)++; // skip any leading spaces
+    n = 0;
+    if (**l == '"') { // quoted
 
-                    // search for provided words
-                    *fnd = 1; // set find 1
-                    if (!strcmp(w, cmd)) return result_ok; // found
-                    *fnd = 2; // set find 2
-                    if (!strcmp(w, cmd2)) return result_ok; // found
-                    *fnd = 3; // set find 3
-                    if (!strcmp(w, cmd3)) return result_ok; // found
+        (*l)++;
+        while (**l && **l != '"') {
 
-                }
-                while (**line && **line != ';') (*line)++; // skip until ';' or end
-                if (**line == ';') (*line)++; // skip ';'
+            if (n < 100) w[n++] = **l;
+            (*l)++;
 
-            }
+        }
+        if (**l == '"') (*l)++; // skip the closing quote
 
-        } while (**line); // not end of line
-        if (introot && introot->next) {
+    } else while (**l && **l != ' ' && **l != ';') {
 
-            // not in immediate mode, advance to next line in program
-            introot->curlin = introot->curlin->next;
-            // if not end of program, set start of new line
-            if (introot->curlin) *line = introot->curlin->line;
-            else {
+        if (n < 100) w[n++] = **l;
+        (*l)++;
 
-                // end of program, flush stack and bail
-                while (introot) poplvl();
-                return result_error;
+    }
+    if (n > 99) {
 
-            }
+        w[0] = 0;
+        printf("*** Error: File name too long, must be 99 characters or less\n");
 
-        }
+        return result_error;
 
-    } while (introot);
+    }
+    w[n] = 0; // terminate buffer
 
-    return result_error;
+    return result_ok;
 
 }
 
-/*******************************************************************************
-
-Variable handlers
-
-*******************************************************************************/
-
 /**
  *
- * Drive size
+ * Hash name
  *
- * Return current size of drive
+ * Finds the hash of a name string, used for all the tables that are searched
+ * by name.
+ *
+ * \returns The hash value.
  *
- * \returns Standard discdiag error code.
- * 
  */
-
-result variable_drvsiz(
-    /** Remaining command line */ char **line,
-    /** Returned value */         long long *ll
+unsigned long hashstr(
+    /** Name string */ char *name
 )
 
 {
 
-    long long t;
-    int r;
+    unsigned long h;
 
-    *ll = drivesize; // return drive size
+    h = 0;
+    while (*name) h = h*31+(unsigned char) *name++;
 
-    return result_ok; // return no fault
+    return h;
 
 }
 
 /**
  *
- * Random number
+ * Find symbol
  *
- * Returns a random number.
+ * Searches the symbol table for a name. If it is not there, and create is set,
+ * it is added. Returns the symbol, or NULL if it was not found or there is no
+ * space for it.
  *
- * Note that this is currently a 32 bit implementation, we need to extend
- * to 64 bits. This is required to handle larger drives.
+ * \returns Symbol entry.
  *
- * \returns Standard discdiag error code.
- * 
  */
-
-result variable_rand(
-    /** Remaining command line */ char **line,
-    /** Returned value */         long long *ll
+symbol *fndsym(
+    /** Name of symbol */      char *name,
+    /** Add if not found */    int create
 )
 
 {
 
-    *ll = rand64();
+    symbol **root;
+    symbol *sp;
+    int s;
 
-    return result_ok; // return no fault
+    root = &symtbl[hashstr(name) & (SYMHASH-1)];
+    sp = *root;
+    while (sp && strcmp(name, sp->name)) sp = sp->next;
+    if (!sp && create) { // make a new entry
+
+        sp = (symbol *) malloc(sizeof(symbol));
+        if (!sp) return NULL;
+        s = strlen(name); // find length of name
+        sp->name = (char *) malloc(s+1);
+        if (!sp->name) {
+
+            free(sp);
+
+            return NULL;
+
+        }
+        strncpy(sp->name, name, s+1); // place name in string
+        sp->top = NULL; // no variable yet
+        sp->next = *root; // push onto hash chain
+        *root = sp;
+
+    }
+
+    return sp; // return entry or NULL
 
 }
 
 /**
  *
- * Random LBA
+ * Free symbols
  *
- * Returns a random number limited to the LBA size
+ * Empties the variables stack, and frees its chunks and all the symbols of the
+ * thread.
  *
- * \returns Standard discdiag error code.
- * 
  */
-
-result variable_lbarnd(
-    /** Remaining command line */ char **line,
-    /** Returned value */         long long *ll
-)
+void freesym(void)
+
+{
+
+    symbol *sp;
+    varchunk *cp;
+    int i;
+
+    while (vartop && vartop->prev) vartop = vartop->prev; // find bottom chunk
+    while (vartop) {
+
+        cp = vartop;
+        vartop = cp->next;
+        free(cp);
+
+    }
+    varfill = 0;
+    vardepth = 0;
+    for (i = 0; i < SYMHASH; i++) {
+
+        while (symtbl[i]) {
+
+            sp = symtbl[i];
+            symtbl[i] = sp->next;
+            free(sp->name);
+            free(sp);
+
+        }
+
+    }
+
+}
+
+/**
+ *
+ * List variables stack
+ *
+ * Dumps the contents of the variables stack in LI order. A diagnostic.
+ *
+ */
+void listvar(void)
+
+{
+
+    varchunk *cp;
+    int i;
+    uservar *p;
+
+    // go down the stack from the top
+    cp = vartop;
+    i = varfill;
+    while (cp) {
+
+        while (i) {
+
+            p = &cp->var[--i];
+            printf("%s: var: %s val: %lld\n", __FUNCTION__, p->varstr, p->val);
+
+        }
+        cp = cp->prev; // link chunk below
+        i = VARCHUNK;
+
+    }
+
+}
+
+/**
+ *
+ * Find user variable
+ *
+ * Searches for a user variable by name. Returns a pointer to the variable
+ * entry or NULL if not found.
+ *
+ * \returns User variable entry.
+ *
+ */
+uservar *fndvar(
+    /** Name of user variable */ char *name
+)
+
+{
+
+    symbol *sp;
+
+    sp = fndsym(name, 0);
+    if (!sp) return NULL; // never seen
+
+    return sp->top; // return entry or NULL
+
+}
+
+/**
+ *
+ * Enter new user variable
+ *
+ * Creates and pushes a new variable on the variables stack with the given name
+ * and value.
+ *
+ * \returns Standard discdiag error code.
+ * 
+ */
+result pushvar(
+    /** Name of variable */ char *name,
+    /** Value for variable */ long long val
+)
+
+{
+
+    uservar *uvar; // pointer to user variable entry
+    varchunk *cp;
+    symbol *sp;
+
+    sp = fndsym(name, 1); // find or make the name
+    if (!sp) {
+
+        printf("*** Error: Cannot allocate space\n");
+
+        return result_error;
+
+    }
+    if (!vartop || varfill == VARCHUNK) { // top chunk is full
+
+        if (vartop && vartop->next) cp = vartop->next; // reuse chunk above
+        else {
+
+            cp = (varchunk *) malloc(sizeof(varchunk));
+            if (!cp) {
+
+                printf("*** Error: Cannot allocate space\n");
+
+                return result_error;
+
+            }
+            cp->prev = vartop;
+            cp->next = NULL;
+            if (vartop) vartop->next = cp;
+
+        }
+        vartop = cp;
+        varfill = 0;
+
+    }
+    uvar = &vartop->var[varfill++]; // get a new entry
+    vardepth++;
+    uvar->next = NULL; // not in a list
+    uvar->varstr = sp->name; // names are kept by the symbol
+    uvar->val = val; // place value
+    uvar->sym = sp;
+    uvar->shadow = sp->top; // bind the name
+    sp->top = uvar;
+
+    return result_ok;
+
+}
+
+/**
+ *
+ * Release user variables
+ *
+ * Pops the variables stack back to the depth given, which was marked before
+ * the variables to be released were pushed. Names go back to what they were
+ * bound to before.
+ *
+ */
+void relvar(
+    /** Stack depth to keep */ long mark
+)
+
+{
+
+    uservar *uvar;
+
+    while (vardepth > mark) {
+
+        if (!varfill) { // top chunk is empty, go down
+
+            vartop = vartop->prev;
+            varfill = VARCHUNK;
+
+        }
+        uvar = &vartop->var[--varfill];
+        vardepth--;
+        uvar->sym->top = uvar->shadow; // unbind the name
+
+    }
+
+}
+
+/** Number of slots in the command and predefined variable indexes, must be a
+    power of 2 and more than either table has entries */
+#define TBLHASH 512
+
+/** Command table index */              command *cmdhash[TBLHASH];
+/** Predefined variable table index */  variable *varhash[TBLHASH];
+
+/**
+ *
+ * Index command and variable tables
+ *
+ * Hashes the command and predefined variable tables by name, so they are not
+ * searched entry by entry. Where a name appears twice, only the first can be
+ * found, as with a search. Done once at startup, before any workers.
+ *
+ */
+void indextbls(void)
+
+{
+
+    command *cmd;
+    variable *var;
+    unsigned long h;
+
+    for (cmd = cmdtbl; cmd->cmd; cmd++) {
+
+        h = hashstr(cmd->cmdstr) & (TBLHASH-1);
+        while (cmdhash[h] && strcmp(cmd->cmdstr, cmdhash[h]->cmdstr))
+            h = (h+1) & (TBLHASH-1);
+        if (!cmdhash[h]) cmdhash[h] = cmd;
+
+    }
+    for (var = vartbl; var->var; var++) {
+
+        h = hashstr(var->varstr) & (TBLHASH-1);
+        while (varhash[h] && strcmp(var->varstr, varhash[h]->varstr))
+            h = (h+1) & (TBLHASH-1);
+        if (!varhash[h]) varhash[h] = var;
+
+    }
+
+}
+
+/**
+ *
+ * Find command
+ *
+ * Looks up a built in command by name.
+ *
+ * \returns Command table entry, or NULL if not found.
+ *
+ */
+command *fndcmd(
+    /** Name of command */ char *name
+)
+
+{
+
+    unsigned long h;
+
+    h = hashstr(name) & (TBLHASH-1);
+    while (cmdhash[h] && strcmp(name, cmdhash[h]->cmdstr))
+        h = (h+1) & (TBLHASH-1);
+
+    return cmdhash[h];
+
+}
+
+/**
+ *
+ * Find predefined variable
+ *
+ * Looks up a predefined variable by name.
+ *
+ * \returns Variable table entry, or NULL if not found.
+ *
+ */
+variable *fndsysvar(
+    /** Name of variable */ char *name
+)
+
+{
+
+    unsigned long h;
+
+    h = hashstr(name) & (TBLHASH-1);
+    while (varhash[h] && strcmp(name, varhash[h]->varstr))
+        h = (h+1) & (TBLHASH-1);
+
+    return varhash[h];
+
+}
+
+/**
+ *
+ * Compiled line caches
+ *
+ * Program text is parsed again every time it runs, which is most of the time
+ * spent on a short loop. So the first time a command verb or an expression is
+ * parsed, the result is kept, keyed by where in the text it starts. The verb
+ * keeps the command or procedure it found, and the expression is kept as a
+ * list of operations, in reverse polish order, that runs without parsing
+ * again. Both keep where the text after them starts.
+ *
+ * Text stays put until the program is edited or a new line is entered, when
+ * the cache generation is advanced, and all entries made before then are
+ * dropped. Each thread has its own caches.
+ *
+ */
+
+/** Number of entries in each cache, must be a power of 2 */
+#define CACHESIZE 256
+
+/** Longest expression, in operations, that is cached */
+#define EXPMAX 32
+
+/**
+ *
+ * Expression operations
+ *
+ */
+typedef enum {
+
+    /** Push constant */           op_const,
+    /** Push predefined variable */ op_sysvar,
+    /** Push user variable */      op_uservar,
+    /** -a */                      op_neg,
+    /** a * b */                   op_mul,
+    /** a / b */                   op_div,
+    /** a % b */                   op_mod,
+    /** a + b */                   op_add,
+    /** a - b */                   op_sub,
+    /** a > b */                   op_gt,
+    /** a >= b */                  op_ge,
+    /** a < b */                   op_lt,
+    /** a <= b */                  op_le,
+    /** a = b */                   op_eq,
+    /** a != b */                  op_ne
+
+} opcode;
+
+/**
+ *
+ * Expression operation
+ *
+ */
+typedef struct _expop {
+
+    /** Operation */                            opcode op;
+    /** Constant value */                       long long val;
+    /** Predefined variable */                  variable *var;
+    /** Text after predefined variable */       char *str;
+    /** User variable name */                   symbol *sym;
+
+} expop;
+
+/**
+ *
+ * Cached expression
+ *
+ */
+typedef struct _expent {
+
+    /** Start of text, or NULL if unused */ char *key;
+    /** Text after expression */          char *end;
+    /** Cache generation made in */       unsigned gen;
+    /** Number of operations */           int nops;
+    /** Operations */                     expop *ops;
+
+} expent;
+
+/**
+ *
+ * Cached command verb
+ *
+ */
+typedef struct _cmdent {
+
+    /** Start of text, or NULL if unused */ char *key;
+    /** Text after verb */                char *end;
+    /** Cache generation made in */       unsigned gen;
+    /** Built in command, or NULL */      command *cmd;
+    /** Procedure, or NULL */             linestr *pgm;
+
+} cmdent;
+
+/** Current cache generation */            THREAD unsigned cachegen;
+/** Command verb cache */                  THREAD cmdent cmdcache[CACHESIZE];
+/** Expression cache */                    THREAD expent expcache[CACHESIZE];
+/** Expression being compiled */           THREAD expop trace[EXPMAX];
+/** Operations in expression compiled */   THREAD int ntrace;
+/** Expression compile is active */        THREAD int tracing;
+/** Expression compiled can be cached */   THREAD int traceok;
+
+/**
+ *
+ * Find cache slot
+ *
+ * Hashes the text position to its slot in a cache.
+ *
+ */
+
+int cacheslot(
+    /** Text position */ char *key
+)
+
+{
+
+    unsigned long h;
+
+    h = (unsigned long) (size_t) key;
+    h ^= h >> 11;
+    h *= 2654435761UL;
+
+    return (int) (h >> 8) & (CACHESIZE-1);
+
+}
+
+/**
+ *
+ * Free cache
+ *
+ * Frees all the cached expressions of this thread, and clears both caches.
+ *
+ */
+
+void freecache(void)
+
+{
+
+    int i;
+
+    for (i = 0; i < CACHESIZE; i++) {
+
+        if (expcache[i].ops) free(expcache[i].ops);
+        expcache[i].key = NULL;
+        expcache[i].ops = NULL;
+        cmdcache[i].key = NULL;
+
+    }
+
+}
+
+/**
+ *
+ * Flush cache
+ *
+ * Drops everything cached so far, because the text it came from may change.
+ *
+ */
+
+void flushcache(void)
+
+{
+
+    cachegen++;
+    if (!cachegen) freecache(); // wrapped, old entries could match again
+
+}
+
+/**
+ *
+ * Compile expression operation
+ *
+ * Adds an operation to the expression being compiled, if any.
+ *
+ */
+
+void emit(
+    /** Operation */                       opcode op,
+    /** Constant value */                  long long val,
+    /** Predefined variable */             variable *var,
+    /** Text after predefined variable, or user variable name */ char *str
+)
+
+{
+
+    expop *p;
+
+    if (!tracing || !traceok) return; // not compiling
+    if (ntrace >= EXPMAX) { // too long to cache
+
+        traceok = 0;
+        return;
+
+    }
+    p = &trace[ntrace];
+    p->op = op;
+    p->val = val;
+    p->var = var;
+    p->str = str;
+    p->sym = NULL;
+    if (op == op_uservar) { // keep the name as its symbol
+
+        p->str = NULL;
+        p->sym = fndsym(str, 0);
+        if (!p->sym) {
+
+            traceok = 0;
+            return;
+
+        }
+
+    }
+    ntrace++;
+
+}
+
+/**
+ *
+ * Run cached expression
+ *
+ * \returns Standard discdiag error code.
+ *
+ */
+
+result runexp(
+    /** Cached expression */ expent *ep,
+    /** Number returned */   long long *n
+)
+
+{
+
+    long long stk[EXPMAX]; // value stack
+    long long a, b;
+    int sp, i;
+    expop *p;
+    char *l;
+    uservar *uvar;
+    result r;
+
+    sp = 0;
+    for (i = 0, p = ep->ops; i < ep->nops; i++, p++) {
+
+        if (p->op == op_const) stk[sp++] = p->val;
+        else if (p->op == op_sysvar) {
+
+            l = p->str; // give it the text it had
+            r = p->var->var(&l, &stk[sp]);
+            if (r != result_ok) return r;
+            sp++;
+
+        } else if (p->op == op_uservar) {
+
+            uvar = p->sym->top;
+            if (!uvar) { // gone since it was compiled
+
+                printf("*** Error: Variable \"%s\" invalid\n", p->sym->name);
+
+                return result_error; // bad value
+
+            }
+            stk[sp++] = uvar->val;
+
+        } else if (p->op == op_neg) stk[sp-1] = -stk[sp-1];
+        else {
+
+            b = stk[--sp]; // binary, get right and left sides
+            a = stk[sp-1];
+            switch (p->op) {
+
+                case op_mul: a = a * b; break;
+                case op_div:
+                case op_mod:
+                    if (b == 0) { // check zero divide
+
+                        printf("*** Error: Zero divide\n");
+
+                        return result_error;
+
+                    }
+                    if (p->op == op_div) a = a / b; else a = a % b;
+                    break;
+                case op_add: a = a + b; break;
+                case op_sub: a = a - b; break;
+                case op_gt: a = a > b; break;
+                case op_ge: a = a >= b; break;
+                case op_lt: a = a < b; break;
+                case op_le: a = a <= b; break;
+                case op_eq: a = a == b; break;
+                case op_ne: a = a != b; break;
+                default: break;
+
+            }
+            stk[sp-1] = a;
+
+        }
+
+    }
+    *n = stk[0];
+
+    return result_ok;
+
+}
+
+/**
+ *
+ * Get number off command line
+ *
+ * Gets a number off the command line. If no number is found, returns -1.
+ *
+ * \returns Standard discdiag error code.
+ * 
+ */
+result getval(
+    /** Line to parse */      char **l,
+    /** Number returned */    long long *n
+)
+
+{
+
+    char w[100]; // buffer for parameter
+    variable *var; // pointer to variable table
+    result r;
+    uservar *uvar;
+    char *p;
+
+    getword(l, w); // get next word
+    if (isalpha(*w)) { // is variable
+
+        var = fndsysvar(w); // search predefined variables
+        if (var) { // execute it
+
+            p = *l; // keep the text it gets
+            r = var->var(l, n); // execute variable
+            // check valid
+            if (r != result_ok) return r;
+            // if it parsed parameters, it has to be parsed every time
+            if (*l != p) traceok = 0;
+            emit(op_sysvar, 0, var, p);
+
+        } else {
+
+            /* try searching the user variables list */
+            uvar = fndvar(w);
+            if (!uvar) { // nothing found
+     
+                printf("*** Error: Variable \"%s\" invalid\n", w);
+
+                return result_error; // bad value
+
+            }
+            *n = uvar->val; // return user variable  
+            emit(op_uservar, 0, NULL, w);
+    
+        }
+
+    } else if (isdigit(*w)) {
+
+        *n = (long long)strtoull(w, NULL, 0); // return resulting number
+        emit(op_const, *n, NULL, NULL);
+
+    } else {
+      
+        printf("*** Error: Invalid value\n", w);
+
+        return result_error; // bad value
+
+    }
+
+    return result_ok;
+
+} 
+
+result getrel(char **l, long long *n);
+
+/**
+ *
+ * Process factor
+ *
+ * Processes factor. The factors are:
+ *
+ * +a
+ *
+ * -a
+ *
+ * (a)
+ *
+ * \returns Standard discdiag error code.
+ * 
+ */
+result getfact(
+    /** Line to parse */   char **l,
+    /** Number returned */ long long *n
+)
+
+{
+
+    long long v;
+    result r;
+
+    if (**l == '+') { // +a
+
+        (*l)++; // skip 
+        r = getfact(l, &v); // get subexpression
+        if (r != result_ok) return r;
+        *n = +v; // find +a
+
+    } else if (**l == '-') { // -a
+
+        (*l)++; // skip -
+        r = getfact(l, &v); // get subexpression
+        if (r != result_ok) return r;
+        *n = -v; // find -a
+        emit(op_neg, 0, NULL, NULL);
+
+    } else if (**l == '(') { // (a)
+
+        (*l)++; // skip (
+        r = getrel(l, n); // get subexpression
+        if (r != result_ok) return r;
+        while (**l == ' ') (*l)++; // skip spaces
+        if (**l != ')') {
+
+            printf("*** Error: ')' expected\n");
+ 
+            return result_error;
+
+        }
+        (*l)++; // skip )
+
+    } else {
+
+        r = getval(l, n); // get value
+        if (r != result_ok) return r;
+
+    }
+
+    return result_ok; // exit good 
+
+}
+
+/**
+ *
+ * Process multiply class operator
+ *
+ * Processes a multiply or divide. The expressions are:
+ *
+ * a * b
+ *
+ * a / b
+ *
+ * a % b
+ *
+ * \returns Standard discdiag error code.
+ * 
+ */
+result getmult(
+    /** Line to parse */   char **l,
+    /** Number returned */ long long *n
+)
+
+{
+
+    long long v;
+    result r;
+
+    /* get left side expression */
+    r = getfact(l, n);
+    if (r != result_ok) return r;
+    while (**l == '*' || **l == '/' || **l == '%') {
+
+        if (**l == '*') { // *
+    
+            (*l)++; // skip *
+            r = getfact(l, &v); // get right
+            if (r != result_ok) return r;
+            *n = *n * v; // find a * b
+            emit(op_mul, 0, NULL, NULL);
+    
+        } else if (**l == '/') { // /
+    
+            (*l)++; // skip /
+            r = getfact(l, &v); // get right
+            if (r != result_ok) return r;
+            if (v == 0) { // check zero divide
+
+                printf("*** Error: Zero divide\n");
+
+                return result_error;
+
+            }
+            *n = *n / v; // find a / b
+            emit(op_div, 0, NULL, NULL);
+    
+        } else if (**l == '%') { // %
+    
+            (*l)++; // skip %
+            r = getfact(l, &v); // get right
+            if (r != result_ok) return r;
+            if (v == 0) { // check zero divide
+
+                printf("*** Error: Zero divide\n");
+
+                return result_error;
+
+            }
+            *n = *n % v; // find a % b
+            emit(op_mod, 0, NULL, NULL);
+    
+        }
+
+    }
+
+    return result_ok; // exit good 
+
+}
+
+/**
+ *
+ * Process add class operator
+ *
+ * Processes an add or subtract. The expressions are:
+ *
+ * a + b
+ *
+ * a - b
+ *
+ * \returns Standard discdiag error code.
+ * 
+ */
+result getadd(
+    /** Line to parse */   char **l,
+    /** Number returned */ long long *n
+)
+
+{
+
+    long long v;
+    result r;
+
+    /* get left side expression */
+    r = getmult(l, n);
+    if (r != result_ok) return r;
+    while (**l == '+' || **l == '/' || **l == '-') {
+
+        if (**l == '+') { // +
+       
+            (*l)++; // skip +
+            r = getmult(l, &v); // get right
+            if (r != result_ok) return r;
+            *n = *n + v; // find a + b
+            emit(op_add, 0, NULL, NULL);
+       
+        } else if (**l == '-') { // -
+       
+            (*l)++; // skip -
+            r = getmult(l, &v); // get right
+            if (r != result_ok) return r;
+            *n = *n - v; // find a - b
+            emit(op_sub, 0, NULL, NULL);
+       
+        }
+
+    }
+
+    return result_ok; // exit good 
+
+}
+
+/**
+ *
+ * Process relation
+ *
+ * Processes relation expressions. The expressions are:
+ *
+ * a > b
+ *
+ * a < b
+ *
+ * a = b
+ *
+ * a != b
+ *
+ * a >= b
+ *
+ * a <= b
+ *
+ * \returns Standard discdiag error code.
+ * 
+ */
+result getrel(
+    /** Line to parse */      char **l,
+    /** Number returned */    long long *n
+)
+
+{
+
+    long long v;
+    result r;
+
+    /* get left side expression */
+    r = getadd(l, n);
+    if (r != result_ok) return r;
+    if (**l == '>') { // > or >=
+
+        (*l)++; // skip >
+        if (**l == '=') { // >=
+
+            (*l)++; // skip =
+            r = getadd(l, &v); // get right
+            if (r != result_ok) return r;
+            *n = *n >= v; // find a >= b
+            emit(op_ge, 0, NULL, NULL);
+
+        } else {
+
+            r = getadd(l, &v); // get right
+            if (r != result_ok) return r;
+            *n = *n > v; // find a > b
+            emit(op_gt, 0, NULL, NULL);
+
+        }
+
+    } else if (**l == '<') { // < or <=
+
+        (*l)++; // skip <
+        if (**l == '=') { // >=
+
+            (*l)++; // skip =
+            r = getadd(l, &v); // get right
+            if (r != result_ok) return r;
+            *n = *n <= v; // find a <= b
+            emit(op_le, 0, NULL, NULL);
+
+        } else {
+
+            r = getadd(l, &v); // get right
+            if (r != result_ok) return r;
+            *n = *n < v; // find a < b
+            emit(op_lt, 0, NULL, NULL);
+
+        }
+
+    } else if (**l == '=') { // =
+
+        (*l)++; // skip =
+        r = getadd(l, &v); // get right
+        if (r != result_ok) return r;
+        *n = *n == v; // find a = b
+        emit(op_eq, 0, NULL, NULL);
+
+    } else if (**l == '!') { // !=
+
+        (*l)++; // skip !
+        if (**l != '=') {
+
+            // this could be a comment, we need to back out
+            (*l)--;
+
+        } else {
+
+            (*l)++; // skip =
+            r = getadd(l, &v); // get right
+            if (r != result_ok) return r;
+            *n = *n != v; // find a != b
+            emit(op_ne, 0, NULL, NULL);
+
+        }
+
+    }
+
+    return result_ok; // exit good 
+
+}
+
+/**
+ *
+ * Process parameter
+ *
+ * Processes a parameter expression. An expression that has been parsed at
+ * this place in the text before runs from the expression cache. Otherwise it
+ * is parsed, and compiled into the cache as it goes.
+ *
+ * \returns Standard discdiag error code.
+ * 
+ */
+result getparam(
+    /** Line to parse */      char **l,
+    /** Number returned */    long long *n
+)
+
+{
+
+    expent *ep;
+    char *start;
+    result r;
+
+    // inside a compile already, just parse
+    if (tracing) return getrel(l, n);
+    ep = &expcache[cacheslot(*l)];
+    if (ep->key == *l && ep->gen == cachegen) { // run it compiled
+
+        r = runexp(ep, n);
+        if (r != result_ok) return r;
+        *l = ep->end;
+
+        return result_ok;
+
+    }
+    // parse and compile it
+    start = *l;
+    ntrace = 0;
+    traceok = 1;
+    tracing = 1;
+    r = getrel(l, n);
+    tracing = 0;
+    if (r != result_ok || !traceok || !ntrace) return r; // not cacheable
+    // replace what the slot had
+    if (ep->ops) free(ep->ops);
+    ep->key = NULL;
+    ep->ops = (expop *) malloc(sizeof(expop)*ntrace);
+    if (!ep->ops) return result_ok;
+    memcpy(ep->ops, trace, sizeof(expop)*ntrace);
+    ep->nops = ntrace;
+    ep->key = start;
+    ep->end = *l;
+    ep->gen = cachegen;
+
+    return result_ok;
+
+}
+
+/**
+ *
+ * Print comparision
+ *
+ * Accepts two byte values, and prints out if they miscompare.
+ *
+ * \returns Standard discdiag error code.
+ * 
+ */
+result printcomp(
+    /** Buffer address */      long addr,
+    /** New (read) byte */     unsigned char nb, 
+    /** Old (existing) byte */ unsigned char ob
+)
+
+{
+
+    result r;
+    
+    r = result_ok; // set result code ok
+    if (nb != ob) {
+
+        // check is first miscompare or mode is print all
+        if (first || curmode == compmode_all) {
+
+            if (dataset && nb == comp_a && ob == comp_b) {
+
+                repcnt++; // just count
+
+            } else {
+
+                // message if miscompares have accumulated
+                if (repcnt) {
+
+                    printf("*** Info: There were %d occurrances of the above mismatch\n", repcnt);
+                    repcnt = 0; // reset counter
+
+                }
+                printf("*** Error: Buffer miscompare: %8.8lx: %2.2x s/b %2.2x\n", 
+                       addr, nb, ob);
+
+            }
+
+        }
+
+        first = 0; // set no longer first compare
+
+        // return fatal if mode is fail miscompare
+        if (curmode == compmode_fail) return result_error;
+
+        // place last compare values
+        comp_a = nb;
+        comp_b = ob;
+        dataset = 1;
+
+    }
+
+    return r; // return result code
+
+}
+
+/**
+ *
+ * Compare block
+ *
+ * Compares a block of the read buffer to the expected data. The whole block is
+ * compared at once, which the C library does as wide as the machine allows,
+ * and only a block that differs is gone through a byte at a time with
+ * printcomp, so the mismatch reporting is the same as comparing every byte.
+ * A break is checked once for the block, when it is done.
+ *
+ * If sector relative addressing is set, mismatches are given as the offset
+ * within their sector, instead of within the buffer.
+ *
+ * \returns Standard discdiag error code.
+ *
+ */
+
+result compblk(
+    /** Read data */                  unsigned char *buf,
+    /** Expected data */              unsigned char *exp,
+    /** Length in bytes */            long long len,
+    /** Buffer address of block */    long long addr,
+    /** Sector relative addressing */ int secrel
+)
+
+{
+
+    long long i;
+    result r;
+
+    r = result_ok;
+    if (memcmp(buf, exp, (size_t)len)) { // differs, go through it
+
+        compdiff++;
+        for (i = 0; i < len && r == result_ok; i++) {
+
+            if (secrel) r = printcomp((long)((addr+i)%secsize), buf[i], exp[i]);
+            else r = printcomp((long)(addr+i), buf[i], exp[i]);
+
+        }
+        if (r != result_ok) return r;
+
+    }
+    if (chkbrk()) {
+
+        if (exiterror) r = result_exit; // exit diagnostic
+        else r = result_stop; // check break
+
+    }
+
+    return r;
+
+}
+
+/**
+ *
+ * Replicate block
+ *
+ * The first blk bytes of the buffer are copied across the rest of it, doubling
+ * the pattern each time, so that the copies are as wide as the C library can
+ * make them.
+ *
+ */
+
+void fillrep(
+    /** Buffer */                 unsigned char *buf,
+    /** Bytes already filled */   long long blk,
+    /** Total bytes to fill */    long long len
+)
+
+{
+
+    long long n;
+
+    while (blk < len) {
+
+        n = blk;
+        if (n > len-blk) n = len-blk;
+        memcpy(buf+blk, buf, (size_t)n);
+        blk += n;
+
+    }
+
+}
+
+/**
+ *
+ * Fill byte count pattern
+ *
+ * Each byte gets the low 8 bits of its offset. That repeats every 256 bytes,
+ * so one run is made and replicated.
+ *
+ */
+
+void fillcnt(
+    /** Buffer */          unsigned char *buf,
+    /** Length in bytes */ long long len
+)
+
+{
+
+    int i;
+
+    for (i = 0; i < 256 && i < len; i++) buf[i] = i;
+    fillrep(buf, i, len);
+
+}
+
+/**
+ *
+ * Fill 32 bit count pattern
+ *
+ * Each dword gets the next count, big endian, starting with the given count.
+ * The vector units make several dwords at once.
+ *
+ */
+
+void filldwcnt(
+    /** Buffer */          unsigned char *buf,
+    /** Starting count */  unsigned long l,
+    /** Length in bytes */ long long len
+)
+
+{
+
+    long long i;
+#if defined(PATAVX2)
+    __m256i v, inc, swap;
+
+    // counts l..l+7, and the shuffle that makes each one big endian
+    v = _mm256_add_epi32(_mm256_set1_epi32((int)l),
+                         _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    inc = _mm256_set1_epi32(8);
+    swap = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                            3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    for (i = 0; i+32 <= len; i += 32) {
+
+        _mm256_storeu_si256((__m256i *)(buf+i), _mm256_shuffle_epi8(v, swap));
+        v = _mm256_add_epi32(v, inc);
+
+    }
+    l += (unsigned long)(i/4);
+#elif defined(PATSSE2)
+    __m128i v, inc, m, b;
+
+    // counts l..l+3, byte swapped with shifts since SSE2 has no shuffle
+    v = _mm_add_epi32(_mm_set1_epi32((int)l), _mm_setr_epi32(0, 1, 2, 3));
+    inc = _mm_set1_epi32(4);
+    m = _mm_set1_epi32(0x00ff00ff);
+    for (i = 0; i+16 <= len; i += 16) {
+
+        b = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(v, 8), m),
+                         _mm_slli_epi32(_mm_and_si128(v, m), 8));
+        b = _mm_or_si128(_mm_srli_epi32(b, 16), _mm_slli_epi32(b, 16));
+        _mm_storeu_si128((__m128i *)(buf+i), b);
+        v = _mm_add_epi32(v, inc);
+
+    }
+    l += (unsigned long)(i/4);
+#elif defined(PATNEON)
+    uint32x4_t v, inc;
+    static const unsigned int start[4] = { 0, 1, 2, 3 };
+
+    // counts l..l+3, byte swapped a dword at a time
+    v = vaddq_u32(vdupq_n_u32((unsigned int)l), vld1q_u32(start));
+    inc = vdupq_n_u32(4);
+    for (i = 0; i+16 <= len; i += 16) {
+
+        vst1q_u8(buf+i, vrev32q_u8(vreinterpretq_u8_u32(v)));
+        v = vaddq_u32(v, inc);
+
+    }
+    l += (unsigned long)(i/4);
+#else
+    i = 0;
+#endif
+
+    // finish what is left, the whole buffer without vectors
+    for (; i+4 <= len; i += 4) {
+
+        buf[i] = l >> 24 & 0xff;
+        buf[i+1] = l >> 16 & 0xff;
+        buf[i+2] = l >> 8 & 0xff;
+        buf[i+3] = l & 0xff;
+        l++;
+
+    }
+
+}
+
+/**
+ *
+ * Fill value pattern
+ *
+ * Each dword gets the same 32 bit value, big endian.
+ *
+ */
+
+void fillval(
+    /** Buffer */          unsigned char *buf,
+    /** Value */           long long val,
+    /** Length in bytes */ long long len
+)
+
+{
+
+    unsigned char b[4];
+    int i;
+
+    b[0] = val >> 24 & 0xff;
+    b[1] = val >> 16 & 0xff;
+    b[2] = val >> 8 & 0xff;
+    b[3] = val & 0xff;
+    for (i = 0; i < 4 && i < len; i++) buf[i] = b[i];
+    fillrep(buf, i, len);
+
+}
+
+/**
+ *
+ * Fill random pattern
+ *
+ * Each sector gets the same run of random bytes, from the generator seeded
+ * with 42. One sector is made, then replicated. The seed is left changed.
+ *
+ */
+
+void fillrand(
+    /** Buffer */          unsigned char *buf,
+    /** Length in bytes */ long long len
+)
+
+{
+
+    int i;
+
+    seed = 42; // reset random number generator
+    for (i = 0; i < secsize && i < len; i++) buf[i] = rand64() & 0xff;
+    fillrep(buf, i, len);
+
+}
+
+/**
+ *
+ * Fill lba pattern
+ *
+ * The first dword of each sector gets the next LBA, big endian, starting with
+ * the given LBA. The rest of each sector is left as it is.
+ *
+ */
+
+void filllba(
+    /** Buffer */             unsigned char *buf,
+    /** Starting LBA */       long long val,
+    /** Length in sectors */  long long len
+)
+
+{
+
+    long long s;
+
+    for (s = 0; s < len; s++) {
+
+        buf[0] = val >> 24 & 0xff;
+        buf[1] = val >> 16 & 0xff;
+        buf[2] = val >> 8 & 0xff;
+        buf[3] = val & 0xff;
+        buf += secsize;
+        val++;
+
+    }
+
+}
+
+/**
+ *
+ * Make CRC32C tables
+ *
+ * Makes the tables for finding a CRC32C 8 bytes at a time without the CRC
+ * instructions. Entry [k][b] is the CRC of byte b followed by k zero bytes.
+ * They are made once at startup, before any workers, and only read after.
+ *
+ */
+
+void crcinit(void)
+
+{
+
+    unsigned long c;
+    int i, j;
+
+    for (i = 0; i < 256; i++) {
+
+        c = i;
+        for (j = 0; j < 8; j++) c = c & 1 ? (c >> 1) ^ CRCPOLY : c >> 1;
+        crctbl[0][i] = c;
+
+    }
+    for (i = 0; i < 256; i++)
+        for (j = 1; j < 8; j++)
+            crctbl[j][i] = (crctbl[j-1][i] >> 8) ^ crctbl[0][crctbl[j-1][i] & 0xff];
+
+}
+
+/**
+ *
+ * Find CRC32C
+ *
+ * Finds the CRC32C (Castagnoli) of a block, with the CPU's CRC instruction if
+ * it has one, else with the tables 8 bytes at a time.
+ *
+ */
+
+unsigned long crc32c(
+    /** Block */           unsigned char *buf,
+    /** Length in bytes */ long long len
+)
+
+{
+
+#if defined(CRCSSE42)
+    unsigned long long c, v;
+
+    c = 0xffffffff;
+    for (; len >= 8; len -= 8, buf += 8) {
+
+        memcpy(&v, buf, 8);
+        c = _mm_crc32_u64(c, v);
+
+    }
+    for (; len > 0; len--) c = _mm_crc32_u8((unsigned int) c, *buf++);
+
+    return (unsigned long) (~c & 0xffffffff);
+#elif defined(CRCARM)
+    unsigned int c;
+    unsigned long long v;
+
+    c = 0xffffffff;
+    for (; len >= 8; len -= 8, buf += 8) {
+
+        memcpy(&v, buf, 8);
+        c = __crc32cd(c, v);
+
+    }
+    for (; len > 0; len--) c = __crc32cb(c, *buf++);
+
+    return (unsigned long) ~c & 0xffffffff;
+#else
+    unsigned long c;
+
+    c = 0xffffffff;
+    for (; len >= 8; len -= 8, buf += 8) {
+
+        c ^= buf[0] | (unsigned long) buf[1] << 8 |
+             (unsigned long) buf[2] << 16 | (unsigned long) buf[3] << 24;
+        c = crctbl[7][c & 0xff] ^ crctbl[6][c >> 8 & 0xff] ^
+            crctbl[5][c >> 16 & 0xff] ^ crctbl[4][c >> 24 & 0xff] ^
+            crctbl[3][buf[4]] ^ crctbl[2][buf[5]] ^
+            crctbl[1][buf[6]] ^ crctbl[0][buf[7]];
+
+    }
+    for (; len > 0; len--) c = (c >> 8) ^ crctbl[0][(c ^ *buf++) & 0xff];
+
+    return ~c & 0xffffffff;
+#endif
+
+}
+
+/**
+ *
+ * Put big endian number
+ *
+ */
+
+void putbe(
+    /** Buffer */          unsigned char *buf,
+    /** Value */           unsigned long long val,
+    /** Length in bytes */ int len
+)
+
+{
+
+    while (len--) {
+
+        buf[len] = (unsigned char) (val & 0xff);
+        val >>= 8;
+
+    }
+
+}
+
+/**
+ *
+ * Get big endian number
+ *
+ */
+
+unsigned long long getbe(
+    /** Buffer */          unsigned char *buf,
+    /** Length in bytes */ int len
+)
+
+{
+
+    unsigned long long v;
+
+    v = 0;
+    while (len--) v = v << 8 | *buf++;
+
+    return v;
+
+}
+
+/**
+ *
+ * Fill signature pattern
+ *
+ * Each sector gets a header of the signature mark, CRC, LBA, write generation,
+ * seed and time, all big endian, then data from a generator started from the
+ * LBA, generation and seed, so no two sectors are alike. The CRC32C covers
+ * everything after itself, so each sector can be checked on its own.
+ *
+ */
+
+void fillsig(
+    /** Buffer */             unsigned char *buf,
+    /** Starting LBA */       long long lba,
+    /** Length in sectors */  long long len,
+    /** Seed */               unsigned long long seedv
+)
+
+{
+
+    unsigned long long x;
+    long long s, t;
+    int i;
+
+    t = gettim();
+    for (s = 0; s < len; s++, lba++, buf += secsize) {
+
+        putbe(buf+SIGMARK, SIGMAGIC, 4);
+        putbe(buf+SIGLBA, (unsigned long long) lba, 8);
+        putbe(buf+SIGGEN, (unsigned long long) siggen, 8);
+        putbe(buf+SIGSEED, seedv, 8);
+        putbe(buf+SIGTIME, (unsigned long long) t, 8);
+        x = seedv ^ (unsigned long long) lba*0x9e3779b97f4a7c15ULL ^
+            (unsigned long long) siggen << 1;
+        if (!x) x = 1; // xorshift can't start at 0
+        for (i = SIGHDR; i+8 <= secsize; i += 8) {
+
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+            memcpy(buf+i, &x, 8);
+
+        }
+        putbe(buf+SIGCRC, crc32c(buf+SIGLBA, secsize-SIGLBA), 4);
+
+    }
+
+}
+
+/**
+ *
+ * Check signature
+ *
+ * Checks one sector against the sig pattern, for the LBA it was read from. With
+ * a generation, a sector from before it fails as stale.
+ *
+ * Returns 0 if good, 1 for no signature, 2 for a bad CRC, 3 for another LBA
+ * and 4 for stale, with the LBA or generation found in val.
+ *
+ */
+
+int chksig(
+    /** Sector */                     unsigned char *p,
+    /** LBA it was read from */       long long lba,
+    /** Oldest generation, or 0 */    long long gen,
+    /** Returns LBA or generation */  long long *val
+)
+
+{
+
+    *val = 0;
+    if (getbe(p+SIGMARK, 4) != SIGMAGIC) return 1; // no signature
+    if (getbe(p+SIGCRC, 4) != crc32c(p+SIGLBA, secsize-SIGLBA)) return 2;
+    *val = (long long) getbe(p+SIGLBA, 8);
+    if (*val != lba) return 3; // misdirected
+    *val = (long long) getbe(p+SIGGEN, 8);
+    if (*val < gen) return 4; // stale
+
+    return 0;
+
+}
+
+/**
+ *
+ * Print signature failure
+ *
+ * Prints what chksig found wrong with a sector.
+ *
+ */
+
+void prtsig(
+    /** What chksig found */         int why,
+    /** LBA of sector */             long long lba,
+    /** LBA or generation found */   long long val,
+    /** Oldest generation */         long long gen
+)
+
+{
+
+    if (why == 1) printf("*** Error: No signature at lba %lld\n", lba);
+    else if (why == 2) printf("*** Error: Signature CRC mismatch at lba %lld\n", lba);
+    else if (why == 3)
+        printf("*** Error: Signature at lba %lld is for lba %lld\n", lba, val);
+    else printf("*** Error: Signature at lba %lld is generation %lld s/b %lld\n",
+                lba, val, gen);
+
+}
+
+/**
+ *
+ * Free extents
+ *
+ * Frees an extent tree.
+ *
+ */
+
+void extfree(
+    /** Tree to free */ extent *t
+)
+
+{
+
+    if (!t) return;
+    extfree(t->left);
+    extfree(t->right);
+    free(t);
+    extcnt--;
+
+}
+
+/**
+ *
+ * Clear written map
+ *
+ */
+
+void mapclear(void)
+
+{
+
+    extfree(extroot);
+    extroot = NULL;
+    extcnt = 0;
+
+}
+
+/**
+ *
+ * Find extent priority
+ *
+ * Hashes the LBA of an extent to its place in the treap heap, higher nearer
+ * the root. The LBA of an extent never changes, so neither does this.
+ *
+ * \returns The priority.
+ *
+ */
+
+unsigned long long extpri(
+    /** LBA of extent */ long long lba
+)
+
+{
+
+    unsigned long long x;
+
+    x = (unsigned long long) lba+0x9e3779b97f4a7c15ULL; // splitmix64 finish
+    x = (x^(x >> 30))*0xbf58476d1ce4e5b9ULL;
+    x = (x^(x >> 27))*0x94d049bb133111ebULL;
+
+    return x^(x >> 31);
+
+}
+
+/**
+ *
+ * Split extents
+ *
+ * Splits a tree into the extents that start before an LBA and the rest.
+ *
+ */
+
+void extsplit(
+    /** Tree to split */        extent *t,
+    /** LBA to split at */      long long lba,
+    /** Returns those before */ extent **l,
+    /** Returns the rest */     extent **r
+)
+
+{
+
+    if (!t) *l = *r = NULL;
+    else if (t->lba < lba) {
+
+        extsplit(t->right, lba, &t->right, r);
+        *l = t;
+
+    } else {
+
+        extsplit(t->left, lba, l, &t->left);
+        *r = t;
+
+    }
+
+}
+
+/**
+ *
+ * Join extents
+ *
+ * Joins two trees, where every extent of the first is before the second.
+ *
+ * \returns The joined tree.
+ *
+ */
+
+extent *extjoin(
+    /** Tree before */ extent *l,
+    /** Tree after */  extent *r
+)
+
+{
+
+    if (!l) return r;
+    if (!r) return l;
+    if (extpri(l->lba) > extpri(r->lba)) {
+
+        l->right = extjoin(l->right, r);
+
+        return l;
+
+    }
+    r->left = extjoin(l, r->left);
+
+    return r;
+
+}
+
+/**
+ *
+ * Take first extent
+ *
+ * Removes the first extent of a tree, which the caller then owns.
+ *
+ * \returns The tree without it.
+ *
+ */
+
+extent *exttake(
+    /** Tree */ extent *t
+)
+
+{
+
+    if (!t->left) return t->right;
+    t->left = exttake(t->left);
+
+    return t;
+
+}
+
+/**
+ *
+ * Find extent in written map
+ *
+ * Finds the first extent that ends past an LBA, which is the one holding it
+ * if there is one.
+ *
+ * \returns The extent, or NULL if none ends past the LBA.
+ *
+ */
+
+extent *mapfind(
+    /** LBA to find */ long long lba
+)
+
+{
+
+    extent *t, *e;
+
+    e = NULL;
+    t = extroot;
+    while (t) {
+
+        if (t->lba+t->num > lba) { e = t; t = t->left; }
+        else t = t->right;
+
+    }
+
+    return e;
+
+}
+
+/**
+ *
+ * Next extent in written map
+ *
+ * \returns The extent after the given one, or NULL if it is the last.
+ *
+ */
+
+extent *mapnext(
+    /** Extent */ extent *e
+)
+
+{
+
+    return mapfind(e->lba+e->num);
+
+}
+
+/**
+ *
+ * Put extent in written map
+ *
+ * Files a span as written with the given generation, replacing whatever the
+ * map had for it, or with a generation below 0, takes it out of the map. The
+ * extents it overlaps are cut back to what is left of them on either side.
+ * Nothing is filed while the map is off, and if it outgrows MAPMAX extents,
+ * it is cleared and turned off with a warning, since what it holds would no
+ * longer be all that was written.
+ *
+ * \returns Standard discdiag error code.
+ *
+ */
+
+result mapput(
+    /** First LBA */                    long long lba,
+    /** Number of sectors */            long long num,
+    /** Generation, or < 0 to remove */ long long gen
+)
+
+{
+
+    extent nx[2]; // what goes in place of the overlapped extents
+    extent *a, *m, *c, *e, *f;
+    long long end;
+    int nn, k;
+    result r;
+
+    if (num <= 0 || mapoff) return result_ok;
+    end = lba+num;
+    // cut the tree into before the span, in it and after it
+    extsplit(extroot, lba, &a, &m);
+    extsplit(m, end, &m, &c);
+    nn = 0;
+    if (gen >= 0) {
+
+        nx[nn].lba = lba;
+        nx[nn].num = num;
+        nx[nn].gen = gen;
+        nn++;
+
+    }
+    for (e = a; e && e->right; e = e->right); // last before the span
+    if (e && e->lba+e->num > lba) { // overlaps it
+
+        if (e->lba+e->num > end) { // keep the back
+
+            nx[nn].lba = end;
+            nx[nn].num = e->lba+e->num-end;
+            nx[nn].gen = e->gen;
+            nn++;
+
+        }
+        e->num = lba-e->lba; // and the front
+
+    }
+    for (e = m; e && e->right; e = e->right); // last in the span
+    if (e && e->lba+e->num > end) { // keep the back
+
+        nx[nn].lba = end;
+        nx[nn].num = e->lba+e->num-end;
+        nx[nn].gen = e->gen;
+        nn++;
+
+    }
+    extfree(m); // the rest is covered
+    // add the pieces on the end of before, joining those that touch with the
+    // same generation
+    r = result_ok;
+    for (k = 0; k < nn; k++) {
+
+        for (e = a; e && e->right; e = e->right);
+        if (e && e->gen == nx[k].gen && e->lba+e->num == nx[k].lba)
+            e->num += nx[k].num;
+        else if (extcnt >= MAPMAX) r = result_stop; // full
+        else {
+
+            f = (extent *) malloc(sizeof(extent));
+            if (!f) {
+
+                r = result_error;
+                break;
+
+            }
+            *f = nx[k];
+            f->left = f->right = NULL;
+            extcnt++;
+            a = extjoin(a, f);
+
+        }
+
+    }
+    // join the first after, if it now touches
+    for (e = a; e && e->right; e = e->right);
+    for (f = c; f && f->left; f = f->left);
+    if (e && f && e->gen == f->gen && e->lba+e->num == f->lba) {
+
+        e->num += f->num;
+        c = exttake(c);
+        free(f);
+        extcnt--;
+
+    }
+    extroot = extjoin(a, c);
+    if (r == result_error) {
+
+        printf("*** Error: Cannot allocate space for the written map\n");
+
+        return result_error;
+
+    }
+    if (r == result_stop) {
+
+        mapclear();
+        mapoff = 1;
+        printf("*** Warning: Written map is past %d extents, map is off\n", MAPMAX);
+
+    }
+
+    return result_ok;
+
+}
+
+/**
+ *
+ * Find generation written
+ *
+ * Finds the signature generation a write from the write buffer leaves on the
+ * drive. That is the buffer's, if the sectors go to the LBAs they are signed
+ * for, else 0, since they would fail anyway.
+ *
+ */
+
+long long wrgen(
+    /** LBA written to */             long long lba,
+    /** Sector in the write buffer */ long long off
+)
+
+{
+
+    return sigbuf && lba == siglba+off ? sigbuf : 0;
+
+}
+
+/**
+ *
+ * Add to LBA list
+ *
+ * \returns Standard discdiag error code.
+ *
+ */
+
+result lbaadd(
+    /** List */              lbalist *lp,
+    /** LBA */               long long lba,
+    /** Number of sectors */ long long num
+)
+
+{
+
+    lbaent *ne;
+    long long m;
+
+    if (lp->cnt >= lp->max) { // make room
+
+        m = lp->max ? lp->max*2 : LBAINIT;
+        ne = (lbaent *) realloc(lp->ent, (size_t) m*sizeof(lbaent));
+        if (!ne) {
+
+            printf("*** Error: Cannot allocate space\n");
+
+            return result_error;
+
+        }
+        lp->ent = ne;
+        lp->max = m;
+
+    }
+    lp->ent[lp->cnt].lba = lba;
+    lp->ent[lp->cnt].num = num;
+    lp->cnt++;
+
+    return result_ok;
+
+}
+
+/**
+ *
+ * Clear LBA list
+ *
+ */
+
+void lbaclear(
+    /** List */ lbalist *lp
+)
+
+{
+
+    if (lp->ent) free(lp->ent);
+    lp->ent = NULL;
+    lp->cnt = 0;
+    lp->max = 0;
+
+}
+
+/**
+ *
+ * Allocate from arena
+ *
+ * Hands out space from an arena, adding a block if the current one is full.
+ * Space is aligned for any of the interpreter structures.
+ *
+ * \returns The space, or NULL if no more could be had.
+ *
+ */
+void *arenalloc(
+    /** Arena */           arena *a,
+    /** Size of space */   size_t n
+)
+
+{
+
+    arenablk *bp;
+    void *p;
+
+    n = (n+sizeof(long long)-1) & ~(sizeof(long long)-1); // align
+    // go to a kept block with room, if any
+    while (a->cur && a->cur->used+n > a->cur->size && a->cur->next)
+        a->cur = a->cur->next;
+    if (!a->cur || a->cur->used+n > a->cur->size) { // need a new block
+
+        bp = (arenablk *) malloc(sizeof(arenablk)+(n > ARENABLK ? n : ARENABLK));
+        if (!bp) return NULL;
+        bp->size = n > ARENABLK ? n : ARENABLK;
+        bp->used = 0;
+        bp->next = NULL;
+        if (a->cur) a->cur->next = bp; else a->first = bp;
+        a->cur = bp;
+
+    }
+    p = (char *) (a->cur+1)+a->cur->used;
+    a->cur->used += n;
+
+    return p;
+
+}
+
+/**
+ *
+ * Reset arena
+ *
+ * Takes back everything handed out by an arena, keeping its blocks.
+ *
+ */
+void arenarst(
+    /** Arena */ arena *a
+)
+
+{
+
+    arenablk *bp;
+
+    for (bp = a->first; bp; bp = bp->next) bp->used = 0;
+    a->cur = a->first;
+
+}
+
+/**
+ *
+ * Free arena
+ *
+ * Frees all the blocks of an arena.
+ *
+ */
+void arenafree(
+    /** Arena */ arena *a
+)
+
+{
+
+    arenablk *bp;
+
+    while (a->first) {
+
+        bp = a->first;
+        a->first = bp->next;
+        free(bp);
+
+    }
+    a->cur = NULL;
+
+}
+
+/**
+ *
+ * Enter text line
+ *
+ * Enters a line to the edit list. If the line has a number in front, that is
+ * used to sequence the line. The line number will be stripped off and the line
+ * will be placed at that position in the edit buffer. Otherwise, it will be
+ * placed at the end of the edit list. Typically, the user will place the number
+ * there, which both signals the line is to be stored, as well as where. In a
+ * file, the lines are simply dumped into the edit store at the end. If there
+ * are numbers in the loaded file, they will cause the lines to be ordered
+ * according to number, which is unlikely what the user wanted, but is the
+ * correct thing. In any case, a line with a leading number is not a valid
+ * command.
+ *
+ * \returns Standard discdiag error code.
+ * 
+ */
+result enterline(char *line)
+
+{
+
+    long long n;
+    linestr *p, *l, *p2;
+    int s;
+    result r;
+    char *lines;
+    char *label;
+    char cbuf[100];
+    uservar *params, *params2, *params3, *vp;
+    char w[100];
+
+    n = -1; // set impossible line
+    lines = line; // save line position
+    while (*line == ' ') line++; // skip spaces
+    // check leading number exists
+    if (isdigit(*line)) {
+
+        r = getval(&line, &n); // get the number
+        if (r != result_ok) return r; // error
+
+    } else line = lines; // no line number, back up to start
+    // look ahead for label
+    label = NULL; // set no label
+    params = NULL;
+    lines = line; // save line position
+    while (*line == ' ') line++; // skip spaces
+    if (isalpha(*line)) { // if there is an alpha label
+
+        getword(&line, cbuf); // get the label
+        while (*line == ' ') line++; // skip spaces
+        if (*line == ':' || *line == '(') { // its a label
+
+            // if the form is: "label:" at the start of line, its a label. We
+            // strip this off and set it to a special field in the text line
+            // tracking entry.
+            if (*line == '(') { // parameter list
+
+                line++; // skip '('
+                while (*line == ' ') line++; // skip spaces
+                while (*line && *line != ')' && *line != ':') {
+
+                    getword(&line, w); // get a parameter
+                    s = strlen(w); // get length
+                    if (!s) { // flag bad parameter
+
+                        printf("*** Error: Bad parameter specification\n");
+                        return result_error;
+
+                    }
+                    // get a new variable entry
+                    vp = (uservar *) arenalloc(&pgmarena, sizeof(uservar));
+                    if (vp) vp->varstr = (char *) arenalloc(&pgmarena, s+1);
+                    if (!vp || !vp->varstr) {
+
+                        printf("*** Error: Cannot allocate space\n");
+                        return result_error;
+
+                    }
+                    // push to parameters list
+                    vp->next = params;
+                    params = vp;
+                    memcpy(vp->varstr, w, s); // place label
+                    vp->varstr[s] = 0;
+                    vp->val = 0; // set initializer value
+
+                }
+                // reverse the parameter list into order
+                params2 = NULL;
+                while (params != NULL) { // drain the list
+
+                    params3 = params; // remove from source list
+                    params = params->next;
+                    params3->next = params2; // push to destination
+                    params2 = params3;
+                   
+                }
+                params = params2; // place final list
+                if (*line != ')') { // bad ending
+
+                    printf("*** Error: ')' expected\n");
+                    return result_error;
+
+                } else line++; // skip ')'
+                while (*line == ' ') line++; // skip spaces
+                if (*line != ':') { // no ':'
+
+                    printf("*** Error: ':' expected\n");
+                    return result_error;
+
+                }
+                
+            }
+            line++; // skip ':'
+            s = strlen(cbuf); // find length of label
+            label = (char *) arenalloc(&pgmarena, s+1); // allocate plus zero
+            if (!label) {
+
+                printf("*** Error: Cannot allocate space\n");
+                return result_error;
+
+            }
+            memcpy(label, cbuf, s); // place in label
+            label[s] = 0;
+
+        } else {
+
+            // we failed to find a label, back out of the deal
+            line = lines;
+
+        }
+
+    } else {
+
+        // we failed to find a label, back out of the deal
+        line = lines;
+
+    }
+
+    // get new entry, with trailing zero on the line
+    s = strlen(line); // find remaining length of line
+    p2 = (linestr *) arenalloc(&pgmarena, sizeof(linestr));
+    if (p2) p2->line = (char *) arenalloc(&pgmarena, s+1);
+    if (!p2 || !p2->line) {
+
+        printf("*** Error: Cannot allocate space\n");
+        return result_error;
+
+    }
+    p = editroot;
+    l = NULL;
+    while (--n && p) { l = p; p = p-> next; } // find line by numeric sequence 
+    // insert line to present position
+    if (!l) { p2->next = editroot; editroot = p2; } // list was empty or first
+    else { p2->next = l->next; l->next = p2; } // append/insert here
+    // Now fill in the entry
+    p2->label = label; // set label
+    p2->params = params; // set parameters
+    strncpy(p2->line, line, s+1); // place text line
+    flushcache(); // program changed
+    pgmdirty = 1; // and its labels
+
+    return result_ok; 
+
+}
+
+void clrcnt(void);
+
+/**
+ *
+ * Clear program
+ *
+ * Clear current program base and recycle all entries. The lines all come from
+ * the program arena, so that is just reset. Loop counters are filed by their
+ * place in the text, so they go too.
+ *
+ */
+
+void clrpgm(void)
+
+{
+
+    editroot = NULL; // empty list
+    arenarst(&pgmarena); // recycle all entries
+    clrcnt(); // drop loop counters
+    flushcache(); // program changed
+    pgmdirty = 1; // and its labels
+
+}
+
+/**
+ *
+ * Load program from file
+ *
+ * Loads a program from a given file. Returns 0 for success.
+ *
+ * \returns 0 if the file loaded, otherwise 1.
+ *
+ */
+
+int loadfile(
+    /** Filename to load */ char *fname
+)
+
+{
+
+    FILE *fp;
+    char buffer[250];
+    int r;
+
+    // start by clearing out and recycling the old progam
+    fp = fopen(fname, "r");
+    if (!fp) return 1; // couldn't open file    
+    clrpgm(); // clear existing program out
+    do { // read lines
+
+       r = readline(fp, buffer, sizeof(buffer)); // read a line 
+       // if not eof, enter the line
+       if (!r) enterline(buffer);
+
+    } while (!r); // until eof
+    fclose(fp);
+
+    return 0; // return result ok
+
+}
+
+/**
+ *
+ * Push new interpreter level
+ *
+ * Adds a new level to the interpreter stack using the line buffer and character
+ * position given.
+ *
+ */
+void pushlvl(
+    /** Current line buffer */ linestr *line,
+    /** Current character position within buffer */ char *cpos
+)
+
+{
+
+    intstk *p;
+
+    // get a new stack entry, reusing a free one if we can
+    if (intfree) { p = intfree; intfree = p->next; }
+    else p = (intstk *) malloc(sizeof(intstk));
+    if (!p) {
+
+        printf("*** Error: System fault: Cannot allocate interpreter stack\n");
+        printf("***        Halting program\n");
+
+        exit(1);
+
+    }
+    p->next = introot; // push onto stack
+    introot = p;
+    p->curlin = line; // set buffer
+    p->curchr = cpos; // set character position
+    p->mark = vardepth; // mark locals
+    p->snap = line->label ? rptnew() : NULL; // procedures get a record
+    if (p->snap) { // keep the name, the program could change under it
+
+        strncpy(p->snap->name, line->label, sizeof(p->snap->name)-1);
+        p->snap->name[sizeof(p->snap->name)-1] = 0;
+
+    }
+   
+}
+
+/**
+ *
+ * Pop old interpreter level
+ *
+ * Removes an interpreter level. Note that the interpreter stack should never
+ * go dry.
+ *
+ */
+void poplvl(void)
+
+{
+
+    intstk *p;
+
+    if (!introot) {
+
+        printf("*** Error: System fault: Interpreter stack runs dry\n");
+        printf("***        Halting program\n");
+
+        exit(1);
+
+    }
+    // remove locals if present, and we are not in immediate mode
+    if (introot->next) relvar(introot->mark);
+    // file the record of a procedure
+    if (introot->snap) rptproc(introot->snap, rptres);
+    // remove stack entry
+    p = introot; // index top entry
+    introot = p->next; // gap out
+    p->next = intfree; // recycle entry
+    intfree = p;
+
+}
+
+/**
+ *
+ * Find program label
+ *
+ * Searches for a label in the program store using the given name, and returns
+ * that if found, otherwise NULL.
+ *
+ * \returns The label string.
+ *
+ */
+linestr *fndpgm(
+    /** Name of user variable */ char *name
+)
+
+{
+
+    linestr *p, *pf;
+    int i;
+
+    if (pgmdirty) { // index the labels again
+
+        for (i = 0; i < PGMHASH; i++) pgmhash[i] = NULL;
+        for (p = editroot; p; p = p->next) if (p->label) {
+
+            i = (int) (hashstr(p->label) & (PGMHASH-1));
+            pf = pgmhash[i]; // search for the same label
+            while (pf && strcmp(p->label, pf->label)) pf = pf->hash;
+            if (!pf) { // only the first of a label counts
+
+                p->hash = pgmhash[i];
+                pgmhash[i] = p;
+
+            }
+
+        }
+        pgmdirty = 0;
+
+    }
+    // search its chain
+    pf = pgmhash[hashstr(name) & (PGMHASH-1)];
+    while (pf && strcmp(name, pf->label)) pf = pf->hash;
+
+    return pf; // return entry or NULL
+
+}
+
+/**
+ *
+ * Find line counter
+ *
+ * Either finds an existing line counter, or adds a new one. The line count entry
+ * is identified by the line character position, which is passed. That is, each
+ * loop command will have a unique place on the command line, and the counter
+ * for it is filed using that position.
+ *
+ * \returns The loopcounter entry.
+ *
+ */
+loopcounter* fndcnt(
+    /** Character position of loop */ char* pos)
+
+{
+
+    /* loopcounter index root */    loopcounter **root;
+    /* loopcounter found pointer */ loopcounter *f; 
+
+    root = &cnthash[cacheslot(pos) & (CNTHASH-1)];
+    f = *root; // search its chain
+    while (f && f->pos != pos) f = f->hash;
+    if (f == NULL) { // no entry found
+
+        // create new line counter entry
+        if (cntfree) { f = cntfree; cntfree = f->next; }
+        else f = (loopcounter*) malloc(sizeof(loopcounter));
+        if (!f) {
+
+            printf("*** Error: System fault: Cannot allocate loop counter\n");
+            printf("***        Halting program\n");
+
+            exit(1);
+
+        }
+        f->next = cntroot; // push to top of counter list
+        cntroot = f;
+        f->hash = *root; // and its index chain
+        *root = f;
+        f->pos = pos; // set character position to match
+        f->loopcount = 0; // clear counter
+
+    }
+
+    return f; // return found/made entry
+
+}
+
+/**
+ *
+ * Clear line counters
+ *
+ * Releases all of this thread's loop counters, keeping them for reuse.
+ *
+ */
+
+void clrcnt(void)
+
+{
+
+    loopcounter *cp;
+    int i;
+
+    while (cntroot) {
+
+        cp = cntroot;
+        cntroot = cp->next;
+        cp->next = cntfree;
+        cntfree = cp;
+
+    }
+    for (i = 0; i < CNTHASH; i++) cnthash[i] = NULL;
+
+}
+
+/**
+ *
+ * Reset line counters
+ *
+ * Resets all of this thread's loop counters to zero
+ *
+ */
+
+void rstlin(void)
+
+{
+
+    loopcounter* cp;
+
+    cp = cntroot; // index top of loopcounter list
+    while (cp != NULL) { // cross the list 
+
+        cp->loopcount = 0; // reset counter
+        cp = cp->next; // next entry
+
+    }
+
+}
+
+/**
+ *
+ * Push control level
+ *
+ * Adds a new control level, reusing one freed before if there is one.
+ *
+ * \returns The new level, or NULL if there is no space.
+ *
+ */
+ctlstk *pushctl(void)
+
+{
+
+    ctlstk *cp;
+
+    if (ctlfree) { cp = ctlfree; ctlfree = cp->next; }
+    else cp = (ctlstk *) malloc(sizeof(ctlstk));
+    if (!cp) {
+
+        printf("*** Error: Cannot allocate space\n");
+
+        return NULL;
+
+    }
+    cp->next = ctlroot; // push onto controls stack
+    ctlroot = cp;
+
+    return cp;
+
+}
+
+/**
+ *
+ * Pop control level
+ *
+ * Removes one control level, and keeps it for reuse
+ *
+ */
+void popctl(void)
+
+{
+
+    ctlstk *cp;
+
+    if (ctlroot) { // there is a level
+
+        cp = ctlroot; // index top entry 
+        ctlroot = cp->next; // gap out
+        cp->next = ctlfree; // keep for reuse
+        ctlfree = cp;
+
+    }
+
+}
+
+/**
+ *
+ * Free stack entries
+ *
+ * Frees the interpreter stack, control stack and loop counter entries kept for
+ * reuse. They must all have been released first.
+ *
+ */
+void freeframes(void)
+
+{
+
+    intstk *ip;
+    ctlstk *cp;
+    loopcounter *lp;
+
+    while (intfree) { ip = intfree; intfree = ip->next; free(ip); }
+    while (ctlfree) { cp = ctlfree; ctlfree = cp->next; free(cp); }
+    while (cntfree) { lp = cntfree; cntfree = lp->next; free(lp); }
+
+}
+
+/**
+ *
+ * Skip commands
+ *
+ * Skip commands until the recognized one is found. Takes a command verb,
+ * and skips forward until that command verb is found. Expects to be at the
+ * end of a command, which means that the next ';' command separator or end
+ * of line is to be found, then the commands after that examined.
+ *
+ * \returns Standard discdiag error code.
+ * 
+ */
+result skipcmd(
+    /** Remaining command line */ char **line,
+    /** Command to skip */        char *cmd,
+    /** Command to skip 2 */      char *cmd2,
+    /** Command to skip 3 */      char *cmd3,
+    /** What label was found */   int  *fnd
+)
+
+{
+
+    char w[100]; // word buffer
+    int whlcnt; // nested while counter
+    int repcnt; // nested repeat counter
+    int forcnt; // nested for counter
+    int selcnt; // nested select counter
+
+    whlcnt = 0; // clear nesting counts
+    repcnt = 0;
+    forcnt = 0;
+    selcnt = 0;
+    // skip the rest of the command/parameters
+    while (**line && **line != ';') (*line)++; // skip until ';' or end
+    if (**line == ';') (*line)++; // skip ';'
+    do { // skip lines in program
+
+        // skip commands on line
+        do {
+
+            while (**line && **line == ' ') (*line)++; // skip spaces
+            if (**line) { // line is not empty
+
+                getword(line, w); // find command verb
+                // update nesting counts
+                if (!strcmp(w, "while"))  whlcnt++;
+                if (!strcmp(w, "wend"))   { whlcnt--; if (whlcnt < 0) whlcnt = 0; }
+                if (!strcmp(w, "repeat")) repcnt++;
+                if (!strcmp(w, "until"))  { repcnt--; if (repcnt < 0) repcnt = 0; }
+                if (!strcmp(w, "for"))    forcnt++;
+                if (!strcmp(w, "fend"))   { forcnt--; if (forcnt < 0) forcnt = 0; }
+                if (!strcmp(w, "select")) selcnt++;
+                if (!strcmp(w, "send"))   { selcnt--; if (selcnt < 0) selcnt = 0; }
+                // lock out nested sections. We treat excesss ends as no-ops,
+                // but at that point the algorithim is suspect in any case.
+                // It means the source is playing games with the nesting.
+                if (!(whlcnt || repcnt || forcnt || selcnt)) {
+
+                    // search for provided words
+                    *fnd = 1; // set find 1
+                    if (!strcmp(w, cmd)) return result_ok; // found
+                    *fnd = 2; // set find 2
+                    if (!strcmp(w, cmd2)) return result_ok; // found
+                    *fnd = 3; // set find 3
+                    if (!strcmp(w, cmd3)) return result_ok; // found
+
+                }
+                while (**line && **line != ';') (*line)++; // skip until ';' or end
+                if (**line == ';') (*line)++; // skip ';'
+
+            }
+
+        } while (**line); // not end of line
+        if (introot && introot->next) {
+
+            // not in immediate mode, advance to next line in program
+            introot->curlin = introot->curlin->next;
+            // if not end of program, set start of new line
+            if (introot->curlin) *line = introot->curlin->line;
+            else {
+
+                // end of program, flush stack and bail
+                rptres = result_error;
+                while (introot) poplvl();
+                return result_error;
+
+            }
+
+        }
+
+    } while (introot);
+
+    return result_error;
+
+}
+
+/**
+ *
+ * Get transfer parameters
+ *
+ * Parses the optional lba and sector count taken by the read and write
+ * commands, then checks them against the current drive and the buffer size.
+ * The defaults are lba 0 and 1 sector.
+ *
+ * \returns Standard discdiag error code.
+ *
+ */
+result getxfer(
+    /** Remaining command line */ char **line,
+    /** Returns lba */            long long *lba,
+    /** Returns sector count */   long long *numsecs
+)
+
+{
+
+    long long v;
+    result r;
+
+    *lba = 0; // set default lba
+    *numsecs = 1; // set default number of sectors
+    while (**line == ' ') (*line)++; // skip any leading spaces
+    if (**line && **line != ';') { // get lba number
+
+        r = getparam(line, &v);
+        *lba = v;
+        if (r != result_ok) return r;
+        if (**line && **line != ';') { // get number of sectors
+
+            r = getparam(line, &v);
+            *numsecs = v;
+            if (r != result_ok) return r;
+
+        } 
+        
+    }
+    // validate drive is active
+    if (currentdrive < 0) {
+
+        printf("*** Error: No current drive is set\n");
+
+        return result_error;
+
+    }
+    // validate sector count is within buffer
+    if (*numsecs < 1 || *numsecs > bufsecs) {
+
+        printf("*** Error: Invalid sector count, must be 1 to %lld\n", bufsecs);
+
+        return result_error;
+
+    }
+    // validate lba is 0 to drive size
+    if (*lba < 0 || *lba >= drivesize) {
+
+        printf("*** Error: Invalid lba number, must be <= %lld\n", drivesize);
+
+        return result_error;
+
+    }
+    // validate lba+sectors are within drive
+    if (*lba+*numsecs-1 >= drivesize) {
+
+        printf("*** Error: Operation will exceed drive size\n");
+
+        return result_error;
+
+    }
+
+    return result_ok;
+
+}
+
+/**
+ *
+ * Tally completed request
+ *
+ * Adds a queued request that finished good to the statistics.
+ *
+ */
+
+void tallycmp(
+    /** Completion */ iocmp *cp
+)
+
+{
+
+    if (cp->write) {
+
+        iopwrite += 1.0; // write IOPs
+        bcwrite += cp->numsec*secsize; // write bytes
+        addlat(&latwrite, cp->lat);
+
+    } else {
+
+        iopread += 1.0; // read IOPs
+        bcread += cp->numsec*secsize; // read bytes
+        addlat(&latread, cp->lat);
+
+    }
+
+}
+
+/**
+ *
+ * Submit timed
+ *
+ * Queues a read or a write, counting the time as device time, since the
+ * system may do the transfer itself before it returns.
+ *
+ * Returns 1 on error, 0 on success.
+ *
+ */
+int devsubmit(
+    /** Is a write */         int write,
+    /** Buffer */             unsigned char *buffer,
+    /** LBA */                long long lba,
+    /** Number of sectors */  long long numsec,
+    /** Tag */                int tag
+)
+
+{
+
+    long long t;
+    int e;
+
+    t = gettim();
+    if (write) e = submitwrite(buffer, lba, numsec, tag);
+    else e = submitread(buffer, lba, numsec, tag);
+    devns += gettim()-t;
+
+    return e;
+
+}
+
+/**
+ *
+ * Reap timed
+ *
+ * Collects finished queued requests as reap does, counting the time waited
+ * as device time.
+ *
+ * Returns the number collected, or -1 on error.
+ *
+ */
+int devreap(
+    /** Completions */        iocmp *cmp,
+    /** Minimum to wait for */ int min,
+    /** Most to collect */    int max
+)
+
+{
+
+    long long t;
+    int n;
+
+    t = gettim();
+    n = reap(cmp, min, max);
+    devns += gettim()-t;
+
+    return n;
+
+}
+
+/**
+ *
+ * Queued write generations
+ *
+ * wq tags each write with WQTAG and a slot here, holding the signature
+ * generation the write leaves, found when it was sent. The write buffer can
+ * be patterned again before the write is reaped, so it can't be found then.
+ * Nothing is in flight when the queue is empty, so the slots are all freed
+ * then, which also frees any whose transfers were cancelled.
+ *
+ */
+#define WQTAG 0x40000000
+/** Generation each slot's write leaves */ THREAD long long wqgen[QDMAX];
+/** Slot is in flight */                   THREAD unsigned char wquse[QDMAX];
+
+/**
+ *
+ * Tally queued requests
+ *
+ * Adds reaped requests to the statistics, and files where writes went.
+ *
+ * \returns Standard discdiag error code.
+ *
+ */
+result tallyq(
+    /** Completions */     iocmp *cmp,
+    /** Number of them */ int n
+)
+
+{
+
+    long long g;
+    int i, k;
+    result r;
+
+    r = result_ok; // set result ok
+    for (i = 0; i < n; i++) {
+
+        k = cmp[i].tag-WQTAG; // wq slot, if it is one
+        g = 0;
+        if (cmp[i].write && k >= 0 && k < QDMAX) {
+
+            g = wqgen[k];
+            wquse[k] = 0;
+
+        } else if (cmp[i].write) g = wrgen(cmp[i].lba, 0);
+        if (cmp[i].error) { // only count good transfers
+
+            rptbad(cmp[i].write ? bad_write : bad_read, cmp[i].lba);
+            r = result_error;
+
+        } else {
+
+            tallycmp(&cmp[i]);
+            if (cmp[i].write && mapput(cmp[i].lba, cmp[i].numsec, g) != result_ok)
+                r = result_error;
+
+        }
+
+    }
+    if (r != result_ok) printf("*** Error: Queued transfer error\n");
+
+    return r;
+
+}
+
+/**
+ *
+ * Reap queued requests
+ *
+ * Waits for at least the given number of queued requests to finish, and adds
+ * those that finished to the statistics.
+ *
+ * \returns Standard discdiag error code.
+ *
+ */
+result reapq(
+    /** Minimum number to wait for */ int min
+)
+
+{
+
+    iocmp cmp[QDMAX];
+    int n;
+
+    n = devreap(cmp, min, QDMAX);
+    if (n < 0) return result_error;
+
+    return tallyq(cmp, n);
+
+}
+
+/**
+ *
+ * Wait for queue to empty
+ *
+ * Reaps queued requests until none are in flight.
+ *
+ * \returns Standard discdiag error code.
+ *
+ */
+result waitq(void)
+
+{
+
+    result r, r2;
+    int n;
+
+    r = result_ok; // set result ok
+    while ((n = inflight()) > 0) {
+
+        r2 = reapq(n);
+        if (r2 != result_ok) r = r2; // keep the error, but finish draining
+        if (inflight() == n) break; // reap itself failed, don't spin
+
+    }
+
+    return r;
+
+}
+
+/**
+ *
+ * Find when paced transfer is due
+ *
+ * Returns the time the next transfer is due at the rate set, starting the
+ * pacing now if it hasn't started, or 0 if no rate is set.
+ *
+ */
+long long ratedue(void)
+
+{
+
+    if (!rateiops && !ratebps) return 0; // not paced
+    if (!ratenext) ratenext = gettim(); // first one goes now
+
+    return ratenext;
+
+}
+
+/**
+ *
+ * Take paced transfer
+ *
+ * Moves the time the next transfer is due on past one of the given size.
+ *
+ */
+void ratetake(
+    /** Bytes in transfer */ long long bytes
+)
+
+{
+
+    if (rateiops) ratenext += 1000000000LL/rateiops;
+    else if (ratebps) ratenext += (long long) (bytes*1e9/ratebps);
+
+}
+
+/**
+ *
+ * Reap while paced
+ *
+ * Waits for a queued request to finish, or until the given time, but no longer
+ * than PACEPOLL, counting the wait as pacing time.
+ *
+ * Returns the number collected, or -1 on error.
+ *
+ */
+int pacereap(
+    /** Completions */        iocmp *cmp,
+    /** Time to wait until */ long long t
+)
+
+{
+
+    long long now;
+    int n;
+
+    now = gettim();
+    if (t > now+PACEPOLL) t = now+PACEPOLL;
+    n = reapby(cmp, QDMAX, t);
+    idlens += gettim()-now;
+
+    return n;
+
+}
+
+/**
+ *
+ * Pace transfer
+ *
+ * Waits until the next transfer is due at the rate set, and takes it. Queued
+ * requests that finish while waiting are reaped as they finish, so their
+ * latency isn't counted as long as the wait. Returns the time the transfer was
+ * due, or 0 if no rate is set, in due.
+ *
+ * \returns Standard discdiag error code.
+ *
+ */
+result pace(
+    /** Bytes in transfer */ long long bytes,
+    /** Returns time due */  long long *due
+)
+
+{
+
+    iocmp cmp[QDMAX];
+    int n;
+    result r;
+
+    *due = ratedue();
+    if (!*due) return result_ok; // not paced
+    ratetake(bytes);
+    while (gettim() < *due) {
+
+        if (chkbrk()) {
+
+            if (exiterror) return result_exit; // exit diagnostic
+            return result_stop; // check break
+
+        }
+        n = pacereap(cmp, *due);
+        if (n < 0) return result_error;
+        r = tallyq(cmp, n);
+        if (r != result_ok) return r;
+
+    }
+
+    return result_ok;
+
+}
+
+/**
+ *
+ * Set buffers
+ *
+ * Reallocates every buffer in the pool to the given number of sectors of the
+ * given size. As much of the old contents as fits is kept. Queued transfers
+ * must be finished first.
+ *
+ * \returns Standard discdiag error code.
+ * 
+ */
+
+result setbufs(
+    /** Number of sectors */   long long v,
+    /** Size of sectors */     int ssize
+)
+
+{
+
+    long long n;
+    unsigned char *nb[BUFSLOTS];
+    int i;
+
+    for (i = 0; i < BUFSLOTS; i++) {
+
+        nb[i] = NULL;
+        if (bufpool[i]) {
+
+            nb[i] = allocbuf(v*ssize);
+            if (!nb[i]) {
+
+                while (i--) if (nb[i]) freebuf(nb[i], v*ssize);
+                printf("*** Error: Cannot allocate space\n");
+
+                return result_error;
+
+            }
+
+        }
+
+    }
+    // carry over what fits of the old contents
+    n = v*ssize < bufsecs*secsize ? v*ssize : bufsecs*secsize;
+    for (i = 0; i < BUFSLOTS; i++) if (bufpool[i]) {
+
+        memcpy(nb[i], bufpool[i], (size_t) n);
+        freebuf(bufpool[i], bufsecs*secsize);
+        bufpool[i] = nb[i];
+
+    }
+    writebuffer = bufpool[wrslot];
+    readbuffer = bufpool[rdslot];
+    bufsecs = v;
+    secsize = ssize;
+
+    return result_ok;
+
+}
+
+/**
+ *
+ * Start buffer pool
+ *
+ * Puts the write buffer in slot 0 and the read buffer in slot 1, with nothing
+ * else in the pool.
+ *
+ */
+
+void initpool(void)
+
+{
+
+    int i;
+
+    for (i = 0; i < BUFSLOTS; i++) {
+
+        bufpool[i] = NULL;
+        slotsig[i] = 0;
+        slotsiglba[i] = 0;
+
+    }
+    bufpool[0] = writebuffer;
+    bufpool[1] = readbuffer;
+    wrslot = 0;
+    rdslot = 1;
+
+}
+
+/**
+ *
+ * Free buffer pool
+ *
+ * Frees every buffer in the pool, including the read and write buffers.
+ *
+ */
+
+void freepool(void)
+
+{
+
+    int i;
+
+    for (i = 0; i < BUFSLOTS; i++) if (bufpool[i]) {
+
+        freebuf(bufpool[i], secsize*bufsecs);
+        bufpool[i] = NULL;
+
+    }
+    writebuffer = readbuffer = NULL;
+
+}
+
+/**
+ *
+ * Select buffers
+ *
+ * Points the write and read roles at the given slots, which must be in the
+ * pool and different. The write buffer's signature goes back to its slot and
+ * the new one's is taken up. Reads land in the read slot, so what it held is
+ * no longer known.
+ *
+ */
+
+void selbufs(
+    /** Write slot */ int w,
+    /** Read slot */  int r
+)
+
+{
+
+    slotsig[wrslot] = sigbuf;
+    slotsiglba[wrslot] = siglba;
+    slotsig[r] = 0;
+    wrslot = w;
+    rdslot = r;
+    sigbuf = slotsig[w];
+    siglba = slotsiglba[w];
+    writebuffer = bufpool[w];
+    readbuffer = bufpool[r];
+
+}
+
+/**
+ *
+ * Place thread
+ *
+ * Pins this thread to its CPU or NUMA node and sets its memory to come from
+ * the node. With the node set to auto, that is the node the current drive is
+ * on, if it is known. The buffers can be made again, by this thread, so that
+ * their pages come from where it now runs.
+ *
+ * \returns Standard discdiag error code.
+ *
+ */
+result placethread(
+    /** Make buffers again */ int rebuf
+)
+
+{
+
+    int node;
+    result r;
+
+    node = numaset;
+    if (node == NUMAAUTO) node = currentdrive >= 0 ? drivenode(currentdrive) : -1;
+    if (pinthread(cpupin, node)) return result_error;
+    curnode = node;
+    if (rebuf) {
+
+        r = waitq(); // queued transfers may still be using the buffers
+        if (r != result_ok) return r;
+        r = setbufs(bufsecs, secsize);
+        if (r != result_ok) return r;
+
+    }
+
+    return result_ok;
+
+}
+
+/**
+ *
+ * Select drive
+ *
+ * Sets the given drive active for this thread, loads its size and clears the
+ * statistics. The write protect goes back on for the new drive. If its sectors
+ * are a different size, the buffers are made again to hold the same number of
+ * them.
+ *
+ * \returns Standard discdiag error code.
+ *
+ */
+result selectdrive(
+    /** Drive number */ int drive
+)
+
+{
+
+    int ri, ls, ps;
+    long long t, v;
+    result r;
+
+    writeprot = 1; // set the write protect on the new drive by default
+    if (!drive) printf("*** Warning: You have selected the system drive\n");
+    ri = setdrive(drive); // set physical drive active
+    if (ri) return result_error; // error
+    currentdrive = drive; // set that active
+    // get and store current drive size
+    ri = physize(&t);
+    if (ri != 0) return result_error;
+    ri = sectorsize(&ls, &ps);
+    if (ri != 0) return result_error;
+    if (ls != secsize) { // buffers hold whole sectors of the new size
+
+        // setdrive finished anything queued on the old drive
+        v = bufsecs;
+        if (v > (long long) MAXSECS*SECSIZE/ls) {
+
+            v = (long long) MAXSECS*SECSIZE/ls;
+            printf("*** Warning: Buffer size cut to %lld sectors\n", v);
+
+        }
+        r = setbufs(v, ls);
+        if (r != result_ok) return r;
+
+    }
+    physecsize = ps;
+    if (ps > ls)
+        printf("**** Info: Drive has %d byte sectors, written %d at a time\n",
+               ls, ps/ls);
+    drivesize = t / secsize; // find net size in sectors
+    if (t % secsize) {
+
+        printf("*** Warning: Drive total size is not an even number of sectors\n");
+
+    }
+    // clear the statistics on this drive
+    carryops();
+    carrylat();
+    iopwrite = 0.0;
+    iopread = 0.0;
+    bcwrite = 0.0;
+    bcread = 0.0;
+    ioptrim = iopzero = bctrim = bczero = 0.0;
+    clrlat(&latread);
+    clrlat(&latwrite);
+    mapclear(); // nothing written here yet
+    if (numaset == NUMAAUTO && drivenode(drive) != curnode) {
+
+        r = placethread(1); // follow the drive to its node
+        if (r != result_ok) return r;
+
+    }
+
+    return result_ok;
+
+}
+
+/**
+ *
+ * Check program can be changed
+ *
+ * All workers run from the one program store, so it can't be changed while any
+ * are running, and never from a worker.
+ *
+ * \returns Standard discdiag error code.
+ *
+ */
+result chkedit(void)
+
+{
+
+    if (workerno) {
+
+        printf("*** Error: Program cannot be changed from a worker\n");
+        return result_error;
+
+    }
+    if (nworkers) {
+
+        printf("*** Error: Workers are running, join them first\n");
+        return result_error;
+
+    }
+
+    return result_ok;
+
+}
+
+result exec(char **line);
+
+/**
+ *
+ * Run program
+ *
+ * Executes commands from the given line position, following the interpreter
+ * stack across program lines until it gets back to the bottom (immediate)
+ * level.
+ *
+ * \returns result_ok when the run finishes, result_exit for exit, or
+ * result_error on an error. A user break gives result_break, and anything else
+ * that stops the run gives result_stop.
+ *
+ */
+result runpgm(
+    /** Position to start at */ char *linep
+)
+
+{
+
+    result r;
+
+    do { // execute across program lines
+
+        // if comment, go next line
+        while (*linep == ' ') linep++; // skip spaces
+        if (*linep == '!') goto nxtpgm;
+        if (*linep) { // ignore blank lines
+
+            while (*linep) { // execute commands on line
+
+                // execute single command
+                r = exec(&linep);
+                // dispatch special codes
+                if (r == result_exit || r == result_stop || r == result_error)
+                    return r;
+                chkint(); // sample statistics if the interval is up
+                if (chkbrk()) return result_break; // check break
+                while (*linep == ' ') linep++; // skip spaces
+                // if comment, go next line
+                if (*linep == '!') goto nxtpgm;
+                if (r != result_restart) { // check for command ending
+
+                    if (*linep && *linep != ';') {
+
+                        printf("*** Error: Invalid command termination\n");
+                        return result_stop;
+
+                    }
+                    if (*linep == ';') linep++; // skip ';'
+                    while (*linep == ' ') linep++; // skip spaces
+
+                }
+
+            }
+
+        }
+        nxtpgm: // execute next program line
+        if (introot && introot->next) {
+
+            // not in immediate mode, advance to next line in program
+            introot->curlin = introot->curlin->next;
+            // if not end of program, set start of new line
+            if (introot->curlin) linep = introot->curlin->line;
+            else {
+
+                // end of program, flush stack and bail
+                rptres = result_ok;
+                while (introot) poplvl();
+
+            }
+
+        }
+
+    } while (introot && introot->next); // while not immediate mode
+
+    return result_ok;
+
+}
+
+/**
+ *
+ * Run worker
+ *
+ * This is the body of a worker thread. It sets up this thread's copy of the
+ * interpreter and drive state from the worker entry, runs the procedure until
+ * it ends, then files the statistics back in the entry and frees everything
+ * the thread had.
+ *
+ * Each worker starts its random numbers with its worker number as the seed, so
+ * that workers on the same drive don't follow each other.
+ *
+ */
+void runworker(
+    /** Worker entry */ void *arg
+)
+
+{
+
+    worker *wp;
+    linestr workline; // bottom level the procedure returns to
+    uservar *pp;
+    long mark;
+    int i;
+    result r;
+
+    wp = (worker *) arg;
+    workerno = (int) (wp-workers)+1;
+    initthread(); // get our own drive and queue
+    // set up the interpreter state
+    writebuffer = wp->wbuf;
+    readbuffer = wp->rbuf;
+    initpool(); // the copies are all of the pool it gets
+    bufsecs = wp->bufsecs;
+    sigbuf = wp->sigbuf;
+    siglba = wp->siglba;
+    secsize = wp->secsize; // selectdrive remakes the buffers if it changes
+    alignlba = wp->alignlba;
+    curdist = wp->dist;
+    curmode = wp->mode;
+    cpupin = wp->cpupin;
+    numaset = wp->numaset;
+    rateiops = wp->rateiops;
+    ratebps = wp->ratebps;
+    deadline = wp->deadline;
+    curnode = -1;
+    currentdrive = -1;
+    vartop = NULL;
+    varfill = 0;
+    vardepth = 0;
+    introot = NULL;
+    ctlroot = NULL;
+    cntroot = NULL;
+    seed = workerno;
+    lbaseed(workerno);
+    marktime = gettim();
+    r = result_ok;
+    if (setdirect(wp->direct)) r = result_error;
+    // the buffers were made by the main thread, so make them again here
+    if (r == result_ok && (cpupin >= 0 || numaset >= 0)) r = placethread(1);
+    if (r == result_ok) r = selectdrive(wp->drive); // places numa auto
+    if (r == result_ok) {
+
+        workline.next = NULL; // no next
+        workline.label = NULL; // no label
+        workline.params = NULL; // no parameters
+        workline.line = ""; // nothing to run
+        pushlvl(&workline, workline.line);
+        // load the parameters and enter the procedure, as exec does
+        mark = vardepth;
+        pp = wp->proc->params;
+        i = 0;
+        while (pp) {
+
+            pushvar(pp->varstr, wp->params[i++]);
+            pp = pp->next;
+
+        }
+        pushlvl(wp->proc, wp->proc->line);
+        introot->mark = mark; // parameters belong to the procedure
+        r = runpgm(wp->proc->line);
+        if (waitq() != result_ok && r != result_error) r = result_error;
+        rptres = r;
+        while (introot) poplvl(); // drain the interpreter stack
+
+    }
+    // file the results
+    wp->r = r;
+    wp->time = elapsed(marktime);
+    wp->iopwrite = iopwrite;
+    wp->iopread = iopread;
+    wp->bcwrite = bcwrite;
+    wp->bcread = bcread;
+    wp->ioptrim = ioptrim;
+    wp->iopzero = iopzero;
+    wp->bctrim = bctrim;
+    wp->bczero = bczero;
+    wp->devtime = devns;
+    wp->pattime = patns;
+    wp->comptime = compns;
+    wp->idletime = idlens;
+    wp->latread = latread;
+    wp->latwrite = latwrite;
+    wp->drvsize = drivesize;
+    wp->secsize = secsize;
+    memcpy(wp->nbad, rptnbad, sizeof(rptnbad));
+    rptflush(); // write out this worker's records
+    // free everything this thread had
+    rptclear();
+    deinitthread();
+    freecache();
+    freesym();
+    mapclear();
+    lbaclear(&lbalst);
+    while (ctlroot) popctl();
+    clrcnt();
+    freeframes();
+    freepool();
+    free(wp->params);
+
+}
+
+/**
+ *
+ * Wait for workers
+ *
+ * Waits for all spawned workers to finish. Their results stay in the worker
+ * table until the next spawn after this.
+ *
+ */
+
+void waitworkers(void)
+
+{
+
+    int i;
+
+    for (i = 0; i < nworkers; i++) waitthread(i);
+    FLAGSET(workbreak, 0); // break has been seen by all
+
+}
+
+/*******************************************************************************
+
+Variable handlers
+
+*******************************************************************************/
+
+/**
+ *
+ * Drive size
+ *
+ * Return current size of drive
+ *
+ * \returns Standard discdiag error code.
+ * 
+ */
+
+result variable_drvsiz(
+    /** Remaining command line */ char **line,
+    /** Returned value */         long long *ll
+)
+
+{
+
+    long long t;
+    int r;
+
+    *ll = drivesize; // return drive size
+
+    return result_ok; // return no fault
+
+}
+
+/**
+ *
+ * Random number
+ *
+ * Returns a random number.
+ *
+ * Note that this is currently a 32 bit implementation, we need to extend
+ * to 64 bits. This is required to handle larger drives.
+ *
+ * \returns Standard discdiag error code.
+ * 
+ */
+
+result variable_rand(
+    /** Remaining command line */ char **line,
+    /** Returned value */         long long *ll
+)
+
+{
+
+    *ll = rand64();
+
+    return result_ok; // return no fault
+
+}
+
+/**
+ *
+ * Zipf sums
+ *
+ * The zipf pick needs the sum of i^-theta for i = 1 to the span, which is too
+ * long to add up for a whole drive. It is kept for the last span and theta
+ * used.
+ *
+ */
+/** Span the sum is for */     THREAD long long zipfn;
+/** Theta the sum is for */    THREAD double zipftheta;
+/** Sum to span */             THREAD double zipfzeta;
+/** Scale for large ranks */   THREAD double zipfeta;
+
+/**
+ *
+ * Find zipf sum
+ *
+ * Adds up the first terms, then finds the rest from the integral with the
+ * Euler-Maclaurin correction, which is well within a part in a million past
+ * that.
+ *
+ * \returns Sum of i^-theta for i = 1 to n.
+ *
+ */
+double zipfsum(
+    /** Number of terms */ long long n,
+    /** Skew */            double theta
+)
+
+{
+
+    double sum, a, b;
+    long long i, m;
+
+    m = n < 10000 ? n : 10000;
+    sum = 0.0;
+    for (i = 1; i <= m; i++) sum += pow((double) i, -theta);
+    if (n > m) {
+
+        a = (double) m;
+        b = (double) n;
+        sum += (pow(b, 1.0-theta)-pow(a, 1.0-theta))/(1.0-theta);
+        sum += (pow(b, -theta)-pow(a, -theta))/2.0;
+        sum += theta*(pow(a, -theta-1.0)-pow(b, -theta-1.0))/12.0;
+
+    }
+
+    return sum;
+
+}
+
+/**
+ *
+ * Pick random place
+ *
+ * Picks a random place in a span with the current distribution. Zipf is the
+ * method from Gray et al., "Quickly Generating Billion-Record Synthetic
+ * Databases", the same as YCSB uses, with place 0 the most used. The hotspot
+ * is at the start of the span.
+ *
+ * \returns Place, 0 <= n < span.
+ *
+ */
+long long pickrnd(
+    /** Size of span */ long long n
+)
+
+{
+
+    double u, v, z;
+    long long hs;
+
+    if (n < 2) return 0;
+    switch (curdist.kind) {
+
+        case dist_zipf:
+            if (n != zipfn || curdist.theta != zipftheta) { // new span
+
+                zipfn = n;
+                zipftheta = curdist.theta;
+                zipfzeta = zipfsum(n, zipftheta);
+                zipfeta = (1.0-pow(2.0/n, 1.0-zipftheta))/
+                          (1.0-(1.0+pow(0.5, zipftheta))/zipfzeta);
+
+            }
+            u = lbafrac();
+            v = u*zipfzeta;
+            if (v < 1.0) return 0;
+            if (v < 1.0+pow(0.5, zipftheta)) return 1;
+            hs = (long long) (n*pow(zipfeta*u-zipfeta+1.0, 1.0/(1.0-zipftheta)));
+            if (hs < 0) hs = 0;
+            if (hs >= n) hs = n-1;
+            return hs;
+
+        case dist_hotspot:
+            hs = n*curdist.hotspan/100; // size of hot part
+            if (hs < 1) hs = 1;
+            if (hs >= n || (long long) (lbanext()%100) < curdist.hotio)
+                return (long long) (lbanext()%hs);
+            return hs+(long long) (lbanext()%(n-hs));
+
+        case dist_normal:
+            while (1) { // Box-Muller, retry off the span
+
+                u = 1.0-lbafrac(); // keep from 0
+                z = sqrt(-2.0*log(u))*cos(6.283185307179586*lbafrac());
+                v = n*(curdist.centre+z*curdist.dev)/100.0;
+                if (v >= 0.0 && v < (double) n) return (long long) v;
+
+            }
+
+        default: break;
+
+    }
+
+    return (long long) (lbanext()%n); // uniform
+
+}
+
+/**
+ *
+ * Pick random start
+ *
+ * Picks a random start for a transfer of size sectors that fits in the span,
+ * with the current distribution. The start is a multiple of step counted from
+ * LBA 0, not from the span start, so it stays on a physical sector when the
+ * span itself does not start on one. If no such start fits, the span start is
+ * used.
+ *
+ * The place is picked over the starts of the smallest transfer, and pulled
+ * back to the last start that fits when the transfer is bigger. That keeps
+ * the span pickrnd sees the same when transfer sizes vary, so the zipf sum is
+ * not found again for each transfer.
+ *
+ * \returns Starting LBA.
+ *
+ */
+long long pickstart(
+    /** Start of span */          long long lba,
+    /** Sectors in span */        long long num,
+    /** Sectors to fit */         long long size,
+    /** Smallest transfer size */ long long least,
+    /** Alignment, in LBAs */     long long step
+)
+
+{
+
+    long long first, last, p;
+
+    first = (lba+step-1)/step*step; // first aligned LBA in the span
+    if (first+size > lba+num) return lba; // nothing aligned fits
+    last = (lba+num-size-first)/step; // last place this size fits
+    if (least > size) least = size;
+    p = pickrnd((lba+num-least-first)/step+1);
+    if (p > last) p = last;
+
+    return first+p*step;
+
+}
+
+/**
+ *
+ * Random LBA
+ *
+ * Returns a random number limited to the LBA size, picked with the current
+ * distribution. With align on, it is also rounded down to the start of a
+ * physical sector.
+ *
+ * \returns Standard discdiag error code.
+ * 
+ */
+
+result variable_lbarnd(
+    /** Remaining command line */ char **line,
+    /** Returned value */         long long *ll
+)
+
+{
+
+    char *dummystr = "";
+    result r;
+    long long drivesize;
+    int n;
+    
+
+    r = variable_drvsiz(&dummystr, &drivesize);
+    if (r == result_ok) {
+
+        *ll = pickrnd(drivesize);
+        n = physecsize/secsize; // LBAs in a physical sector
+        if (alignlba && n > 1) *ll -= *ll % n;
+
+    }
+
+    return r;
+
+}
+
+/**
+ *
+ * Sector size
+ *
+ * Returns the logical sector size of the current drive. This is pretty much
+ * set at 512 since the dawn of fire, but drives with 4096 byte sectors exist.
+ *
+ * \returns Standard discdiag error code.
+ * 
+ */
+
+result variable_secsiz(
+    /** Remaining command line */ char **line,
+    /** Returned value */         long long *ll
+)
+
+{
+
+    char *dummystr = "";
+    
+    *ll = secsize;
+
+    return result_ok;
+
+}
+
+/**
+ *
+ * Physical sector size
+ *
+ * Returns the physical sector size of the current drive, which is what it
+ * writes at once. Writes that cover only part of one are slower.
+ *
+ * \returns Standard discdiag error code.
+ * 
+ */
+
+result variable_psecsiz(
+    /** Remaining command line */ char **line,
+    /** Returned value */         long long *ll
+)
+
+{
+
+    *ll = physecsize;
+
+    return result_ok;
+
+}
+
+/**
+ *
+ * Buffer size
+ *
+ * Returns the size, in sectors, of both the read and the write buffer.
+ *
+ * \returns Standard discdiag error code.
+ * 
+ */
+
+result variable_bufsiz(
+    /** Remaining command line */ char **line,
+    /** Returned value */         long long *ll
+)
 
 {
 
     char *dummystr = "";
+    
+    *ll = bufsecs;
+
+    return result_ok;
+
+}
+
+/**
+ *
+ * 50th percentile read latency
+ *
+ * Finds the 50th percentile read latency on the current drive in nanoseconds.
+ *
+ */
+
+result variable_latp50r(
+    /** Remaining command line */ char **line,
+    /** Returned value */         long long *ll
+)
+
+{
+
+    *ll = pctlat(&latread, 5000);
+
+    return result_ok;
+
+}
+
+/**
+ *
+ * 99th percentile read latency
+ *
+ * Finds the 99th percentile read latency on the current drive in nanoseconds.
+ *
+ */
+
+result variable_latp99r(
+    /** Remaining command line */ char **line,
+    /** Returned value */         long long *ll
+)
+
+{
+
+    *ll = pctlat(&latread, 9900);
+
+    return result_ok;
+
+}
+
+/**
+ *
+ * 99.9th percentile read latency
+ *
+ * Finds the 99.9th percentile read latency on the current drive in nanoseconds.
+ *
+ */
+
+result variable_latp999r(
+    /** Remaining command line */ char **line,
+    /** Returned value */         long long *ll
+)
+
+{
+
+    *ll = pctlat(&latread, 9990);
+
+    return result_ok;
+
+}
+
+/**
+ *
+ * Longest read latency
+ *
+ * Finds the longest read latency on the current drive in nanoseconds.
+ *
+ */
+
+result variable_latmaxr(
+    /** Remaining command line */ char **line,
+    /** Returned value */         long long *ll
+)
+
+{
+
+    *ll = latread.max;
+
+    return result_ok;
+
+}
+
+/**
+ *
+ * 50th percentile write latency
+ *
+ * Finds the 50th percentile write latency on the current drive in nanoseconds.
+ *
+ */
+
+result variable_latp50w(
+    /** Remaining command line */ char **line,
+    /** Returned value */         long long *ll
+)
+
+{
+
+    *ll = pctlat(&latwrite, 5000);
+
+    return result_ok;
+
+}
+
+/**
+ *
+ * 99th percentile write latency
+ *
+ * Finds the 99th percentile write latency on the current drive in nanoseconds.
+ *
+ */
+
+result variable_latp99w(
+    /** Remaining command line */ char **line,
+    /** Returned value */         long long *ll
+)
+
+{
+
+    *ll = pctlat(&latwrite, 9900);
+
+    return result_ok;
+
+}
+
+/**
+ *
+ * 99.9th percentile write latency
+ *
+ * Finds the 99.9th percentile write latency on the current drive in nanoseconds.
+ *
+ */
+
+result variable_latp999w(
+    /** Remaining command line */ char **line,
+    /** Returned value */         long long *ll
+)
+
+{
+
+    *ll = pctlat(&latwrite, 9990);
+
+    return result_ok;
+
+}
+
+/**
+ *
+ * Longest write latency
+ *
+ * Finds the longest write latency on the current drive in nanoseconds.
+ *
+ */
+
+result variable_latmaxw(
+    /** Remaining command line */ char **line,
+    /** Returned value */         long long *ll
+)
+
+{
+
+    *ll = latwrite.max;
+
+    return result_ok;
+
+}
+
+/**
+ *
+ * Signature generation
+ *
+ * Returns the write generation of the last sig pattern made, so that csig can
+ * be told to fail sectors written before it.
+ *
+ * \returns Standard discdiag error code.
+ * 
+ */
+
+result variable_siggen(
+    /** Remaining command line */ char **line,
+    /** Returned value */         long long *ll
+)
+
+{
+
+    *ll = siggen;
+
+    return result_ok;
+
+}
+
+/**
+ *
+ * Device time
+ *
+ * Returns the nanoseconds spent waiting on the drive since the statistics
+ * started, at the start of the line or worker.
+ *
+ * \returns Standard discdiag error code.
+ * 
+ */
+
+result variable_devns(
+    /** Remaining command line */ char **line,
+    /** Returned value */         long long *ll
+)
+
+{
+
+    *ll = devns;
+
+    return result_ok;
+
+}
+
+/**
+ *
+ * Diagnostic time
+ *
+ * Returns the nanoseconds since the statistics started that were not spent
+ * waiting on the drive, or waiting for paced transfers to be due.
+ *
+ * \returns Standard discdiag error code.
+ * 
+ */
+
+result variable_cpuns(
+    /** Remaining command line */ char **line,
+    /** Returned value */         long long *ll
+)
+
+{
+
+    *ll = gettim()-marktime-devns-idlens;
+
+    return result_ok;
+
+}
+
+/**
+ *
+ * Pattern time
+ *
+ * Returns the nanoseconds spent making patterns since the statistics started.
+ *
+ * \returns Standard discdiag error code.
+ * 
+ */
+
+result variable_patns(
+    /** Remaining command line */ char **line,
+    /** Returned value */         long long *ll
+)
+
+{
+
+    *ll = patns;
+
+    return result_ok;
+
+}
+
+/**
+ *
+ * Compare time
+ *
+ * Returns the nanoseconds spent comparing since the statistics started.
+ *
+ * \returns Standard discdiag error code.
+ * 
+ */
+
+result variable_compns(
+    /** Remaining command line */ char **line,
+    /** Returned value */         long long *ll
+)
+
+{
+
+    *ll = compns;
+
+    return result_ok;
+
+}
+
+/**
+ *
+ * Device time percent
+ *
+ * Returns the percent of the time since the statistics started that was spent
+ * waiting on the drive.
+ *
+ * \returns Standard discdiag error code.
+ * 
+ */
+
+result variable_devpct(
+    /** Remaining command line */ char **line,
+    /** Returned value */         long long *ll
+)
+
+{
+
+    long long t;
+
+    t = gettim()-marktime;
+    *ll = t > 0 ? devns*100/t : 0;
+
+    return result_ok;
+
+}
+
+/**
+ *
+ * Pacing time
+ *
+ * Returns the nanoseconds spent waiting for paced transfers to be due since
+ * the statistics started.
+ *
+ * \returns Standard discdiag error code.
+ * 
+ */
+
+result variable_idlens(
+    /** Remaining command line */ char **line,
+    /** Returned value */         long long *ll
+)
+
+{
+
+    *ll = idlens;
+
+    return result_ok;
+
+}
+
+/*******************************************************************************
+
+Command handlers
+
+*******************************************************************************/
+
+/**
+ *
+ * Help
+ *
+ * Print command menu.
+ *
+ * \returns Standard discdiag error code.
+ * 
+ */
+
+result command_help(
+    /** Remaining command line */ char **line
+)
+
+{
+
+    linecounter = 0; // clear screen line count
+    printf("\n"); pause();
+    printf("Commands available:\n"); pause();
+    printf("\n"); pause();
+    printf("?, help                     - Print command help.\n"); pause();
+    printf("r, read [lba][num]          - Read sector(s) at LBA, default read 0 1.\n"); pause();
+    printf("w, write [lba][num]         - Read sector(s) at LBA, default read 0 1.\n"); pause();
+    printf("qd [num]                    - Set queue depth, default is print current.\n"); pause();
+    printf("rq, readq [lba][num]        - Queue read of sector(s) at LBA, default 0 1.\n"); pause();
+    printf("wq, writeq [lba][num]       - Queue write of sector(s) at LBA, default 0 1.\n"); pause();
+    printf("rv, readv [lba num]...      - Read a batch of transfers together, default is\n"); pause();
+    printf("                              the LBA list.\n"); pause();
+    printf("wrv, writev [lba num]...    - Write a batch of transfers together, default is\n"); pause();
+    printf("                              the LBA list.\n"); pause();
+    printf("lbalist [clear|add lba num...|rand count [num]] - Fill the LBA list,\n"); pause();
+    printf("                              default is print its size.\n"); pause();
+    printf("qwait                       - Wait for all queued reads and writes to finish.\n"); pause();
+    printf("wv, verify [lba [num [pat [val]]]] - Write pattern to sector(s) from LBA,\n"); pause();
+    printf("                              read back and compare, default is lba to\n"); pause();
+    printf("                              drive end.\n"); pause();
+    printf("workload [keyword val]... [rand|seq] - Run a queued mix of reads and\n"); pause();
+    printf("                              writes, keywords read, bs, bsmax, lba, num,\n"); pause();
+    printf("                              qd, time, ios.\n"); pause();
+    printf("rate [num [iops|mbps] | off] - Pace reads, writes and workload to a rate,\n"); pause();
+    printf("                              default is print current.\n"); pause();
+    printf("runfor [secs|off]           - Stop the run after secs, as a break does,\n"); pause();
+    printf("                              default is print time left.\n"); pause();
+    printf("trim [lba [num]]            - Discard sector(s) from LBA, default is 1 sector.\n"); pause();
+    printf("zero [lba [num]]            - Set sector(s) from LBA to zero, default is 1\n"); pause();
+    printf("                              sector.\n"); pause();
+    printf("precondition [passes]       - Trim the whole drive, then fill it from the\n"); pause();
+    printf("                              write buffer at full queue depth, default is\n"); pause();
+    printf("                              1 pass.\n"); pause();
+    printf("verifyall                   - Read back everything written, and check the\n"); pause();
+    printf("                              signatures of what was written with sig.\n"); pause();
+    printf("direct [on|off]             - Set direct (uncached) drive access, default is\n"); pause();
+    printf("                              print current.\n"); pause();
+    printf("bufsize [num]               - Set read and write buffer size in sectors,\n"); pause();
+    printf("                              default is print current.\n"); pause();
+    printf("bufsel [w slot] [r slot]    - Point writes or reads at a buffer slot, 0 to 7,\n"); pause();
+    printf("                              default is print current.\n"); pause();
+    printf("swap                        - Swap the read and write buffers.\n"); pause();
+    printf("bufcopy [off [num [src [dst]]]] - Copy sectors between buffer slots,\n"); pause();
+    printf("                              default is all of the read buffer to the\n"); pause();
+    printf("                              write buffer.\n"); pause();
+    printf("align [on|off]              - Set lbarnd to physical sector starts, default is\n"); pause();
+    printf("                              print current.\n"); pause();
+    printf("dist [kind [val...]]        - Set lbarnd distribution, uniform, zipf theta,\n"); pause();
+    printf("                              hotspot iopct spanpct or normal centre dev,\n"); pause();
+    printf("                              default is print current.\n"); pause();
+    printf("affinity [cpu|off]          - Pin thread to a CPU, default is print current.\n"); pause();
+    printf("numa [node|auto|off]        - Run thread and take its buffers on a NUMA node,\n"); pause();
+    printf("                              auto is the drive's, default is print current.\n"); pause();
+    printf("spawn label drive [val]...  - Run procedure on drive in a new worker.\n"); pause();
+    printf("join                        - Wait for all workers and print their totals.\n"); pause();
+    printf("lat [clear]                 - Print read and write latency percentiles, or\n"); pause();
+    printf("                              clear them.\n"); pause();
+    printf("interval [secs [file [csv|json]] | off] - Sample statistics every secs\n"); pause();
+    printf("                              while running, default is print current.\n"); pause();
+    printf("report [json|csv [file] | off] - Write a record of each line, procedure\n"); pause();
+    printf("                              and worker, default is print current.\n"); pause();
+    printf("bench [ms]                  - Time the diagnostic's own fills, compares,\n"); pause();
+    printf("                              random numbers, expressions and dispatch, ms\n"); pause();
+    printf("                              for each, default 200.\n"); pause();
+    printf("dw, dumpwrite [num]         - Dump sector(s) from write buffer, default 1.\n"); pause();
+    printf("dr, dumpread [num]          - Dump sector(s) from read buffer, default 1.\n"); pause();
+    printf("pt, pattn [pat [val [cnt [off]]]] - Set write buffer to pattern, from\n"); pause();
+    printf("                              sector off, default is count.\n"); pause();
+    printf("c, comp [pat [val [cnt]]]   - Compare read buffer to pattern, default is count.\n"); pause();
+    printf("csig [lba [cnt [gen]]]      - Check sector signatures in read buffer, default\n"); pause();
+    printf("                              is lba 0 and the whole buffer.\n"); pause();
+    printf("map [on|off|clear|save file|load file] - Show, turn on or off, clear,\n"); pause();
+    printf("                              save or load the map of what was written,\n"); pause();
+    printf("                              default is show.\n"); pause();
+    printf("cm, compmode mode           - Set miscompare handling mode, default is one.\n"); pause();
+    printf("drive [num|path]            - Set current phy drive, default is print current.\n"); pause();
+    printf("listdrives, ld              - List available physical drives.\n"); pause();
+    printf("devopt [name [val]]         - Set device option, default is list them.\n"); pause();
+    printf("unprot                      - Unprotect current drive.\n"); pause();
+    printf("echo [text]                 - Echo the parameter area with next line.\n"); pause();
+    printf("echon [text]                - Echo the parameter area without next line.\n"); pause();
+    printf("p, print [fmt] val...       - Print calulated value(s) with next line.\n"); pause();
+    printf("pn, printn [fmt] val...     - Print calulated value(s) without next line.\n"); pause();
+    printf("l, loop [num]               - Loop from line start num times, default is\n"); pause();
+    printf("                              forever.\n"); pause();
+    printf("lq, loopq [num]             - Loop quiet from line start num times, defult is\n"); pause();
+    printf("                              forever.\n"); pause();
+    printf("u [num]                     - Loop until condition is true.\n"); pause();
+    printf("while cond                  - Start while/wend loop. Exec loop if cond is true.\n"); pause();
+    printf("wend                        - Terminate while/wend loop.\n"); pause();
+    printf("repeat                      - Start repeat/until loop.\n"); pause();
+    printf("until cond                  - End repeat/until loop. Repeat if cond is false.\n"); pause();
+    printf("for var start end [step]    - Run for loop, start to end in var.\n");              pause();
+    printf("fend                        - End for loop.\n"); pause();
+    printf("select val                  - Select value, match successive cases for val.\n"); pause();
+    printf("case val                    - Start new select case.\n"); pause();
+    printf("default                     - Start select case matching any value.\n"); pause();
+    printf("send                        - Terminate select statement.\n"); pause();
+    printf("end                         - Terminate procedure.\n"); pause();
+    printf("go label                    - Go to program label.\n"); pause();
+    printf("if cond                     - Continue if condition met, otherwise next line.\n"); pause();
+    printf("s, set var val              - Set/reset user variable.\n"); pause();
+    printf("local var                   - Mark variable as local.\n"); pause();
+    printf("srand                       - Reset random number sequence.\n"); pause();
+    printf("list                        - List stored program.\n"); pause();
+    printf("clear                       - Clear stored program.\n"); pause();
+    printf("save filename               - Save stored program to file.\n"); pause();
+    printf("load filename               - Load stored program from file.\n"); pause();
+    printf("delt num                    - Delete line in program with line number.\n"); pause();
+    printf("exit                        - Exit diagnostic.\n"); pause();
+    printf("exitonerror                 - Exit the diagnostic on error.\n"); pause();
+    printf("\n"); pause();
+    printf("[option] Means an optional parameter.\n"); pause();
+    printf("\n"); pause();
+    printf("Multiple commands can appear on a line as a; b; c...\n"); pause();
+    printf("\n"); pause();
+    printf("Patterns are:\n"); pause();
+    printf("\n"); pause();
+    printf("cnt   - Byte incrementing count.\n"); pause();
+    printf("dwcnt - 32 bit incrementing count.\n"); pause();
+    printf("val   - Numeric 32 bit value, big endian.\n"); pause();
+    printf("rand  - Random byte value.\n"); pause();
+    printf("lba   - Only the first 32 bits get LBA, rest is $ff. LBA starts \n"); pause();
+    printf("        at [val], and increments across buffer. Note that this only\n"); pause();
+    printf("        writes the first dword of each sector, use another pattern\n"); pause();
+    printf("        to fill the background.\n"); pause();
+    printf("sig   - Each sector gets a signature: its LBA, starting at [val], the write\n"); pause();
+    printf("        generation, the random seed and the time, then data made from\n"); pause();
+    printf("        those, and a CRC32C over it all. csig checks it, a sector at a\n"); pause();
+    printf("        time, without knowing how it was written.\n"); pause();
+    printf("buffs - Compare the read and write buffers to each other. This allows\n"); pause();
+    printf("        complex patterns to be built up in the write buffer.\n"); pause();
+    printf("\n"); pause();
+    printf("All write operations are from the write buffer which is %lld sectors long.\n", bufsecs); pause();
+    printf("All read operations are from the read buffer which is %lld sectors long.\n", bufsecs); pause();
+    printf("The size of both buffers is set with bufsize.\n"); pause();
+    printf("\n"); pause();
+    printf("The read and write buffers are two slots of a pool of %d, 0 for writes and\n", BUFSLOTS); pause();
+    printf("1 for reads at startup. bufsel points either at any slot, and swap trades\n"); pause();
+    printf("them, so data read can be patched with pattn from a sector offset and\n"); pause();
+    printf("written back without copying. Patterns made once in spare slots can be\n"); pause();
+    printf("selected again instead of being filled each time.\n"); pause();
+    printf("\n"); pause();
+    printf("Queued reads and writes (rq and wq) are sent to the drive without waiting\n"); pause();
+    printf("for them to finish, so that up to the queue depth set by qd are in flight at\n"); pause();
+    printf("once. When the queue is full, the next queued command waits for the oldest\n"); pause();
+    printf("to finish. Plain reads and writes, changing drives and the end of each\n"); pause();
+    printf("command line all wait for the queue to empty. Since queued reads all land in\n"); pause();
+    printf("the read buffer, its contents are only meaningful with a queue depth of 1.\n"); pause();
+    printf("\n"); pause();
+    printf("Normally the operating system caches the drive, so reading a sector again\n"); pause();
+    printf("may not touch the drive at all. \"direct on\" bypasses the cache so that\n"); pause();
+    printf("the statistics measure the drive itself.\n"); pause();
+    printf("\n"); pause();
+    printf("Real loads use some LBAs much more than others, which drive caches favour.\n"); pause();
+    printf("dist sets how lbarnd and random workloads pick LBAs: uniform, zipf with a\n"); pause();
+    printf("skew theta (0.99 is typical), hotspot with a percent of the I/O going to a\n"); pause();
+    printf("percent of the span at its start, or normal around a centre. The places in\n"); pause();
+    printf("the span used most are at its start, except for normal. srand restarts the\n"); pause();
+    printf("LBA sequence too.\n"); pause();
+    printf("\n"); pause();
+    printf("wv writes a pattern over a span of sectors, reads it back and compares it, a\n"); pause();
+    printf("buffer's worth at a time, with the buffers kept in a ring (up to 16, limited\n"); pause();
+    printf("by the queue depth) so that the drive is busy with one chunk while the next is\n"); pause();
+    printf("patterned and the last is compared. The default pattern is lba, which marks\n"); pause();
+    printf("every sector with its own LBA, over the write buffer contents. Mismatches are\n"); pause();
+    printf("reported by LBA, with offsets within the sector, and end with an error.\n"); pause();
+    printf("\n"); pause();
+    printf("spawn runs a procedure on its own thread, as a worker, against the given\n"); pause();
+    printf("drive. Each worker has its own drive, buffers, variables and statistics, so\n"); pause();
+    printf("several drives, or several parts of one drive, can be tested at once. The\n"); pause();
+    printf("worker starts with a copy of the buffers and the drive write locked. join\n"); pause();
+    printf("waits for all the workers to end, then prints the totals for each drive and\n"); pause();
+    printf("for all drives. The program can't be changed while workers are running.\n"); pause();
+    printf("\n"); pause();
+    printf("Each read and write is timed, from the time it is sent to the drive until it\n"); pause();
+    printf("is seen done, and filed in a latency histogram for its direction. The\n"); pause();
+    printf("histogram doubles its range every 32 buckets, so any latency is held to\n"); pause();
+    printf("within about 3%%, without keeping the samples themselves. lat prints the\n"); pause();
+    printf("percentiles so far. The histograms are cleared when the drive is changed,\n"); pause();
+    printf("and join prints them for each drive.\n"); pause();
+    printf("\n"); pause();
+    printf("The statistics end with a line on where the time went, when any of it was\n"); pause();
+    printf("spent on the drive, making patterns or comparing: Dev is the time waiting on\n"); pause();
+    printf("the drive, in transfers and in queueing and reaping them, and CPU is the rest,\n"); pause();
+    printf("the diagnostic's own, split into patterns (Pat), compares (Comp), and Other,\n"); pause();
+    printf("which is parsing and running commands. When the IOPS are low and Dev is not\n"); pause();
+    printf("most of the time, the drive is not what holds the test back. With a rate\n"); pause();
+    printf("set, the time spent waiting for transfers to be due is taken out as Idle.\n"); pause();
+    printf("\n"); pause();
+    printf("rate paces r, w, rq, wq, rv, wrv and workload to a number of transfers\n"); pause();
+    printf("(iops) or megabytes (mbps) a second, instead of running flat out, so the\n"); pause();
+    printf("latency can be measured at a load below what the drive can take. Running a\n"); pause();
+    printf("workload at 10%%, 20%% and so on of the rate it does flat out shows where the\n"); pause();
+    printf("latency turns up. Each transfer is due a fixed time after the last one was,\n"); pause();
+    printf("and its latency is counted from then. When the drive falls behind, the\n"); pause();
+    printf("transfers after go as soon as they can to catch up, and the time they were\n"); pause();
+    printf("held up counts in their latency, as it would for a program that needed them\n"); pause();
+    printf("then. Each worker runs at the rate on its own.\n"); pause();
+    printf("\n"); pause();
+    printf("A break (ctrl-c) is taken between blocks compared, transfers and commands.\n"); pause();
+    printf("Queued transfers still in flight are cancelled where the system can, which\n"); pause();
+    printf("for most drives it can't, so they finish and are counted first. runfor\n"); pause();
+    printf("stops the run after so many seconds in the same way, to end a test at a\n"); pause();
+    printf("time without counting loops. Each worker spawned after it stops on its own\n"); pause();
+    printf("when the time is up. With exitonerror, the diagnostic then exits, as it does\n"); pause();
+    printf("on a break.\n"); pause();
+    printf("\n"); pause();
+    printf("trim and zero send a span to the drive to be discarded or zeroed, without\n"); pause();
+    printf("sending data. They are counted apart from writes, and when there were any,\n"); pause();
+    printf("the statistics have a line more with their operations (IOTR, IOZ) and bytes\n"); pause();
+    printf("(BTR, BZ). precondition trims the whole drive and then fills it, to get an\n"); pause();
+    printf("SSD to the speed it settles to in use before it is measured.\n"); pause();
+    printf("\n"); pause();
+    printf("rv and wrv send a batch of transfers to the drive together, as many at a\n"); pause();
+    printf("time as the queue depth, in one call where the system allows it, so a\n"); pause();
+    printf("batch of small random transfers pays for one command line and one system\n"); pause();
+    printf("call. The transfers are given on the line, or come from the LBA list, which\n"); pause();
+    printf("lbalist fills, with pairs or with random LBAs. They go end to end in the\n"); pause();
+    printf("buffer.\n"); pause();
+    printf("\n"); pause();
+    printf("Each write is filed in a map of the extents written on the drive, with the\n"); pause();
+    printf("generation of the sig pattern it wrote, if it did. verifyall reads back only\n"); pause();
+    printf("those, joining extents that touch into long reads, and checks each sector's\n"); pause();
+    printf("signature, so a drive that was written in a few places verifies in the time\n"); pause();
+    printf("it takes to read those. Trims take sectors out of the map, and setting the\n"); pause();
+    printf("drive clears it. map save and map load keep it across runs. map off stops\n"); pause();
+    printf("the filing for runs that don't need it, and the map turns itself off past\n"); pause();
+    printf("a few million extents, so it never costs a run much time or memory.\n"); pause();
+    printf("\n"); pause();
+    printf("Drives 0 to 9 are the system's first ten discs (sda to sdj on Linux). Any\n"); pause();
+    printf("NVMe namespaces found at start come next, then any path given to drive,\n"); pause();
+    printf("which gets the next free number and keeps it. A path starts with /, \\, . or\n"); pause();
+    printf("a double quote, and can be a device or an image file, whose size is the\n"); pause();
+    printf("size of the file. A drive that can't be opened for writing is opened read\n"); pause();
+    printf("only.\n"); pause();
+    printf("\n"); pause();
+    printf("affinity pins the thread to a CPU, and numa runs it on the CPUs of a NUMA\n"); pause();
+    printf("node and takes its buffers from the node's memory. numa auto uses the node\n"); pause();
+    printf("the current drive's controller is on, which Linux gives in sysfs, and\n"); pause();
+    printf("follows the drive when it changes. On a server with more than one socket\n"); pause();
+    printf("this keeps the thread and its buffers next to the drive, so bandwidth is the\n"); pause();
+    printf("same from run to run. Workers take both settings with them when spawned,\n"); pause();
+    printf("and a procedure can set its own.\n"); pause();
+    printf("\n"); pause();
+    printf("The stub build runs against a simulated disc in memory. Only the parts\n"); pause();
+    printf("written use memory, so it can be set to any size. devopt sets its size in\n"); pause();
+    printf("sectors (size), sector sizes (lsec, psec), the nanoseconds to start a\n"); pause();
+    printf("transfer and for each byte (opns, bytens), failed transfers per million\n"); pause();
+    printf("(err, restarted by seed), and erases it (clear). Set the drive again after\n"); pause();
+    printf("changing the size or sector sizes. devopt alone lists the settings.\n"); pause();
+    printf("\n"); pause();
+    printf("interval samples the statistics every so many seconds while commands run,\n"); pause();
+    printf("for the main thread and each worker, and writes what each did since the last\n"); pause();
+    printf("sample as a line of CSV or JSON: the operations, bytes, rates and latency\n"); pause();
+    printf("percentiles for the interval. This shows a long run change over time, as when\n"); pause();
+    printf("a drive's write cache fills. Samples are taken between commands and between\n"); pause();
+    printf("the transfers of wv and workload.\n"); pause();
+    printf("\n"); pause();
+    printf("report writes a record, as a line of JSON or CSV, for each command line, each\n"); pause();
+    printf("procedure and each worker: the drive, its size and sector size, operations,\n"); pause();
+    printf("bytes, time, latency percentiles and result, and the failed transfers and\n"); pause();
+    printf("miscompares, with the LBAs of the first of them. Ending the report, or the\n"); pause();
+    printf("diagnostic, adds a summary record for each drive. Records are held in memory\n"); pause();
+    printf("and written when a line is done, so the file is not written mid-transfer.\n"); pause();
+    printf("\n"); pause();
+    printf("bench times the diagnostic's own work, to show it is not what limits a test:\n"); pause();
+    printf("the pattern fills, compare, CRC32C, the random numbers, an expression run\n"); pause();
+    printf("from the cache and parsed afresh, dispatching a command, and with a drive\n"); pause();
+    printf("set, a one sector read. Each is given in nanoseconds per operation and GB/s,\n"); pause();
+    printf("except the lba fill, which writes only 4 bytes of each sector, so it is\n"); pause();
+    printf("counted in sectors and millions of sectors a second (Ms/s). The read is timed\n"); pause();
+    printf("with the statistics clock, so it takes in the drive. The stub build\n"); pause();
+    printf("(cdiscdiag_stub) reads from memory, but its clock counts the simulated\n"); pause();
+    printf("transfer time, so set devopt opns 0 and bytens 0 first to see the cost of a\n"); pause();
+    printf("transfer with no drive at all.\n"); pause();
+    printf("\n"); pause();
+    printf("All drives start write locked, and are relocked when the drive is changed.\n"); pause();
+    printf("\n"); pause();
+    printf("User variables start with a-z and continue with a-z and 0-9 like Myvar1.\n"); pause();
+    printf("They are created or recreated by set, and can be set any number of times.\n"); pause();
+    printf("A variable can be used anywhere a val can.\n"); pause();
+    printf("\n"); pause();
+    printf("There are several predefined variables:\n"); pause();
+    printf("\n"); pause();
+    printf("drvsiz - Gives the size of the current physical drive.\n"); pause();
+    printf("rand   - Gives a random number.\n"); pause();
+    printf("lbarnd - Gives a random LBA for the current drive, ie., a random number\n"); pause();
+    printf("         that fits into 0..drvsiz-1, picked by dist.\n"); pause();
+    printf("secsiz - Size of sector in bytes (512 or 4096).\n"); pause();
+    printf("psecsiz - Size of physical sector in bytes, what the drive writes at once.\n"); pause();
+    printf("bufsiz - Size of read and write buffers in sectors.\n"); pause();
+    printf("latp50r, latp99r, latp999r, latmaxr - Read latency at the 50th, 99th and\n"); pause();
+    printf("         99.9th percentiles, and the longest, in nanoseconds.\n"); pause();
+    printf("latp50w, latp99w, latp999w, latmaxw - The same for writes.\n"); pause();
+    printf("siggen - Write generation of the last sig pattern made.\n"); pause();
+    printf("devns, cpuns - Nanoseconds waiting on the drive, and in the diagnostic, since\n"); pause();
+    printf("         the line started.\n"); pause();
+    printf("patns, compns - Nanoseconds of cpuns making patterns, and comparing.\n"); pause();
+    printf("devpct - Percent of the time since the line started waiting on the drive.\n"); pause();
+    printf("idlens - Nanoseconds since the line started waiting for paced transfers to\n"); pause();
+    printf("         be due, which is not in cpuns.\n"); pause();
+    printf("\n"); pause();
+    printf("The compare modes are:\n"); pause();
+    printf("\n"); pause();
+    printf("all - Show all mismatches.\n"); pause();
+    printf("one - Show only the first mismatch.\n"); pause();
+    printf("fail - Fail (abort) after the first mismatch (normal is continue).\n"); pause();
+    printf("\n"); pause();
+    printf("All numeric parameters can be expressions, using C style expression operators\n"); pause();
+    printf("+a,-a,(a),a*b,a/b,a%%b,a+b,a-b,a<b,a>b,a=b, a!=b,a<=b and a>b.\n"); pause();
+    printf("Note that expressions cannot contain spaces, ie., a numeric parameter cannot\n"); pause();
+    printf("have spaces within it.\n"); pause();
+    printf("\n"); pause();
+    printf("Format strings used with print must start and end with double quotes.\n"); pause();
+    printf("They can contain standard C style format specifiers like %%[w[.p]f, where\n"); pause();
+    printf("the format character is d, x, or o, for decimal, hexadecimal or octal.\n"); pause();
+    printf("The sign and length cannot be specified, since debug values are always signed\n"); pause();
+    printf("long long values. Anything else in the format string is printed. There are\n"); pause();
+    printf("no character escapes. Use pn/printn and p/print to specify or leave out a\n");  pause();
+    printf("newline after printout.\n"); pause();
+    printf("\n"); pause();
+    printf("Note that leading zeros don't work in the field width. Use the precision\n"); pause();
+    printf("instead, i.e., %%4.4x not %%04x.\n"); pause();
+    printf("\n"); pause();
+    printf("Stored program lines are entered with a leading number as:\n"); pause();
+    printf("\n"); pause();
+    printf("Diag> 1 dothis(num): echon The number is: ; p num\n"); pause();
+    printf("\n"); pause();
+    printf("The line is inserted BEFORE the line in the program.\n"); pause();
+    printf("\n"); pause();
+    printf("Any line with a label (as \"dothis:\" above) can be called as a\n"); pause();
+    printf("procedure by using it's label as a command as:\n"); pause();
+    printf("\n"); pause();
+    printf("Diag> dothis 42\n"); pause();
+    printf("\n"); pause();
+    printf("Note parameters are optional.\n"); pause();
+    printf("\n"); pause();
+    printf("Procedure execution stops with an \"end\" command, and execution\n"); pause();
+    printf("resumes after the calling command.\n"); pause();
+    printf("\n"); pause();
+    printf("All variables created in a procedure are temporary and removed at\n"); pause();
+    printf("the end of the procedure. Variables are only created in a procedure\n"); pause();
+    printf("if they don't exist outside of the procedure OR if \"local\" is used.\n"); pause();
+    printf("Note that parameters are automatically local.\n"); pause();
+    printf("\n"); pause();
+    printf("Note that hitting the end of the program buffer terminates the run\n"); pause();
+    printf("ALWAYS.\n"); pause();
+    printf("\n"); pause();
+    printf("The file \"discdiag.ini\", if present in the current directory, is\n"); pause();
+    printf("automatically loaded when discdiag starts.\n"); pause();
+    printf("\n"); pause();
+    printf("*** WARNING: This diagnostic CAN and WILL distroy your hard disc!\n"); pause();
+    printf("\n"); pause();
+
+    return result_ok; // return no fault
+    
+}
+
+/**
+ *
+ * Read sector
+ *
+ * Read sector to buffer
+ *
+ * \returns Standard discdiag error code.
+ * 
+ */
+
+result command_read(
+    /** Remaining command line */ char **line
+)
+
+{
+
+    long long lba; // lba to read
+    long long numsecs; // number of sectors to read
+    long long t; // start time of transfer
+    long long due; // time paced transfer was due
+    result r;
+    int nr;
+    
+    r = getxfer(line, &lba, &numsecs); // get and check lba and length
+    if (r != result_ok) return r;
+    r = waitq(); // finish queued transfers first
+    if (r != result_ok) return r;
+    r = pace(numsecs*secsize, &due); // wait until due at the rate
+    if (r != result_ok) return r;
+
+    /* read sector to buffer */
+    t = gettim();
+    nr = readsector(readbuffer, lba, numsecs);
+    devns += gettim()-t;
+    if (due) t = due; // late is counted in the latency
+    t = gettim()-t;
+    if (nr) {
+
+        printf("*** Error: Read error\n");
+        rptbad(bad_read, lba);
+
+        return result_error; // read failed, exit
+
+    }
+
+    // update statistics
+    iopread += 1.0; // read IOPs
+    bcread += numsecs*secsize; // read bytes
+    addlat(&latread, t);
+ 
+    return result_ok; // return no fault
+   
+}
+
+/**
+ *
+ * Write sector
+ *
+ * Write sector from buffer
+ *
+ * \returns Standard discdiag error code.
+ * 
+ */
+
+result command_write(
+    /** Remaining command line */ char **line
+)
+
+{
+
+    long long lba; // lba to read
+    long long numsecs; // number of sectors to read
+    long long t; // start time of transfer
+    long long due; // time paced transfer was due
+    result r;
+    int nr;
+    
+    if (writeprot) {
+
+        printf("*** Error: Drive is write protected, use unprot command\n");
+        return result_error;
+
+    }
+
+    r = getxfer(line, &lba, &numsecs); // get and check lba and length
+    if (r != result_ok) return r;
+    r = waitq(); // finish queued transfers first
+    if (r != result_ok) return r;
+    r = pace(numsecs*secsize, &due); // wait until due at the rate
+    if (r != result_ok) return r;
+
+    /* write sector from buffer */
+    t = gettim();
+    nr = writesector(writebuffer, lba, numsecs);
+    devns += gettim()-t;
+    if (due) t = due; // late is counted in the latency
+    t = gettim()-t;
+    if (nr) {
+
+        printf("*** Error: Write error\n");
+        rptbad(bad_write, lba);
+
+        return result_error; // read failed, exit
+
+    }
+ 
+    // update statistics
+    iopwrite += 1.0; // write IOPs
+    bcwrite += numsecs*secsize; // write bytes
+    addlat(&latwrite, t);
+
+    return mapput(lba, numsecs, wrgen(lba, 0)); // note where it went
+   
+}
+
+/**
+ *
+ * Set queue depth
+ *
+ * Sets the number of queued reads and writes that can be in flight at once.
+ * With no parameter, prints the current depth.
+ *
+ * \returns Standard discdiag error code.
+ * 
+ */
+
+result command_queuedepth(
+    /** Remaining command line */ char **line
+)
+
+{
+
+    long long v;
+    result r;
+
+    while (**line == ' ') (*line)++; // skip any leading spaces
+    if (**line && **line != ';') { // get depth
+
+        r = getparam(line, &v);
+        if (r != result_ok) return r;
+        r = waitq(); // queue must be empty to change
+        if (r != result_ok) return r;
+        if (setqd((int) v)) return result_error;
+
+    } else printf("Queue depth is: %d\n", getqd());
+
+    return result_ok; // return no fault
+
+}
+
+/**
+ *
+ * Queue read sector
+ *
+ * Sends a read to the drive without waiting for it to finish. If the queue is
+ * full, waits for whichever request finishes first.
+ *
+ * \returns Standard discdiag error code.
+ * 
+ */
+
+result command_readq(
+    /** Remaining command line */ char **line
+)
+
+{
+
+    long long lba; // lba to read
+    long long numsecs; // number of sectors to read
+    long long due; // time paced transfer was due
+    result r;
+
+    r = getxfer(line, &lba, &numsecs); // get and check lba and length
+    if (r != result_ok) return r;
+    r = pace(numsecs*secsize, &due); // wait until due at the rate
+    if (r != result_ok) return r;
+    if (inflight() >= getqd()) { // queue full, make room
+
+        r = reapq(1);
+        if (r != result_ok) return r;
+
+    }
+    setissue(due); // latency counts from when it was due
+    if (devsubmit(0, readbuffer, lba, numsecs, 0)) return result_error;
+
+    return result_ok; // return no fault
+
+}
+
+/**
+ *
+ * Queue write sector
+ *
+ * Sends a write to the drive without waiting for it to finish. If the queue is
+ * full, waits for whichever request finishes first.
+ *
+ * \returns Standard discdiag error code.
+ * 
+ */
+
+result command_writeq(
+    /** Remaining command line */ char **line
+)
+
+{
+
+    long long lba; // lba to write
+    long long numsecs; // number of sectors to write
+    long long due; // time paced transfer was due
+    int k;
+    result r;
+
+    if (writeprot) {
+
+        printf("*** Error: Drive is write protected, use unprot command\n");
+        return result_error;
+
+    }
+    r = getxfer(line, &lba, &numsecs); // get and check lba and length
+    if (r != result_ok) return r;
+    r = pace(numsecs*secsize, &due); // wait until due at the rate
+    if (r != result_ok) return r;
+    if (inflight() >= getqd()) { // queue full, make room
+
+        r = reapq(1);
+        if (r != result_ok) return r;
+
+    }
+    // find a slot to keep the generation this write leaves
+    if (!inflight()) memset(wquse, 0, sizeof(wquse));
+    for (k = 0; k < QDMAX && wquse[k]; k++);
+    if (k >= QDMAX) { // all held by cancelled writes, make room
+
+        r = waitq();
+        if (r != result_ok) return r;
+        memset(wquse, 0, sizeof(wquse));
+        k = 0;
+
+    }
+    wquse[k] = 1;
+    wqgen[k] = wrgen(lba, 0);
+    setissue(due); // latency counts from when it was due
+    if (devsubmit(1, writebuffer, lba, numsecs, WQTAG+k)) {
+
+        wquse[k] = 0;
+
+        return result_error;
+
+    }
+
+    return result_ok; // return no fault
+
+}
+
+/**
+ *
+ * Transfer LBA list
+ *
+ * Reads or writes each transfer of a list, sending as many at once as the
+ * queue has room for in one batch, so the drive and backend see them together.
+ * The transfers go end to end in the buffer, from the start again when the
+ * next doesn't fit, after any reads still landing there are done. With a rate
+ * set, each is sent alone when it is due. Each write is filed in the written
+ * map when it is done, so one that fails doesn't lose the rest.
+ *
+ * \returns Standard discdiag error code.
+ *
+ */
+
+result xferv(
+    /** Writes, else reads */ int write,
+    /** Transfers */          lbalist *lp
+)
+
+{
+
+    unsigned char *bufs[QDMAX];
+    long long lbas[QDMAX], nums[QDMAX];
+    long long *gens; // generation each write leaves, by transfer
+    iocmp cmp[QDMAX];
+    long long i, first, off, t, due, wait;
+    int m, k, cn;
+    result r, r2;
+
+    if (currentdrive < 0) {
+
+        printf("*** Error: No current drive is set\n");
+
+        return result_error;
+
+    }
+    if (write && writeprot) {
+
+        printf("*** Error: Drive is write protected, use unprot command\n");
+        return result_error;
+
+    }
+    if (lp->cnt > WQTAG) { // transfers are tagged with their place
+
+        printf("*** Error: Too many transfers, must be %d or less\n", WQTAG);
+
+        return result_error;
+
+    }
+    for (i = 0; i < lp->cnt; i++) { // check them all before sending any
+
+        if (lp->ent[i].num < 1 || lp->ent[i].num > bufsecs) {
+
+            printf("*** Error: Invalid sector count, must be 1 to %lld\n", bufsecs);
+
+            return result_error;
+
+        }
+        if (lp->ent[i].lba < 0 || lp->ent[i].lba+lp->ent[i].num > drivesize) {
+
+            printf("*** Error: Operation will exceed drive size\n");
+
+            return result_error;
+
+        }
+
+    }
+    r = waitq(); // finish queued transfers first
+    if (r != result_ok) return r;
+    gens = NULL;
+    if (write && lp->cnt) {
+
+        gens = (long long *) malloc((size_t) lp->cnt*sizeof(long long));
+        if (!gens) {
+
+            printf("*** Error: Cannot allocate space\n");
+
+            return result_error;
+
+        }
+
+    }
+
+    i = 0;
+    off = 0;
+    while (1) {
+
+        if (r == result_ok && chkbrk()) {
+
+            if (exiterror) r = result_exit; // exit diagnostic
+            else r = result_stop; // check break
+
+        }
+        // make a batch of what the queue has room for
+        m = 0;
+        wait = 0;
+        first = i;
+        while (r == result_ok && i < lp->cnt && inflight()+m < getqd()) {
+
+            due = ratedue();
+            if (due) { // paced, one at a time when due
+
+                if (m) break;
+                if (due > gettim()) {
+
+                    wait = due;
+                    break;
+
+                }
+                ratetake(lp->ent[i].num*secsize);
+                setissue(due); // latency counts from when it was due
+
+            }
+            if (off+lp->ent[i].num > bufsecs) { // back to buffer start
+
+                // reads still going there would be overwritten, so wait
+                if (!write && (m || inflight())) break;
+                off = 0;
+
+            }
+            bufs[m] = (write ? writebuffer : readbuffer)+off*secsize;
+            lbas[m] = lp->ent[i].lba;
+            nums[m] = lp->ent[i].num;
+            if (write) gens[i] = wrgen(lbas[m], off);
+            off += nums[m];
+            m++;
+            i++;
+
+        }
+        if (m) {
+
+            t = gettim();
+            if (submitv(write, bufs, lbas, nums, m, (int) first)) r = result_error;
+            devns += gettim()-t;
+
+        }
+        if (wait) cn = pacereap(cmp, wait); // reap until the next is due
+        else if (!inflight()) break; // all done
+        else cn = devreap(cmp, 1, QDMAX);
+        if (cn < 0) {
+
+            r = result_error;
+            break;
+
+        }
+        for (k = 0; k < cn; k++) {
+
+            if (cmp[k].error) {
+
+                printf("*** Error: %s error at lba %lld\n",
+                       cmp[k].write ? "Write" : "Read", cmp[k].lba);
+                rptbad(cmp[k].write ? bad_write : bad_read, cmp[k].lba);
+                r = result_error;
+
+            } else {
+
+                tallycmp(&cmp[k]);
+                // file where each write went as it is done
+                if (cmp[k].write &&
+                    mapput(cmp[k].lba, cmp[k].numsec, gens[cmp[k].tag]) != result_ok)
+                    r = result_error;
+
+            }
+
+        }
+
+    }
+    r2 = waitq(); // drain anything left after an error
+    if (r == result_ok) r = r2;
+    if (gens) free(gens);
+
+    return r;
+
+}
+
+/**
+ *
+ * Get LBA pairs
+ *
+ * Parses pairs of lba and sector count to the end of the command into a
+ * list.
+ *
+ * \returns Standard discdiag error code.
+ *
+ */
+
+result getpairs(
+    /** Remaining command line */ char **line,
+    /** List to add to */         lbalist *lp
+)
+
+{
+
+    long long lba, num;
+    result r;
+
+    while (**line == ' ') (*line)++; // skip any leading spaces
+    while (**line && **line != ';') {
+
+        r = getparam(line, &lba);
+        if (r != result_ok) return r;
+        while (**line == ' ') (*line)++; // skip any leading spaces
+        if (!**line || **line == ';') {
+
+            printf("*** Error: LBA %lld has no sector count\n", lba);
+
+            return result_error;
+
+        }
+        r = getparam(line, &num);
+        if (r != result_ok) return r;
+        r = lbaadd(lp, lba, num);
+        if (r != result_ok) return r;
+        while (**line == ' ') (*line)++; // skip any leading spaces
+
+    }
+
+    return result_ok;
+
+}
+
+/**
+ *
+ * Batched transfer
+ *
+ * Does the work of rv and wrv, from the pairs on the line, or the LBA list if
+ * there are none.
+ *
+ * \returns Standard discdiag error code.
+ *
+ */
+
+result batch(
+    /** Remaining command line */ char **line,
+    /** Writes, else reads */     int write
+)
+
+{
+
+    lbalist l;
+    result r;
+
+    while (**line == ' ') (*line)++; // skip any leading spaces
+    if (!**line || **line == ';') return xferv(write, &lbalst);
+    l.ent = NULL;
+    l.cnt = 0;
+    l.max = 0;
+    r = getpairs(line, &l);
+    if (r == result_ok) r = xferv(write, &l);
+    lbaclear(&l);
+
+    return r;
+
+}
+
+/**
+ *
+ * Batched read
+ *
+ * Reads a list of transfers, sending as many together as the queue holds. The
+ * command format is:
+ *
+ *    rv [lba num]...
+ *
+ * With no pairs, the LBA list is read. The reads land end to end in the read
+ * buffer, from the start again when the next doesn't fit, so set the queue
+ * depth to the batch wanted, and the buffer to hold it.
+ *
+ * \returns Standard discdiag error code.
+ *
+ */
+
+result command_readv(
+    /** Remaining command line */ char **line
+)
+
+{
+
+    return batch(line, 0);
+
+}
+
+/**
+ *
+ * Batched write
+ *
+ * Writes a list of transfers from the write buffer, the same way rv reads
+ * them. The command format is:
+ *
+ *    wrv [lba num]...
+ *
+ * \returns Standard discdiag error code.
+ *
+ */
+
+result command_writev(
+    /** Remaining command line */ char **line
+)
+
+{
+
+    return batch(line, 1);
+
+}
+
+/**
+ *
+ * LBA list
+ *
+ * Fills the LBA list that rv and wrv use. The command format is:
+ *
+ *    lbalist [clear | add lba num [lba num]... | rand count [num]]
+ *
+ * add puts the pairs on the end of the list. rand puts count transfers of num
+ * sectors, default 1, at LBAs picked as lbarnd does. With no parameter, the
+ * size of the list is printed.
+ *
+ * \returns Standard discdiag error code.
+ *
+ */
+
+result command_lbalist(
+    /** Remaining command line */ char **line
+)
+
+{
+
+    char w[100]; // subcommand
+    long long i, n, num, step, lba;
+    result r;
+
+    w[0] = 0;
+    while (**line == ' ') (*line)++; // skip any leading spaces
+    if (**line && **line != ';') getword(line, w);
+    if (!w[0]) { // print
+
+        n = 0;
+        for (i = 0; i < lbalst.cnt; i++) n += lbalst.ent[i].num;
+        printf("%lld transfers of %lld sectors in the LBA list\n", lbalst.cnt, n);
+
+    } else if (!strcmp(w, "clear")) lbaclear(&lbalst);
+    else if (!strcmp(w, "add")) return getpairs(line, &lbalst);
+    else if (!strcmp(w, "rand")) {
+
+        r = getparam(line, &n);
+        if (r != result_ok) return r;
+        num = 1;
+        while (**line == ' ') (*line)++; // skip any leading spaces
+        if (**line && **line != ';') {
+
+            r = getparam(line, &num);
+            if (r != result_ok) return r;
+
+        }
+        if (currentdrive < 0) {
+
+            printf("*** Error: No current drive is set\n");
+
+            return result_error;
+
+        }
+        if (n < 0 || num < 1 || num > drivesize) {
+
+            printf("*** Error: Invalid count or sector count\n");
+
+            return result_error;
+
+        }
+        step = 1; // random starts go on physical sectors if aligned
+        if (alignlba && physecsize > secsize) step = physecsize/secsize;
+        for (i = 0; i < n; i++) {
+
+            lba = pickstart(0, drivesize, num, num, step);
+            r = lbaadd(&lbalst, lba, num);
+            if (r != result_ok) return r;
+
+        }
+
+    } else {
+
+        printf("*** Error: Invalid lbalist command \"%s\"\n", w);
+
+        return result_error;
+
+    }
+
+    return result_ok;
+
+}
+
+/**
+ *
+ * Maximum number of chunks a verify keeps in flight at once
+ *
+ */
+#define VRMAX 16
+
+/**
+ *
+ * Compare verify chunk
+ *
+ * Compares a chunk read back by verify with what was written. Each sector that
+ * differs is reported by LBA, then its bytes are reported by printcomp with
+ * offsets within the sector.
+ *
+ * \returns Standard discdiag error code.
+ *
+ */
+
+result compchunk(
+    /** Data read back */       unsigned char *rbuf,
+    /** Data written */         unsigned char *wbuf,
+    /** LBA of chunk */         long long lba,
+    /** Sectors in chunk */     long long numsecs,
+    /** Count of bad sectors */ long long *bad
+)
+
+{
+
+    long long s;
+    result r;
+
+    // the whole chunk goes at once, unless it mismatches
+    if (!memcmp(rbuf, wbuf, (size_t)(numsecs*secsize)))
+        return compblk(rbuf, wbuf, 0, 0, 0); // just check break
+    for (s = 0; s < numsecs; s++) {
+
+        if (memcmp(rbuf+s*secsize, wbuf+s*secsize, secsize)) {
+
+            (*bad)++;
+            rptbad(bad_comp, lba+s);
+            if (first || curmode == compmode_all) {
+
+                // finish the last sector's run of mismatches first
+                if (repcnt) {
+
+                    printf("*** Info: There were %d occurrances of the above mismatch\n", repcnt);
+                    repcnt = 0; // reset counter
+
+                }
+                printf("*** Error: Verify miscompare at lba %lld\n", lba+s);
+                dataset = 0; // start new runs in this sector
+
+            }
+            r = compblk(rbuf+s*secsize, wbuf+s*secsize, secsize, 0, 1);
+            if (r != result_ok) return r;
+
+        }
+
+    }
+
+    return result_ok;
+
+}
+
+/**
+ *
+ * Write and verify
+ *
+ * Writes a pattern to a span of sectors, reads it back and compares it. This is
+ * the same as the loop:
+ *
+ *    pt lba lba; w lba bufsiz; r lba bufsiz; c lba lba; s lba lba+bufsiz
+ *
+ * But the span is cut into buffer sized chunks that go through a ring of
+ * buffers on the queue, so the drive writes and reads some chunks while
+ * others are patterned and compared.
+ *
+ * The command format is:
+ *
+ *    verify [lba [num [pat [val]]]]
+ *
+ * The span defaults to lba to the end of the drive. The patterns are the same
+ * as pattn, and default to lba. The lba and sig patterns always mark each
+ * sector with its own LBA, so val is only used with the val pattern. Each
+ * ring buffer starts with the contents of the write buffer, which is the
+ * background for the lba pattern.
+ *
+ * \returns Standard discdiag error code.
+ *
+ */
+
+result command_verify(
+    /** Remaining command line */ char **line
+)
+
+{
+
+    char pat[100]; // pattern name
+    long long lba, num, val, end, next, n, bad, t;
+    unsigned char *wbuf[VRMAX], *rbuf[VRMAX]; // ring buffers
+    long long clba[VRMAX], csecs[VRMAX]; // chunk each buffer holds
+    int avail[VRMAX], navail; // stack of free buffers
+    int pend[VRMAX], npend; // buffers read back and waiting to compare
+    iocmp cmp[QDMAX];
+    unsigned long seeds; // save for random seed
+    int slots, i, k, cn;
+    result r, r2;
+
+    lba = 0; // set defaults
+    num = -1;
+    strcpy(pat, "lba");
+    val = 0;
+    while (**line == ' ') (*line)++; // skip any leading spaces
+    if (**line && **line != ';') { // get lba
+
+        r = getparam(line, &lba);
+        if (r != result_ok) return r;
+        while (**line == ' ') (*line)++; // skip any leading spaces
+        if (**line && **line != ';') { // get number of sectors
+
+            r = getparam(line, &num);
+            if (r != result_ok) return r;
+            while (**line == ' ') (*line)++; // skip any leading spaces
+            if (**line && **line != ';') { // get pattern name
+
+                getword(line, pat);
+                while (**line == ' ') (*line)++; // skip any leading spaces
+                if (**line && **line != ';') { // get value
+
+                    r = getparam(line, &val);
+                    if (r != result_ok) return r;
+
+                }
+
+            }
+
+        }
+
+    }
+    if (currentdrive < 0) {
+
+        printf("*** Error: No current drive is set\n");
+
+        return result_error;
+
+    }
+    if (writeprot) {
+
+        printf("*** Error: Drive is write protected, use unprot command\n");
+        return result_error;
+
+    }
+    if (lba < 0 || lba >= drivesize) {
+
+        printf("*** Error: Invalid lba number, must be < %lld\n", drivesize);
+
+        return result_error;
+
+    }
+    if (num < 0) num = drivesize-lba; // default to end of drive
+    if (num < 1 || lba+num > drivesize) {
+
+        printf("*** Error: Operation will exceed drive size\n");
+
+        return result_error;
+
+    }
+    if (strcmp(pat, "cnt") && strcmp(pat, "dwcnt") && strcmp(pat, "val") &&
+        strcmp(pat, "rand") && strcmp(pat, "lba") && strcmp(pat, "sig")) {
+
+        printf("*** Error: bad pattern name: %s\n", pat);
+
+        return result_error;
+
+    }
+    r = waitq(); // finish queued transfers first
+    if (r != result_ok) return r;
+
+    // make the ring, twice what the queue holds (and never less than 4), so
+    // the next chunks are written while the last ones are compared
+    slots = getqd() < 2 ? 4 : getqd()*2;
+    if (slots > VRMAX) slots = VRMAX;
+    if (slots > (num+bufsecs-1)/bufsecs) slots = (int)((num+bufsecs-1)/bufsecs);
+    seeds = seed; // save the random seed
+    for (navail = 0; navail < slots; navail++) {
+
+        wbuf[navail] = allocbuf(secsize*bufsecs);
+        rbuf[navail] = allocbuf(secsize*bufsecs);
+        if (!wbuf[navail] || !rbuf[navail]) {
+
+            if (wbuf[navail]) freebuf(wbuf[navail], secsize*bufsecs);
+            if (rbuf[navail]) freebuf(rbuf[navail], secsize*bufsecs);
+            while (navail--) {
+
+                freebuf(wbuf[navail], secsize*bufsecs);
+                freebuf(rbuf[navail], secsize*bufsecs);
+
+            }
+            seed = seeds; // restore the random seed
+            printf("*** Error: Cannot allocate space\n");
+
+            return result_error;
+
+        }
+        // patterns other than lba are the same for every chunk, so set once
+        memcpy(wbuf[navail], writebuffer, (size_t)(secsize*bufsecs));
+        if (!strcmp(pat, "cnt")) fillcnt(wbuf[navail], secsize*bufsecs);
+        else if (!strcmp(pat, "dwcnt")) filldwcnt(wbuf[navail], 0, secsize*bufsecs);
+        else if (!strcmp(pat, "val")) fillval(wbuf[navail], val, secsize*bufsecs);
+        else if (!strcmp(pat, "rand")) fillrand(wbuf[navail], secsize*bufsecs);
+        avail[navail] = navail;
+
+    }
+    seed = seeds; // restore the random seed
+    if (!strcmp(pat, "sig")) siggen++; // a new write generation
+
+    first = 1; // set first miscompare
+    dataset = 0; // last data not set
+    repcnt = 0; // clear mismatch count
+    bad = 0;
+    next = lba;
+    end = lba+num;
+    npend = 0;
+    r = result_ok;
+    while (1) {
+
+        chkint(); // sample statistics if the interval is up
+        if (r == result_ok && chkbrk()) {
+
+            if (exiterror) r = result_exit; // exit diagnostic
+            else r = result_stop; // check break
+
+        }
+        // start writing chunks into free buffers while the queue has room
+        while (r == result_ok && next < end && navail && inflight() < getqd()) {
+
+            k = avail[--navail];
+            n = end-next;
+            if (n > bufsecs) n = bufsecs;
+            clba[k] = next;
+            csecs[k] = n;
+            t = gettim();
+            if (!strcmp(pat, "lba")) filllba(wbuf[k], next, n);
+            else if (!strcmp(pat, "sig")) fillsig(wbuf[k], next, n, seeds);
+            patns += gettim()-t;
+            if (devsubmit(1, wbuf[k], next, n, k)) {
+
+                avail[navail++] = k;
+                r = result_error;
+
+            } else next += n;
+
+        }
+        // compare what was read back while those writes are on the drive
+        while (npend) {
+
+            k = pend[--npend];
+            if (r == result_ok) {
+
+                t = gettim();
+                r2 = compchunk(rbuf[k], wbuf[k], clba[k], csecs[k], &bad);
+                compns += gettim()-t;
+                if (r2 != result_ok) r = r2;
+
+            }
+            avail[navail++] = k;
+
+        }
+        if (!inflight()) { // nothing on the drive
+
+            if (r == result_ok && next < end) continue; // buffers came free
+            break; // all done
+
+        }
+        cn = devreap(cmp, 1, QDMAX);
+        if (cn < 0) {
+
+            r = result_error;
+            break;
+
+        }
+        for (i = 0; i < cn; i++) {
+
+            k = cmp[i].tag;
+            if (cmp[i].error) {
+
+                printf("*** Error: %s error at lba %lld\n",
+                       cmp[i].write ? "Write" : "Read", cmp[i].lba);
+                rptbad(cmp[i].write ? bad_write : bad_read, cmp[i].lba);
+                r = result_error;
+                avail[navail++] = k;
+
+            } else if (cmp[i].write && r == result_ok) {
+
+                // written, now read it back into the same slot
+                tallycmp(&cmp[i]);
+                if (mapput(clba[k], csecs[k], strcmp(pat, "sig") ? 0 : siggen) !=
+                    result_ok) r = result_error;
+                else if (devsubmit(0, rbuf[k], clba[k], csecs[k], k)) {
+
+                    avail[navail++] = k;
+                    r = result_error;
+
+                }
+
+            } else {
+
+                tallycmp(&cmp[i]);
+                // compare after the next writes are started
+                if (!cmp[i].write && r == result_ok) pend[npend++] = k;
+                else avail[navail++] = k;
+
+            }
+
+        }
+
+    }
+    r2 = waitq(); // drain anything left after an error
+    if (r == result_ok) r = r2;
+    for (k = 0; k < slots; k++) {
+
+        freebuf(wbuf[k], secsize*bufsecs);
+        freebuf(rbuf[k], secsize*bufsecs);
+
+    }
+    // message if miscompares have accumulated
+    if (repcnt) {
+
+        printf("**** Info: There were %d occurrances of the above mismatch\n", repcnt);
+        repcnt = 0; // reset counter
+
+    }
+    if (bad) {
+
+        printf("*** Error: %lld sector%s miscompared\n", bad, bad > 1 ? "s" : "");
+        if (r == result_ok) r = result_error;
+
+    }
+
+    return r;
+
+}
+
+/**
+ *
+ * Run workload
+ *
+ * Runs a mix of reads and writes over a span of the drive, keeping the queue
+ * full, until a time or a count of transfers is reached. This does the work of
+ * a loop like:
+ *
+ *    s l lbarnd; rq l bs; l 1000
+ *
+ * without running any lines per transfer. The transfers go into the IOPs, byte
+ * and latency statistics, the same as rq and wq.
+ *
+ * The command format is:
+ *
+ *    workload [keyword val]... [rand|seq]
+ *
+ * with the keywords:
+ *
+ *    read pct  - Percent of transfers that are reads, default 100.
+ *    bs num    - Sectors in each transfer, default 1.
+ *    bsmax num - Largest transfer, sizes are picked evenly from bs to bsmax in
+ *                steps of bs, default bs.
+ *    lba num   - First lba of span, default 0.
+ *    num num   - Sectors in span, default lba to the end of the drive.
+ *    qd num    - Queue depth to run at, default the current qd.
+ *    time secs - Seconds to run.
+ *    ios num   - Number of transfers to run.
+ *
+ * Transfers go to random places in the span, or one after another with seq,
+ * starting again at the span start when they get to the end. Random starts
+ * follow the dist setting, and are on physical sectors if align is on.
+ * Without time or ios, it runs as many transfers as fit in the span. Reads go
+ * to the read buffer and writes come from the write buffer, so the write
+ * buffer is set with pattn first.
+ *
+ * With a rate set, each transfer is sent when it is due, as long as the queue
+ * has room, and the queue depth only limits how many can be held up on the
+ * drive at once.
+ *
+ * \returns Standard discdiag error code.
+ *
+ */
+
+result command_workload(
+    /** Remaining command line */ char **line
+)
+
+{
+
+    char word[100]; // keyword
+    long long readpct, bs, bsmax, lba, num, qd, secs, ios;
+    long long next, n, size, start, done, limit, step;
+    int seq, oldqd, i, cn;
+    iocmp cmp[QDMAX];
+    long long t, due, wait;
+    result r, r2;
+
+    readpct = 100; // set defaults
+    bs = 1;
+    bsmax = -1;
+    lba = 0;
+    num = -1;
+    qd = getqd();
+    secs = 0;
+    ios = 0;
+    seq = 0;
+    while (**line == ' ') (*line)++; // skip any leading spaces
+    while (**line && **line != ';') { // get keywords
+
+        getword(line, word);
+        if (!strcmp(word, "rand")) seq = 0;
+        else if (!strcmp(word, "seq")) seq = 1;
+        else if (!strcmp(word, "read") || !strcmp(word, "bs") ||
+                 !strcmp(word, "bsmax") || !strcmp(word, "lba") ||
+                 !strcmp(word, "num") || !strcmp(word, "qd") ||
+                 !strcmp(word, "time") || !strcmp(word, "ios")) {
+
+            r = getparam(line, &n);
+            if (r != result_ok) return r;
+            if (!strcmp(word, "read")) readpct = n;
+            else if (!strcmp(word, "bs")) bs = n;
+            else if (!strcmp(word, "bsmax")) bsmax = n;
+            else if (!strcmp(word, "lba")) lba = n;
+            else if (!strcmp(word, "num")) num = n;
+            else if (!strcmp(word, "qd")) qd = n;
+            else if (!strcmp(word, "time")) secs = n;
+            else ios = n;
+
+        } else {
+
+            printf("*** Error: Invalid workload parameter \"%s\"\n", word);
+
+            return result_error;
+
+        }
+        while (**line == ' ') (*line)++; // skip any leading spaces
+
+    }
+    if (bsmax < 0) bsmax = bs;
+    if (currentdrive < 0) {
+
+        printf("*** Error: No current drive is set\n");
+
+        return result_error;
+
+    }
+    if (readpct < 0 || readpct > 100) {
+
+        printf("*** Error: Read percent must be 0 to 100\n");
+
+        return result_error;
+
+    }
+    if (readpct < 100 && writeprot) {
+
+        printf("*** Error: Drive is write protected, use unprot command\n");
+        return result_error;
+
+    }
+    if (bs < 1 || bsmax < bs || bsmax > bufsecs) {
+
+        printf("*** Error: Transfer size must be 1 to buffer size %lld\n", bufsecs);
+
+        return result_error;
+
+    }
+    if (lba < 0 || lba >= drivesize) {
+
+        printf("*** Error: Invalid lba number, must be < %lld\n", drivesize);
+
+        return result_error;
+
+    }
+    if (num < 0) num = drivesize-lba; // default to end of drive
+    if (num < bsmax || lba+num > drivesize) {
+
+        printf("*** Error: Operation will exceed drive size\n");
+
+        return result_error;
+
+    }
+    if (qd < 1 || qd > QDMAX) {
+
+        printf("*** Error: Queue depth must be 1 to %d\n", QDMAX);
+
+        return result_error;
+
+    }
+    if (secs < 0 || ios < 0) {
+
+        printf("*** Error: Time and count must not be negative\n");
+
+        return result_error;
+
+    }
+    if (!secs && !ios) ios = (num+bs-1)/bs; // default to one pass of the span
+    r = waitq(); // finish queued transfers first
+    if (r != result_ok) return r;
+    oldqd = getqd();
+    if (qd != oldqd && setqd((int) qd)) return result_error;
+
+    step = 1; // random starts go on physical sectors if aligned
+    if (alignlba && physecsize > secsize) step = physecsize/secsize;
+    limit = secs*1000000000LL; // run time in nanoseconds
+    t = gettim();
+    ratenext = 0; // pacing starts now
+    next = lba;
+    done = 0;
+    r = result_ok;
+    while (1) {
+
+        chkint(); // sample statistics if the interval is up
+        if (r == result_ok && chkbrk()) {
+
+            if (exiterror) r = result_exit; // exit diagnostic
+            else r = result_stop; // check break
+
+        }
+        if (r == result_ok && limit && gettim()-t >= limit) break;
+        // send transfers while the queue has room
+        wait = 0;
+        while (r == result_ok && (!ios || done < ios) && inflight() < qd) {
+
+            due = ratedue();
+            if (due > gettim()) { // paced, and not due yet
+
+                wait = due;
+                if (limit && wait > t+limit) wait = t+limit;
+                break;
+
+            }
+            size = bs*(1+rand64()%(bsmax/bs));
+            if (seq) {
+
+                if (next+size > lba+num) next = lba; // wrap to span start
+                start = next;
+                next += size;
+
+            } else {
+
+                start = pickstart(lba, num, size, bs, step);
+
+            }
+            ratetake(size*secsize);
+            setissue(due); // latency counts from when it was due
+            if (rand64()%100 < readpct) {
+
+                if (devsubmit(0, readbuffer, start, size, 0)) r = result_error;
+
+            } else if (devsubmit(1, writebuffer, start, size, 0)) r = result_error;
+            done++;
+
+        }
+        if (wait) cn = pacereap(cmp, wait); // reap until the next is due
+        else if (!inflight()) break; // all done
+        else cn = devreap(cmp, 1, QDMAX);
+        if (cn < 0) {
+
+            r = result_error;
+            break;
+
+        }
+        for (i = 0; i < cn; i++) {
+
+            if (cmp[i].error) {
+
+                printf("*** Error: %s error at lba %lld\n",
+                       cmp[i].write ? "Write" : "Read", cmp[i].lba);
+                rptbad(cmp[i].write ? bad_write : bad_read, cmp[i].lba);
+                r = result_error;
+
+            } else {
+
+                tallycmp(&cmp[i]);
+                // the buffer goes to random places, so no signatures
+                if (cmp[i].write &&
+                    mapput(cmp[i].lba, cmp[i].numsec, 0) != result_ok)
+                    r = result_error;
+
+            }
+
+        }
+
+    }
+    r2 = waitq(); // drain anything left
+    if (r == result_ok) r = r2;
+    if (qd != oldqd && setqd(oldqd) && r == result_ok) r = result_error;
+
+    return r;
+
+}
+
+/**
+ *
+ * Largest trim or zero sent at once, in bytes
+ *
+ * Bigger spans are sent in pieces this size, so a break can stop them between
+ * pieces. Each piece counts as one operation.
+ *
+ */
+#define DISCMAX 0x40000000LL
+
+/**
+ *
+ * Trim or zero sectors
+ *
+ * Sends a span of sectors to the drive to be trimmed or zeroed, a piece at a
+ * time, and tallies each piece. With quiet, a piece that fails is left for
+ * the caller to tell of, and is not counted as a failure.
+ *
+ * \returns Standard discdiag error code.
+ *
+ */
+
+result discsecs(
+    /** Zero, else trim */      int zero,
+    /** LBA to start */         long long lba,
+    /** Number of sectors */    long long numsecs,
+    /** Don't report failure */ int quiet
+)
+
+{
+
+    long long n, t;
+    int e;
+
+    while (numsecs > 0) {
+
+        if (chkbrk()) {
+
+            if (exiterror) return result_exit; // exit diagnostic
+            return result_stop; // check break
+
+        }
+        n = DISCMAX/secsize;
+        if (n > numsecs) n = numsecs;
+        t = gettim();
+        e = zero ? zerosector(lba, n) : trimsector(lba, n);
+        devns += gettim()-t;
+        if (e) {
+
+            if (quiet) return result_error;
+            printf("*** Error: %s error at lba %lld\n", zero ? "Zero" : "Trim", lba);
+            rptbad(bad_trim, lba);
+
+            return result_error;
+
+        }
+        if (zero) {
+
+            iopzero += 1.0; // zero IOPs
+            bczero += n*secsize; // zero bytes
+
+        } else {
+
+            ioptrim += 1.0; // trim IOPs
+            bctrim += n*secsize; // trim bytes
+
+        }
+        // not written any more
+        if (mapput(lba, n, -1) != result_ok) return result_error;
+        lba += n;
+        numsecs -= n;
+
+    }
+
+    return result_ok;
+
+}
+
+/**
+ *
+ * Get trim or zero parameters
+ *
+ * Parses and checks the lba and sector count taken by trim and zero. These are
+ * as for write, but the count is not limited by the buffer size.
+ *
+ * \returns Standard discdiag error code.
+ *
+ */
+
+result getdisc(
+    /** Remaining command line */ char **line,
+    /** Returns lba */            long long *lba,
+    /** Returns sector count */   long long *numsecs
+)
+
+{
+
+    result r;
+
+    *lba = 0; // set defaults
+    *numsecs = 1;
+    while (**line == ' ') (*line)++; // skip any leading spaces
+    if (**line && **line != ';') { // get lba
+
+        r = getparam(line, lba);
+        if (r != result_ok) return r;
+        while (**line == ' ') (*line)++; // skip any leading spaces
+        if (**line && **line != ';') { // get number of sectors
+
+            r = getparam(line, numsecs);
+            if (r != result_ok) return r;
+
+        }
+
+    }
+    if (currentdrive < 0) {
+
+        printf("*** Error: No current drive is set\n");
+
+        return result_error;
+
+    }
+    if (writeprot) {
+
+        printf("*** Error: Drive is write protected, use unprot command\n");
+        return result_error;
+
+    }
+    if (*lba < 0 || *lba >= drivesize) {
+
+        printf("*** Error: Invalid lba number, must be < %lld\n", drivesize);
+
+        return result_error;
+
+    }
+    if (*numsecs < 1 || *lba+*numsecs > drivesize) {
+
+        printf("*** Error: Operation will exceed drive size\n");
+
+        return result_error;
+
+    }
+
+    return waitq(); // finish queued transfers first
+
+}
+
+/**
+ *
+ * Trim sectors
+ *
+ * Tells the drive a span of sectors is no longer used. The command format is:
+ *
+ *    trim [lba [num]]
+ *
+ * The defaults are lba 0 and 1 sector. What trimmed sectors read back as is up
+ * to the drive.
+ *
+ * \returns Standard discdiag error code.
+ *
+ */
+
+result command_trim(
+    /** Remaining command line */ char **line
+)
+
+{
+
+    long long lba, numsecs;
+    result r;
+
+    r = getdisc(line, &lba, &numsecs);
+    if (r != result_ok) return r;
+
+    return discsecs(0, lba, numsecs, 0);
+
+}
+
+/**
+ *
+ * Zero sectors
+ *
+ * Has the drive set a span of sectors to zero, without sending the data where
+ * the drive can do that itself. The command format is:
+ *
+ *    zero [lba [num]]
+ *
+ * The defaults are lba 0 and 1 sector.
+ *
+ * \returns Standard discdiag error code.
+ *
+ */
+
+result command_zero(
+    /** Remaining command line */ char **line
+)
+
+{
+
+    long long lba, numsecs;
+    result r;
+
+    r = getdisc(line, &lba, &numsecs);
+    if (r != result_ok) return r;
+
+    return discsecs(1, lba, numsecs, 0);
+
+}
+
+/**
+ *
+ * Precondition drive
+ *
+ * Puts a drive into the state it will settle into in use, before it is
+ * measured. A new or just trimmed SSD has free blocks to spare and runs much
+ * faster than it will once every block has been written. This trims the whole
+ * drive, then writes it end to end from the write buffer, a buffer at a time,
+ * at the deepest queue the system allows. The command format is:
+ *
+ *    precondition [passes]
+ *
+ * Each pass writes the drive once, default 1. Two passes are usual. Drives that
+ * compress need a write buffer that doesn't, so set it with "pt rand" first.
+ * Drives and image files that can't be trimmed are just filled, with a warning.
+ *
+ * \returns Standard discdiag error code.
+ *
+ */
+
+result command_precondition(
+    /** Remaining command line */ char **line
+)
+
+{
+
+    long long passes, next;
+    long long n;
+    int oldqd, i, cn;
+    iocmp cmp[QDMAX];
+    result r, r2;
+
+    passes = 1;
+    while (**line == ' ') (*line)++; // skip any leading spaces
+    if (**line && **line != ';') { // get passes
+
+        r = getparam(line, &passes);
+        if (r != result_ok) return r;
+
+    }
+    if (currentdrive < 0) {
+
+        printf("*** Error: No current drive is set\n");
+
+        return result_error;
+
+    }
+    if (writeprot) {
+
+        printf("*** Error: Drive is write protected, use unprot command\n");
+        return result_error;
+
+    }
+    if (passes < 1) {
+
+        printf("*** Error: Passes must be at least 1\n");
+
+        return result_error;
+
+    }
+    r = waitq(); // finish queued transfers first
+    if (r != result_ok) return r;
+    r = discsecs(0, 0, drivesize, 1); // trim it all, if it can be
+    if (r == result_error) { // the fill is what counts, go on without
+
+        printf("*** Warning: Drive could not be trimmed, filling it anyway\n");
+        r = result_ok;
+
+    } else if (r != result_ok) return r;
+    oldqd = getqd();
+    if (oldqd != QDMAX && setqd(QDMAX)) return result_error;
+
+    next = 0;
+    while (1) {
+
+        chkint(); // sample statistics if the interval is up
+        if (r == result_ok && chkbrk()) {
+
+            if (exiterror) r = result_exit; // exit diagnostic
+            else r = result_stop; // check break
+
+        }
+        // fill the queue with the next buffers of the drive
+        while (r == result_ok && passes && inflight() < QDMAX) {
+
+            n = drivesize-next;
+            if (n > bufsecs) n = bufsecs;
+            if (devsubmit(1, writebuffer, next, n, 0)) r = result_error;
+            next += n;
+            if (next >= drivesize) { // end of a pass
+
+                next = 0;
+                passes--;
+
+            }
+
+        }
+        if (!inflight()) break; // all done
+        cn = devreap(cmp, 1, QDMAX);
+        if (cn < 0) {
+
+            r = result_error;
+            break;
+
+        }
+        for (i = 0; i < cn; i++) {
+
+            if (cmp[i].error) {
+
+                printf("*** Error: Write error at lba %lld\n", cmp[i].lba);
+                rptbad(bad_write, cmp[i].lba);
+                r = result_error;
+
+            } else {
+
+                tallycmp(&cmp[i]);
+                if (mapput(cmp[i].lba, cmp[i].numsec, 0) != result_ok)
+                    r = result_error;
+
+            }
+
+        }
+
+    }
+    r2 = waitq(); // drain anything left
+    if (r == result_ok) r = r2;
+    if (oldqd != QDMAX && setqd(oldqd) && r == result_ok) r = result_error;
+
+    return r;
+
+}
+
+/**
+ *
+ * Verify all written
+ *
+ * Reads back everything in the written map, and checks the signature of
+ * each sector written with the sig pattern, as csig does, failing sectors
+ * from before the generation written. Extents that touch are read together,
+ * a buffer at a time, through a ring of buffers on the queue, so the drive is
+ * read as fast as it will go, and only where it was written. Sectors written
+ * with other patterns are read, but can't be checked. The command format is:
+ *
+ *    verifyall
+ *
+ * Failures go by the compare mode.
+ *
+ * \returns Standard discdiag error code.
+ *
+ */
+
+result command_verifyall(
+    /** Remaining command line */ char **line
+)
+
+{
+
+    unsigned char *rbuf[VRMAX]; // ring buffers
+    long long clba[VRMAX], csecs[VRMAX]; // chunk each buffer holds
+    extent *cext[VRMAX]; // and the extent it starts in
+    int avail[VRMAX], navail; // stack of free buffers
+    iocmp cmp[QDMAX];
+    extent *e, *f, *x;
+    long long next, end, n, v, sl, bad, unchk, total, t;
+    int slots, i, k, cn, why;
+    result r, r2;
+
+    if (currentdrive < 0) {
+
+        printf("*** Error: No current drive is set\n");
+
+        return result_error;
+
+    }
+    if (mapoff) {
+
+        printf("**** Info: The written map is off\n");
+
+        return result_ok;
+
+    }
+    if (!extcnt) {
+
+        printf("**** Info: Nothing has been written\n");
+
+        return result_ok;
+
+    }
+    r = waitq(); // finish queued transfers first
+    if (r != result_ok) return r;
+
+    // make the ring, as many buffers as the queue holds
+    slots = getqd();
+    if (slots > VRMAX) slots = VRMAX;
+    for (navail = 0; navail < slots; navail++) {
+
+        rbuf[navail] = allocbuf(secsize*bufsecs);
+        if (!rbuf[navail]) {
+
+            while (navail--) freebuf(rbuf[navail], secsize*bufsecs);
+            printf("*** Error: Cannot allocate space\n");
+
+            return result_error;
+
+        }
+        avail[navail] = navail;
+
+    }
+
+    bad = 0;
+    unchk = 0;
+    total = 0;
+    e = mapfind(0); // extent the next read starts in
+    next = e->lba;
+    while (1) {
+
+        chkint(); // sample statistics if the interval is up
+        if (r == result_ok && chkbrk()) {
+
+            if (exiterror) r = result_exit; // exit diagnostic
+            else r = result_stop; // check break
+
+        }
+        // read the next buffer of written sectors while the queue has room
+        while (r == result_ok && e && navail && inflight() < getqd()) {
+
+            // run on through the extents that touch, up to a buffer
+            end = e->lba+e->num;
+            for (f = mapnext(e); f && f->lba == end && end-next < bufsecs; f = mapnext(f))
+                end += f->num;
+            n = end-next;
+            if (n > bufsecs) n = bufsecs;
+            k = avail[--navail];
+            clba[k] = next;
+            csecs[k] = n;
+            cext[k] = e;
+            if (devsubmit(0, rbuf[k], next, n, k)) {
+
+                avail[navail++] = k;
+                r = result_error;
+                break;
+
+            }
+            next += n;
+            while (e && e->lba+e->num <= next) e = mapnext(e);
+            if (e && next < e->lba) next = e->lba;
+
+        }
+        if (!inflight()) break; // all done
+        cn = devreap(cmp, 1, QDMAX);
+        if (cn < 0) {
+
+            r = result_error;
+            break;
+
+        }
+        for (i = 0; i < cn; i++) {
+
+            k = cmp[i].tag;
+            if (cmp[i].error) {
+
+                printf("*** Error: Read error at lba %lld\n", cmp[i].lba);
+                rptbad(bad_read, cmp[i].lba);
+                r = result_error;
+
+            } else {
+
+                tallycmp(&cmp[i]);
+                t = gettim();
+                x = cext[k];
+                for (sl = 0; sl < csecs[k] && r == result_ok; sl++) {
+
+                    // find the extent each sector is in
+                    while (x->lba+x->num <= clba[k]+sl) x = mapnext(x);
+                    total++;
+                    if (!x->gen) {
+
+                        unchk++; // no signature to check
+                        continue;
+
+                    }
+                    why = chksig(rbuf[k]+sl*secsize, clba[k]+sl, x->gen, &v);
+                    if (!why) continue;
+                    bad++;
+                    rptbad(bad_comp, clba[k]+sl);
+                    if (bad == 1 || curmode == compmode_all)
+                        prtsig(why, clba[k]+sl, v, x->gen);
+                    if (curmode == compmode_fail) r = result_error;
+
+                }
+                compns += gettim()-t;
+
+            }
+            avail[navail++] = k;
+
+        }
+
+    }
+    r2 = waitq(); // drain anything left after an error
+    if (r == result_ok) r = r2;
+    for (k = 0; k < slots; k++) freebuf(rbuf[k], secsize*bufsecs);
+    printf("**** Info: Read %lld sectors in %lld extents\n", total, extcnt);
+    if (unchk)
+        printf("**** Info: %lld sectors were written without signatures, not checked\n",
+               unchk);
+    if (bad) {
+
+        printf("*** Error: %lld sector%s failed signature check\n", bad,
+               bad > 1 ? "s" : "");
+        if (r == result_ok) r = result_error;
+
+    }
+
+    return r;
+
+}
+
+/**
+ *
+ * Wait for queued transfers
+ *
+ * Waits until all queued reads and writes have finished.
+ *
+ * \returns Standard discdiag error code.
+ * 
+ */
+
+result command_qwait(
+    /** Remaining command line */ char **line
+)
+
+{
+
+    return waitq(); // drain the queue
+
+}
+
+/**
+ *
+ * Set direct access
+ *
+ * Turns direct access to the drive, bypassing the operating system cache, on
+ * or off. With no parameter, prints the current mode.
+ *
+ * \returns Standard discdiag error code.
+ * 
+ */
+
+result command_direct(
+    /** Remaining command line */ char **line
+)
+
+{
+
+    char w[100]; // word buffer
+    int on;
+    result r;
+
+    getword(line, w); // get mode
+    if (!strcmp(w, "on")) on = 1;
+    else if (!strcmp(w, "off")) on = 0;
+    else if (!*w) {
+
+        printf("Direct mode is: %s\n", getdirect() ? "on" : "off");
+
+        return result_ok;
+
+    } else {
+
+        printf("*** Error: mode not recognized\n");
+
+        return result_error;
+
+    }
+    r = waitq(); // drive may be reopened, finish queued transfers
+    if (r != result_ok) return r;
+    if (setdirect(on)) return result_error;
+
+    return result_ok;
+
+}
+
+/**
+ *
+ * Set buffer size
+ *
+ * Reallocates both the read and write buffers to the given number of sectors.
+ * As much of the old contents as fits is kept. With no parameter, prints the
+ * current size. The largest size is MAXSECS sectors of SECSIZE bytes, so it is
+ * less on drives with bigger sectors.
+ *
+ * \returns Standard discdiag error code.
+ * 
+ */
+
+result command_bufsize(
+    /** Remaining command line */ char **line
+)
+
+{
+
+    long long v, m;
+    result r;
+
+    while (**line == ' ') (*line)++; // skip any leading spaces
+    if (**line && **line != ';') { // get size
+
+        r = getparam(line, &v);
+        if (r != result_ok) return r;
+        m = (long long) MAXSECS*SECSIZE/secsize; // most that fits
+        if (v < 1 || v > m) {
+
+            printf("*** Error: Invalid buffer size, must be 1 to %lld\n", m);
+
+            return result_error;
+
+        }
+        r = waitq(); // queued transfers may still be using the buffers
+        if (r != result_ok) return r;
+        r = setbufs(v, secsize);
+        if (r != result_ok) return r;
+
+    } else printf("Buffer size is: %lld sectors\n", bufsecs);
+
+    return result_ok;
+
+}
+
+/**
+ *
+ * Get buffer slot
+ *
+ * Checks a slot number, and allocates its buffer if it is not in the pool yet.
+ * A new buffer starts out zeroed.
+ *
+ * \returns Standard discdiag error code.
+ *
+ */
+
+result getslot(
+    /** Slot number */ long long n
+)
+
+{
+
+    if (n < 0 || n >= BUFSLOTS) {
+
+        printf("*** Error: Invalid buffer slot, must be 0 to %d\n", BUFSLOTS-1);
+
+        return result_error;
+
+    }
+    if (!bufpool[n]) {
+
+        bufpool[n] = allocbuf(secsize*bufsecs);
+        if (!bufpool[n]) {
+
+            printf("*** Error: Cannot allocate space\n");
+
+            return result_error;
+
+        }
+        memset(bufpool[n], 0, (size_t) (secsize*bufsecs));
+        slotsig[n] = 0;
+
+    }
+
+    return result_ok;
+
+}
+
+/**
+ *
+ * Select buffer slots
+ *
+ * Points writes, reads or both at slots of the buffer pool. The command format
+ * is:
+ *
+ *    bufsel [w slot] [r slot]
+ *
+ * Either can be given, in any order. The read and write buffers must end up in
+ * different slots, since queued reads could otherwise land under writes. With
+ * no parameter, prints the current slots.
+ *
+ * \returns Standard discdiag error code.
+ *
+ */
+
+result command_bufsel(
+    /** Remaining command line */ char **line
+)
+
+{
+
+    char w[100]; // word buffer
+    long long v;
+    int ws, rs;
+    result r;
+
+    ws = wrslot;
+    rs = rdslot;
+    while (**line == ' ') (*line)++; // skip any leading spaces
+    if (!**line || **line == ';') {
+
+        printf("Buffer slots are: write %d, read %d\n", wrslot, rdslot);
+
+        return result_ok;
+
+    }
+    while (**line && **line != ';') {
+
+        getword(line, w); // get role
+        if (strcmp(w, "w") && strcmp(w, "r")) {
+
+            printf("*** Error: Buffer role must be w or r\n");
+
+            return result_error;
+
+        }
+        r = getparam(line, &v);
+        if (r != result_ok) return r;
+        r = getslot(v);
+        if (r != result_ok) return r;
+        if (!strcmp(w, "w")) ws = (int) v; else rs = (int) v;
+        while (**line == ' ') (*line)++; // skip any leading spaces
+
+    }
+    if (ws == rs) {
+
+        printf("*** Error: Read and write buffers must be different slots\n");
+
+        return result_error;
+
+    }
+    r = waitq(); // queued transfers may still be using the buffers
+    if (r != result_ok) return r;
+    selbufs(ws, rs);
+
+    return result_ok;
+
+}
+
+/**
+ *
+ * Swap read and write buffers
+ *
+ * Trades the read and write slots, so what was just read is what the next
+ * write sends, and can be patched first. Nothing is copied.
+ *
+ * \returns Standard discdiag error code.
+ *
+ */
+
+result command_swap(
+    /** Remaining command line */ char **line
+)
+
+{
+
+    result r;
+
+    r = waitq(); // queued transfers may still be using the buffers
+    if (r != result_ok) return r;
+    selbufs(rdslot, wrslot);
+
+    return result_ok;
+
+}
+
+/**
+ *
+ * Copy between buffers
+ *
+ * Copies a run of sectors from one slot of the buffer pool to the same place
+ * in another. The command format is:
+ *
+ *    bufcopy [off [num [src [dst]]]]
+ *
+ * The run starts at sector off of the buffer, default 0, and is num sectors
+ * long, default to the end of the buffer. The slots default to the read buffer
+ * for src and the write buffer for dst. A copy of the whole buffer takes the
+ * source's signature with it, and a part of one only leaves the destination
+ * signed if the source had the same signature.
+ *
+ * \returns Standard discdiag error code.
+ *
+ */
+
+result command_bufcopy(
+    /** Remaining command line */ char **line
+)
+
+{
+
+    long long off, num, src, dst;
+    result r;
+
+    off = 0; // set defaults
+    num = -1;
+    src = rdslot;
+    dst = wrslot;
+    while (**line == ' ') (*line)++; // skip any leading spaces
+    if (**line && **line != ';') { // get offset
+
+        r = getparam(line, &off);
+        if (r != result_ok) return r;
+        while (**line == ' ') (*line)++; // skip any leading spaces
+        if (**line && **line != ';') { // get number of sectors
+
+            r = getparam(line, &num);
+            if (r != result_ok) return r;
+            while (**line == ' ') (*line)++; // skip any leading spaces
+            if (**line && **line != ';') { // get source slot
+
+                r = getparam(line, &src);
+                if (r != result_ok) return r;
+                while (**line == ' ') (*line)++; // skip any leading spaces
+                if (**line && **line != ';') { // get destination slot
+
+                    r = getparam(line, &dst);
+                    if (r != result_ok) return r;
+
+                }
+
+            }
+
+        }
+
+    }
+    if (off < 0 || off >= bufsecs) {
+
+        printf("*** Error: Invalid sector offset, must be < %lld\n", bufsecs);
+
+        return result_error;
+
+    }
+    if (num < 0) num = bufsecs-off; // default to end of buffer
+    if (off+num > bufsecs) {
+
+        printf("*** Error: Invalid sector count, must be <= %lld\n", bufsecs-off);
+
+        return result_error;
+
+    }
+    r = getslot(src);
+    if (r != result_ok) return r;
+    r = getslot(dst);
+    if (r != result_ok) return r;
+    r = waitq(); // queued transfers may still be using the buffers
+    if (r != result_ok) return r;
+    if (src == dst) return result_ok; // already there
+    memcpy(bufpool[dst]+off*secsize, bufpool[src]+off*secsize,
+           (size_t) (num*secsize));
+    // bring the write buffer's signature up to date, then mark the destination
+    slotsig[wrslot] = sigbuf;
+    slotsiglba[wrslot] = siglba;
+    if (num == bufsecs) { // all of it, so it is signed as the source is
+
+        slotsig[dst] = slotsig[src];
+        slotsiglba[dst] = slotsiglba[src];
+
+    } else if (slotsig[dst] != slotsig[src] || slotsiglba[dst] != slotsiglba[src])
+        slotsig[dst] = 0;
+    sigbuf = slotsig[wrslot];
+    siglba = slotsiglba[wrslot];
+
+    return result_ok;
+
+}
+
+/**
+ *
+ * Set LBA alignment
+ *
+ * With align on, random LBAs from lbarnd start on a physical sector. With no
+ * parameter, prints the current mode and the sector sizes.
+ *
+ * \returns Standard discdiag error code.
+ * 
+ */
+
+result command_align(
+    /** Remaining command line */ char **line
+)
+
+{
+
+    char w[100]; // word buffer
+
+    getword(line, w); // get mode
+    if (!strcmp(w, "on")) alignlba = 1;
+    else if (!strcmp(w, "off")) alignlba = 0;
+    else if (!*w) printf("Align mode is: %s, sector size: %d, physical: %d\n",
+                         alignlba ? "on" : "off", secsize, physecsize);
+    else {
+
+        printf("*** Error: mode not recognized\n");
+
+        return result_error;
+
+    }
+
+    return result_ok;
+
+}
+
+/**
+ *
+ * Set LBA distribution
+ *
+ * Sets how lbarnd and random workloads pick LBAs. The command format is:
+ *
+ *    dist [uniform | zipf theta | hotspot iopct spanpct | normal centre dev]
+ *
+ * zipf picks LBA 0 most, and each LBA after less, by theta, which is a decimal
+ * fraction like 0.99. hotspot sends iopct percent of the I/O to the first
+ * spanpct percent of the span, and the rest evenly over the rest. normal picks
+ * around centre, with a deviation of dev, both in percent of the span. With no
+ * parameter, prints the current distribution.
+ *
+ * \returns Standard discdiag error code.
+ * 
+ */
+
+result command_dist(
+    /** Remaining command line */ char **line
+)
+
+{
+
+    char w[100]; // word buffer
+    char *e;
+    long long a, b;
+    double t;
+    result r;
+
+    getword(line, w); // get kind
+    if (!strcmp(w, "uniform")) curdist.kind = dist_uniform;
+    else if (!strcmp(w, "zipf")) {
+
+        getword(line, w); // get theta
+        t = strtod(w, &e);
+        if (!*w || *e || t <= 0.0 || t >= 1.0) {
+
+            printf("*** Error: Zipf theta must be between 0 and 1\n");
+
+            return result_error;
+
+        }
+        curdist.kind = dist_zipf;
+        curdist.theta = t;
+
+    } else if (!strcmp(w, "hotspot") || !strcmp(w, "normal")) {
+
+        r = getparam(line, &a);
+        if (r != result_ok) return r;
+        r = getparam(line, &b);
+        if (r != result_ok) return r;
+        if (!strcmp(w, "hotspot")) {
+
+            if (a < 0 || a > 100 || b < 1 || b > 100) {
+
+                printf("*** Error: Hotspot I/O must be 0 to 100 percent, span 1 to 100 percent\n");
+
+                return result_error;
+
+            }
+            curdist.kind = dist_hotspot;
+            curdist.hotio = a;
+            curdist.hotspan = b;
+
+        } else {
+
+            if (a < 0 || a > 100 || b < 1) {
+
+                printf("*** Error: Normal centre must be 0 to 100 percent, deviation at least 1\n");
+
+                return result_error;
+
+            }
+            curdist.kind = dist_normal;
+            curdist.centre = a;
+            curdist.dev = b;
+
+        }
+
+    } else if (!*w) {
+
+        printf("LBA distribution is: ");
+        switch (curdist.kind) {
+
+            case dist_zipf: printf("zipf %g\n", curdist.theta); break;
+            case dist_hotspot:
+                printf("hotspot %lld%% of I/O to %lld%% of span\n",
+                       curdist.hotio, curdist.hotspan);
+                break;
+            case dist_normal:
+                printf("normal centre %lld%% deviation %lld%% of span\n",
+                       curdist.centre, curdist.dev);
+                break;
+            default: printf("uniform\n"); break;
+
+        }
+
+    } else {
+
+        printf("*** Error: distribution not recognized\n");
+
+        return result_error;
+
+    }
+
+    return result_ok;
+
+}
+
+/**
+ *
+ * Set CPU affinity
+ *
+ * Pins this thread to a CPU, or with off, lets it run anywhere, or on its NUMA
+ * node if one is set. Workers spawned after take the setting with them. With
+ * no parameter, prints the current CPU.
+ *
+ * \returns Standard discdiag error code.
+ * 
+ */
+
+result command_affinity(
+    /** Remaining command line */ char **line
+)
+
+{
+
+    char w[100]; // word buffer
+    char *l;
+    long long v;
+    int o;
+    result r;
+
+    while (**line == ' ') (*line)++; // skip any leading spaces
+    if (!**line || **line == ';') {
+
+        if (cpupin < 0) printf("CPU affinity is: off\n");
+        else printf("CPU affinity is: %d\n", cpupin);
+
+        return result_ok;
+
+    }
+    l = *line;
+    getword(line, w);
+    if (!strcmp(w, "off")) v = -1;
+    else {
+
+        *line = l; // not a word, so a CPU number
+        r = getparam(line, &v);
+        if (r != result_ok) return r;
+        if (v < 0 || v > 0x7fffffffLL) {
+
+            printf("*** Error: Invalid CPU number\n");
+
+            return result_error;
+
+        }
+
+    }
+    o = cpupin;
+    cpupin = (int) v;
+    r = placethread(1);
+    if (r != result_ok) cpupin = o; // not taken, keep the old one
+
+    return r;
+
+}
+
+/**
+ *
+ * Set NUMA node
+ *
+ * Runs this thread on the CPUs of a NUMA node, and takes its buffers from the
+ * node's memory. With auto, the node is the one the current drive is attached
+ * to, and follows the drive when it changes. With off, memory comes from
+ * anywhere. A CPU set by affinity is kept. Workers spawned after take the
+ * setting with them. With no parameter, prints the current node.
+ *
+ * \returns Standard discdiag error code.
+ * 
+ */
+
+result command_numa(
+    /** Remaining command line */ char **line
+)
+
+{
+
+    char w[100]; // word buffer
+    char *l;
+    long long v;
+    int o;
+    result r;
+
+    while (**line == ' ') (*line)++; // skip any leading spaces
+    if (!**line || **line == ';') {
+
+        if (numaset == NUMAAUTO) {
+
+            if (curnode < 0) printf("NUMA node is: auto, drive node not known\n");
+            else printf("NUMA node is: auto, drive is on node %d\n", curnode);
+
+        } else if (numaset < 0) printf("NUMA node is: off\n");
+        else printf("NUMA node is: %d\n", numaset);
+
+        return result_ok;
+
+    }
+    l = *line;
+    getword(line, w);
+    if (!strcmp(w, "off")) v = -1;
+    else if (!strcmp(w, "auto")) v = NUMAAUTO;
+    else {
+
+        *line = l; // not a word, so a node number
+        r = getparam(line, &v);
+        if (r != result_ok) return r;
+        if (v < 0 || v > 0x7fffffffLL) {
+
+            printf("*** Error: Invalid NUMA node number\n");
+
+            return result_error;
+
+        }
+
+    }
+    o = numaset;
+    numaset = (int) v;
+    r = placethread(1);
+    if (r != result_ok) numaset = o; // not taken, keep the old one
+    else if (numaset == NUMAAUTO && currentdrive >= 0 && curnode < 0)
+        printf("*** Warning: NUMA node of drive is not known\n");
+
+    return r;
+
+}
+
+/**
+ *
+ * Set transfer rate
+ *
+ * Sets the rate reads and writes are paced to, as:
+ *
+ * rate num [iops|mbps]
+ *
+ * in transfers a second (the default), or megabytes of 1048576 bytes a second,
+ * or turns pacing off with rate off. Workers spawned after take the rate with
+ * them. With no parameter, prints the current rate.
+ *
+ * \returns Standard discdiag error code.
+ * 
+ */
+
+result command_rate(
+    /** Remaining command line */ char **line
+)
+
+{
+
+    char w[100]; // word buffer
+    char *l;
+    long long v;
+    result r;
+
+    while (**line == ' ') (*line)++; // skip any leading spaces
+    if (!**line || **line == ';') {
+
+        if (rateiops) printf("Rate is: %lld iops\n", rateiops);
+        else if (ratebps) printf("Rate is: %lld MB/s\n", ratebps/1048576);
+        else printf("Rate is: off\n");
+
+        return result_ok;
+
+    }
+    l = *line;
+    getword(line, w);
+    if (!strcmp(w, "off")) {
+
+        rateiops = ratebps = 0;
+
+        return result_ok;
+
+    }
+    *line = l; // not a word, so a rate
+    r = getparam(line, &v);
+    if (r != result_ok) return r;
+    strcpy(w, "iops");
+    while (**line == ' ') (*line)++; // skip any leading spaces
+    if (**line && **line != ';') getword(line, w);
+    if (strcmp(w, "iops") && strcmp(w, "mbps")) {
+
+        printf("*** Error: Rate must be in iops or mbps\n");
+
+        return result_error;
+
+    }
+    if (v < 1 || v > 1000000000LL) {
+
+        printf("*** Error: Rate must be 1 to 1000000000\n");
+
+        return result_error;
+
+    }
+    if (!strcmp(w, "iops")) {
+
+        rateiops = v;
+        ratebps = 0;
+
+    } else {
+
+        rateiops = 0;
+        ratebps = v*1048576;
+
+    }
+    ratenext = 0; // start pacing again
+
+    return result_ok;
+
+}
+
+/**
+ *
+ * Set run time limit
+ *
+ * Sets a limit on how long the run goes on, as:
+ *
+ * runfor secs
+ *
+ * from now. When it is up, whatever is running stops as if a break was hit,
+ * and the limit is gone. runfor off takes the limit away. Workers spawned
+ * after take the limit with them, and stop on their own when it is up. With
+ * no parameter, prints the time left.
+ *
+ * \returns Standard discdiag error code.
+ * 
+ */
+
+result command_runfor(
+    /** Remaining command line */ char **line
+)
+
+{
+
+    char w[100]; // word buffer
+    char *l;
+    long long v;
+    result r;
+
+    while (**line == ' ') (*line)++; // skip any leading spaces
+    if (!**line || **line == ';') {
+
+        if (deadline) printf("Run time left is: %.2fs\n", -elapsed(deadline));
+        else printf("Run time limit is: off\n");
+
+        return result_ok;
+
+    }
+    l = *line;
+    getword(line, w);
+    if (!strcmp(w, "off")) {
+
+        deadline = 0;
+
+        return result_ok;
+
+    }
+    *line = l; // not a word, so a time
+    r = getparam(line, &v);
+    if (r != result_ok) return r;
+    if (v < 1 || v > 1000000000LL) {
+
+        printf("*** Error: Run time must be 1 to 1000000000 seconds\n");
+
+        return result_error;
+
+    }
+    deadline = gettim()+v*1000000000LL;
+
+    return result_ok;
+
+}
+
+/**
+ *
+ * Spawn worker
+ *
+ * Starts a worker thread that runs the given procedure on the given drive:
+ *
+ * spawn label drive [parameters]
+ *
+ * Parameters for the procedure are found here, before the worker starts. The
+ * worker gets its own copy of the buffers, so it starts with the current
+ * pattern, and the drive is write protected for it until it does unprot.
+ *
+ * \returns Standard discdiag error code.
+ *
+ */
+
+result command_spawn(
+    /** Remaining command line */ char **line
+)
+
+{
+
+    char w[100];
+    linestr *fp;
+    uservar *pp;
+    worker *wp;
+    long long v;
+    int n;
     result r;
-    long long drivesize;
-    
 
-    r = variable_drvsiz(&dummystr, &drivesize);
-    if (r == result_ok)
-        *ll = rand64() % drivesize;
+    if (workerno) {
 
-    return r;
+        printf("*** Error: Workers cannot spawn workers\n");
+        return result_error;
+
+    }
+    getword(line, w); // get procedure name
+    fp = fndpgm(w);
+    if (!fp) {
+
+        printf("*** Error: Procedure \"%s\" not found\n", w);
+        return result_error;
+
+    }
+    r = getparam(line, &v); // get drive number
+    if (r != result_ok) return r;
+    if (v < 0 || v >= MAXDRIVES || !getdrvstr((int) v)) {
+
+        printf("*** Error: Invalid drive number\n");
+        return result_error;
+
+    }
+    if (nworkers >= MAXWORKERS) {
+
+        printf("*** Error: No more than %d workers can run\n", MAXWORKERS);
+        return result_error;
+
+    }
+    wp = &workers[nworkers];
+    // find the procedure parameters here, while they are ours to parse
+    n = 0;
+    for (pp = fp->params; pp; pp = pp->next) n++;
+    wp->params = (long long *) malloc(sizeof(long long)*(n+1));
+    if (!wp->params) {
+
+        printf("*** Error: Cannot allocate space\n");
+        return result_error;
+
+    }
+    n = 0;
+    for (pp = fp->params; pp; pp = pp->next) {
+
+        r = getparam(line, &wp->params[n++]);
+        if (r != result_ok) { free(wp->params); return r; }
+
+    }
+    // give the worker its own copy of the buffers
+    wp->wbuf = allocbuf(secsize*bufsecs);
+    wp->rbuf = allocbuf(secsize*bufsecs);
+    if (!wp->wbuf || !wp->rbuf) {
+
+        printf("*** Error: Cannot allocate space\n");
+        if (wp->wbuf) freebuf(wp->wbuf, secsize*bufsecs);
+        if (wp->rbuf) freebuf(wp->rbuf, secsize*bufsecs);
+        free(wp->params);
+
+        return result_error;
+
+    }
+    memcpy(wp->wbuf, writebuffer, secsize*bufsecs);
+    memcpy(wp->rbuf, readbuffer, secsize*bufsecs);
+    wp->bufsecs = bufsecs;
+    wp->sigbuf = sigbuf;
+    wp->siglba = siglba;
+    wp->secsize = secsize;
+    wp->alignlba = alignlba;
+    wp->dist = curdist;
+    wp->proc = fp;
+    wp->drive = (int) v;
+    wp->mode = curmode;
+    wp->direct = getdirect();
+    wp->cpupin = cpupin;
+    wp->numaset = numaset;
+    wp->rateiops = rateiops;
+    wp->ratebps = ratebps;
+    wp->deadline = deadline;
+    wp->r = result_ok;
+    wp->time = 0.0;
+    wp->iopwrite = 0.0;
+    wp->iopread = 0.0;
+    wp->bcwrite = 0.0;
+    wp->bcread = 0.0;
+    wp->ioptrim = wp->iopzero = wp->bctrim = wp->bczero = 0.0;
+    wp->devtime = wp->pattime = wp->comptime = wp->idletime = 0;
+    if (newthread(nworkers, runworker, wp)) {
+
+        freebuf(wp->wbuf, secsize*bufsecs);
+        freebuf(wp->rbuf, secsize*bufsecs);
+        free(wp->params);
+
+        return result_error;
+
+    }
+    nworkers++; // count it running
+
+    return result_ok;
 
 }
 
 /**
  *
- * Sector size
+ * Join workers
  *
- * Returns the sector size. This is pretty much set at 512 since the dawn of
- * fire.
+ * Waits for all of the spawned workers to finish, then prints the statistics
+ * for each drive they ran on, and for all the drives together. The time for a
+ * drive is the time of its longest running worker, so the rates are for the
+ * workers on it taken together.
  *
  * \returns Standard discdiag error code.
- * 
+ *
  */
 
-result variable_secsiz(
-    /** Remaining command line */ char **line,
-    /** Returned value */         long long *ll
+result command_join(
+    /** Remaining command line */ char **line
 )
 
 {
 
-    char *dummystr = "";
-    
-    *ll = SECSIZE;
+    worker *wp;
+    int i, d, n, k;
+    double time, iopw, iopr, bcw, bcr, iopt, iopz, bct, bcz;
+    double ttime, tiopw, tiopr, tbcw, tbcr, tiopt, tiopz, tbct, tbcz;
+    long long wt, dev, idle, pat, comp, twt, tdev, tidle, tpat, tcomp; // thread times
+    static lathist lr, lw, tlr, tlw; // too big for the stack
+    result r;
 
-    return result_ok;
+    if (workerno) {
+
+        printf("*** Error: Workers cannot join workers\n");
+        return result_error;
+
+    }
+    waitworkers(); // wait for them all to finish
+    r = result_ok;
+    for (i = 0; i < nworkers; i++) {
+
+        wp = &workers[i];
+        if (wp->r == result_error) {
+
+            printf("*** Error: Worker %d (%s on drive %d) stopped on error\n",
+                   i+1, wp->proc->label, wp->drive);
+            r = result_error;
+
+        }
+
+    }
+    ttime = tiopw = tiopr = tbcw = tbcr = 0.0;
+    tiopt = tiopz = tbct = tbcz = 0.0;
+    twt = tdev = tidle = tpat = tcomp = 0;
+    clrlat(&tlr);
+    clrlat(&tlw);
+    for (d = 0; d < MAXDRIVES; d++) { // total up each drive
+
+        n = 0;
+        time = iopw = iopr = bcw = bcr = 0.0;
+        iopt = iopz = bct = bcz = 0.0;
+        wt = dev = idle = pat = comp = 0;
+        clrlat(&lr);
+        clrlat(&lw);
+        memset(rptcur.nbad, 0, sizeof(rptcur.nbad));
+        for (i = 0; i < nworkers; i++) {
+
+            wp = &workers[i];
+            if (wp->drive == d) {
+
+                n++;
+                rptcur.size = wp->drvsize;
+                rptcur.secsize = wp->secsize;
+                for (k = 0; k < bad_count; k++) rptcur.nbad[k] += wp->nbad[k];
+                if (wp->time > time) time = wp->time;
+                iopw += wp->iopwrite;
+                iopr += wp->iopread;
+                bcw += wp->bcwrite;
+                bcr += wp->bcread;
+                iopt += wp->ioptrim;
+                iopz += wp->iopzero;
+                bct += wp->bctrim;
+                bcz += wp->bczero;
+                wt += (long long) (wp->time*1e9);
+                dev += wp->devtime;
+                idle += wp->idletime;
+                pat += wp->pattime;
+                comp += wp->comptime;
+                mrglat(&lr, &wp->latread);
+                mrglat(&lw, &wp->latwrite);
+
+            }
+
+        }
+        if (n) {
+
+            printf("Drive %d (%s), %d worker%s:\n", d, getdrvstr(d), n,
+                   n > 1 ? "s" : "");
+            printstats(time, iopw, iopr, bcw, bcr);
+            printdisc(time, iopt, iopz, bct, bcz);
+            printcpu(wt, dev, idle, pat, comp);
+            printlat("Read", &lr);
+            printlat("Write", &lw);
+            if (rpton) { // add the drive's workers to its summary
+
+                rptcur.secs = time;
+                rptcur.iopw = iopw;
+                rptcur.iopr = iopr;
+                rptcur.bcw = bcw;
+                rptcur.bcr = bcr;
+                rptcur.iopt = iopt;
+                rptcur.iopz = iopz;
+                rptcur.bct = bct;
+                rptcur.bcz = bcz;
+                rptcur.latr = lr;
+                rptcur.latw = lw;
+                rptsum(d, &rptcur);
+
+            }
+            if (time > ttime) ttime = time;
+            tiopw += iopw;
+            tiopr += iopr;
+            tbcw += bcw;
+            tbcr += bcr;
+            tiopt += iopt;
+            tiopz += iopz;
+            tbct += bct;
+            tbcz += bcz;
+            twt += wt;
+            tdev += dev;
+            tidle += idle;
+            tpat += pat;
+            tcomp += comp;
+            mrglat(&tlr, &lr);
+            mrglat(&tlw, &lw);
+
+        }
+
+    }
+    if (nworkers) {
+
+        printf("All drives, %d worker%s:\n", nworkers, nworkers > 1 ? "s" : "");
+        printstats(ttime, tiopw, tiopr, tbcw, tbcr);
+        printdisc(ttime, tiopt, tiopz, tbct, tbcz);
+        printcpu(twt, tdev, tidle, tpat, tcomp);
+        printlat("Read", &tlr);
+        printlat("Write", &tlw);
+
+    }
+    nworkers = 0; // table is free again
+    // if we were broken out of, let that stop the line instead
+    if (FLAGGET(breakflag)) r = result_ok;
+
+    return r;
 
 }
 
 /**
  *
- * Buffer size
+ * Print latencies
  *
- * Returns the size, in sectors, of both the read and the write buffer.
+ * Prints the count and percentiles of the read and write latencies on the
+ * current drive, or clears them with "clear".
  *
  * \returns Standard discdiag error code.
- * 
+ *
  */
 
-result variable_bufsiz(
-    /** Remaining command line */ char **line,
-    /** Returned value */         long long *ll
+result command_lat(
+    /** Remaining command line */ char **line
 )
 
 {
 
-    char *dummystr = "";
-    
-    *ll = NOSECS;
+    char w[100]; // word buffer
+    result r;
 
-    return result_ok;
+    getword(line, w); // get option
+    if (*w && strcmp(w, "clear")) {
 
-}
+        printf("*** Error: option not recognized\n");
 
-/*******************************************************************************
+        return result_error;
 
-Command handlers
+    }
+    r = waitq(); // file the latencies of queued transfers
+    if (r != result_ok) return r;
+    if (*w) {
 
-*******************************************************************************/
+        carrylat();
+        clrlat(&latread);
+        clrlat(&latwrite);
+
+    } else if (!latread.total && !latwrite.total) printf("No latencies\n");
+    else {
+
+        printlat("Read", &latread);
+        printlat("Write", &latwrite);
+
+    }
+
+    return result_ok;
+
+}
 
 /**
  *
- * Help
+ * Set statistics interval
  *
- * Print command menu.
+ * Samples the statistics every so many seconds while commands run, in the main
+ * thread and every worker. The command format is:
+ *
+ *    interval [secs [file [csv|json]] | off]
+ *
+ * Each sample is one line, of CSV by default, or JSON if asked for or the file
+ * ends with .json. Without a file, samples go to the console. A CSV file starts
+ * with a line of column names. With no parameter, prints the current setting.
  *
  * \returns Standard discdiag error code.
- * 
+ *
  */
 
-result command_help(
+result command_interval(
     /** Remaining command line */ char **line
 )
 
 {
 
-    linecounter = 0; // clear screen line count
-    printf("\n"); pause();
-    printf("Commands available:\n"); pause();
-    printf("\n"); pause();
-    printf("?, help                     - Print command help.\n"); pause();
-    printf("r, read [lba][num]          - Read sector(s) at LBA, default read 0 1.\n"); pause();
-    printf("w, write [lba][num]         - Read sector(s) at LBA, default read 0 1.\n"); pause();
-    printf("dw, dumpwrite [num]         - Dump sector(s) from write buffer, default 1.\n"); pause();
-    printf("dr, dumpread [num]          - Dump sector(s) from read buffer, default 1.\n"); pause();
-    printf("pt, pattn [pat [val [cnt]]] - Set write buffer to pattern, default is count.\n"); pause();
-    printf("c, comp [pat [val [cnt]]]   - Compare read buffer to pattern, default is count.\n"); pause();
-    printf("cm, compmode mode           - Set miscompare handling mode, default is one.\n"); pause();
-    printf("drive [num]                 - Set current phy drive, default is print current.\n"); pause();
-    printf("listdrives, ld              - List available physical drives.\n"); pause();
-    printf("unprot                      - Unprotect current drive.\n"); pause();
-    printf("echo [text]                 - Echo the parameter area with next line.\n"); pause();
-    printf("echon [text]                - Echo the parameter area without next line.\n"); pause();
-    printf("p, print [fmt] val...       - Print calulated value(s) with next line.\n"); pause();
-    printf("pn, printn [fmt] val...     - Print calulated value(s) without next line.\n"); pause();
-    printf("l, loop [num]               - Loop from line start num times, default is\n"); pause();
-    printf("                              forever.\n"); pause();
-    printf("lq, loopq [num]             - Loop quiet from line start num times, defult is\n"); pause();
-    printf("                              forever.\n"); pause();
-    printf("u [num]                     - Loop until condition is true.\n"); pause();
-    printf("while cond                  - Start while/wend loop. Exec loop if cond is true.\n"); pause();
-    printf("wend                        - Terminate while/wend loop.\n"); pause();
-    printf("repeat                      - Start repeat/until loop.\n"); pause();
-    printf("until cond                  - End repeat/until loop. Repeat if cond is false.\n"); pause();
-    printf("for var start end [step]    - Run for loop, start to end in var.\n");              pause();
-    printf("fend                        - End for loop.\n"); pause();
-    printf("select val                  - Select value, match successive cases for val.\n"); pause();
-    printf("case val                    - Start new select case.\n"); pause();
-    printf("default                     - Start select case matching any value.\n"); pause();
-    printf("send                        - Terminate select statement.\n"); pause();
-    printf("end                         - Terminate procedure.\n"); pause();
-    printf("go label                    - Go to program label.\n"); pause();
-    printf("if cond                     - Continue if condition met, otherwise next line.\n"); pause();
-    printf("s, set var val              - Set/reset user variable.\n"); pause();
-    printf("local var                   - Mark variable as local.\n"); pause();
-    printf("srand                       - Reset random number sequence.\n"); pause();
-    printf("list                        - List stored program.\n"); pause();
-    printf("clear                       - Clear stored program.\n"); pause();
-    printf("save filename               - Save stored program to file.\n"); pause();
-    printf("load filename               - Load stored program from file.\n"); pause();
-    printf("delt num                    - Delete line in program with line number.\n"); pause();
-    printf("exit                        - Exit diagnostic.\n"); pause();
-    printf("exitonerror                 - Exit the diagnostic on error.\n"); pause();
-    printf("\n"); pause();
-    printf("[option] Means an optional parameter.\n"); pause();
-    printf("\n"); pause();
-    printf("Multiple commands can appear on a line as a; b; c...\n"); pause();
-    printf("\n"); pause();
-    printf("Patterns are:\n"); pause();
-    printf("\n"); pause();
-    printf("cnt   - Byte incrementing count.\n"); pause();
-    printf("dwcnt - 32 bit incrementing count.\n"); pause();
-    printf("val   - Numeric 32 bit value, big endian.\n"); pause();
-    printf("rand  - Random byte value.\n"); pause();
-    printf("lba   - Only the first 32 bits get LBA, rest is $ff. LBA starts \n"); pause();
-    printf("        at [val], and increments across buffer. Note that this only\n"); pause();
-    printf("        writes the first dword of each sector, use another pattern\n"); pause();
-    printf("        to fill the background.\n"); pause();
-    printf("buffs - Compare the read and write buffers to each other. This allows\n"); pause();
-    printf("        complex patterns to be built up in the write buffer.\n"); pause();
-    printf("\n"); pause();
-    printf("All write operations are from the write buffer which is %d sectors long.\n", NOSECS); pause();
-    printf("All read operations are from the read buffer which is %d sectors long.\n", NOSECS); pause();
-    printf("\n"); pause();
-    printf("All drives start write locked, and are relocked when the drive is changed.\n"); pause();
-    printf("\n"); pause();
-    printf("User variables start with a-z and continue with a-z and 0-9 like Myvar1.\n"); pause();
-    printf("They are created or recreated by set, and can be set any number of times.\n"); pause();
-    printf("A variable can be used anywhere a val can.\n"); pause();
-    printf("\n"); pause();
-    printf("There are several predefined variables:\n"); pause();
-    printf("\n"); pause();
-    printf("drvsiz - Gives the size of the current physical drive.\n"); pause();
-    printf("rand   - Gives a random number.\n"); pause();
-    printf("lbarnd - Gives a random LBA for the current drive, ie., a random number\n"); pause();
-    printf("         that fits into 0..drvsiz-1.\n"); pause();
-    printf("secsiz - Size of sector in bytes (always 512).\n"); pause();
-    printf("bufsiz - Size of read and write buffers in sectors.\n"); pause();
-    printf("\n"); pause();
-    printf("The compare modes are:\n"); pause();
-    printf("\n"); pause();
-    printf("all - Show all mismatches.\n"); pause();
-    printf("one - Show only the first mismatch.\n"); pause();
-    printf("fail - Fail (abort) after the first mismatch (normal is continue).\n"); pause();
-    printf("\n"); pause();
-    printf("All numeric parameters can be expressions, using C style expression operators\n"); pause();
-    printf("+a,-a,(a),a*b,a/b,a%%b,a+b,a-b,a<b,a>b,a=b, a!=b,a<=b and a>b.\n"); pause();
-    printf("Note that expressions cannot contain spaces, ie., a numeric parameter cannot\n"); pause();
-    printf("have spaces within it.\n"); pause();
-    printf("\n"); pause();
-    printf("Format strings used with print must start and end with double quotes.\n"); pause();
-    printf("They can contain standard C style format specifiers like %%[w[.p]f, where\n"); pause();
-    printf("the format character is d, x, or o, for decimal, hexadecimal or octal.\n"); pause();
-    printf("The sign and length cannot be specified, since debug values are always signed\n"); pause();
-    printf("long long values. Anything else in the format string is printed. There are\n"); pause();
-    printf("no character escapes. Use pn/printn and p/print to specify or leave out a\n");  pause();
-    printf("newline after printout.\n"); pause();
-    printf("\n"); pause();
-    printf("Note that leading zeros don't work in the field width. Use the precision\n"); pause();
-    printf("instead, i.e., %%4.4x not %%04x.\n"); pause();
-    printf("\n"); pause();
-    printf("Stored program lines are entered with a leading number as:\n"); pause();
-    printf("\n"); pause();
-    printf("Diag> 1 dothis(num): echon The number is: ; p num\n"); pause();
-    printf("\n"); pause();
-    printf("The line is inserted BEFORE the line in the program.\n"); pause();
-    printf("\n"); pause();
-    printf("Any line with a label (as \"dothis:\" above) can be called as a\n"); pause();
-    printf("procedure by using it's label as a command as:\n"); pause();
-    printf("\n"); pause();
-    printf("Diag> dothis 42\n"); pause();
-    printf("\n"); pause();
-    printf("Note parameters are optional.\n"); pause();
-    printf("\n"); pause();
-    printf("Procedure execution stops with an \"end\" command, and execution\n"); pause();
-    printf("resumes after the calling command.\n"); pause();
-    printf("\n"); pause();
-    printf("All variables created in a procedure are temporary and removed at\n"); pause();
-    printf("the end of the procedure. Variables are only created in a procedure\n"); pause();
-    printf("if they don't exist outside of the procedure OR if \"local\" is used.\n"); pause();
-    printf("Note that parameters are automatically local.\n"); pause();
-    printf("\n"); pause();
-    printf("Note that hitting the end of the program buffer terminates the run\n"); pause();
-    printf("ALWAYS.\n"); pause();
-    printf("\n"); pause();
-    printf("The file \"discdiag.ini\", if present in the current directory, is\n"); pause();
-    printf("automatically loaded when discdiag starts.\n"); pause();
-    printf("\n"); pause();
-    printf("*** WARNING: This diagnostic CAN and WILL distroy your hard disc!\n"); pause();
-    printf("\n"); pause();
+    char fname[100]; // file name
+    char w[100]; // word buffer
+    long long v;
+    FILE *fp;
+    size_t n;
+    result r;
+
+    while (**line == ' ') (*line)++; // skip any leading spaces
+    if (!**line || **line == ';') { // print current
+
+        if (!intlen) printf("Interval is: off\n");
+        else printf("Interval is: %.3fs, %s to %s\n", intlen/1e9,
+                    intjson ? "json" : "csv", intfp ? "file" : "console");
+
+        return result_ok;
+
+    }
+    if (workerno || nworkers) {
+
+        printf("*** Error: Interval cannot be changed while workers are running\n");
+        return result_error;
+
+    }
+    if (!strncmp(*line, "off", 3) && !isalnum((*line)[3])) { // turn off
+
+        getword(line, w);
+        v = 0;
+
+    } else {
+
+        r = getparam(line, &v);
+        if (r != result_ok) return r;
+
+    }
+    if (v < 0) {
+
+        printf("*** Error: Interval must not be negative\n");
+        return result_error;
+
+    }
+    r = getfile(line, fname); // get file, if any
+    if (r != result_ok) return r;
+    getword(line, w); // get format, if any
+    if (*w && strcmp(w, "csv") && strcmp(w, "json")) {
+
+        printf("*** Error: format not recognized\n");
+        return result_error;
+
+    }
+    fp = NULL;
+    if (v && *fname) {
+
+        fp = fopen(fname, "w");
+        if (!fp) {
+
+            printf("*** Error: could not create file %s\n", fname);
+            return result_error; // couldn't open file
+
+        }
+
+    }
+    if (intfp) fclose(intfp); // close the last file
+    intfp = fp;
+    n = strlen(fname);
+    intjson = !strcmp(w, "json") ||
+              (!*w && n > 5 && !strcmp(fname+n-5, ".json"));
+    intlen = v*1000000000LL;
+    intbase = gettim();
+    intgen++; // every thread starts over
+    if (intlen && !intjson) // name the columns
+        fprintf(intfp ? intfp : stdout, "time,worker,drive,secs,rops,wops,"
+                "rbytes,wbytes,riops,wiops,rbw,wbw,rlat50,rlat99,rlat999,"
+                "rlatmax,wlat50,wlat99,wlat999,wlatmax\n");
+    chkint(); // start this thread now
+
+    return result_ok;
 
-    return result_ok; // return no fault
-    
 }
 
 /**
  *
- * Read sector
+ * Set structured report
  *
- * Read sector to buffer
+ * Starts a report of records of what each command line, procedure and worker
+ * did, or ends it. The command format is:
+ *
+ *    report [json|csv [file] | off]
+ *
+ * Without a file, records go to the console. A CSV report starts with a line
+ * of column names. Ending a report, or starting another, first writes the
+ * summary of each drive to it. With no parameter, prints the current setting.
  *
  * \returns Standard discdiag error code.
- * 
+ *
  */
 
-result command_read(
+result command_report(
     /** Remaining command line */ char **line
 )
 
 {
 
-    long long lba; // lba to read
-    long long numsecs; // number of sectors to read
-    long long v;
-    result r;
-    int nr;
-    
-    lba = 0; // set default lba
-    numsecs = 1; // set default number of sectors
+    char fname[100]; // file name
+    char w[100]; // word buffer
+    FILE *fp;
+
     while (**line == ' ') (*line)++; // skip any leading spaces
-    if (**line && **line != ';') { // get lba number
+    if (!**line || **line == ';') { // print current
 
-        r = getparam(line, &v);
-        lba = v;
-        if (r != result_ok) return r;
-        if (**line && **line != ';') { // get number of sectors
+        if (!rpton) printf("Report is: off\n");
+        else printf("Report is: %s to %s\n", rptjson ? "json" : "csv",
+                    rptfp ? "file" : "console");
 
-            r = getparam(line, &v);
-            numsecs = v;
-            if (r != result_ok) return r;
+        return result_ok;
 
-        } 
-        
     }
-    // validate drive is active
-    if (currentdrive < 0) {
-
-        printf("*** Error: No current drive is set\n");
+    if (workerno || nworkers) {
 
+        printf("*** Error: Report cannot be changed while workers are running\n");
         return result_error;
 
     }
-    // validate sector count is within buffer
-    if (numsecs > NOSECS) {
-
-        printf("*** Error: Invalid sector count, must be <= %d\n", NOSECS);
+    getword(line, w); // get format
+    if (strcmp(w, "off") && strcmp(w, "csv") && strcmp(w, "json")) {
 
+        printf("*** Error: format not recognized\n");
         return result_error;
 
     }
-    // validate lba is 0 to drive size
-    if (lba >= drivesize) {
+    fname[0] = 0;
+    if (strcmp(w, "off") && getfile(line, fname) != result_ok) // get file, if any
+        return result_error;
+    fp = NULL;
+    if (*fname) {
 
-        printf("*** Error: Invalid lba number, must be <= %lld\n", drivesize);
+        fp = fopen(fname, "w");
+        if (!fp) {
 
-        return result_error;
+            printf("*** Error: could not create file %s\n", fname);
+            return result_error; // couldn't open file
+
+        }
 
     }
-    // validate lba+sectors are within drive
-    if (lba+numsecs-1 >= drivesize) {
+    rptend(); // finish the last report
+    if (!strcmp(w, "off")) return result_ok;
+    rptfp = fp;
+    rptjson = !strcmp(w, "json");
+    rpton = 1;
+    if (!rptjson) // name the columns
+        rptout("type,name,worker,drive,dev,size,secsize,result,secs,rops,wops,"
+               "rbytes,wbytes,tops,zops,tbytes,zbytes,rlat50,rlat99,rlat999,"
+               "rlatmax,wlat50,wlat99,wlat999,wlatmax,rerrors,werrors,terrors,"
+               "miscompares,bad\n");
+    rptmark(&rptlin); // this line counts from now
 
-        printf("*** Error: Operation will exceed drive size\n");
+    return result_ok;
 
-        return result_error;
+}
 
-    }
+/**
+ *
+ * Benchmark items
+ *
+ * The operations bench times, in the order it prints them. The ones that work
+ * on a buffer do the whole buffer as one operation, the rest are done BENCHRUN
+ * at a time, so that the loop around them costs little.
+ *
+ */
+#define BENCHRUN 1000
+typedef enum {
 
-    /* read sector to buffer */
-    nr = readsector(readbuffer, lba, numsecs);
-    if (nr) {
+    /** Fill cnt pattern */               bench_fillcnt,
+    /** Fill dwcnt pattern */             bench_filldwcnt,
+    /** Fill rand pattern */              bench_fillrand,
+    /** Fill lba pattern */               bench_filllba,
+    /** Fill sig pattern */               bench_fillsig,
+    /** Compare buffers */                bench_compare,
+    /** CRC32C of buffer */               bench_crc,
+    /** Random number */                  bench_rand,
+    /** Random LBA */                     bench_lbarnd,
+    /** Expression from cache */          bench_expr,
+    /** Expression parsed */              bench_parse,
+    /** Command dispatch */               bench_dispatch,
+    /** Read of one sector */             bench_read,
+    /** Number of items */                bench_count
+
+} benchitem;
+
+/** Names of items */
+char *benchname[bench_count] = {
+
+    "fill cnt", "fill dwcnt", "fill rand", "fill lba", "fill sig", "compare",
+    "crc32c", "rand", "lbarnd", "expression", "parse", "dispatch", "read"
 
-        printf("*** Error: Read error\n");
+};
 
-        return result_error; // read failed, exit
+/** Expression timed */ char benchexp[] = "(secsiz*7+bufsiz)%1000<500";
+/** Command line timed */ char benchcmd[] = "if 1";
+
+/**
+ *
+ * Run benchmark item
+ *
+ * Does one run of the given item, and gives the operations and bytes it did.
+ *
+ * \returns Standard discdiag error code.
+ *
+ */
+
+result benchrun(
+    /** Item */               benchitem item,
+    /** Write side buffer */  unsigned char *wb,
+    /** Read side buffer */   unsigned char *rb,
+    /** Size of buffers */    long long len,
+    /** Operations done */    long long *ops,
+    /** Bytes done */         long long *bytes
+)
+
+{
+
+    static volatile unsigned long long sink; // keep results from being dropped
+    unsigned long long x;
+    long long v;
+    char *l;
+    int i;
+    result r;
+
+    *ops = 1;
+    *bytes = len;
+    r = result_ok;
+    x = 0;
+    switch (item) {
+
+        case bench_fillcnt: fillcnt(wb, len); break;
+        case bench_filldwcnt: filldwcnt(wb, 0, len); break;
+        case bench_fillrand: fillrand(wb, len); break;
+        case bench_filllba: // only 4 bytes a sector, so count sectors
+            filllba(wb, 0, len/secsize);
+            *ops = len/secsize;
+            *bytes = 0;
+            break;
+        case bench_fillsig: fillsig(wb, 0, len/secsize, seed); break;
+        case bench_compare: r = compblk(rb, wb, len, 0, 0); break;
+        case bench_crc: x = crc32c(wb, len); break;
+        case bench_rand:
+        case bench_lbarnd:
+            for (i = 0; i < BENCHRUN; i++) {
+
+                if (item == bench_rand) x += rand64();
+                else x += pickrnd(drivesize > 0 ? drivesize : 1LL << 40);
+
+            }
+            *ops = BENCHRUN;
+            *bytes = 8*BENCHRUN;
+            break;
+        case bench_expr:
+        case bench_parse:
+            for (i = 0; i < BENCHRUN && r == result_ok; i++) {
+
+                l = benchexp;
+                if (item == bench_expr) r = getparam(&l, &v);
+                else r = getrel(&l, &v); // parse, without the cache
+                x += v;
+
+            }
+            *ops = BENCHRUN;
+            *bytes = (long long) sizeof(benchexp)*BENCHRUN;
+            break;
+        case bench_dispatch:
+            for (i = 0; i < BENCHRUN && r == result_ok; i++) {
+
+                l = benchcmd;
+                r = exec(&l);
+
+            }
+            *ops = BENCHRUN;
+            *bytes = (long long) sizeof(benchcmd)*BENCHRUN;
+            break;
+        case bench_read:
+            if (readsector(rb, 0, 1)) r = result_error;
+            *bytes = secsize;
+            break;
+        default: break;
 
     }
+    sink += x;
+
+    return r;
 
-    // update statistics
-    iopread += 1.0; // read IOPs
-    bcread += numsecs*SECSIZE; // read bytes
- 
-    return result_ok; // return no fault
-   
 }
 
 /**
  *
- * Write sector
+ * Benchmark the diagnostic
  *
- * Write sector from buffer
+ * Times the diagnostic's own work: filling the buffer with each pattern,
+ * comparing it, CRC32C, the random numbers, expressions from the cache and
+ * parsed each time, and running a command. Each item is run over and over, in
+ * doubling batches, until a batch takes the time given, and then its time per
+ * operation and bytes per second are printed. The command format is:
+ *
+ *    bench [ms]
+ *
+ * The time defaults to 200 ms for each item. The buffers are the size of the
+ * read and write buffers, which are left as they were, and the random seeds
+ * are put back after. The lba fill writes only the first 4 bytes of each
+ * sector, so it is counted in sectors, and its rate is in millions of sectors
+ * a second. With a drive set, a read of one sector is timed too, by the same
+ * clock as the statistics, so it takes in the drive. Against the stub's
+ * simulated disc that is the simulated transfer time, unless devopt opns and
+ * bytens are set to 0 first to leave just the cost of the transfer.
  *
  * \returns Standard discdiag error code.
- * 
+ *
  */
 
-result command_write(
+result command_bench(
     /** Remaining command line */ char **line
 )
 
 {
 
-    long long lba; // lba to read
-    long long numsecs; // number of sectors to read
+    long long ms, len, n, i, ops, bytes, tops, tbytes, t, el;
+    unsigned long long lbas[4]; // save for LBA generator
+    unsigned long seeds; // save for random seed
+    unsigned char *wb, *rb;
+    benchitem item;
     result r;
-    long long v;
-    int nr;
-    
-    if (writeprot) {
-
-        printf("*** Error: Drive is write protected, use unprot command\n");
-        return result_error;
-
-    }
 
-    lba = 0; // set default lba
-    numsecs = 1; // set default number of sectors
+    ms = 200; // set default
     while (**line == ' ') (*line)++; // skip any leading spaces
-    if (**line && **line != ';') { // get lba number
+    if (**line && **line != ';') { // get time
 
-        r = getparam(line, &v);
-        lba = v;
+        r = getparam(line, &ms);
         if (r != result_ok) return r;
-        if (**line && **line != ';') { // get number of sectors
+        if (ms < 1) {
 
-            r = getparam(line, &v);
-            numsecs = v;
-            if (r != result_ok) return r;
-
-        } 
-        
-    }
-    // validate drive is active
-    if (currentdrive < 0) {
+            printf("*** Error: Invalid time, must be at least 1 ms\n");
 
-        printf("*** Error: No current drive is set\n");
+            return result_error;
 
-        return result_error;
+        }
 
     }
-    // validate sector count is within buffer
-    if (numsecs > NOSECS) {
-
-        printf("*** Error: Invalid sector count, must be <= %d\n", NOSECS);
-        return result_error;
+    r = waitq(); // the read goes straight to the drive
+    if (r != result_ok) return r;
+    len = bufsecs*secsize;
+    wb = allocbuf(len);
+    rb = allocbuf(len);
+    if (!wb || !rb) {
 
-    }
-    // validate lba is 0 to drive size
-    if (lba >= drivesize) {
+        if (wb) freebuf(wb, len);
+        if (rb) freebuf(rb, len);
+        printf("*** Error: Cannot allocate space\n");
 
-        printf("*** Error: Invalid lba number, must be <= %lld\n", drivesize);
         return result_error;
 
     }
-    // validate lba+sectors are within drive
-    if (lba+numsecs-1 >= drivesize) {
+    seeds = seed; // save the random seeds
+    memcpy(lbas, lbastate, sizeof(lbas));
+    fillrand(wb, len);
+    printf("%-16s %13s %11s %13s\n", "Item", "Operations", "ns/op", "Rate");
+    for (item = 0; item < bench_count && r == result_ok; item++) {
+
+        if (item == bench_read && currentdrive < 0) continue; // no drive
+        // compare the last fill with itself, so it matches all the way
+        if (item == bench_compare) memcpy(rb, wb, (size_t) len);
+        n = 1;
+        while (r == result_ok) {
+
+            tops = tbytes = 0;
+            t = gettim();
+            for (i = 0; i < n && r == result_ok; i++) {
+
+                r = benchrun(item, wb, rb, len, &ops, &bytes);
+                tops += ops;
+                tbytes += bytes;
 
-        printf("*** Error: Operation will exceed drive size\n");
+            }
+            el = gettim()-t;
+            if (r == result_ok && chkbrk()) {
 
-        return result_error;
+                if (exiterror) r = result_exit; // exit diagnostic
+                else r = result_stop; // check break
 
-    }
+            }
+            if (el >= ms*1000000) break; // long enough to trust
+            n *= 2;
 
-    /* write sector from buffer */
-    nr = writesector(writebuffer, lba, numsecs);
-    if (nr) {
+        }
+        if (r == result_ok) {
 
-        printf("*** Error: Write error\n");
+            if (el < 1) el = 1;
+            if (item == bench_filllba)
+                printf("%-16s %13lld %11.2f %8.3f Ms/s\n", benchname[item], tops,
+                       (double) el/tops, tops*1000.0/el);
+            else printf("%-16s %13lld %11.2f %8.3f GB/s\n", benchname[item], tops,
+                        (double) el/tops, (double) tbytes/el);
 
-        return result_error; // read failed, exit
+        }
 
     }
- 
-    // update statistics
-    iopwrite += 1.0; // write IOPs
-    bcwrite += numsecs*SECSIZE; // write bytes
+    seed = seeds; // restore the random seeds
+    memcpy(lbastate, lbas, sizeof(lbas));
+    freebuf(wb, len);
+    freebuf(rb, len);
+
+    return r;
 
-    return result_ok; // return no fault
-   
 }
- 
+
 /**
  *
  * Dump write sectors
@@ -2631,9 +11427,9 @@ result command_dumpwrite(
         if (r != result_ok) return r;
 
     } 
-    if (numsecs > NOSECS) {
+    if (numsecs > bufsecs) {
 
-        printf("*** Error: Invalid sector count, must be <= %d\n", NOSECS);
+        printf("*** Error: Invalid sector count, must be <= %lld\n", bufsecs);
         return result_error;
 
     }
@@ -2641,7 +11437,7 @@ result command_dumpwrite(
     /* dump sector in buffer in hex and ASCII */
     printf("Contents of sector:\n");
     printf("\n");
-    r = dump(writebuffer, SECSIZE*numsecs);
+    r = dump(writebuffer, secsize*numsecs);
     if (r != result_ok) return r;
     printf("\n");
  
@@ -2679,9 +11475,9 @@ result command_dumpread(
 
     } 
 
-    if (numsecs > NOSECS) {
+    if (numsecs > bufsecs) {
 
-        printf("*** Error: Invalid sector count, must be <= %d\n", NOSECS);
+        printf("*** Error: Invalid sector count, must be <= %lld\n", bufsecs);
         return result_error;
 
     }
@@ -2689,7 +11485,7 @@ result command_dumpread(
     /* dump sector in buffer in hex and ASCII */
     printf("Contents of sector:\n");
     printf("\n");
-    r = dump(readbuffer, SECSIZE*numsecs);
+    r = dump(readbuffer, secsize*numsecs);
     if (r != result_ok) return r;
     printf("\n");
  
@@ -2710,13 +11506,19 @@ result command_dumpread(
  * lba   - Only the first 32 bits get LBA, rest is $ff. LBA starts
  *         at [val], and increments across buffer. Note that this only writes
  *         the first dword of each sector.
+ * sig   - Signature of LBA, starting at [val], write generation, seed and
+ *         time, with data and a CRC32C, in each sector. Checked by csig.
  *
  * The command format is:
  *
- *    pattn [type] [val]
+ *    pattn [type] [val] [cnt] [off]
  *
  * The type is the name of the pattern from above. The val is numeric and
- * is only used for the val and lba patterns, and ignored otherwise.
+ * is only used for the val, lba and sig patterns, and ignored otherwise.
+ * Only cnt sectors from sector off are filled, default the whole buffer, and
+ * they get what a fill of the whole buffer would have put there, so a patch
+ * leaves the rest of the buffer as it is. Writes of a sig patch past sector 0
+ * are mapped as unsigned, since the sectors before it are not its generation.
  * 
  * \returns Standard discdiag error code.
  * 
@@ -2731,9 +11533,10 @@ result command_pattn(
     char pat[100]; // pattern name
     long long val; // value
     long long len; // length in sectors
+    long long off; // first sector filled
+    long long t; // start of fill
+    unsigned char *b; // where fill starts
     unsigned long seeds; // save for random seed
-    unsigned long l;
-    long i, s;
     result r;
 
     seeds = seed; // save the random seed
@@ -2741,7 +11544,8 @@ result command_pattn(
 
     strcpy(pat, "cnt"); // set default pattern is byte count
     val = 0; // set default value
-    len = NOSECS; // set length is full buffer
+    len = -1; // set length is rest of buffer
+    off = 0; // set start is buffer start
     while (**line == ' ') (*line)++; // skip any leading spaces
     if (**line && **line != ';') { // get pattern name
 
@@ -2767,74 +11571,107 @@ result command_pattn(
                     return r;
 
                 }
+                while (**line == ' ') (*line)++; // skip any leading spaces
+                if (**line && **line != ';') { // get starting sector
+
+                    r = getparam(line, &off);
+                    if (r != result_ok) {
+
+                        seed = seeds; // restore the random seed
+
+                        return r;
+
+                    }
+
+                }
 
             }
 
         } 
         
     }
+    // validate offset and length are within buffer
+    if (off < 0 || off >= bufsecs) {
 
-    if (!strcmp(pat, "cnt")) {
+        printf("*** Error: Invalid sector offset, must be < %lld\n", bufsecs);
+        seed = seeds; // restore the random seed
 
-        for (i = 0; i < SECSIZE*len; i++) writebuffer[i] = i & 0xff;
+        return result_error;
 
-    } else if (!strcmp(pat, "dwcnt")) {
+    }
+    if (len < 0) len = bufsecs-off;
+    if (off+len > bufsecs) {
 
-        l = 0;
-        for (i = 0; i < SECSIZE*len; i += 4) {
+        printf("*** Error: Invalid sector count, must be <= %lld\n", bufsecs-off);
+        seed = seeds; // restore the random seed
 
-            writebuffer[i] = l >> 24 & 0xff;
-            writebuffer[i+1] = l >> 16 & 0xff;
-            writebuffer[i+2] = l >> 8 & 0xff;
-            writebuffer[i+3] = l & 0xff;
-            l++;
+        return result_error;
 
-        }
+    }
 
-    } else if (!strcmp(pat, "val")) {
+    // each sector gets what it would in a fill of the whole buffer
+    b = writebuffer+off*secsize;
+    t = gettim();
+    if (!strcmp(pat, "cnt")) fillcnt(b, secsize*len);
+    else if (!strcmp(pat, "dwcnt")) filldwcnt(b, (unsigned long) (off*secsize/4), secsize*len);
+    else if (!strcmp(pat, "val")) fillval(b, val, secsize*len);
+    else if (!strcmp(pat, "rand")) fillrand(b, secsize*len);
+    else if (!strcmp(pat, "lba")) filllba(b, val+off, len);
+    else if (!strcmp(pat, "sig")) {
 
-        for (i = 0; i < SECSIZE*len; i += 4) {
+        siggen++; // a new write generation
+        fillsig(b, val+off, len, seeds);
 
-            writebuffer[i] = val >> 24 & 0xff;
-            writebuffer[i+1] = val >> 16 & 0xff;
-            writebuffer[i+2] = val >> 8 & 0xff;
-            writebuffer[i+3] = val & 0xff;
+    } else {
 
-        }
+        printf("*** Error: bad pattern name: %s\n", pat);
+        seed = seeds; // restore the random seed
 
-    } else if (!strcmp(pat, "rand")) {
+        return result_error;
 
-        for (s = 0; s < len; s++) { // sectors
+    }
+    patns += gettim()-t;
+    // what the map files writes as, a patch leaves sectors of other generations
+    sigbuf = strcmp(pat, "sig") || off ? 0 : siggen;
+    siglba = val;
+    seed = seeds; // restore the random seed
 
-            // the random pattern needs to be the same for each sector
-            seed = 42; // reset random number generator
-            for (i = 0; i < SECSIZE; i++) writebuffer[s*SECSIZE+i] = rand64() & 0xff;
+    return result_ok;
 
-        }
+}
 
-    } else if (!strcmp(pat, "lba")) {
+/**
+ *
+ * Count miscompared sectors
+ *
+ * Reports each sector in a block of the read buffer that differs from what was
+ * expected. A sector is only counted once, even if it spans blocks.
+ *
+ */
+void countcomp(
+    /** Read data */               unsigned char *buf,
+    /** Expected data */           unsigned char *exp,
+    /** Length in bytes */         long long len,
+    /** Buffer address of block */ long long addr,
+    /** Last sector counted */     long long *last
+)
 
-        for (i = 0; i < SECSIZE*len; i += SECSIZE) {
+{
 
-            writebuffer[i] = val >> 24 & 0xff;
-            writebuffer[i+1] = val >> 16 & 0xff;
-            writebuffer[i+2] = val >> 8 & 0xff;
-            writebuffer[i+3] = val & 0xff;
-            val++;
+    long long o, e;
 
-        }
+    for (o = 0; o < len; o = e) {
 
-    } else {
+        e = ((addr+o)/secsize+1)*secsize-addr; // end of this sector
+        if (e > len) e = len;
+        if ((addr+o)/secsize != *last && memcmp(buf+o, exp+o, (size_t)(e-o))) {
 
-        printf("*** Error: bad pattern name: %s\n", pat);
-        seed = seeds; // restore the random seed
+            *last = (addr+o)/secsize;
+            rptbad(bad_comp, -1); // which LBA the buffer came from isn't known
 
-        return result_error;
+        }
 
     }
-    seed = seeds; // restore the random seed
-
-    return result_ok;
 
 }
 
@@ -2877,8 +11714,10 @@ result command_comp(
     long long val; // value
     long long len; // length in sectors
     unsigned long seeds; // save for random seed
-    unsigned long l;
-    long i, s;
+    long long i, n, t;
+    long long d, last; // blocks different, last sector counted
+    unsigned char *cb; // expected data for a block
+    long long blk; // size of block
     result r;
     
     seeds = seed; // save the random seed
@@ -2886,7 +11725,7 @@ result command_comp(
 
     strcpy(pat, "cnt"); // set default pattern is byte count
     val = 0; // set default value
-    len = NOSECS; // set length is full buffer
+    len = bufsecs; // set length is full buffer
     first = 1; // set first miscompare
     dataset = 0; // last data not set
     repcnt = 0; // clear mismatch count
@@ -2922,194 +11761,307 @@ result command_comp(
         } 
         
     }
-    if (!strcmp(pat, "cnt")) {
-
-        for (i = 0; i < SECSIZE*len; i++) {
-
-            r = printcomp(i, readbuffer[i], i & 0xff);
-            if (r != result_ok) {
+    // validate length is within buffer
+    if (len > bufsecs) {
 
-                seed = seeds; // restore the random seed
+        printf("*** Error: Invalid sector count, must be <= %lld\n", bufsecs);
+        seed = seeds; // restore the random seed
 
-                return r;
+        return result_error;
 
-            }
+    }
+    if (strcmp(pat, "cnt") && strcmp(pat, "val") && strcmp(pat, "rand") &&
+        strcmp(pat, "dwcnt") && strcmp(pat, "lba") && strcmp(pat, "buffs")) {
 
-        }
+        printf("*** Error: bad pattern name: %s\n", pat);
+        seed = seeds; // restore the random seed
 
-    } else if (!strcmp(pat, "dwcnt")) {
+        return result_error;
 
-        l = 0;
-        for (i = 0; i < SECSIZE*len; i += 4) {
+    }
+    // blocks are whole sectors, so the rand pattern lines up with each block
+    blk = CMPBLK;
+    cb = cmpbuf;
+    if (secsize > blk) {
 
-            r = printcomp(i, readbuffer[i], l >> 24 & 0xff);
-            if (r != result_ok) {
+        blk = secsize;
+        cb = (unsigned char *) malloc((size_t) blk);
+        if (!cb) {
 
-                seed = seeds; // restore the random seed
+            printf("*** Error: Cannot allocate space\n");
+            seed = seeds; // restore the random seed
 
-                return r;
+            return result_error;
 
-            }
-            r = printcomp(i+1, readbuffer[i+1], l >> 16 & 0xff);
-            if (r != result_ok) {
+        }
 
-                seed = seeds; // restore the random seed
+    }
+    // set up the expected data that is the same for every block
+    if (!strcmp(pat, "cnt")) fillcnt(cb, blk);
+    else if (!strcmp(pat, "val")) fillval(cb, val, blk);
+    else if (!strcmp(pat, "rand")) fillrand(cb, blk);
+    r = result_ok;
+    last = -1;
+    t = gettim();
+    if (!strcmp(pat, "lba")) {
+
+        // only the first dword of each sector has the lba
+        for (i = 0; i < secsize*len && r == result_ok; i += secsize) {
+
+            fillval(cb, val, 4);
+            d = compdiff;
+            r = compblk(readbuffer+i, cb, 4, i, 0);
+            if (compdiff != d) countcomp(readbuffer+i, cb, 4, i, &last);
+            val++;
 
-                return r;
+        }
 
-            }
-            r = printcomp(i+2, readbuffer[i+2], l >> 8 & 0xff);
-            if (r != result_ok) {
+    } else for (i = 0; i < secsize*len && r == result_ok; i += n) {
 
-                seed = seeds; // restore the random seed
+        n = secsize*len-i;
+        if (n > blk) n = blk;
+        if (!strcmp(pat, "dwcnt")) filldwcnt(cb, (unsigned long)(i/4), n);
+        d = compdiff;
+        // rand gives addresses within the sector
+        if (!strcmp(pat, "buffs")) r = compblk(readbuffer+i, writebuffer+i, n, i, 0);
+        else r = compblk(readbuffer+i, cb, n, i, !strcmp(pat, "rand"));
+        if (compdiff != d) countcomp(readbuffer+i, !strcmp(pat, "buffs") ?
+                                     writebuffer+i : cb, n, i, &last);
 
-                return r;
+    }
+    compns += gettim()-t;
+    if (cb != cmpbuf) free(cb);
+    if (r != result_ok) {
 
-                
-            }
-            r = printcomp(i+3, readbuffer[i+3], l & 0xff);
-            if (r != result_ok) {
+        seed = seeds; // restore the random seed
 
-                seed = seeds; // restore the random seed
+        return r;
 
-                return r;
+    }
+    // message if miscompares have accumulated
+    if (repcnt) {
 
-            }
-            l++;
+        printf("**** Info: There were %d occurrances of the above mismatch\n", repcnt);
+        repcnt = 0; // reset counter
 
-        }
+    }
+    seed = seeds; // restore the random seed
 
-    } else if (!strcmp(pat, "val")) {
+    return result_ok;
 
-        for (i = 0; i < SECSIZE*len; i += 4) {
+}
 
-            r = printcomp(i, readbuffer[i], val >> 24 & 0xff);
-            if (r != result_ok) {
+/**
+ *
+ * Check signatures
+ *
+ * Checks the sig pattern in each sector of the read buffer, on its own. A
+ * sector fails if it has no signature (never written, or lost), if its CRC
+ * doesn't match (torn or corrupted), if it holds another LBA (misdirected),
+ * or if it is from before the given write generation (an overwrite was lost).
+ * The command format is:
+ *
+ *    csig [lba [cnt [gen]]]
+ *
+ * The lba is where the buffer was read from, default 0, and cnt the sectors to
+ * check, default the whole buffer. The generation is not checked unless gen
+ * is given, as siggen for instance. Failures go by the compare mode.
+ *
+ * \returns Standard discdiag error code.
+ *
+ */
 
-                seed = seeds; // restore the random seed
+result command_csig(
+    /** Remaining command line */ char **line
+)
 
-                return r;
+{
 
-            }
-            r = printcomp(i+1, readbuffer[i+1], val >> 16 & 0xff);
-            if (r != result_ok) {
+    long long lba, len, gen, s, bad, v, t;
+    int why; // what is wrong with a sector
+    result r;
 
-                seed = seeds; // restore the random seed
+    lba = 0; // set defaults
+    len = bufsecs;
+    gen = 0;
+    while (**line == ' ') (*line)++; // skip any leading spaces
+    if (**line && **line != ';') { // get lba
 
-                return r;
+        r = getparam(line, &lba);
+        if (r != result_ok) return r;
+        while (**line == ' ') (*line)++; // skip any leading spaces
+        if (**line && **line != ';') { // get length in sectors
+
+            r = getparam(line, &len);
+            if (r != result_ok) return r;
+            while (**line == ' ') (*line)++; // skip any leading spaces
+            if (**line && **line != ';') { // get generation
+
+                r = getparam(line, &gen);
+                if (r != result_ok) return r;
 
             }
-            r = printcomp(i+2, readbuffer[i+2], val >> 8 & 0xff);
-            if (r != result_ok) {
 
-                seed = seeds; // restore the random seed
+        }
 
-                return r;
+    }
+    if (len < 1 || len > bufsecs) {
 
-            }
-            r = printcomp(i+3, readbuffer[i+3], val & 0xff);
-            if (r != result_ok) {
+        printf("*** Error: Invalid sector count, must be 1 to %lld\n", bufsecs);
 
-                seed = seeds; // restore the random seed
+        return result_error;
 
-                return r;
+    }
+    bad = 0;
+    t = gettim();
+    r = result_ok;
+    for (s = 0; s < len && r == result_ok; s++) {
+
+        if (chkbrk()) {
 
-            }  
+            if (exiterror) r = result_exit; // exit diagnostic
+            else r = result_stop; // check break
+            break;
 
         }
+        why = chksig(readbuffer+s*secsize, lba+s, gen, &v);
+        if (!why) continue; // good
+        bad++;
+        rptbad(bad_comp, lba+s);
+        if (bad == 1 || curmode == compmode_all) prtsig(why, lba+s, v, gen);
+        if (curmode == compmode_fail) r = result_error;
 
-    } else if (!strcmp(pat, "rand")) {
+    }
+    compns += gettim()-t;
+    if (r != result_ok) return r;
+    if (bad > 1 && curmode != compmode_all)
+        printf("**** Info: There were %lld more sectors with bad signatures\n", bad-1);
 
-        for (s = 0; s < len; s++) { // sectors
+    return result_ok;
 
-            // the random pattern needs to be the same for each sector
-            seed = 42; // reset random number generator
-            for (i = 0; i < SECSIZE; i++) {
+}
 
-                r = printcomp(i, readbuffer[s*SECSIZE+i], rand64() & 0xff);
-                if (r != result_ok) {
+/**
+ *
+ * Written map
+ *
+ * Shows, clears, saves or loads the map of what was written on the current
+ * drive. The command format is:
+ *
+ *    map [on|off|clear|save file|load file]
+ *
+ * With no parameter, prints how much has been written. The file has a line
+ * for each extent, of its lba, sectors and signature generation, and lines
+ * starting with ! are comments. Loading adds to what the map has, so load
+ * after setting the drive. off clears the map and stops filing writes in it,
+ * for long random runs that don't need verifyall, and on starts it again.
+ *
+ * \returns Standard discdiag error code.
+ *
+ */
 
-                    seed = seeds; // restore the random seed
+result command_map(
+    /** Remaining command line */ char **line
+)
 
-                    return r;
+{
 
-                }
+    char w[100]; // subcommand
+    char fname[100]; // file name
+    char buf[200]; // file line
+    long long n, lba, num, gen;
+    extent *e;
+    FILE *fp;
+    result r;
 
-            }
+    w[0] = 0;
+    while (**line == ' ') (*line)++; // skip any leading spaces
+    if (**line && **line != ';') getword(line, w);
+    if (!w[0]) { // print
 
-        }
+        if (mapoff) {
 
-    } else if (!strcmp(pat, "lba")) {
+            printf("Written map is off\n");
 
-        for (i = 0; i < SECSIZE*len; i += SECSIZE) {
+            return result_ok;
 
-            r = printcomp(i, readbuffer[i], val >> 24 & 0xff);
-            if (r != result_ok) {
+        }
+        n = 0;
+        for (e = mapfind(0); e; e = mapnext(e)) n += e->num;
+        printf("%lld sectors written in %lld extents", n, extcnt);
+        if (drivesize > 0) printf(", %.2f%% of the drive", 100.0*n/drivesize);
+        printf("\n");
 
-                seed = seeds; // restore the random seed
+    } else if (!strcmp(w, "on")) mapoff = 0;
+    else if (!strcmp(w, "off")) {
 
-                return r;
+        mapclear();
+        mapoff = 1;
 
-            }
-            r = printcomp(i+1, readbuffer[i+1], val >> 16 & 0xff);
-            if (r != result_ok) {
+    } else if (!strcmp(w, "clear")) mapclear();
+    else if (!strcmp(w, "save")) {
 
-                seed = seeds; // restore the random seed
+        r = getfile(line, fname);
+        if (r != result_ok) return r;
+        fp = fopen(fname, "w");
+        if (!fp) {
 
-                return r;
+            printf("*** Error: could not create file %s\n", fname);
+            return result_error;
 
-            }
-            r = printcomp(i+2, readbuffer[i+2], val >> 8 & 0xff);
-            if (r != result_ok) {
+        }
+        fprintf(fp, "! discdiag written map: lba sectors generation\n");
+        for (e = mapfind(0); e; e = mapnext(e))
+            fprintf(fp, "%lld %lld %lld\n", e->lba, e->num, e->gen);
+        fclose(fp);
 
-                seed = seeds; // restore the random seed
+    } else if (!strcmp(w, "load")) {
 
-                return r;
+        r = getfile(line, fname);
+        if (r != result_ok) return r;
+        if (currentdrive < 0) {
 
-            }
-            r = printcomp(i+3, readbuffer[i+3], val & 0xff);
-            if (r != result_ok) {
+            printf("*** Error: No current drive is set\n");
 
-                seed = seeds; // restore the random seed
+            return result_error;
 
-                return r;
+        }
+        fp = fopen(fname, "r");
+        if (!fp) {
 
-            }
-            val++;
+            printf("*** Error: could not open file %s\n", fname);
+            return result_error;
 
         }
+        r = result_ok;
+        while (r == result_ok && fgets(buf, sizeof(buf), fp)) {
 
-    } else if (!strcmp(pat, "buffs")) {
-
-        for (i = 0; i < SECSIZE*len; i++) {
+            if (buf[0] == '!' || buf[0] == '\n') continue; // comment or blank
+            if (sscanf(buf, "%lld %lld %lld", &lba, &num, &gen) != 3 ||
+                lba < 0 || num < 1 || gen < 0) {
 
-            r = printcomp(i, readbuffer[i], writebuffer[i]);
-            if (r != result_ok) {
+                printf("*** Error: Invalid map line: %s", buf);
+                r = result_error;
 
-                seed = seeds; // restore the random seed
+            } else if (lba+num > drivesize) {
 
-                return r;
+                printf("*** Error: Map extent at lba %lld is past the drive end\n", lba);
+                r = result_error;
 
-            }
+            } else r = mapput(lba, num, gen);
 
         }
+        fclose(fp);
+
+        return r;
 
     } else {
 
-        printf("*** Error: bad pattern name: %s\n", pat);
-        seed = seeds; // restore the random seed
+        printf("*** Error: Invalid map command \"%s\"\n", w);
 
         return result_error;
 
     }
-    // message if miscompares have accumulated
-    if (repcnt) {
-
-        printf("**** Info: There were %d occurrances of the above mismatch\n", repcnt);
-        repcnt = 0; // reset counter
-
-    }
-    seed = seeds; // restore the random seed
 
     return result_ok;
 
@@ -3173,37 +12125,39 @@ result command_drive(
 
 {
 
+    char path[100]; // drive path
     result r;
     long long v;
-    int ri;
-    int drive;
-    long long t;
+    int d;
 
     while (**line == ' ') (*line)++; // skip any leading spaces
-    if (**line && **line != ';') { // get drive parameter
+    if (**line == '/' || **line == '.' || **line == '"' || **line == '\\') {
 
-        r = getparam(line, &v); // get drive number
+        // a path, find or give it a drive number
+        r = getfile(line, path);
         if (r != result_ok) return r;
-        drive = (int) v;
-        writeprot = 1; // set the write protect on the new drive by default
-        if (!drive) printf("*** Warning: You have selected the system drive\n");
-        ri = setdrive(drive); // set physical drive active
-        if (ri) return result_error; // error
-        currentdrive = drive; // set that active
-        // get and store current drive size
-        r = physize(&t);
-        if (r != 0) return result_error;
-        drivesize = t / SECSIZE; // find net size in sectors
-        if (t % SECSIZE) {
-        
-            printf("*** Warning: Drive total size is not an even number of sectors\n");
-        
+        if (workerno || nworkers) {
+
+            printf("*** Error: Drives cannot be added while workers are running\n");
+            return result_error;
+
         }
-        // clear the statistics on this drive
-        iopwrite = 0.0;
-        iopread = 0.0;
-        bcwrite = 0.0;
-        bcread = 0.0;
+        d = adddrive(path);
+        if (d < 0) return result_error;
+        printf("**** Info: %s is drive %d\n", path, d);
+        r = waitq(); // finish queued transfers on the old drive
+        if (r != result_ok) return r;
+        r = selectdrive(d); // set it active
+        if (r != result_ok) return r;
+
+    } else if (**line && **line != ';') { // get drive parameter
+
+        r = getparam(line, &v); // get drive number
+        if (r != result_ok) return r;
+        r = waitq(); // finish queued transfers on the old drive
+        if (r != result_ok) return r;
+        r = selectdrive((int) v); // set it active
+        if (r != result_ok) return r;
 
     } else {
 
@@ -3239,7 +12193,7 @@ result command_listdrives(
 
     printf("Physical drives available:\n");
     printf("\n");
-    for (i = 0; i < 10; i++) {
+    for (i = 0; i < MAXDRIVES; i++) {
 
         r = testdrive(i); // test this drive
         if (!r) {
@@ -3247,7 +12201,8 @@ result command_listdrives(
             r = testsize(i, &t); // get the drive size
             if (!r) {
 
-                s = t / SECSIZE; // find net size in sectors
+                // find net size, in 512 byte sectors as the drive is not open
+                s = t / SECSIZE;
                 printf("Drive %d (%s) available %lld lbas\n", i, getdrvstr(i), s);
 
             }
@@ -3261,6 +12216,56 @@ result command_listdrives(
    
 }
 
+/**
+ *
+ * Set device option
+ *
+ * Sets an option of the I/O system, or lists them with no parameter. Only the
+ * simulated disc has options, which set its size, sector sizes, transfer
+ * times and failure rate. The command format is:
+ *
+ *    devopt [name [val]]
+ *
+ * The value defaults to 0, for options like clear that don't need one.
+ *
+ * \returns Standard discdiag error code.
+ *
+ */
+
+result command_devopt(
+    /** Remaining command line */ char **line
+)
+
+{
+
+    char w[100]; // option name
+    long long v;
+    result r;
+
+    getword(line, w); // get name
+    if (!*w) {
+
+        devopt(NULL, 0);
+
+        return result_ok;
+
+    }
+    v = 0;
+    while (**line == ' ') (*line)++; // skip any leading spaces
+    if (**line && **line != ';') { // get value
+
+        r = getparam(line, &v);
+        if (r != result_ok) return r;
+
+    }
+    r = waitq(); // options can change how queued transfers go
+    if (r != result_ok) return r;
+    if (devopt(w, v)) return result_error;
+
+    return result_ok;
+
+}
+
 /**
  *
  * Unprotect the current drive
@@ -3388,7 +12393,7 @@ result command_loop(
     if (introot) {
 
         // find or create line counter entry
-        cp = fndcnt(&introot->curlin->looplist, *line);
+        cp = fndcnt(*line);
         cp->loopcount++; // increment loop count
         printf("Iteration: %d\n", cp->loopcount);
         if (stopcount < 0 || cp->loopcount < stopcount) {
@@ -3447,7 +12452,7 @@ result command_loopq(
     if (introot) {
 
         // find or create line counter entry
-        cp = fndcnt(&introot->curlin->looplist, *line);
+        cp = fndcnt(*line);
         cp->loopcount++; // increment loop count
         if (stopcount < 0 || cp->loopcount < stopcount) {
 
@@ -3537,9 +12542,8 @@ result command_while(
     } else {
 
         // condition met, throw control frame and continue
-        cp = (ctlstk *) malloc(sizeof(ctlstk));
-        cp->next = ctlroot; // push onto controls stack
-        ctlroot = cp;
+        cp = pushctl(); // push onto controls stack
+        if (!cp) return result_error;
         cp->linpos = introot->curlin; // place line
         cp->chrpos = lines; // set repeat back to parameter
         cp->ctl = ctl_while;
@@ -3629,9 +12633,8 @@ result command_repeat(
     ctlstk *cp;
 
     // throw control frame and continue
-    cp = (ctlstk *) malloc(sizeof(ctlstk));
-    cp->next = ctlroot; // push onto controls stack
-    ctlroot = cp;
+    cp = pushctl(); // push onto controls stack
+    if (!cp) return result_error;
     cp->linpos = introot->curlin; // place line
     cp->chrpos = *line; // set repeat back to parameter
     cp->ctl = ctl_repeat;
@@ -3751,9 +12754,8 @@ result command_for(
     else {
 
         // condition met, throw control frame and continue
-        cp = (ctlstk *) malloc(sizeof(ctlstk));
-        cp->next = ctlroot; // push onto controls stack
-        ctlroot = cp;
+        cp = pushctl(); // push onto controls stack
+        if (!cp) return result_error;
         cp->linpos = introot->curlin; // place line
         cp->chrpos = lines; // set repeat back to parameter
         cp->ctl = ctl_for; // place control type
@@ -4166,6 +13168,12 @@ result command_input(
 
     r = result_ok; // set result ok
     getword(line, w); // get name of variable
+    if (workerno) {
+
+        printf("*** Error: Workers cannot input from the console\n");
+        return result_error;
+
+    }
     // get value for variable from user
     b = readline(stdin, linebuffer, sizeof(linebuffer));
     if (chkbrk() || b) {
@@ -4174,7 +13182,7 @@ result command_input(
         
     } else {
     
-        v = strtoul(linebuffer, NULL, 0); // find number
+        v = (long long)strtoull(linebuffer, NULL, 0); // find number
     
         // try searching the user variables list
         uvar = fndvar(w);
@@ -4246,6 +13254,7 @@ result command_srand(
 {
 
     seed = 42; // reset random number generator
+    lbaseed(42);
 
     return result_ok; // return result ok
 
@@ -4343,6 +13352,10 @@ result command_clear(
 
 {
 
+    result r;
+
+    r = chkedit(); // check program can change
+    if (r != result_ok) return r;
     clrpgm(); // clear out program
 
     return result_ok; // return result ok
@@ -4419,6 +13432,7 @@ result command_load(
     int r;
 
     getword(line, fname); // get filename
+    if (chkedit() != result_ok) return result_error;
     r = loadfile(fname);
     if (r) {
 
@@ -4435,7 +13449,8 @@ result command_load(
  *
  * Delete program line
  *
- * Deletes a single program line by number.
+ * Deletes a single program line by number. Its space is not taken back until
+ * the program is cleared or loaded again.
  *
  * \returns Standard discdiag error code.
  * 
@@ -4450,10 +13465,11 @@ result command_delt(
     long long num;
     result r;
     linestr *p, *l;
-    loopcounter* cp;
 
     r = getparam(line, &num); // get line number to delete
     if (r != result_ok) return r;
+    r = chkedit(); // check program can change
+    if (r != result_ok) return r;
     p = editroot; // index first line
     l = NULL; // set no last line
     while (p && --num) { l = p; p = p->next; } // find target line
@@ -4462,17 +13478,9 @@ result command_delt(
         // gap over line
         if (l) l->next = p->next;
         else editroot = p->next;
-        // remove entry
-        if (p->label) free(p->label); // free label if exists
-        while (p->looplist) { // free any loop counters
-
-            cp = p->looplist; // gap from list
-            p->looplist = cp->next;
-            free(cp); // free
-
-        }
-        free(p->line); // free text line
-        free(p); // free the text header
+        // the entry stays in the program arena until it is cleared
+        flushcache(); // program changed
+        pgmdirty = 1; // and its labels
         
     }
 
@@ -4504,6 +13512,7 @@ result command_end(
         return result_error;
 
     }
+    rptres = result_ok;
     poplvl(); // remove a level
     *line = introot->curchr; // restore at old position
 
@@ -4722,19 +13731,51 @@ result exec(
 
     char w[100]; // command/parameter buffer
     command *cmd; // pointer to command table
-    int found; // found command
     result r; // command result value
     linestr *fp;
     uservar *pp;
     long long val;
+    long mark;
+    cmdent *cp;
+
+    cp = &cmdcache[cacheslot(*line)];
+    if (cp->key == *line && cp->gen == cachegen) { // seen here before
+
+        *line = cp->end; // skip verb
+        fp = cp->pgm;
+        cmd = cp->cmd;
 
-    getword(line, w); // get command verb
-    // search program commands
-    found = 0; // set no command found 
-    fp = fndpgm(w); // search program label
+    } else {
+
+        cp->key = *line; // save where the verb starts
+        getword(line, w); // get command verb
+        // search program commands
+        cmd = NULL;
+        fp = fndpgm(w); // search program label
+        if (!fp) {
+
+            cmd = fndcmd(w); // search built-in commands
+            if (!cmd) {
+           
+                cp->key = NULL; // nothing to keep
+                printf("*** Error: Command \"%s\" invalid\n", w);
+
+                return result_error;
+           
+            }
+
+        }
+        // keep what was found
+        cp->end = *line;
+        cp->gen = cachegen;
+        cp->pgm = fp;
+        cp->cmd = cmd;
+
+    }
     if (fp) { // found a program command execute it
 
         // process parameters
+        mark = vardepth; // they go with the procedure level
         pp = fp->params; // get the parameters list
         while (pp) { // parse and load parameters
 
@@ -4747,34 +13788,11 @@ result exec(
         // save our current position
         if (introot) introot->curchr = *line;
         pushlvl(fp, fp->line); // start a new interp level
+        introot->mark = mark; // release parameters with it
         *line = fp->line; // and point to that
+        r = result_restart; // restart at procedure start
 
-    } else {
-
-        // search built-in commands
-        cmd = cmdtbl; // index start of command table
-        while (cmd && cmd->cmd) { // traverse until end marker seen
-       
-            // If the command matches, execute it
-            if (!strcmp(w, cmd->cmdstr)) {
-       
-                r = cmd->cmd(line); // execute comand 
-                found = 1; // set command was found
-                cmd = NULL; // flag found
-       
-            }
-            if (cmd) cmd++; // next command entry
-       
-        }
-        if (!found) {
-       
-            printf("*** Error: Command \"%s\" invalid\n", w);
-
-            return result_error;
-       
-        }
-
-    }
+    } else r = cmd->cmd(line); // execute comand 
 
     return r; // return with exit status
 
@@ -4800,8 +13818,6 @@ int main(
     linestr dummyline; // We keep a dummy line for immediate mode
     int startup; // we are starting up
     linestr *fp;
-    long long marktime;
-    loopcounter* cp;
     double time;
     int error_result;
 
@@ -4815,13 +13831,28 @@ int main(
     // 
     initio();
     //
+    // Get the transfer buffers. These come from the I/O package so that they
+    // meet any alignment needed for direct access.
+    //
+    bufsecs = NOSECS;
+    writebuffer = allocbuf(secsize*bufsecs);
+    readbuffer = allocbuf(secsize*bufsecs);
+    if (!writebuffer || !readbuffer) {
+
+        printf("*** Error: Cannot allocate space\n");
+
+        return 1;
+
+    }
+    initpool();
+    //
     // Set up ctl-c handler. We don't check if it fails, this would simply mean
     // that the old mode, break out of program, is in effect.
     //
     // Note you will want to comment this out for debugging, since it removes
     // your ability to stop the program if it hangs.
     //
-    breakflag = 0; // clear any break
+    FLAGSET(breakflag, 0); // clear any break
     signal(SIGINT, ctlchandler);
     signal(SIGABRT, ctlchandler);
     //
@@ -4830,13 +13861,22 @@ int main(
     currentdrive = -1; // set no drive active
     writeprot = 1; // set write protect by default
     curmode = compmode_one; // set to compare one by default
-    varroot = NULL; // clear variables root
+    vartop = NULL; // clear variables stack
+    varfill = 0;
+    vardepth = 0;
     editroot = NULL; // clear edit buffer
+    indextbls(); // index commands and variables
+    crcinit(); // make CRC32C tables
+    lbaseed(0); // workers count from 1
     introot = NULL; // clear interpreter stack
     ctlroot = NULL; // clear controls root
+    cntroot = NULL; // clear loop counters
+    nworkers = 0; // no workers running
+    workerno = 0; // this is the main thread
     finish = 0; // set not end
     error_result = 0; // set no error
     exiterror = 0; // set do not exit diagnostic on error
+    r = result_ok; // no line run yet
     // try to find and load our init file
     ri = loadfile("discdiag.ini"); // try to read it
     if (!ri) {
@@ -4849,7 +13889,6 @@ int main(
     dummyline.next = NULL; // no next
     dummyline.label = NULL; // no label
     dummyline.line = linebuffer; // Index standard input buffer
-    dummyline.looplist = NULL; // no loop counters
     // index line buffer
     linep = linebuffer; // index command line
     startup = 1; // set startup active
@@ -4858,15 +13897,10 @@ int main(
         // go to next line
         nxtlin:
 
+        // unwind what an error or break left on the interpreter stack
+        rptres = r;
+        while (introot) poplvl();
         linep = linebuffer; // index line
-        // free any loopcounters in line
-        while (dummyline.looplist != NULL) { // free any loop counters
-
-            cp = dummyline.looplist; // gap from list
-            dummyline.looplist = cp->next;
-            free(cp); // free
-
-        }
         pushlvl(&dummyline, linep); // push as new interpreter level
         rstlin(); // reset all line counters
         if (startup) { // This is the first command execute
@@ -4878,10 +13912,16 @@ int main(
                 // mark time
                 marktime = gettim();
                 // clear the statistics block
+                carryops();
                 iopwrite = 0.0;
                 iopread = 0.0;
                 bcwrite = 0.0; 
                 bcread = 0.0;
+                ioptrim = iopzero = bctrim = bczero = 0.0;
+                devns = patns = compns = idlens = 0;
+                ratenext = 0; // pacing starts with the line
+                rptnlist = 0; // and its list of failures
+                rptmark(&rptlin);
                 pushlvl(fp, fp->line); // start a new interp level
                 linep = fp->line; // and point to that
                 startup = 0; // set not in startup
@@ -4892,21 +13932,18 @@ int main(
 
         } else { // process time
 
+            waitq(); // count any transfers still queued
             time = elapsed(marktime); // get the time passed in seconds
-            printf("Time: %.2fs ", time);
-            printscpersec("IOW: ", iopwrite, time);
-            printscpersec("IOR: ", iopread, time);
-            printscpersec("IO: ", iopwrite+iopread, time);
-            printf("\n");
-            printscpersec("BW: ", bcwrite, time);
-            printscpersec("BR: ", bcread, time);
-            printscpersec("BT: ", bcwrite+bcread, time);
-            printf("\n");
+            printstats(time, iopwrite, iopread, bcwrite, bcread);
+            printdisc(time, ioptrim, iopzero, bctrim, bczero);
+            printcpu(gettim()-marktime, devns, idlens, patns, compns);
+            rptline(linebuffer, time, r);
 
         }
         // prompt and get command line
         printf("Diag> ");
         readline(stdin, linebuffer, sizeof(linebuffer));
+        flushcache(); // the line buffer has new text
         // see if we got a break during line entry
         if (chkbrk()) {
 
@@ -4918,95 +13955,76 @@ int main(
         // mark time
         marktime = gettim();
         // clear the statistics block
+        carryops();
         iopwrite = 0.0;
         iopread = 0.0;
         bcwrite = 0.0; 
         bcread = 0.0;
+        ioptrim = iopzero = bctrim = bczero = 0.0;
+        devns = patns = compns = idlens = 0;
+        ratenext = 0; // pacing starts with the line
+        rptnlist = 0; // and its list of failures
+        rptmark(&rptlin);
+        r = result_ok;
         while (*linep == ' ') linep++; // skip spaces
         if (isdigit(*linep)) { // leading number, is edit line
 
-            enterline(linep); // place line in storage
+            // place line in storage, if it can change now
+            if (chkedit() == result_ok) enterline(linep);
 
         } else { // execute immediate
 
-            do { // execute across program lines
-
-                nxtcmd: // execute next command
-
-                // if comment, go next line
-                while (*linep == ' ') linep++; // skip spaces
-                if (*linep == '!') goto nxtpgm;
-                if (*linep) { // ignore blank lines
-                
-                    while (!finish && *linep) { // execute commands on line
-                
-                        // execute single command
-                        r = exec(&linep);
-                        // set error status for diagnostic exit purposes
-                        error_result = r == result_error;
-                        // dispatch special codes
-                        if (r == result_exit) goto exit; // exit command
-                        if (r == result_stop) goto nxtlin; // go fetch next line
-                        if (r == result_error) {
-
-                            if (exiterror) goto exit; // exit diagnostic
-                            else goto nxtlin; // go fetch next line
-
-                        }
-                        if (chkbrk()) { // check break
-                        
-                            if (exiterror) goto exit; // exit diagnostic
-                            goto nxtlin; // return to command entry
-                            
-                        }
-                        while (*linep == ' ') linep++; // skip spaces
-                        // if comment, go next line
-                        if (*linep == '!') goto nxtpgm;
-                        if (r != result_restart) { // check for command ending
-
-                            if (*linep && *linep != ';') {
-      
-                                printf("*** Error: Invalid command termination\n");
-                                goto nxtlin; // go fetch next line
-
-                            }
-                            if (*linep == ';') linep++; // skip ';'
-                            while (*linep == ' ') linep++; // skip spaces
+            nxtcmd: // execute from line position
+            r = runpgm(linep);
+            // set error status for diagnostic exit purposes
+            error_result = r == result_error;
+            // dispatch special codes
+            if (r == result_exit) goto exit; // exit command
+            if (r == result_error || r == result_break) {
 
-                        }
-                
-                    }
-                
-                }
-                nxtpgm: // execute next program line
-                if (introot && introot->next) {
-
-                    // not in immediate mode, advance to next line in program
-                    introot->curlin = introot->curlin->next;
-                    // if not end of program, set start of new line
-                    if (introot->curlin) linep = introot->curlin->line;
-                    else {
-
-                        // end of program, flush stack and bail
-                        while (introot) poplvl();
-
-                    }
+                if (exiterror) goto exit; // exit diagnostic
+                else goto nxtlin; // go fetch next line
 
-                }
-
-            } while (introot && introot->next); // while not immediate mode
+            }
+            if (r == result_stop) goto nxtlin; // go fetch next line
 
         }
         // drain the interpreter stack
+        rptres = r;
         while (introot) poplvl();
 
     } while (!finish); // until exit
 
     exit:// exit diagnostic
 
+    // stop any workers still running
+    if (nworkers) {
+
+        FLAGSET(workbreak, 1);
+        waitworkers();
+
+    }
+
     // deinitialize I/O package
     deinitio();
 
+    // release the transfer buffers
+    freepool();
+    // release the interpreter state
+    rptres = r;
+    while (introot) poplvl();
+    rptend(); // summarize the drives and close the report
+    rptclear();
+    while (ctlroot) popctl();
+    clrcnt();
+    freeframes();
+    arenafree(&pgmarena);
+    freecache();
+    freesym();
+    mapclear();
+    lbaclear(&lbalst);
+    if (intfp) fclose(intfp); // close any statistics file
+
     // exit with the last command result
     return error_result;
 
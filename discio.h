@@ -13,7 +13,7 @@
 
 /**
  *
- * Total sectors that can reside in the buffer
+ * Total sectors that reside in the buffer at startup
  *
  */
 #ifdef __LARGE__
@@ -22,27 +22,184 @@
 #define NOSECS 256 // windows/linux
 #endif
 
+/**
+ *
+ * Largest buffer, in sectors, that can be set with the bufsize command
+ *
+ * A whole buffer goes to the drive as one queued request, and Linux moves at
+ * most 0x7ffff000 bytes in one request, so the buffer stops there. It is a
+ * multiple of 8, so it is still whole sectors on 4096 byte sector drives.
+ *
+ */
+#ifdef __LARGE__
+#define MAXSECS NOSECS // dos (buffers can't grow past a segment)
+#else
+#define MAXSECS 4194296 // windows/linux (0x7ffff000 bytes in SECSIZE sectors)
+#endif
+
 /**
  *
  * Size of a sector (same since the PDP-11 days, 256 * 16 bits)
  *
+ * This is the smallest sector size, and the one drives have unless they say
+ * otherwise. Drives with 4096 byte sectors report that through sectorsize().
+ *
  */
 #define SECSIZE 512
 
+/**
+ *
+ * Alignment of transfer buffers
+ *
+ * Direct (unbuffered) transfers need the buffer aligned to at least the
+ * sector size of the drive. A page covers every drive we know of.
+ *
+ */
+#define BUFALIGN 4096
+
+/**
+ *
+ * Size of a huge page
+ *
+ * Buffers at least this big are aligned to it, so the system can back them
+ * with huge pages where it supports that.
+ *
+ */
+#define HUGEPAGE (2*1024*1024)
+
+/**
+ *
+ * Maximum number of asynchronous requests that can be in flight
+ *
+ */
+#ifdef __LARGE__
+#define QDMAX 4 // dos
+#else
+#define QDMAX 256 // windows/linux
+#endif
+
+/**
+ *
+ * Number of drive numbers
+ *
+ * Drives known at startup have the first numbers, and paths given to
+ * adddrive, like image files, get the next ones.
+ *
+ */
+#ifdef __LARGE__
+#define MAXDRIVES 10 // dos (BIOS drives only)
+#else
+#define MAXDRIVES 64 // windows/linux
+#endif
+
+/**
+ *
+ * Maximum number of worker threads
+ *
+ */
+#ifdef __LARGE__
+#define MAXWORKERS 1 // dos (no threads)
+#else
+#define MAXWORKERS 64 // windows/linux
+#endif
+
+/**
+ *
+ * Thread local storage
+ *
+ * Marks state that each worker thread keeps its own copy of. Compilers that
+ * don't have it are single threaded here anyway.
+ *
+ */
+#if defined(__GNUC__)
+#define THREAD __thread
+#elif defined(_MSC_VER)
+#define THREAD __declspec(thread)
+#else
+#define THREAD
+#endif
+
+/**
+ *
+ * Flags shared between threads
+ *
+ * Reads and sets a flag that one thread sets and others look at, with the
+ * order that needs, so whatever was done before it is set is seen by those
+ * that see it set. Volatile alone doesn't give that. Microsoft C gives
+ * volatile accesses that order, so there the flag, an int, is reached
+ * through a volatile pointer, and the rest are single threaded here.
+ *
+ */
+#if defined(__GNUC__)
+#define FLAGGET(f) __atomic_load_n(&(f), __ATOMIC_ACQUIRE)
+#define FLAGSET(f, v) __atomic_store_n(&(f), (v), __ATOMIC_RELEASE)
+#else
+#define FLAGGET(f) (*(volatile int *) &(f))
+#define FLAGSET(f, v) (*(volatile int *) &(f) = (v))
+#endif
+
+/**
+ *
+ * Asynchronous I/O completion
+ *
+ * Filled in by reap() for each queued request that has finished.
+ *
+ */
+typedef struct _iocmp {
+
+    /** Request was a write */           int write;
+    /** Logical block address */         long long lba;
+    /** Number of sectors */             long long numsec;
+    /** Tag given at submit */           int tag;
+    /** Request failed */                int error;
+    /** Latency in nanoseconds */        long long lat;
+
+} iocmp;
+
 /**
  *
  * Exported functons declarations
  *
+ * Transfers are positional. Each call gives its own 64 bit LBA and sector
+ * count, and no file position is kept between calls.
+ *
  */
 int setdrive(int drive);
 int getdrive(void);
 int testdrive(int drive);
 int readsector(unsigned char *buffer, long long lba, long long numsec);
 int writesector(unsigned char *buffer, long long lba, long long numsec);
+int trimsector(long long lba, long long numsec);
+int zerosector(long long lba, long long numsec);
 int physize(long long *size);
+int sectorsize(int *lsize, int *psize);
+int devopt(const char *name, long long val);
 int testsize(int drive, long long *size);
+int setqd(int depth);
+int getqd(void);
+int submitread(unsigned char *buffer, long long lba, long long numsec, int tag);
+int submitwrite(unsigned char *buffer, long long lba, long long numsec, int tag);
+int submitv(int write, unsigned char **buffers, long long *lbas,
+            long long *numsecs, int n, int tag);
+int reap(iocmp *cmp, int min, int max);
+int inflight(void);
+int reapby(iocmp *cmp, int max, long long t);
+void setissue(long long t);
+int cancelq(void);
+int setdirect(int on);
+int getdirect(void);
+unsigned char *allocbuf(long long size);
+void freebuf(unsigned char *buffer, long long size);
+int newthread(int id, void (*fn)(void *), void *arg);
+int waitthread(int id);
+void initthread(void);
+void deinitthread(void);
+int pinthread(int cpu, int node);
+int drivenode(int drive);
 const char* getdrvstr(int drive);
+int adddrive(const char *path);
 int chkbrk(void);
+int brkpend(void);
 long long gettim(void);
 double elapsed(long long t);
 void initio(void);
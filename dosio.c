@@ -14,15 +14,70 @@
 *
 * writesector - Write one or more sectors to a buffer.
 *
+* trimsector  - Discard one or more sectors, not supported.
+*
+* zerosector  - Set one or more sectors to zero.
+*
 * physize     - Get the size of the physical drive in lbas.
 *
+* sectorsize  - Get the logical and physical sector sizes of the drive.
+*
+* devopt      - Set or list device options, of which there are none.
+*
 * testsize    - Get the size of a physical drive in lbas, but takes drive as
 *               parameter.
 *
+* setqd       - Set the asynchronous queue depth.
+*
+* getqd       - Get the asynchronous queue depth.
+*
+* submitread  - Queue a read of one or more sectors to a buffer.
+*
+* submitwrite - Queue a write of one or more sectors from a buffer.
+*
+* submitv     - Queue a batch of reads or writes.
+*
+* reap        - Collect finished queued requests.
+*
+* inflight    - Get the number of queued requests not yet reaped.
+*
+* reapby      - Collect finished queued requests, waiting no later than a
+*               given time.
+*
+* setissue    - Set the time the next queued request was meant to be sent.
+*
+* cancelq     - Cancel queued requests still in flight.
+*
+* setdirect   - Set direct (unbuffered) access mode on or off.
+*
+* getdirect   - Get direct access mode.
+*
+* allocbuf    - Allocate an aligned transfer buffer.
+*
+* freebuf     - Free a transfer buffer.
+*
+* newthread   - Start a worker thread.
+*
+* waitthread  - Wait for a worker thread to finish.
+*
+* initthread  - Set up the I/O state of a new thread.
+*
+* deinitthread - Tear down the I/O state of a thread.
+*
+* pinthread   - Pin the calling thread to a CPU or NUMA node.
+*
+* drivenode   - Get the NUMA node a drive is attached to.
+*
 * closedrive  - Close current drive.
 *
 * getdrvstr   - Gets the string corresponding to a given logical drive.
 *
+* adddrive    - Give a path a drive number.
+*
+* gettim      - Get the high resolution timer in nanoseconds.
+*
+* elapsed     - Find the seconds passed since a timer reading.
+*
 * initio      - Initializes this module
 *
 * deinitio    - Deinitializes this module.
@@ -30,6 +85,8 @@
 ******************************************************************************/
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
 #include "discio.h"
 
 /*
@@ -42,9 +99,37 @@ int getdrive(void);
 int testdrive(int drive);
 int readsector(unsigned char *buffer, long long lba, long long numsec);
 int writesector(unsigned char *buffer, long long lba, long long numsec);
+int trimsector(long long lba, long long numsec);
+int zerosector(long long lba, long long numsec);
 int physize(long long *size);
+int sectorsize(int *lsize, int *psize);
+int devopt(const char *name, long long val);
 int testsize(int drive, long long *size);
+int setqd(int depth);
+int getqd(void);
+int submitread(unsigned char *buffer, long long lba, long long numsec, int tag);
+int submitwrite(unsigned char *buffer, long long lba, long long numsec, int tag);
+int submitv(int write, unsigned char **buffers, long long *lbas,
+            long long *numsecs, int n, int tag);
+int reap(iocmp *cmp, int min, int max);
+int inflight(void);
+int reapby(iocmp *cmp, int max, long long t);
+void setissue(long long t);
+int cancelq(void);
+int setdirect(int on);
+int getdirect(void);
+unsigned char *allocbuf(long long size);
+void freebuf(unsigned char *buffer, long long size);
+int newthread(int id, void (*fn)(void *), void *arg);
+int waitthread(int id);
+void initthread(void);
+void deinitthread(void);
+int pinthread(int cpu, int node);
+int drivenode(int drive);
 const char* getdrvstr(int drive);
+int adddrive(const char *path);
+long long gettim(void);
+double elapsed(long long t);
 void initio(void);
 void deinitio(void);
 
@@ -92,6 +177,30 @@ char* phystr[10] = {
  */
 static int phydrive;
 
+/**
+ *
+ * Direct access mode
+ *
+ * BIOS transfers are never cached, so this only records the mode.
+ *
+ */
+static int directio;
+
+/**
+ *
+ * Queued request completions
+ *
+ * BIOS disc calls only return when done, so queued requests are performed when
+ * they are submitted and their completions held here until reaped. The queue
+ * is kept small to save data space.
+ *
+ */
+static iocmp qcmp[QDMAX];
+
+/** Queue depth, or maximum requests in flight */ static int qdepth;
+/** Number of requests waiting to be reaped */    static int qcount;
+/** Time next request was meant to go, 0 is now */ static long long qissue;
+
 /**
  *
  * Current drive geometry information
@@ -377,6 +486,540 @@ int writesector(
 
 }
 
+/**
+ *
+ * Trim sectors
+ *
+ * BIOS drives have no discard, so this always fails.
+ * Returns 1 on error, 0 on success.
+ *
+ */
+int trimsector(
+    /** Logical block address to start */ long long lba,
+    /** Number of sectors to discard */   long long numsec
+)
+
+{
+
+    printf("*** Error: Trim is not supported on this system\n");
+
+    return 1;
+
+}
+
+/**
+ *
+ * Zero sectors
+ *
+ * Sets the given number of sectors to zero, by writing zeros a sector at a
+ * time, since BIOS drives can't zero a span themselves.
+ * Returns 1 on error, 0 on success.
+ *
+ */
+int zerosector(
+    /** Logical block address to start */ long long lba,
+    /** Number of sectors to zero */      long long numsec
+)
+
+{
+
+    static unsigned char zbuf[SECSIZE];
+
+    while (numsec-- > 0) if (writesector(zbuf, lba++, 1)) return 1;
+
+    return 0;
+
+}
+
+/**
+ *
+ * Set queue depth
+ *
+ * Sets the maximum number of requests that can be in flight at once. The queue
+ * must be empty.
+ *
+ * Returns 1 on error, 0 on success.
+ *
+ */
+int setqd(
+    /** Depth of queue */ int depth
+)
+
+{
+
+    if (depth < 1 || depth > QDMAX) {
+
+        printf("*** Error: Queue depth must be 1 to %d\n", QDMAX);
+        return 1;
+
+    }
+    if (qcount) {
+
+        printf("*** Error: Requests are still in flight\n");
+        return 1;
+
+    }
+    qdepth = depth;
+
+    return 0;
+
+}
+
+/**
+ *
+ * Get queue depth
+ *
+ * Gets the maximum number of requests that can be in flight at once.
+ *
+ */
+int getqd(void)
+
+{
+
+    return qdepth; // just return
+
+}
+
+/**
+ *
+ * Submit request
+ *
+ * Performs a read or write right away, and files its completion to be reaped.
+ *
+ * Returns 1 on error, 0 on success.
+ *
+ */
+static int submit(
+    /** Request is write */               int write,
+    /** Buffer to transfer */             unsigned char *buffer,
+    /** Logical block address to start */ long long lba,
+    /** Number of sectors to transfer */  long long numsec,
+    /** Tag to return on completion */    int tag
+)
+
+{
+
+    iocmp *cp;
+    int r;
+    long long t, s;
+
+    s = qissue; // take the send time, good for this request only
+    qissue = 0;
+    if (phydrive < 0) {
+
+        printf("*** Error: Physical drive not set\n");
+        return 1;
+
+    }
+    if (qcount >= qdepth) {
+
+        printf("*** Error: Queue is full\n");
+        return 1;
+
+    }
+    // perform the transfer now
+    t = gettim();
+    if (write) r = writesector(buffer, lba, numsec);
+    else r = readsector(buffer, lba, numsec);
+    // file the completion
+    cp = &qcmp[qcount++];
+    cp->write = write;
+    cp->lba = lba;
+    cp->numsec = numsec;
+    cp->tag = tag;
+    cp->error = r;
+    cp->lat = gettim()-(s ? s : t); // from when it was meant to go
+
+    return 0; // return good
+
+}
+
+/**
+ *
+ * Submit read
+ *
+ * Queues a read of the given number of sectors to the indicated buffer.
+ * Returns 1 on error, 0 on success.
+ *
+ */
+int submitread(
+    /** Buffer to read sector to */       unsigned char *buffer,
+    /** Logical block address to start */ long long lba,
+    /** Number of sectors to read */      long long numsec,
+    /** Tag to return on completion */    int tag
+)
+
+{
+
+    return submit(0, buffer, lba, numsec, tag);
+
+}
+
+/**
+ *
+ * Submit write
+ *
+ * Queues a write of the given number of sectors from the indicated buffer.
+ * Returns 1 on error, 0 on success.
+ *
+ */
+int submitwrite(
+    /** Buffer to write sector from */    unsigned char *buffer,
+    /** Logical block address to start */ long long lba,
+    /** Number of sectors to write */     long long numsec,
+    /** Tag to return on completion */    int tag
+)
+
+{
+
+    return submit(1, buffer, lba, numsec, tag);
+
+}
+
+/**
+ *
+ * Submit batch
+ *
+ * Queues a batch of reads or writes, each with its own buffer and LBA, tagged
+ * from tag up. The BIOS finishes each request as it is sent, so they are just sent one
+ * after another.
+ * Returns 1 on error, 0 on success.
+ *
+ */
+int submitv(
+    /** Batch is writes */                 int write,
+    /** Buffer of each transfer */         unsigned char **buffers,
+    /** Logical block address of each */   long long *lbas,
+    /** Number of sectors in each */       long long *numsecs,
+    /** Number of transfers */             int n,
+    /** Tag of first transfer */           int tag
+)
+
+{
+
+    long long t;
+    int i;
+
+    t = qissue; // the whole batch was meant to go at once
+    for (i = 0; i < n; i++) {
+
+        qissue = t;
+        if (submit(write, buffers[i], lbas[i], numsecs[i], tag+i)) return 1;
+
+    }
+
+    return 0; // return good
+
+}
+
+/**
+ *
+ * Reap finished requests
+ *
+ * Returns up to max finished requests in the completion array, oldest first.
+ * Since everything queued is already finished, this never waits, and the
+ * minimum is only there to match the other platforms.
+ *
+ * Returns the number of completions, or -1 on error.
+ *
+ */
+int reap(
+    /** Completion array */          iocmp *cmp,
+    /** Minimum number to wait for */ int min,
+    /** Maximum number to return */   int max
+)
+
+{
+
+    int i;
+
+    if (max > qcount) max = qcount;
+    for (i = 0; i < max; i++) cmp[i] = qcmp[i];
+    // move any remaining entries down
+    for (i = max; i < qcount; i++) qcmp[i-max] = qcmp[i];
+    qcount -= max;
+
+    return max;
+
+}
+
+/**
+ *
+ * Find requests in flight
+ *
+ * Returns the number of queued requests that have not been reaped.
+ *
+ */
+int inflight(void)
+
+{
+
+    return qcount; // just return
+
+}
+
+/**
+ *
+ * Reap finished requests by a time
+ *
+ * Returns up to max finished requests in the completion array, or if there are
+ * none, waits until the timer reaches the given time. Requests finish as they
+ * are sent, so there is nothing to wait for otherwise. The wait polls the
+ * timer.
+ *
+ * Returns the number of completions, 0 if the time came first, or -1 on error.
+ *
+ */
+int reapby(
+    /** Completion array */          iocmp *cmp,
+    /** Maximum number to return */   int max,
+    /** Time to wait until */         long long t
+)
+
+{
+
+    if (qcount) return reap(cmp, 0, max);
+    while (gettim() < t); // poll the timer
+
+    return 0;
+
+}
+
+/**
+ *
+ * Set send time
+ *
+ * Sets the time the next submitread, submitwrite or submitv was meant to be
+ * sent, when that is earlier than it will be. The latency of what it sends is
+ * counted from then, so a request held up behind others is not counted as
+ * faster than it was. 0 counts from when it is sent, which is also what the
+ * requests after that one do.
+ *
+ */
+void setissue(
+    /** Time meant to send, or 0 */ long long t
+)
+
+{
+
+    qissue = t;
+
+}
+
+/**
+ *
+ * Cancel queued requests
+ *
+ * Requests finish as they are sent, so there is never one in flight to
+ * cancel.
+ *
+ * Returns the number of requests cancelled.
+ *
+ */
+int cancelq(void)
+
+{
+
+    return 0; // nothing to cancel
+
+}
+
+/**
+ *
+ * Set direct access mode
+ *
+ * Turns direct access on or off. BIOS transfers are never cached, so this only
+ * records the mode.
+ *
+ * Returns 1 on error, 0 on success.
+ *
+ */
+int setdirect(
+    /** Direct mode on */ int on
+)
+
+{
+
+    directio = !!on;
+
+    return 0;
+
+}
+
+/**
+ *
+ * Get direct access mode
+ *
+ * Returns true if direct access is on.
+ *
+ */
+int getdirect(void)
+
+{
+
+    return directio; // just return
+
+}
+
+/**
+ *
+ * Allocate transfer buffer
+ *
+ * Allocates a transfer buffer. BIOS transfers have no alignment needs, so this
+ * is a plain allocation.
+ *
+ * Returns the buffer, or NULL if there is no memory.
+ *
+ */
+unsigned char *allocbuf(
+    /** Size of buffer in bytes */ long long size
+)
+
+{
+
+    return (unsigned char *) malloc((size_t) size);
+
+}
+
+/**
+ *
+ * Free transfer buffer
+ *
+ * Frees a buffer from allocbuf().
+ *
+ */
+void freebuf(
+    /** Buffer to free */         unsigned char *buffer,
+    /** Size of buffer in bytes */ long long size
+)
+
+{
+
+    free(buffer);
+
+}
+
+/**
+ *
+ * Start worker thread
+ *
+ * DOS has no threads, so workers are not supported here.
+ *
+ * Returns 1 on error, 0 on success.
+ *
+ */
+int newthread(
+    /** Worker slot */       int id,
+    /** Function to run */   void (*fn)(void *),
+    /** Argument to pass */  void *arg
+)
+
+{
+
+    printf("*** Error: Workers are not supported on this system\n");
+
+    return 1;
+
+}
+
+/**
+ *
+ * Wait for worker thread
+ *
+ * No thread can have been started, so there is nothing to wait for.
+ *
+ * Returns 1 on error, 0 on success.
+ *
+ */
+int waitthread(
+    /** Worker slot */ int id
+)
+
+{
+
+    return 1;
+
+}
+
+/**
+ *
+ * Initialize thread I/O state
+ *
+ * Sets up the drive and queue state. There is only the main thread.
+ *
+ */
+void initthread(void)
+
+{
+
+    phydrive = -1; // set no drive is active
+    directio = 0; // set direct mode off
+    qdepth = 1; // set no queueing
+    qcount = 0;
+
+}
+
+/**
+ *
+ * Deinitialize thread I/O state
+ *
+ * Closes any drive that is open.
+ *
+ */
+void deinitthread(void)
+
+{
+
+    closedrive(); // close any active drive
+
+}
+
+/**
+ *
+ * Pin thread
+ *
+ * DOS has just the one CPU and node, so only they can be given.
+ *
+ * Returns 1 on error, 0 on success.
+ *
+ */
+int pinthread(
+    /** CPU number, or -1 for none */  int cpu,
+    /** Node number, or -1 for none */ int node
+)
+
+{
+
+    if (cpu > 0 || node > 0) {
+
+        printf("*** Error: Only CPU 0 and node 0 exist\n");
+        return 1;
+
+    }
+
+    return 0;
+
+}
+
+/**
+ *
+ * Get drive NUMA node
+ *
+ * DOS has no NUMA nodes.
+ *
+ * Returns -1, not known.
+ *
+ */
+int drivenode(
+    /** Drive number */ int drive
+)
+
+{
+
+    return -1;
+
+}
+
 /**
  *
  * Find size of physical disc
@@ -410,6 +1053,64 @@ int physize(
 
 }
 
+/**
+ *
+ * Get sector sizes of physical disc
+ *
+ * Gets the logical sector size, which LBAs and transfers are counted in, and
+ * the physical sector size the drive writes in. BIOS drives have 512 byte sectors.
+ *
+ * Returns 0 on succeed, 1 on fail.
+ *
+ */
+int sectorsize(
+    /** return logical sector size */  int *lsize,
+    /** return physical sector size */ int *psize
+)
+
+{
+
+    if (phydrive < 0) {
+
+        printf("*** Error: Physical drive not set\n");
+        return 1;
+
+    }
+    *lsize = SECSIZE;
+    *psize = SECSIZE;
+
+    return 0;
+
+}
+
+/**
+ *
+ * Set device option
+ *
+ * Device options are for the simulated disc. There are none for real drives.
+ *
+ * Returns 1 on error, 0 on success.
+ *
+ */
+int devopt(
+    /** Option name, or NULL to list */ const char *name,
+    /** Value to set */                 long long val
+)
+
+{
+
+    if (!name) {
+
+        printf("No device options\n");
+        return 0;
+
+    }
+    printf("*** Error: Device option not recognized\n");
+
+    return 1;
+
+}
+
 /**
  *
  * Test size of physical disc
@@ -475,12 +1176,68 @@ const char* getdrvstr(int drive)
     p = 0; // set no drive string
 
     // check drive is valid and set corresponding string
-    if (drive >= 0 || drive <= 9) p = phystr[drive];
+    if (drive >= 0 && drive <= 9) p = phystr[drive];
 
     return p;
 
 }
 
+/**
+ *
+ * Add drive
+ *
+ * BIOS drives are only known by number, so paths can't be added.
+ *
+ * Returns the drive number, or -1 on error.
+ *
+ */
+int adddrive(
+    /** Path of device or file */ const char *path
+)
+
+{
+
+    printf("*** Error: Drive paths are not supported on this system\n");
+
+    return -1;
+
+}
+
+/**
+ *
+ * Get high resolution timer
+ *
+ * Returns the clock in nanoseconds. DOS only has the tick clock, so this is
+ * still coarse, but BIOS transfers don't return until done, so it is at least
+ * wall time.
+ *
+ */
+long long gettim(void)
+
+{
+
+    return (long long) clock()*1000000000LL/CLOCKS_PER_SEC;
+
+}
+
+/**
+ *
+ * Find elapsed time in seconds
+ *
+ * Finds the seconds passed since the given timer reading. Returns as a floating
+ * point value so that fractional times can be represented.
+ *
+ */
+double elapsed(
+    /** reference time */ long long t
+)
+
+{
+
+    return (gettim()-t)/1000000000.0;
+
+}
+
 /**
  *
  * Initialize I/O package
@@ -495,7 +1252,7 @@ void initio(void)
     printf("DOS/BIOS interface\n");
     printf("\n");
 
-    phydrive = -1; // set no drive is active
+    initthread(); // set up drive and queue state
 
 }
 
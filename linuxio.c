@@ -14,23 +14,95 @@
 *
 * writesector - Write one or more sectors to a buffer.
 *
+* trimsector  - Discard one or more sectors.
+*
+* zerosector  - Set one or more sectors to zero.
+*
 * physize     - Get the size of the physical drive in lbas.
 *
+* sectorsize  - Get the logical and physical sector sizes of the drive.
+*
+* devopt      - Set or list device options, of which there are none.
+*
 * testsize    - Get the size of a physical drive in lbas, but takes drive as
 *               parameter.
 *
+* setqd       - Set the asynchronous queue depth.
+*
+* getqd       - Get the asynchronous queue depth.
+*
+* submitread  - Queue a read of one or more sectors to a buffer.
+*
+* submitwrite - Queue a write of one or more sectors from a buffer.
+*
+* submitv     - Queue a batch of reads or writes.
+*
+* reap        - Collect finished queued requests.
+*
+* inflight    - Get the number of queued requests not yet reaped.
+*
+* reapby      - Collect finished queued requests, waiting no later than a
+*               given time.
+*
+* setissue    - Set the time the next queued request was meant to be sent.
+*
+* cancelq     - Cancel queued requests still in flight.
+*
+* setdirect   - Set direct (unbuffered) access mode on or off.
+*
+* getdirect   - Get direct access mode.
+*
+* allocbuf    - Allocate an aligned transfer buffer.
+*
+* freebuf     - Free a transfer buffer.
+*
+* newthread   - Start a worker thread.
+*
+* waitthread  - Wait for a worker thread to finish.
+*
+* initthread  - Set up the I/O state of a new thread.
+*
+* deinitthread - Tear down the I/O state of a thread.
+*
+* pinthread   - Pin the calling thread to a CPU or NUMA node.
+*
+* drivenode   - Get the NUMA node a drive is attached to.
+*
 * getdrvstr   - Gets the string corresponding to a given logical drive.
 *
+* adddrive    - Give a device or image file path a drive number.
+*
+* gettim      - Get the high resolution timer in nanoseconds.
+*
+* elapsed     - Find the seconds passed since a timer reading.
+*
 * initio      - Initializes this module
 * 
 * deinitio    - Deinitializes this module.
 *
 ******************************************************************************/
 
+#define _GNU_SOURCE // for O_DIRECT
+
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <limits.h>
+#include <dirent.h>
+#include <sched.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
 #include <linux/fs.h>
+#include <linux/aio_abi.h>
+#include <linux/mempolicy.h>
+#include <pthread.h>
 #include "discio.h"
 
 /**
@@ -43,9 +115,37 @@ int getdrive(void);
 int testdrive(int drive);
 int readsector(unsigned char *buffer, long long lba, long long numsec);
 int writesector(unsigned char *buffer, long long lba, long long numsec);
+int trimsector(long long lba, long long numsec);
+int zerosector(long long lba, long long numsec);
 int physize(long long *size);
+int sectorsize(int *lsize, int *psize);
+int devopt(const char *name, long long val);
 int testsize(int drive, long long *size);
+int setqd(int depth);
+int getqd(void);
+int submitread(unsigned char *buffer, long long lba, long long numsec, int tag);
+int submitwrite(unsigned char *buffer, long long lba, long long numsec, int tag);
+int submitv(int write, unsigned char **buffers, long long *lbas,
+            long long *numsecs, int n, int tag);
+int reap(iocmp *cmp, int min, int max);
+int inflight(void);
+int reapby(iocmp *cmp, int max, long long t);
+void setissue(long long t);
+int cancelq(void);
+int setdirect(int on);
+int getdirect(void);
+unsigned char *allocbuf(long long size);
+void freebuf(unsigned char *buffer, long long size);
+int newthread(int id, void (*fn)(void *), void *arg);
+int waitthread(int id);
+void initthread(void);
+void deinitthread(void);
+int pinthread(int cpu, int node);
+int drivenode(int drive);
 const char* getdrvstr(int drive);
+int adddrive(const char *path);
+long long gettim(void);
+double elapsed(long long t);
 void initio(void);
 void deinitio(void);
 
@@ -55,13 +155,45 @@ void deinitio(void);
  *
  */
 static void closedrive(void);
+static void closequeue(void);
+static int getsize(int fd, long long *size);
+static int opendrive(int drive, int flags);
+static int transfer(int write, unsigned char *buffer, long long lba,
+                    long long numsec);
+static int discard(int zero, long long lba, long long numsec);
+static int nodecpus(int node, cpu_set_t *set);
+static int getdone(iocmp *cmp, int min, int max, struct timespec *timeout);
+
+/**
+ *
+ * Largest piece of a synchronous transfer
+ *
+ * Linux moves at most a little under 2gb in one read or write, so bigger
+ * transfers are done in pieces of this many bytes.
+ *
+ */
+#define XFERMAX 0x40000000
+
+/**
+ *
+ * Most NUMA nodes
+ *
+ * Size of the node masks given to the kernel, in nodes.
+ *
+ */
+#define MAXNODES 1024
 
 /**
  *
- * String equivalences of the first 10 phy drives
+ * Drive registry
+ *
+ * The path of each drive number. The first 10 are /dev/sda to /dev/sdj, as
+ * they always were, then the NVMe namespaces found at startup, then paths
+ * given with adddrive, which can be devices or image files. The registry is
+ * only added to from the main thread with no workers running.
  *
  */
-char* phystr[10] = {
+char* phystr[MAXDRIVES] = {
 
     "/dev/sda",
     "/dev/sdb",
@@ -76,6 +208,9 @@ char* phystr[10] = {
 
 };
 
+/** Drive numbers in use */               static int physcount = 10;
+/** Path was allocated by adddrive */     static int physalloc[MAXDRIVES];
+
 /**
  *
  * Active drive number
@@ -83,22 +218,82 @@ char* phystr[10] = {
  * The number of the physical drive to access.
  * -1 indicates drive was never set.
  *
+ * This, and the rest of the drive and queue state, is kept per thread, so
+ * that each worker has its own drive handle and queue.
+ *
  */
-static int phydrive;
+static THREAD int phydrive;
 
 /**
  *
  * Linux handle to phy drive
  *
  */
-static int phydriveh;
+static THREAD int phydriveh;
+
+/**
+ *
+ * Sector sizes of phy drive
+ *
+ * The logical sector size is the unit of LBAs and transfers. The physical one
+ * is what the drive writes at once, and may be a multiple of it.
+ *
+ */
+/** Logical sector size */  static THREAD int lsecsize = SECSIZE;
+/** Physical sector size */ static THREAD int psecsize = SECSIZE;
+
+/**
+ *
+ * Direct access mode
+ *
+ * When set, the drive is opened with O_DIRECT so that transfers go to the
+ * drive instead of the page cache.
+ *
+ */
+static THREAD int directio;
+
+/**
+ *
+ * Asynchronous I/O context
+ *
+ * The kernel AIO context that queued requests are submitted to. It is created
+ * on the first submit after the queue depth is set, and is 0 when it does not
+ * exist.
+ *
+ */
+static THREAD aio_context_t ioctx;
+
+/** Queue depth, or maximum requests in flight */ static THREAD int qdepth;
+/** Number of requests in flight */               static THREAD int qcount;
+/** Request control blocks */                     static THREAD struct iocb qiocb[QDMAX];
+/** Caller tags for requests */                   static THREAD int qtag[QDMAX];
+/** Time requests were submitted */               static THREAD long long qstart[QDMAX];
+/** Stack of free control blocks */               static THREAD int qfree[QDMAX];
+/** Top of free control block stack */            static THREAD int qfreetop;
+/** Time next request was meant to go, 0 is now */ static THREAD long long qissue;
+/** Cancel was tried on request */                static THREAD int qcancel[QDMAX];
+
+/**
+ *
+ * Spin before a deadline
+ *
+ * Sleeps wake some tens of microseconds late, so waits for a time sleep to
+ * this many nanoseconds before it, and poll the rest of the way.
+ *
+ */
+#define SLEEPSPIN 100000
 
 /**
  *
- * Windows ticks per second for high resolution timer
+ * Worker threads
+ *
+ * The pthread for each worker slot, and the function and argument it was
+ * started with.
  *
  */
-long long frequency;
+/** Thread for slot */        static pthread_t thrid[MAXWORKERS];
+/** Function to run */        static void (*thrfn[MAXWORKERS])(void *);
+/** Argument to function */   static void *thrarg[MAXWORKERS];
 
 /**
  *
@@ -114,11 +309,19 @@ int setdrive(
 
 {
 
+    unsigned int ps;
+
     if (drive < 0) {
 
         printf("*** Error: Physical drive not set\n");
         return 1;
 
+    }
+    if (drive >= physcount) {
+
+        printf("*** Error: There is no drive %d\n", drive);
+        return 1;
+
     }
 
     closedrive(); // close any active drive
@@ -127,17 +330,25 @@ int setdrive(
     phydrive = drive;
 
     //open the physical disk
-    phydriveh = open(phystr[drive], O_RDWR, 0);
+    phydriveh = opendrive(drive, directio ? O_DIRECT : 0);
 
     if (phydriveh < 0)
     {
 
         printf("*** Error: Could not open drive: Error: %d\n", errno);
+        phydrive = -1; // nothing to close
 
         return 1;
 
     }
 
+    // find the sector sizes, anything that is not a block device has 512
+    if (ioctl(phydriveh, BLKSSZGET, &lsecsize) < 0 || lsecsize < SECSIZE)
+        lsecsize = SECSIZE;
+    if (ioctl(phydriveh, BLKPBSZGET, &ps) < 0 || (int) ps < lsecsize)
+        ps = lsecsize;
+    psecsize = (int) ps;
+
     return 0;
 
 }
@@ -157,11 +368,70 @@ int getdrive(void)
 
 }
 
+/**
+ *
+ * Open drive
+ *
+ * Opens the path of a drive number for reading and writing. An image file that
+ * can't be written, like a saved copy of a failed drive, is opened read only,
+ * so it can still be read and compared.
+ *
+ * Returns the handle, or -1 on error.
+ *
+ */
+static int opendrive(
+    /** Drive number */      int drive,
+    /** Extra open flags */  int flags
+)
+
+{
+
+    int fd;
+
+    fd = open(phystr[drive], O_RDWR | flags, 0);
+    if (fd < 0 && (errno == EACCES || errno == EROFS))
+        fd = open(phystr[drive], O_RDONLY | flags, 0);
+
+    return fd;
+
+}
+
+/**
+ *
+ * Find size of open drive
+ *
+ * Block devices give their size through the BLKGETSIZE64 ioctl. Image files
+ * are the size of the file.
+ *
+ * Returns 0 on succeed, 1 on fail.
+ *
+ */
+static int getsize(
+    /** Open handle */         int fd,
+    /** return size of disc */ long long *size
+)
+
+{
+
+    struct stat st;
+
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+
+        *size = (long long) st.st_size;
+        return 0;
+
+    }
+
+    return ioctl(fd, BLKGETSIZE64, size) < 0;
+
+}
+
 /**
  *
  * Test physical drive exists
  *
- * Finds if the physical drive is connected. Accepts drive numbers from 0 - 9.
+ * Finds if the physical drive is connected. Accepts any registered drive
+ * number.
  *
  * returns 0 if good, otherwise 1.
  *
@@ -174,8 +444,9 @@ int testdrive(
 
     int driveh;
 
+    if (drive < 0 || drive >= physcount) return 1; // no such drive
     //open the physical disk
-    driveh = open(phystr[drive], O_RDWR, 0);
+    driveh = opendrive(drive, 0);
 
     if (driveh < 0) return 1;
 
@@ -188,22 +459,26 @@ int testdrive(
 
 /**
  *
- * Read sector to buffer
+ * Transfer sectors
  *
- * Reads the given number of sectors to the indicated buffer.
+ * Reads or writes the given number of sectors at the given LBA. The offset
+ * goes with each call, so the handle has no file position to keep, and
+ * pieces that come up short are carried on from where they stopped.
  * Returns 1 on error, 0 on success.
  *
  */
-int readsector(
-    /** Buffer to read sector to */       unsigned char *buffer, 
-    /** Logical block address to start */ long long lba, 
-    /** Number of sectors to read */      long long numsec
+static int transfer(
+    /** Write, else read */               int write,
+    /** Buffer to transfer */             unsigned char *buffer,
+    /** Logical block address to start */ long long lba,
+    /** Number of sectors to transfer */  long long numsec
 )
 
 {
 
-    long long o;
-    int r, s;
+    long long o, left;
+    size_t n;
+    ssize_t r;
 
     if (phydrive < 0) {
 
@@ -211,28 +486,52 @@ int readsector(
         return 1;
 
     }
+    o = lba * (long long)lsecsize;
+    left = numsec * (long long)lsecsize;
+    while (left > 0) {
 
-    //seek to the specified LBA
-    o = lba * (long long)SECSIZE;
-    lseek64(phydriveh, o, 0);
-
-    // set size
-    s = SECSIZE * (int)numsec;
+        n = left > XFERMAX ? XFERMAX : (size_t) left;
+        if (write) r = pwrite64(phydriveh, buffer, n, o);
+        else r = pread64(phydriveh, buffer, n, o);
+        if (r <= 0) {
 
-    // read the sector
-    r = read(phydriveh, buffer, s);
-    if(r != s) {
+            if (r < 0 && errno == EINTR) continue; // try again
+            printf("*** Error: Could not %s: Error: %d\n",
+                   write ? "write" : "read", r < 0 ? errno : 0);
 
-        printf("*** Error: Could not read: Error: %d\n", errno);
+            return 1;
 
-        return 1;
+        }
+        buffer += r;
+        o += r;
+        left -= r;
 
     }
-    
+
     return 0; // return good
 
 }
 
+/**
+ *
+ * Read sector to buffer
+ *
+ * Reads the given number of sectors to the indicated buffer.
+ * Returns 1 on error, 0 on success.
+ *
+ */
+int readsector(
+    /** Buffer to read sector to */       unsigned char *buffer, 
+    /** Logical block address to start */ long long lba, 
+    /** Number of sectors to read */      long long numsec
+)
+
+{
+
+    return transfer(0, buffer, lba, numsec);
+
+}
+
 /**
  *
  * Write sector from buffer
@@ -249,171 +548,1466 @@ int writesector(
 
 {
 
-    long long o;
-    int r, s;
+    return transfer(1, buffer, lba, numsec);
 
-    if (phydrive < 0) {
+}
 
-        printf("*** Error: Physical drive not set\n");
-        return 1;
+/**
+ *
+ * Discard or zero sectors
+ *
+ * Tells the drive a span of sectors is no longer used, or has it set them to
+ * zero without sending the data. Block devices take BLKDISCARD and BLKZEROOUT.
+ * Image files have the span punched out, or zeroed, with fallocate, keeping
+ * the file size. Either way it reads back as zero afterwards, though a drive
+ * need not promise that after a discard.
+ *
+ * Returns 1 on error, 0 on success.
+ *
+ */
+static int discard(
+    /** Zero, else discard */             int zero,
+    /** Logical block address to start */ long long lba,
+    /** Number of sectors */              long long numsec
+)
 
-    }
+{
 
-    //seek to the specified LBA
-    o = lba * (long long)SECSIZE;
-    lseek64(phydriveh, o, 0);
+    unsigned long long range[2];
+    struct stat st;
+    int r;
 
-    // set size
-    s = SECSIZE * (int)numsec;
+    if (phydrive < 0) {
 
-    // write the sector
-    r = write(phydriveh, buffer, s);
-    if(r != s) {
+        printf("*** Error: Physical drive not set\n");
+        return 1;
 
-        printf("*** Error: Could not write: Error: %d\n", errno);
+    }
+    range[0] = (unsigned long long) lba * lsecsize; // byte offset
+    range[1] = (unsigned long long) numsec * lsecsize; // byte length
+    if (fstat(phydriveh, &st) == 0 && S_ISREG(st.st_mode))
+        r = fallocate(phydriveh, FALLOC_FL_KEEP_SIZE |
+                      (zero ? FALLOC_FL_ZERO_RANGE : FALLOC_FL_PUNCH_HOLE),
+                      (off_t) range[0], (off_t) range[1]);
+    else r = ioctl(phydriveh, zero ? BLKZEROOUT : BLKDISCARD, range);
+    if (r < 0) {
+
+        printf("*** Error: Could not %s: Error: %d\n", zero ? "zero" : "trim",
+               errno);
 
         return 1;
 
     }
-    
+
     return 0; // return good
 
 }
 
 /**
  *
- * Find size of physical disc
+ * Trim sectors
  *
- * Returns 0 on succeed, 1 on fail.
+ * Discards the given number of sectors.
+ * Returns 1 on error, 0 on success.
  *
  */
-int physize(
-    /** return size of disc */ long long *size
+int trimsector(
+    /** Logical block address to start */ long long lba,
+    /** Number of sectors to discard */   long long numsec
 )
 
 {
 
-    if (phydrive < 0) {
+    return discard(0, lba, numsec);
 
-        printf("*** Error: Physical drive not set\n");
-        return 1;
+}
 
-    }
+/**
+ *
+ * Zero sectors
+ *
+ * Sets the given number of sectors to zero.
+ * Returns 1 on error, 0 on success.
+ *
+ */
+int zerosector(
+    /** Logical block address to start */ long long lba,
+    /** Number of sectors to zero */      long long numsec
+)
 
-    // find drive total size
-    ioctl(phydriveh, BLKGETSIZE64, size);
+{
 
-    return 0;
+    return discard(1, lba, numsec);
 
 }
 
 /**
  *
- * Test size of physical disc
- *
- * Same as physize, but works on disks that are not opened.
- * Takes the number of the disk.
+ * Kernel AIO system calls
  *
- * Returns 0 on succeed, 1 on fail.
+ * The C library does not wrap these, so we issue them directly. This keeps
+ * the diagnostic free of a libaio dependency.
  *
  */
-int testsize(
-    /** drive number to set */ int drive,
-    /** return size of disc */ long long *size
-)
+static long sys_io_setup(unsigned nr, aio_context_t *ctx)
 
 {
 
-    int driveh;
+    return syscall(__NR_io_setup, nr, ctx);
 
-    //open the physical disk
-    driveh = open(phystr[drive], O_RDWR, 0);
+}
 
-    if (driveh < 0) return 1;
+static long sys_io_destroy(aio_context_t ctx)
 
-    // find drive total size
-    ioctl(driveh, BLKGETSIZE64, size);
-    
-    // close drive
-    close(driveh);
-    
-    return 0;
+{
+
+    return syscall(__NR_io_destroy, ctx);
 
 }
 
-/**
- *
- * Close out physical disk
- *
- * Closes the physical disk prior to exiting the diagnostic.
- *
- */
-static void closedrive(void)
+static long sys_io_submit(aio_context_t ctx, long nr, struct iocb **iocbpp)
 
 {
 
-    if (phydrive >= 0) { // disk is valid
+    return syscall(__NR_io_submit, ctx, nr, iocbpp);
 
-        //close the disk
-        close(phydriveh);
+}
 
-    }
+static long sys_io_getevents(aio_context_t ctx, long min_nr, long nr,
+                             struct io_event *events, struct timespec *timeout)
+
+{
+
+    return syscall(__NR_io_getevents, ctx, min_nr, nr, events, timeout);
+
+}
+
+static long sys_io_cancel(aio_context_t ctx, struct iocb *iocb,
+                          struct io_event *result)
+
+{
+
+    return syscall(__NR_io_cancel, ctx, iocb, result);
 
 }
 
 /**
  *
- * Get logical drive string
+ * Open I/O queue
  *
- * Gets the name of the drive corresponding to the logical number.
- * Returns this as a string, or null pointer if no such drive exists.
+ * Creates the kernel AIO context at the current queue depth, and sets all of
+ * the request control blocks free.
+ *
+ * Returns 1 on error, 0 on success.
  *
  */
-const char* getdrvstr(int drive)
+static int openqueue(void)
 
 {
 
-    const char* p;
+    int i;
 
-    p = 0; // set no drive string
+    ioctx = 0; // context must be zero going in
+    if (sys_io_setup(qdepth, &ioctx) < 0) {
 
-    // check drive is valid and set corresponding string
-    if (drive >= 0 || drive <= 9) p = phystr[drive];
+        printf("*** Error: Could not create I/O queue: Error: %d\n", errno);
+        ioctx = 0;
 
-    return p;
+        return 1;
+
+    }
+    // stack all control blocks as free
+    for (i = 0; i < qdepth; i++) qfree[i] = i;
+    qfreetop = qdepth;
+    qcount = 0;
+
+    return 0;
 
 }
 
 /**
  *
- * Initialize I/O package
+ * Close I/O queue
  *
- * Sets up this package.
+ * Waits for any requests still in flight, discarding their results, then
+ * removes the kernel AIO context.
  *
  */
-void initio(void)
+static void closequeue(void)
 
 {
 
-    printf("Linux interface\n");
-    printf("\n");
+    struct io_event ev[QDMAX];
+    long n;
 
-    phydrive = -1; // set no drive is active
+    if (ioctx) { // queue exists
+
+        while (qcount > 0) { // drain requests in flight
+
+            n = sys_io_getevents(ioctx, qcount, qcount, ev, NULL);
+            if (n < 0 && errno != EINTR) break; // give up on failure
+            if (n > 0) qcount -= n;
+
+        }
+        sys_io_destroy(ioctx);
+        ioctx = 0;
+        qcount = 0;
+
+    }
 
 }
 
 /**
  *
- * Deinitialize I/O package
+ * Set queue depth
  *
- * Tears down this package.
+ * Sets the maximum number of requests that can be in flight at once. The queue
+ * must be empty.
+ *
+ * Returns 1 on error, 0 on success.
  *
  */
-void deinitio(void)
+int setqd(
+    /** Depth of queue */ int depth
+)
 
 {
 
+    if (depth < 1 || depth > QDMAX) {
+
+        printf("*** Error: Queue depth must be 1 to %d\n", QDMAX);
+        return 1;
+
+    }
+    if (qcount) {
+
+        printf("*** Error: Requests are still in flight\n");
+        return 1;
+
+    }
+    closequeue(); // remove old context, next submit makes a new one
+    qdepth = depth;
+
+    return 0;
+
+}
+
+/**
+ *
+ * Get queue depth
+ *
+ * Gets the maximum number of requests that can be in flight at once.
+ *
+ */
+int getqd(void)
+
+{
+
+    return qdepth; // just return
+
+}
+
+/**
+ *
+ * Submit request
+ *
+ * Queues a read or write of the given number of sectors. The buffer must not
+ * be touched until the request is reaped.
+ *
+ * Returns 1 on error, 0 on success.
+ *
+ */
+static int submit(
+    /** AIO operation code */             int op,
+    /** Buffer to transfer */             unsigned char *buffer,
+    /** Logical block address to start */ long long lba,
+    /** Number of sectors to transfer */  long long numsec,
+    /** Tag to return on completion */    int tag
+)
+
+{
+
+    struct iocb *cb;
+    struct iocb *cbp[1];
+    long long t;
+    int slot;
+
+    t = qissue; // take the send time, good for this request only
+    qissue = 0;
+    if (phydrive < 0) {
+
+        printf("*** Error: Physical drive not set\n");
+        return 1;
+
+    }
+    if (!ioctx && openqueue()) return 1; // make context if needed
+    if (qcount >= qdepth) {
+
+        printf("*** Error: Queue is full\n");
+        return 1;
+
+    }
+
+    // fill out a free control block
+    slot = qfree[--qfreetop];
+    cb = &qiocb[slot];
+    memset(cb, 0, sizeof(struct iocb));
+    cb->aio_data = slot; // so we can find it on completion
+    cb->aio_lio_opcode = op;
+    cb->aio_fildes = phydriveh;
+    cb->aio_buf = (unsigned long) buffer;
+    cb->aio_nbytes = numsec * lsecsize;
+    cb->aio_offset = lba * lsecsize;
+    qtag[slot] = tag;
+    qstart[slot] = t ? t : gettim(); // latency counts from when it was meant to go
+    qcancel[slot] = 0;
+
+    // send it to the kernel
+    cbp[0] = cb;
+    if (sys_io_submit(ioctx, 1, cbp) != 1) {
+
+        qfree[qfreetop++] = slot; // return the block
+        printf("*** Error: Could not queue: Error: %d\n", errno);
+
+        return 1;
+
+    }
+    qcount++; // count in flight
+
+    return 0; // return good
+
+}
+
+/**
+ *
+ * Submit read
+ *
+ * Queues a read of the given number of sectors to the indicated buffer.
+ * Returns 1 on error, 0 on success.
+ *
+ */
+int submitread(
+    /** Buffer to read sector to */       unsigned char *buffer,
+    /** Logical block address to start */ long long lba,
+    /** Number of sectors to read */      long long numsec,
+    /** Tag to return on completion */    int tag
+)
+
+{
+
+    return submit(IOCB_CMD_PREAD, buffer, lba, numsec, tag);
+
+}
+
+/**
+ *
+ * Submit write
+ *
+ * Queues a write of the given number of sectors from the indicated buffer.
+ * Returns 1 on error, 0 on success.
+ *
+ */
+int submitwrite(
+    /** Buffer to write sector from */    unsigned char *buffer,
+    /** Logical block address to start */ long long lba,
+    /** Number of sectors to write */     long long numsec,
+    /** Tag to return on completion */    int tag
+)
+
+{
+
+    return submit(IOCB_CMD_PWRITE, buffer, lba, numsec, tag);
+
+}
+
+/**
+ *
+ * Submit batch
+ *
+ * Queues a batch of reads or writes, each with its own buffer and LBA, tagged
+ * from tag up. The whole batch goes to the kernel in one io_submit, so a batch
+ * of small transfers costs one system call. If the kernel takes only part of
+ * it, the rest is sent again, and what it wouldn't take is given back.
+ * Returns 1 on error, 0 on success.
+ *
+ */
+int submitv(
+    /** Batch is writes */                 int write,
+    /** Buffer of each transfer */         unsigned char **buffers,
+    /** Logical block address of each */   long long *lbas,
+    /** Number of sectors in each */       long long *numsecs,
+    /** Number of transfers */             int n,
+    /** Tag of first transfer */           int tag
+)
+
+{
+
+    struct iocb *cbp[QDMAX];
+    struct iocb *cb;
+    long long t;
+    int i, slot, done;
+    long r;
+
+    t = qissue; // take the send time, good for this batch only
+    qissue = 0;
+    if (phydrive < 0) {
+
+        printf("*** Error: Physical drive not set\n");
+        return 1;
+
+    }
+    if (!ioctx && openqueue()) return 1; // make context if needed
+    if (n > qdepth-qcount) {
+
+        printf("*** Error: Queue is full\n");
+        return 1;
+
+    }
+
+    // fill out a control block for each
+    if (!t) t = gettim();
+    for (i = 0; i < n; i++) {
+
+        slot = qfree[--qfreetop];
+        cb = &qiocb[slot];
+        memset(cb, 0, sizeof(struct iocb));
+        cb->aio_data = slot; // so we can find it on completion
+        cb->aio_lio_opcode = write ? IOCB_CMD_PWRITE : IOCB_CMD_PREAD;
+        cb->aio_fildes = phydriveh;
+        cb->aio_buf = (unsigned long) buffers[i];
+        cb->aio_nbytes = numsecs[i] * lsecsize;
+        cb->aio_offset = lbas[i] * lsecsize;
+        qtag[slot] = tag+i;
+        qstart[slot] = t;
+        qcancel[slot] = 0;
+        cbp[i] = cb;
+
+    }
+
+    // send them to the kernel, as many calls as it takes
+    done = 0;
+    while (done < n) {
+
+        r = sys_io_submit(ioctx, n-done, cbp+done);
+        if (r <= 0) {
+
+            if (r < 0 && errno == EINTR) continue; // try again
+            printf("*** Error: Could not queue: Error: %d\n", r < 0 ? errno : 0);
+            for (i = done; i < n; i++) // return the blocks not sent
+                qfree[qfreetop++] = (int) cbp[i]->aio_data;
+            qcount += done;
+
+            return 1;
+
+        }
+        done += (int) r;
+
+    }
+    qcount += n; // count in flight
+
+    return 0; // return good
+
+}
+
+/**
+ *
+ * Get finished requests
+ *
+ * Waits until at least min queued requests have finished, and returns up to
+ * max of them in the completion array. Without a timeout, signals are ridden
+ * over, but if one was a break, what is in flight is cancelled first. With a
+ * timeout, the wait ends when it runs out or a signal comes, and fewer than
+ * min can be returned. Requests that were cancelled are freed and not
+ * returned, so fewer than min can come back then too.
+ *
+ * Returns the number of completions, or -1 on error.
+ *
+ */
+static int getdone(
+    /** Completion array */          iocmp *cmp,
+    /** Minimum number to wait for */ int min,
+    /** Maximum number to return */   int max,
+    /** Longest wait, or NULL */     struct timespec *timeout
+)
+
+{
+
+    struct io_event ev[QDMAX];
+    struct iocb *cb;
+    long long now;
+    long n;
+    int i, j, slot;
+
+    if (max > qcount) max = qcount;
+    if (min > max) min = max;
+    if (max <= 0) return 0; // nothing in flight
+
+    // wait for completions
+    while ((n = sys_io_getevents(ioctx, min, max, ev, timeout)) < 0 &&
+           errno == EINTR && !timeout) {
+
+        if (brkpend()) { // stop what can be stopped, then wait for the rest
+
+            cancelq();
+            // those cancelled are gone from the queue, and won't finish
+            if (max > qcount) max = qcount;
+            if (min > max) min = max;
+            if (max <= 0) return 0; // nothing left in flight
+
+        }
+
+    }
+    if (n < 0 && errno == EINTR) return 0; // cut short
+    if (n < 0) {
+
+        printf("*** Error: Could not reap: Error: %d\n", errno);
+        return -1;
+
+    }
+    now = gettim(); // time they were seen done
+    for (i = j = 0; i < n; i++) {
+
+        slot = (int) ev[i].data; // find the control block
+        cb = &qiocb[slot];
+        qfree[qfreetop++] = slot; // free the block
+        qcount--;
+        if (ev[i].res == -ECANCELED) continue; // never done, nothing to give
+        cmp[j].write = cb->aio_lio_opcode == IOCB_CMD_PWRITE;
+        cmp[j].lba = cb->aio_offset / lsecsize;
+        cmp[j].numsec = cb->aio_nbytes / lsecsize;
+        cmp[j].tag = qtag[slot];
+        cmp[j].error = ev[i].res != (long long) cb->aio_nbytes;
+        cmp[j].lat = now-qstart[slot];
+        if (cmp[j].error) {
+
+            printf("*** Error: Could not %s: Error: %d\n",
+                   cmp[j].write ? "write" : "read",
+                   ev[i].res < 0 ? (int) -ev[i].res : 0);
+
+        }
+        j++;
+
+    }
+
+    return j;
+
+}
+
+/**
+ *
+ * Reap finished requests
+ *
+ * Waits until at least min queued requests have finished, and returns up to
+ * max of them in the completion array. Asking for more than are in flight is
+ * trimmed to what is in flight.
+ *
+ * Returns the number of completions, or -1 on error.
+ *
+ */
+int reap(
+    /** Completion array */          iocmp *cmp,
+    /** Minimum number to wait for */ int min,
+    /** Maximum number to return */   int max
+)
+
+{
+
+    return getdone(cmp, min, max, NULL);
+
+}
+
+/**
+ *
+ * Reap finished requests by a time
+ *
+ * Waits until a queued request finishes or the timer reaches the given time,
+ * and returns up to max finished requests in the completion array. With
+ * nothing in flight, it just waits for the time. A signal ends the wait early.
+ * The wait sleeps until SLEEPSPIN before the time and polls the rest, so it
+ * ends close to the time, and completions are seen soon after they come.
+ *
+ * Returns the number of completions, 0 if the time came first, or -1 on error.
+ *
+ */
+int reapby(
+    /** Completion array */          iocmp *cmp,
+    /** Maximum number to return */   int max,
+    /** Time to wait until */         long long t
+)
+
+{
+
+    struct timespec ts;
+    long long w;
+    int n;
+
+    w = t-SLEEPSPIN-gettim(); // sleep part
+    if (w > 0) {
+
+        if (qcount) {
+
+            ts.tv_sec = w/1000000000LL;
+            ts.tv_nsec = w%1000000000LL;
+            n = getdone(cmp, 1, max, &ts);
+            if (n) return n;
+
+        } else {
+
+            w = t-SLEEPSPIN; // clock_nanosleep takes the time itself
+            ts.tv_sec = w/1000000000LL;
+            ts.tv_nsec = w%1000000000LL;
+            if (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL))
+                return 0; // signal
+
+        }
+
+    }
+    // poll the rest of the way
+    ts.tv_sec = 0;
+    ts.tv_nsec = 0;
+    do {
+
+        if (qcount) {
+
+            n = getdone(cmp, 0, max, &ts);
+            if (n) return n;
+
+        }
+
+    } while (gettim() < t);
+
+    return 0;
+
+}
+
+/**
+ *
+ * Cancel queued requests
+ *
+ * Asks the kernel to cancel each request in flight that it hasn't been asked
+ * about already. Whether it can depends on the device: most block devices
+ * finish what they were sent, and those requests are reaped as usual. Ones
+ * that are cancelled are freed without being returned by reap.
+ *
+ * Returns the number of requests cancelled.
+ *
+ */
+int cancelq(void)
+
+{
+
+    struct io_event ev;
+    char busy[QDMAX];
+    int i, n;
+
+    if (!qcount) return 0; // nothing in flight
+    memset(busy, 1, sizeof(busy)); // find the blocks in flight
+    for (i = 0; i < qfreetop; i++) busy[qfree[i]] = 0;
+    n = 0;
+    for (i = 0; i < qdepth; i++) {
+
+        if (!busy[i] || qcancel[i]) continue;
+        qcancel[i] = 1; // ask only once
+        if (!sys_io_cancel(ioctx, &qiocb[i], &ev)) {
+
+            qfree[qfreetop++] = i; // old kernels give it back here
+            qcount--;
+            n++;
+
+        } else if (errno == EINPROGRESS) n++; // comes back cancelled
+
+    }
+
+    return n;
+
+}
+
+/**
+ *
+ * Set send time
+ *
+ * Sets the time the next submitread, submitwrite or submitv was meant to be
+ * sent, when that is earlier than it will be. The latency of what it sends is
+ * counted from then, so a request held up behind others is not counted as
+ * faster than it was. 0 counts from when it is sent, which is also what the
+ * requests after that one do.
+ *
+ */
+void setissue(
+    /** Time meant to send, or 0 */ long long t
+)
+
+{
+
+    qissue = t;
+
+}
+
+/**
+ *
+ * Find requests in flight
+ *
+ * Returns the number of queued requests that have not been reaped.
+ *
+ */
+int inflight(void)
+
+{
+
+    return qcount; // just return
+
+}
+
+/**
+ *
+ * Set direct access mode
+ *
+ * Turns direct access on or off. With it on, the drive is opened with
+ * O_DIRECT, which bypasses the page cache, so transfer buffers must come from
+ * allocbuf(). If a drive is open, it is reopened in the new mode.
+ *
+ * Returns 1 on error, 0 on success.
+ *
+ */
+int setdirect(
+    /** Direct mode on */ int on
+)
+
+{
+
+    int old;
+
+    old = directio; // save old mode
+    directio = !!on;
+    if (phydrive >= 0 && directio != old && setdrive(phydrive)) {
+
+        // could not reopen it that way, go back to the old mode
+        directio = old;
+        setdrive(phydrive);
+
+        return 1;
+
+    }
+
+    return 0;
+
+}
+
+/**
+ *
+ * Get direct access mode
+ *
+ * Returns true if direct access is on.
+ *
+ */
+int getdirect(void)
+
+{
+
+    return directio; // just return
+
+}
+
+/**
+ *
+ * Allocate transfer buffer
+ *
+ * Allocates a buffer aligned well enough for direct transfers. Large buffers
+ * are aligned to a huge page and marked for transparent huge pages, which cuts
+ * TLB misses when the buffer is swept by pattern and compare operations. If
+ * the kernel does not have them, we just get normal pages.
+ *
+ * Returns the buffer, or NULL if there is no memory.
+ *
+ */
+unsigned char *allocbuf(
+    /** Size of buffer in bytes */ long long size
+)
+
+{
+
+    void *p;
+
+    if (size >= HUGEPAGE) { // large, try for huge pages
+
+        if (posix_memalign(&p, HUGEPAGE, size)) return NULL;
+#ifdef MADV_HUGEPAGE
+        madvise(p, size, MADV_HUGEPAGE); // just advice, ignore failure
+#endif
+
+    } else if (posix_memalign(&p, BUFALIGN, size)) return NULL;
+
+    return (unsigned char *) p;
+
+}
+
+/**
+ *
+ * Free transfer buffer
+ *
+ * Frees a buffer from allocbuf().
+ *
+ */
+void freebuf(
+    /** Buffer to free */         unsigned char *buffer,
+    /** Size of buffer in bytes */ long long size
+)
+
+{
+
+    free(buffer);
+
+}
+
+/**
+ *
+ * Thread start
+ *
+ * Common start for worker threads. Runs the function for the slot.
+ *
+ */
+static void *thrstart(
+    /** Slot number */ void *p
+)
+
+{
+
+    int id;
+
+    id = (int) (long) p;
+    thrfn[id](thrarg[id]);
+
+    return NULL;
+
+}
+
+/**
+ *
+ * Start worker thread
+ *
+ * Starts a thread in the given worker slot that runs the function with the
+ * argument. The slot must not have a thread running in it.
+ *
+ * Returns 1 on error, 0 on success.
+ *
+ */
+int newthread(
+    /** Worker slot */       int id,
+    /** Function to run */   void (*fn)(void *),
+    /** Argument to pass */  void *arg
+)
+
+{
+
+    int e;
+
+    if (id < 0 || id >= MAXWORKERS) {
+
+        printf("*** Error: Invalid worker number\n");
+        return 1;
+
+    }
+    thrfn[id] = fn;
+    thrarg[id] = arg;
+    e = pthread_create(&thrid[id], NULL, thrstart, (void *) (long) id);
+    if (e) {
+
+        printf("*** Error: Could not start thread: Error: %d\n", e);
+        return 1;
+
+    }
+
+    return 0;
+
+}
+
+/**
+ *
+ * Wait for worker thread
+ *
+ * Waits for the thread in the given worker slot to finish.
+ *
+ * Returns 1 on error, 0 on success.
+ *
+ */
+int waitthread(
+    /** Worker slot */ int id
+)
+
+{
+
+    int e;
+
+    e = pthread_join(thrid[id], NULL);
+    if (e) {
+
+        printf("*** Error: Could not wait for thread: Error: %d\n", e);
+        return 1;
+
+    }
+
+    return 0;
+
+}
+
+/**
+ *
+ * Initialize thread I/O state
+ *
+ * Sets up the drive and queue state for the calling thread. A new thread
+ * starts with no drive and no queueing.
+ *
+ */
+void initthread(void)
+
+{
+
+    phydrive = -1; // set no drive is active
+    directio = 0; // use the page cache by default
+    qdepth = 1; // set no queueing
+    ioctx = 0; // no I/O queue yet
+    qcount = 0;
+
+}
+
+/**
+ *
+ * Deinitialize thread I/O state
+ *
+ * Closes any drive and queue the calling thread has open.
+ *
+ */
+void deinitthread(void)
+
+{
+
+    closedrive(); // close any active drive
+
+}
+
+/**
+ *
+ * Find CPUs of NUMA node
+ *
+ * Reads the list of CPUs a NUMA node has from sysfs, which is a list of numbers
+ * and ranges like 0-7,16-23, into a CPU set.
+ *
+ * Returns 1 if the node is not there, 0 on success.
+ *
+ */
+static int nodecpus(
+    /** Node number */ int node,
+    /** Set to fill */ cpu_set_t *set
+)
+
+{
+
+    char path[100];
+    FILE *f;
+    int a, b, c, n;
+
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+    f = fopen(path, "r");
+    if (!f) return 1;
+    CPU_ZERO(set);
+    n = 0;
+    while (fscanf(f, "%d", &a) == 1) {
+
+        b = a;
+        c = fgetc(f);
+        if (c == '-') { // range
+
+            if (fscanf(f, "%d", &b) != 1) break;
+            c = fgetc(f);
+
+        }
+        for (; a <= b && a < CPU_SETSIZE; a++) { CPU_SET(a, set); n++; }
+        if (c != ',') break;
+
+    }
+    fclose(f);
+
+    return !n; // a node without CPUs is no use to run on
+
+}
+
+/**
+ *
+ * Pin thread
+ *
+ * Pins the calling thread to a CPU, or if there is none, to the CPUs of a NUMA
+ * node, or if there is neither, lets it run anywhere again. Memory the thread
+ * touches first from then on is taken from the node where possible, so buffers
+ * it allocates and fills are local to it.
+ *
+ * Returns 1 on error, 0 on success.
+ *
+ */
+int pinthread(
+    /** CPU number, or -1 for none */  int cpu,
+    /** Node number, or -1 for none */ int node
+)
+
+{
+
+    cpu_set_t set;
+    unsigned long mask[MAXNODES/(8*sizeof(unsigned long))];
+    long e;
+    int i;
+
+    if (cpu >= CPU_SETSIZE || node >= MAXNODES) {
+
+        printf("*** Error: Invalid CPU or node number\n");
+        return 1;
+
+    }
+    CPU_ZERO(&set);
+    if (cpu >= 0) CPU_SET(cpu, &set);
+    else if (node >= 0) {
+
+        if (nodecpus(node, &set)) {
+
+            printf("*** Error: Cannot find CPUs of NUMA node %d\n", node);
+            return 1;
+
+        }
+
+    } else for (i = 0; i < CPU_SETSIZE; i++) CPU_SET(i, &set); // anywhere
+    if (sched_setaffinity(0, sizeof(set), &set)) {
+
+        printf("*** Error: Cannot set CPU affinity: Error: %d\n", errno);
+        return 1;
+
+    }
+    if (node >= 0) { // prefer the node for memory
+
+        memset(mask, 0, sizeof(mask));
+        mask[node/(8*sizeof(unsigned long))] |= 1UL << node%(8*sizeof(unsigned long));
+        e = syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask, MAXNODES+1);
+
+    } else e = syscall(SYS_set_mempolicy, MPOL_DEFAULT, NULL, 0);
+    // a kernel without NUMA has just the one node anyway
+    if (e && errno != ENOSYS) {
+
+        printf("*** Error: Cannot set NUMA memory policy: Error: %d\n", errno);
+        return 1;
+
+    }
+
+    return 0;
+
+}
+
+/**
+ *
+ * Get drive NUMA node
+ *
+ * Finds the NUMA node the controller of a drive is attached to. For an image
+ * file, that is the drive the file is on. The block device is looked up in
+ * sysfs, and its parents searched up to the first that knows its node, which
+ * is the PCI device for both SATA/SAS and NVMe drives.
+ *
+ * Returns the node, or -1 if it is not known.
+ *
+ */
+int drivenode(
+    /** Drive number */ int drive
+)
+
+{
+
+    char path[PATH_MAX+20], real[PATH_MAX]; // room for the file name
+    const char *p;
+    struct stat st;
+    dev_t dev;
+    FILE *f;
+    char *s;
+    int n;
+
+    p = getdrvstr(drive);
+    if (!p || stat(p, &st)) return -1;
+    dev = S_ISBLK(st.st_mode) ? st.st_rdev : st.st_dev;
+    snprintf(path, sizeof(path), "/sys/dev/block/%u:%u", major(dev), minor(dev));
+    if (!realpath(path, real)) return -1;
+    while (strncmp(real, "/sys/devices/", 13) == 0) {
+
+        snprintf(path, sizeof(path), "%s/numa_node", real);
+        f = fopen(path, "r");
+        if (f) {
+
+            if (fscanf(f, "%d", &n) != 1) n = -1;
+            fclose(f);
+
+            return n; // -1 there means it has no node
+
+        }
+        s = strrchr(real, '/'); // up to parent
+        *s = 0;
+
+    }
+
+    return -1;
+
+}
+
+/**
+ *
+ * Find size of physical disc
+ *
+ * Returns 0 on succeed, 1 on fail.
+ *
+ */
+int physize(
+    /** return size of disc */ long long *size
+)
+
+{
+
+    if (phydrive < 0) {
+
+        printf("*** Error: Physical drive not set\n");
+        return 1;
+
+    }
+
+    // find drive total size
+    if (getsize(phydriveh, size)) {
+
+        printf("*** Error: Could not get drive size: Error: %d\n", errno);
+        return 1;
+
+    }
+
+    return 0;
+
+}
+
+/**
+ *
+ * Get sector sizes of physical disc
+ *
+ * Gets the logical sector size, which LBAs and transfers are counted in, and
+ * the physical sector size the drive writes in.
+ *
+ * Returns 0 on succeed, 1 on fail.
+ *
+ */
+int sectorsize(
+    /** return logical sector size */  int *lsize,
+    /** return physical sector size */ int *psize
+)
+
+{
+
+    if (phydrive < 0) {
+
+        printf("*** Error: Physical drive not set\n");
+        return 1;
+
+    }
+    *lsize = lsecsize;
+    *psize = psecsize;
+
+    return 0;
+
+}
+
+/**
+ *
+ * Set device option
+ *
+ * Device options are for the simulated disc. There are none for real drives.
+ *
+ * Returns 1 on error, 0 on success.
+ *
+ */
+int devopt(
+    /** Option name, or NULL to list */ const char *name,
+    /** Value to set */                 long long val
+)
+
+{
+
+    if (!name) {
+
+        printf("No device options\n");
+        return 0;
+
+    }
+    printf("*** Error: Device option not recognized\n");
+
+    return 1;
+
+}
+
+/**
+ *
+ * Test size of physical disc
+ *
+ * Same as physize, but works on disks that are not opened.
+ * Takes the number of the disk.
+ *
+ * Returns 0 on succeed, 1 on fail.
+ *
+ */
+int testsize(
+    /** drive number to set */ int drive,
+    /** return size of disc */ long long *size
+)
+
+{
+
+    int driveh, r;
+
+    if (drive < 0 || drive >= physcount) return 1; // no such drive
+    //open the physical disk
+    driveh = opendrive(drive, 0);
+
+    if (driveh < 0) return 1;
+
+    // find drive total size
+    r = getsize(driveh, size);
+    
+    // close drive
+    close(driveh);
+    
+    return r;
+
+}
+
+/**
+ *
+ * Close out physical disk
+ *
+ * Closes the physical disk prior to exiting the diagnostic.
+ *
+ */
+static void closedrive(void)
+
+{
+
+    closequeue(); // requests in flight must finish first
+    if (phydrive >= 0) { // disk is valid
+
+        //close the disk
+        close(phydriveh);
+
+    }
+
+}
+
+/**
+ *
+ * Get logical drive string
+ *
+ * Gets the name of the drive corresponding to the logical number.
+ * Returns this as a string, or null pointer if no such drive exists.
+ *
+ */
+const char* getdrvstr(int drive)
+
+{
+
+    const char* p;
+
+    p = 0; // set no drive string
+
+    // check drive is valid and set corresponding string
+    if (drive >= 0 && drive < physcount) p = phystr[drive];
+
+    return p;
+
+}
+
+/**
+ *
+ * Add drive
+ *
+ * Gives a path a drive number, so it can be used like any other drive. The
+ * path can be any block device, or an image file. A path that already has a
+ * number keeps it.
+ *
+ * Returns the drive number, or -1 on error.
+ *
+ */
+int adddrive(
+    /** Path of device or file */ const char *path
+)
+
+{
+
+    int i;
+
+    for (i = 0; i < physcount; i++)
+        if (!strcmp(phystr[i], path)) return i; // already known
+    if (access(path, F_OK)) {
+
+        printf("*** Error: Cannot find %s: Error: %d\n", path, errno);
+        return -1;
+
+    }
+    if (physcount >= MAXDRIVES) {
+
+        printf("*** Error: No more than %d drives can be known\n", MAXDRIVES);
+        return -1;
+
+    }
+    phystr[physcount] = (char *) malloc(strlen(path)+1);
+    if (!phystr[physcount]) {
+
+        printf("*** Error: Cannot allocate space\n");
+        return -1;
+
+    }
+    strcpy(phystr[physcount], path);
+    physalloc[physcount] = 1;
+
+    return physcount++;
+
+}
+
+/**
+ *
+ * Compare NVMe names
+ *
+ * Orders NVMe namespace names by controller, then namespace, for qsort.
+ *
+ */
+static int cmpnvme(
+    /** First name */  const void *a,
+    /** Second name */ const void *b
+)
+
+{
+
+    unsigned int ca, na, cb, nb;
+
+    sscanf(*(char * const *) a, "nvme%un%u", &ca, &na);
+    sscanf(*(char * const *) b, "nvme%un%u", &cb, &nb);
+    if (ca != cb) return ca < cb ? -1 : 1;
+    if (na != nb) return na < nb ? -1 : 1;
+
+    return 0;
+
+}
+
+/**
+ *
+ * Find NVMe drives
+ *
+ * Registers the NVMe namespaces in /dev, like /dev/nvme0n1, in order. The
+ * partitions on them are left out.
+ *
+ */
+static void findnvme(void)
+
+{
+
+    DIR *dp;
+    struct dirent *ep;
+    char *names[MAXDRIVES]; // namespaces found
+    char path[300];
+    unsigned int c, n;
+    char x;
+    int i, cnt;
+
+    dp = opendir("/dev");
+    if (!dp) return;
+    cnt = 0;
+    while ((ep = readdir(dp)) && cnt < MAXDRIVES) {
+
+        if (sscanf(ep->d_name, "nvme%un%u%c", &c, &n, &x) != 2) continue;
+        names[cnt] = (char *) malloc(strlen(ep->d_name)+1);
+        if (!names[cnt]) break;
+        strcpy(names[cnt++], ep->d_name);
+
+    }
+    closedir(dp);
+    qsort(names, cnt, sizeof(char *), cmpnvme);
+    for (i = 0; i < cnt; i++) {
+
+        sprintf(path, "/dev/%.280s", names[i]);
+        if (physcount < MAXDRIVES) adddrive(path);
+        free(names[i]);
+
+    }
+
+}
+
+/**
+ *
+ * Get high resolution timer
+ *
+ * Returns the monotonic clock in nanoseconds. This is wall time, so time spent
+ * waiting on the drive counts, and it can't step back if the system time is
+ * set.
+ *
+ */
+long long gettim(void)
+
+{
+
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (long long) ts.tv_sec*1000000000LL+ts.tv_nsec;
+
+}
+
+/**
+ *
+ * Find elapsed time in seconds
+ *
+ * Finds the seconds passed since the given timer reading. Returns as a floating
+ * point value so that fractional times can be represented.
+ *
+ */
+double elapsed(
+    /** reference time */ long long t
+)
+
+{
+
+    return (gettim()-t)/1000000000.0;
+
+}
+
+/**
+ *
+ * Initialize I/O package
+ *
+ * Sets up this package.
+ *
+ */
+void initio(void)
+
+{
+
+    printf("Linux interface\n");
+    printf("\n");
+
+    initthread(); // set up the main thread
+    findnvme(); // number the NVMe drives after the fixed ones
+
+}
+
+/**
+ *
+ * Deinitialize I/O package
+ *
+ * Tears down this package.
+ *
+ */
+void deinitio(void)
+
+{
+
+    int i;
+
     closedrive(); // close any active drive
+    for (i = 0; i < physcount; i++) // free the paths added
+        if (physalloc[i]) free(phystr[i]);
 
 } 
  
@@ -4,12 +4,19 @@
 *
 * \brief Stub I/O module
 *
-* Emulates a disc by reading and writing to and from an array. This is for the
+* Emulates a disc by reading and writing to and from memory. This is for the
 * purpose of bring up testing, and also helps when porting to a new platform. 
 * The diagnostic can be compiled and run through complete tests without any real
 * real disk I/O taking place. This module is completely compatible with CLIB,
 * and so should port to any ANSI C installation.
 *
+* The disc is kept as a sparse map of pages, made when they are first written,
+* so it can be set to any size, even many terabytes, and only uses memory for
+* what has been written. Parts never written read as zeros. The size, sector
+* sizes, transfer times and a rate of failed transfers are set with devopt, so
+* scripts and the queue handling can be tested at real drive sizes and with
+* errors, without a drive.
+*
 * setdrive    - Set current physical access drive (and open it).
 *
 * getdrive    - Get the current logical drive number.
@@ -18,13 +25,68 @@
 *
 * writesector - Write one or more sectors to a buffer.
 *
+* trimsector  - Discard one or more sectors.
+*
+* zerosector  - Set one or more sectors to zero.
+*
 * physize     - Get the size of the physical drive in lbas.
 *
+* sectorsize  - Get the logical and physical sector sizes of the drive.
+*
+* devopt      - Set or list the simulated disc options.
+*
 * testsize    - Get the size of a physical drive in lbas, but takes drive as
 *               parameter.
 *
+* setqd       - Set the asynchronous queue depth.
+*
+* getqd       - Get the asynchronous queue depth.
+*
+* submitread  - Queue a read of one or more sectors to a buffer.
+*
+* submitwrite - Queue a write of one or more sectors from a buffer.
+*
+* submitv     - Queue a batch of reads or writes.
+*
+* reap        - Collect finished queued requests.
+*
+* inflight    - Get the number of queued requests not yet reaped.
+*
+* reapby      - Collect finished queued requests, waiting no later than a
+*               given time.
+*
+* setissue    - Set the time the next queued request was meant to be sent.
+*
+* cancelq     - Cancel queued requests still in flight.
+*
+* setdirect   - Set direct (unbuffered) access mode on or off.
+*
+* getdirect   - Get direct access mode.
+*
+* allocbuf    - Allocate an aligned transfer buffer.
+*
+* freebuf     - Free a transfer buffer.
+*
+* newthread   - Start a worker thread.
+*
+* waitthread  - Wait for a worker thread to finish.
+*
+* initthread  - Set up the I/O state of a new thread.
+*
+* deinitthread - Tear down the I/O state of a thread.
+*
+* pinthread   - Pin the calling thread to a CPU or NUMA node.
+*
+* drivenode   - Get the NUMA node a drive is attached to.
+*
 * getdrvstr   - Gets the string corresponding to a given logical drive.
 *
+* adddrive    - Give a path a drive number.
+*
+* gettim      - Get the high resolution timer in nanoseconds.
+*
+* elapsed     - Find the seconds passed since a timer reading.
+*
 * initio      - Initializes this module
 * 
 * deinitio    - Deinitializes this module.
@@ -32,6 +94,9 @@
 ******************************************************************************/
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include "discio.h"
 
 /**
@@ -44,9 +109,35 @@ int getdrive(void);
 int testdrive(int drive);
 int readsector(unsigned char *buffer, long long lba, long long numsec);
 int writesector(unsigned char *buffer, long long lba, long long numsec);
+int trimsector(long long lba, long long numsec);
+int zerosector(long long lba, long long numsec);
 int physize(long long *size);
+int sectorsize(int *lsize, int *psize);
+int devopt(const char *name, long long val);
 int testsize(int drive, long long *size);
+int setqd(int depth);
+int getqd(void);
+int submitread(unsigned char *buffer, long long lba, long long numsec, int tag);
+int submitwrite(unsigned char *buffer, long long lba, long long numsec, int tag);
+int submitv(int write, unsigned char **buffers, long long *lbas,
+            long long *numsecs, int n, int tag);
+int reap(iocmp *cmp, int min, int max);
+int inflight(void);
+int reapby(iocmp *cmp, int max, long long t);
+void setissue(long long t);
+int cancelq(void);
+int setdirect(int on);
+int getdirect(void);
+unsigned char *allocbuf(long long size);
+void freebuf(unsigned char *buffer, long long size);
+int newthread(int id, void (*fn)(void *), void *arg);
+int waitthread(int id);
+void initthread(void);
+void deinitthread(void);
+int pinthread(int cpu, int node);
+int drivenode(int drive);
 const char* getdrvstr(int drive);
+int adddrive(const char *path);
 long long gettim(void);
 double elapsed(long long t);
 void initio(void);
@@ -61,17 +152,49 @@ static void closedrive(void);
 
 /**
  *
- * Size of test disc array in sectors.
+ * Size of test disc at startup in sectors.
  *
  */
 #define SIMSEC 32
 
 /**
  *
- * String equivalences of the first 10 phy drives
+ * Simulated transfer times
+ *
+ * The time a transfer to the simulated disc is taken to need at startup, as a
+ * time to start it plus a time for each byte, giving a drive of about 500mb/s.
+ *
+ */
+#define SIMOPNS   100000 // nanoseconds to start a transfer
+#define SIMBYTENS 2      // nanoseconds for each byte
+
+/**
+ *
+ * Size of a page of the simulated disc in bytes
+ *
+ * The disc is made of pages this big as they are written. It holds a physical
+ * sector of any drive we simulate.
+ *
+ */
+#define SIMPAGE 4096
+
+/**
+ *
+ * Page table buckets at startup, must be a power of 2. The table doubles when
+ * it holds twice as many pages.
  *
  */
-char* phystr[10] = {
+#define SIMBKTS 1024
+
+/**
+ *
+ * Drive registry
+ *
+ * The name of each drive number, Drive0 to Drive9, then names given with
+ * adddrive. All of them are the same simulated disc.
+ *
+ */
+char* phystr[MAXDRIVES] = {
 
     "Drive0",
     "Drive1",
@@ -86,13 +209,63 @@ char* phystr[10] = {
 
 };
 
+/** Drive numbers in use */               static int physcount = 10;
+/** Name was allocated by adddrive */     static int physalloc[MAXDRIVES];
+
+/**
+ *
+ * Simulated disc page
+ *
+ */
+typedef struct _simpage {
+
+    /** Next page in bucket */     struct _simpage *next;
+    /** Page number on the disc */ long long pageno;
+    /** Page contents */           unsigned char data[SIMPAGE];
+
+} simpage;
+
+/**
+ *
+ * Simulated disc page table
+ *
+ * Pages written so far, hashed by page number.
+ *
+ */
+static simpage **pagetbl;
+
+/** Buckets in the page table */        static long long pagebkts;
+/** Pages in the page table */          static long long pagecount;
+/** Size of the disc in bytes */        static long long simbytes = SECSIZE*SIMSEC;
+/** Logical sector size */              static int simlsec = SECSIZE;
+/** Physical sector size */             static int simpsec = SECSIZE;
+/** Nanoseconds to start a transfer */  static long long simopns = SIMOPNS;
+/** Nanoseconds for each byte */        static long long simbytens = SIMBYTENS;
+/** Failed transfers per million */     static long long simerr;
+/** Random number for failures */       static unsigned long long simseed = 1;
+
 /**
  *
- * Simulated disc array
+ * Geometry of the set drive
+ *
+ * The size and sector sizes as they were when the drive was set. devopt can
+ * change the disc at any time, but discdiag has sized its buffers for these,
+ * so transfers go by them until the drive is set again.
  *
  */
+/** Size of the disc in bytes */        static long long drvbytes = SECSIZE*SIMSEC;
+/** Logical sector size */              static int drvlsec = SECSIZE;
+/** Physical sector size */             static int drvpsec = SECSIZE;
 
-static unsigned char simulated_disc[SECSIZE*SIMSEC];
+/**
+ *
+ * Simulated drive time
+ *
+ * The simulated disc finishes every transfer at once, so this adds up the time
+ * the transfers would have taken on a drive, in nanoseconds.
+ *
+ */
+static long long simtime;
 
 /**
  *
@@ -104,6 +277,30 @@ static unsigned char simulated_disc[SECSIZE*SIMSEC];
  */
 static int phydrive;
 
+/**
+ *
+ * Direct access mode
+ *
+ * The simulated disc has no cache, so this only records the mode.
+ *
+ */
+static int directio;
+
+/**
+ *
+ * Queued request completions
+ *
+ * The simulated disc finishes every transfer at once, so queued requests are
+ * performed when they are submitted and their completions held here until
+ * reaped.
+ *
+ */
+static iocmp qcmp[QDMAX];
+
+/** Queue depth, or maximum requests in flight */ static int qdepth;
+/** Number of requests waiting to be reaped */    static int qcount;
+/** Time next request was meant to go, 0 is now */ static long long qissue;
+
 /**
  *
  * Set physical drive
@@ -124,6 +321,12 @@ int setdrive(
 
         return 1;
 
+    }
+    if (drive >= physcount) {
+
+        printf("*** Error: There is no drive %d\n", drive);
+        return 1;
+
     }
     
     closedrive(); // close any active drive
@@ -131,7 +334,10 @@ int setdrive(
     // set logical drive
     phydrive = drive;
 
-    // Other than setting the drive number as active, this routine does nothing.
+    // take the geometry the disc has now
+    drvbytes = simbytes;
+    drvlsec = simlsec;
+    drvpsec = simpsec;
 
     return 0;
 
@@ -156,7 +362,8 @@ int getdrive(void)
  *
  * Test physical drive exists
  *
- * Finds if the physical drive is connected. Accepts drive numbers from 0 - 9.
+ * Finds if the physical drive is connected. Accepts any registered drive
+ * number.
  *
  * returns 0 if good, otherwise 1.
  *
@@ -167,215 +374,1225 @@ int testdrive(
 
 {
 
-    // Not implemented, just say all drives are connected
-    return 0;
+    // every drive registered is the simulated disc
+    return drive < 0 || drive >= physcount;
 
 }
 
 /**
  *
- * Read sector to buffer
+ * Find page
  *
- * Reads the given number of sectors to the indicated buffer.
- * Returns 1 on error, 0 on success.
+ * Finds a page of the simulated disc, and makes it if asked and it doesn't
+ * exist yet. A new page is zeros, as the disc starts out.
+ *
+ * Returns the page, or NULL if it has not been written or there is no memory.
  *
  */
-int readsector(
-    /** Buffer to read sector to */       unsigned char *buffer, 
-    /** Logical block address to start */ long long lba, 
-    /** Number of sectors to read */      long long numsec
+static simpage *fndpage(
+    /** Page number */        long long pageno,
+    /** Make it if missing */ int create
 )
 
 {
 
-    unsigned char *simp;
-    long long i;
+    simpage *p, *np, **nt;
+    long long i, b;
 
-    if (phydrive < 0) {
+    if (pagetbl) {
 
-        printf("*** Error: Physical drive not set\n");
-        return 1;
+        for (p = pagetbl[pageno & (pagebkts-1)]; p; p = p->next)
+            if (p->pageno == pageno) return p;
 
     }
+    if (!create) return NULL;
+    if (!pagetbl || pagecount >= pagebkts*2) { // make or double the table
 
-    // read sectors from simulated array
-    simp = &simulated_disc[lba*SECSIZE]; // index source in simulated disc
-    for (i = 0; i < numsec*SECSIZE; i++) *buffer++ = *simp++;
-    
-    return 0; // return good
+        b = pagetbl ? pagebkts*2 : SIMBKTS;
+        nt = (simpage **) calloc((size_t) b, sizeof(simpage *));
+        if (!nt) {
+
+            if (!pagetbl) return NULL;
+            b = pagebkts; // keep the old table, just longer chains
+
+        } else {
+
+            for (i = 0; pagetbl && i < pagebkts; i++) { // move pages over
+
+                for (p = pagetbl[i]; p; p = np) {
+
+                    np = p->next;
+                    p->next = nt[p->pageno & (b-1)];
+                    nt[p->pageno & (b-1)] = p;
+
+                }
+
+            }
+            free(pagetbl);
+            pagetbl = nt;
+            pagebkts = b;
+
+        }
+
+    }
+    p = (simpage *) calloc(1, sizeof(simpage));
+    if (!p) return NULL;
+    p->pageno = pageno;
+    p->next = pagetbl[pageno & (pagebkts-1)];
+    pagetbl[pageno & (pagebkts-1)] = p;
+    pagecount++;
+
+    return p;
 
 }
 
 /**
  *
- * Write sector from buffer
+ * Free pages
  *
- * Writes the given number of sectors to the indicated buffer.
- * Returns 1 on error, 0 on success.
+ * Frees the pages of the simulated disc from the given byte on, which are off
+ * the end when the disc is made smaller, and clears the rest of a page the end
+ * falls in. From 0 frees the whole disc.
  *
  */
-int writesector(
-    /** Buffer to write sector from */    unsigned char *buffer, 
-    /** Logical block address to start */ long long lba, 
-    /** Number of sectors to write */     long long numsec
+static void freepages(
+    /** First byte to free */ long long from
 )
 
 {
 
-    unsigned char *simp;
+    simpage *p, **pp;
     long long i;
 
-    if (phydrive < 0) {
+    for (i = 0; pagetbl && i < pagebkts; i++) {
 
-        printf("*** Error: Physical drive not set\n");
-        return 1;
+        pp = &pagetbl[i];
+        while (*pp) {
+
+            p = *pp;
+            if (p->pageno*SIMPAGE >= from) { // all past the end
+
+                *pp = p->next;
+                free(p);
+                pagecount--;
+
+            } else {
+
+                if (p->pageno*SIMPAGE+SIMPAGE > from) // clear the part past
+                    memset(p->data+from % SIMPAGE, 0,
+                           (size_t) (SIMPAGE-from % SIMPAGE));
+                pp = &p->next;
+
+            }
+
+        }
 
     }
+    if (!from && pagetbl) { // all gone, drop the table too
 
-    // write sectors to simulated array
-    simp = &simulated_disc[lba*SECSIZE]; // index source in simulated disc
-    for (i = 0; i < numsec*SECSIZE; i++) *simp++ = *buffer++;
+        free(pagetbl);
+        pagetbl = NULL;
+        pagebkts = 0;
 
-    return 0; // return good
+    }
 
 }
 
 /**
  *
- * Find size of physical disc
+ * Transfer to or from the simulated disc
  *
- * Returns 0 on succeed, 1 on fail.
+ * Copies the sectors a page at a time. Fails a transfer that goes past the end
+ * of the disc, and fails the given number per million at random, without
+ * transferring. Counts the time the drive would have taken.
+ *
+ * Returns 1 on error, 0 on success.
  *
  */
-int physize(
-    /** return size of disc */ long long *size
+static int transfer(
+    /** Transfer is write */              int write,
+    /** Buffer to transfer */             unsigned char *buffer,
+    /** Logical block address to start */ long long lba,
+    /** Number of sectors to transfer */  long long numsec
 )
 
 {
 
+    long long pos, len, off, n;
+    simpage *p;
+
     if (phydrive < 0) {
 
         printf("*** Error: Physical drive not set\n");
         return 1;
 
     }
+    pos = lba*drvlsec;
+    len = numsec*drvlsec;
+    simtime += simopns+len*simbytens; // count drive time
+    if (lba < 0 || numsec < 0 || pos+len > drvbytes || pos+len > simbytes)
+        return 1; // off the disc
+    if (simerr) { // see if this one fails
 
-    // place to caller
-    *size = SECSIZE*SIMSEC;
+        simseed = simseed*6364136223846793005ULL+1442695040888963407ULL;
+        if ((long long) ((simseed >> 33) % 1000000) < simerr) return 1;
 
-    return 0;
+    }
+    while (len > 0) {
+
+        off = pos % SIMPAGE;
+        n = SIMPAGE-off;
+        if (n > len) n = len;
+        p = fndpage(pos/SIMPAGE, write);
+        if (write) {
+
+            if (!p) {
+
+                printf("*** Error: No memory for simulated disc\n");
+                return 1;
+
+            }
+            memcpy(p->data+off, buffer, (size_t) n);
+
+        } else if (p) memcpy(buffer, p->data+off, (size_t) n);
+        else memset(buffer, 0, (size_t) n); // never written
+        buffer += n;
+        pos += n;
+        len -= n;
+
+    }
+
+    return 0; // return good
 
 }
 
 /**
  *
- * Test size of physical disc
- *
- * Same as physize, but works on disks that are not opened.
- * Takes the number of the disk.
+ * Read sector to buffer
  *
- * Returns 0 on succeed, 1 on fail.
+ * Reads the given number of sectors to the indicated buffer.
+ * Returns 1 on error, 0 on success.
  *
  */
-int testsize(
-    /** drive number to set */ int drive,
-    /** return size of disc */ long long *size
+int readsector(
+    /** Buffer to read sector to */       unsigned char *buffer, 
+    /** Logical block address to start */ long long lba, 
+    /** Number of sectors to read */      long long numsec
 )
 
 {
 
-    // place to caller
-    *size = SECSIZE*SIMSEC;
-
-    return 0;
+    return transfer(0, buffer, lba, numsec);
 
 }
 
 /**
  *
- * Close out physical disk
+ * Write sector from buffer
  *
- * Closes the physical disk prior to exiting the diagnostic.
+ * Writes the given number of sectors to the indicated buffer.
+ * Returns 1 on error, 0 on success.
  *
  */
-static void closedrive(void)
+int writesector(
+    /** Buffer to write sector from */    unsigned char *buffer, 
+    /** Logical block address to start */ long long lba, 
+    /** Number of sectors to write */     long long numsec
+)
 
 {
 
-    // not needed
+    return transfer(1, buffer, lba, numsec);
 
 }
 
 /**
  *
- * Get logical drive string
+ * Clear page
  *
- * Gets the name of the drive corresponding to the logical number.
- * Returns this as a string, or null pointer if no such drive exists.
+ * Clears the part of a page that falls in a span of bytes. A page the span
+ * covers all of is unlinked from its chain and freed.
+ *
+ * Returns 1 if the page was freed, else 0.
  *
  */
-const char* getdrvstr(int drive)
+static int clearpage(
+    /** Link to the page */  simpage **pp,
+    /** First byte */        long long pos,
+    /** Number of bytes */   long long len
+)
 
 {
 
-    const char* p;
+    simpage *p;
+    long long s, e;
 
-    p = 0; // set no drive string
+    p = *pp;
+    s = p->pageno*SIMPAGE; // bytes of the span in this page
+    e = s+SIMPAGE;
+    if (s < pos) s = pos;
+    if (e > pos+len) e = pos+len;
+    if (s >= e) return 0; // not in the span
+    if (e-s == SIMPAGE) { // whole page goes
 
-    // check drive is valid and set corresponding string
-    if (drive >= 0 || drive <= 9) p = phystr[drive];
+        *pp = p->next;
+        free(p);
+        pagecount--;
 
-    return p;
+        return 1;
+
+    }
+    memset(p->data+s % SIMPAGE, 0, (size_t) (e-s));
+
+    return 0;
 
 }
 
 /**
  *
- * Initialize high resolution timer
+ * Discard sectors of the simulated disc
  *
- * Performs any initialization tasks for the high resolution timer faciltity.
+ * Frees the pages a span covers, and clears the parts of pages at its ends, so
+ * it reads as zeros and gives the memory back. A span of more pages than are
+ * in use is found by going through them all, else by looking each page of the
+ * span up. The drive only takes the time to start it, since no data moves.
+ * Trim and zero are the same here.
+ *
+ * Returns 1 on error, 0 on success.
  *
  */
-void initim(void)
+static int discard(
+    /** Logical block address to start */ long long lba,
+    /** Number of sectors */              long long numsec
+)
 
 {
 
-    // not implemented
+    long long pos, len, i;
+    simpage **pp;
+
+    if (phydrive < 0) {
+
+        printf("*** Error: Physical drive not set\n");
+        return 1;
+
+    }
+    pos = lba*drvlsec;
+    len = numsec*drvlsec;
+    simtime += simopns; // count drive time
+    if (lba < 0 || numsec < 0 || pos+len > drvbytes || pos+len > simbytes)
+        return 1; // off the disc
+    if (!pagetbl || !len) return 0; // nothing written
+    if (len/SIMPAGE > pagecount) { // go through all the pages
+
+        for (i = 0; i < pagebkts; i++) {
+
+            pp = &pagetbl[i];
+            while (*pp) if (!clearpage(pp, pos, len)) pp = &(*pp)->next;
+
+        }
+
+    } else for (i = pos/SIMPAGE; i <= (pos+len-1)/SIMPAGE; i++) {
+
+        pp = &pagetbl[i & (pagebkts-1)]; // look up each page
+        while (*pp && (*pp)->pageno != i) pp = &(*pp)->next;
+        if (*pp) clearpage(pp, pos, len);
+
+    }
+
+    return 0; // return good
 
 }
 
 /**
  *
- * Initialize I/O package
+ * Trim sectors
  *
- * Sets up this package.
+ * Discards the given number of sectors.
+ * Returns 1 on error, 0 on success.
  *
  */
-void initio(void)
+int trimsector(
+    /** Logical block address to start */ long long lba,
+    /** Number of sectors to discard */   long long numsec
+)
 
 {
 
-    phydrive = -1; // set no drive is active
+    return discard(lba, numsec);
 
-    //
-    // Initialize high resolution timer
-    //
-    initim();
+}
+
+/**
+ *
+ * Zero sectors
+ *
+ * Sets the given number of sectors to zero.
+ * Returns 1 on error, 0 on success.
+ *
+ */
+int zerosector(
+    /** Logical block address to start */ long long lba,
+    /** Number of sectors to zero */      long long numsec
+)
+
+{
+
+    return discard(lba, numsec);
 
 }
 
 /**
  *
- * Deinitialize I/O package
+ * Set queue depth
  *
- * Tears down this package.
+ * Sets the maximum number of requests that can be in flight at once. The queue
+ * must be empty.
+ *
+ * Returns 1 on error, 0 on success.
  *
  */
-void deinitio(void)
+int setqd(
+    /** Depth of queue */ int depth
+)
 
 {
 
+    if (depth < 1 || depth > QDMAX) {
+
+        printf("*** Error: Queue depth must be 1 to %d\n", QDMAX);
+        return 1;
+
+    }
+    if (qcount) {
+
+        printf("*** Error: Requests are still in flight\n");
+        return 1;
+
+    }
+    qdepth = depth;
+
+    return 0;
+
+}
+
+/**
+ *
+ * Get queue depth
+ *
+ * Gets the maximum number of requests that can be in flight at once.
+ *
+ */
+int getqd(void)
+
+{
+
+    return qdepth; // just return
+
+}
+
+/**
+ *
+ * Submit request
+ *
+ * Performs a read or write right away, and files its completion to be reaped.
+ *
+ * Returns 1 on error, 0 on success.
+ *
+ */
+static int submit(
+    /** Request is write */               int write,
+    /** Buffer to transfer */             unsigned char *buffer,
+    /** Logical block address to start */ long long lba,
+    /** Number of sectors to transfer */  long long numsec,
+    /** Tag to return on completion */    int tag
+)
+
+{
+
+    iocmp *cp;
+    int r;
+    long long t, s;
+
+    s = qissue; // take the send time, good for this request only
+    qissue = 0;
+    if (phydrive < 0) {
+
+        printf("*** Error: Physical drive not set\n");
+        return 1;
+
+    }
+    if (qcount >= qdepth) {
+
+        printf("*** Error: Queue is full\n");
+        return 1;
+
+    }
+    // perform the transfer now
+    t = gettim();
+    if (write) r = writesector(buffer, lba, numsec);
+    else r = readsector(buffer, lba, numsec);
+    // file the completion
+    cp = &qcmp[qcount++];
+    cp->write = write;
+    cp->lba = lba;
+    cp->numsec = numsec;
+    cp->tag = tag;
+    cp->error = r;
+    cp->lat = gettim()-(s ? s : t); // from when it was meant to go
+
+    return 0; // return good
+
+}
+
+/**
+ *
+ * Submit read
+ *
+ * Queues a read of the given number of sectors to the indicated buffer.
+ * Returns 1 on error, 0 on success.
+ *
+ */
+int submitread(
+    /** Buffer to read sector to */       unsigned char *buffer,
+    /** Logical block address to start */ long long lba,
+    /** Number of sectors to read */      long long numsec,
+    /** Tag to return on completion */    int tag
+)
+
+{
+
+    return submit(0, buffer, lba, numsec, tag);
+
+}
+
+/**
+ *
+ * Submit write
+ *
+ * Queues a write of the given number of sectors from the indicated buffer.
+ * Returns 1 on error, 0 on success.
+ *
+ */
+int submitwrite(
+    /** Buffer to write sector from */    unsigned char *buffer,
+    /** Logical block address to start */ long long lba,
+    /** Number of sectors to write */     long long numsec,
+    /** Tag to return on completion */    int tag
+)
+
+{
+
+    return submit(1, buffer, lba, numsec, tag);
+
+}
+
+/**
+ *
+ * Submit batch
+ *
+ * Queues a batch of reads or writes, each with its own buffer and LBA, tagged
+ * from tag up. The simulated disc finishes each request as it is sent, so they are just
+ * sent one after another.
+ * Returns 1 on error, 0 on success.
+ *
+ */
+int submitv(
+    /** Batch is writes */                 int write,
+    /** Buffer of each transfer */         unsigned char **buffers,
+    /** Logical block address of each */   long long *lbas,
+    /** Number of sectors in each */       long long *numsecs,
+    /** Number of transfers */             int n,
+    /** Tag of first transfer */           int tag
+)
+
+{
+
+    long long t;
+    int i;
+
+    t = qissue; // the whole batch was meant to go at once
+    for (i = 0; i < n; i++) {
+
+        qissue = t;
+        if (submit(write, buffers[i], lbas[i], numsecs[i], tag+i)) return 1;
+
+    }
+
+    return 0; // return good
+
+}
+
+/**
+ *
+ * Reap finished requests
+ *
+ * Returns up to max finished requests in the completion array, oldest first.
+ * Since everything queued is already finished, this never waits, and the
+ * minimum is only there to match the other platforms.
+ *
+ * Returns the number of completions, or -1 on error.
+ *
+ */
+int reap(
+    /** Completion array */          iocmp *cmp,
+    /** Minimum number to wait for */ int min,
+    /** Maximum number to return */   int max
+)
+
+{
+
+    int i;
+
+    if (max > qcount) max = qcount;
+    for (i = 0; i < max; i++) cmp[i] = qcmp[i];
+    // move any remaining entries down
+    for (i = max; i < qcount; i++) qcmp[i-max] = qcmp[i];
+    qcount -= max;
+
+    return max;
+
+}
+
+/**
+ *
+ * Find requests in flight
+ *
+ * Returns the number of queued requests that have not been reaped.
+ *
+ */
+int inflight(void)
+
+{
+
+    return qcount; // just return
+
+}
+
+/**
+ *
+ * Reap finished requests by a time
+ *
+ * Returns up to max finished requests in the completion array, or if there are
+ * none, waits until the timer reaches the given time. Requests finish as they
+ * are sent, so there is nothing to wait for otherwise. The simulated disc
+ * keeps its own time, so the wait just moves the clock on to the time.
+ *
+ * Returns the number of completions, 0 if the time came first, or -1 on error.
+ *
+ */
+int reapby(
+    /** Completion array */          iocmp *cmp,
+    /** Maximum number to return */   int max,
+    /** Time to wait until */         long long t
+)
+
+{
+
+    if (qcount) return reap(cmp, 0, max);
+    if (t > gettim()) simtime += t-gettim(); // spend the time at once
+
+    return 0;
+
+}
+
+/**
+ *
+ * Set send time
+ *
+ * Sets the time the next submitread, submitwrite or submitv was meant to be
+ * sent, when that is earlier than it will be. The latency of what it sends is
+ * counted from then, so a request held up behind others is not counted as
+ * faster than it was. 0 counts from when it is sent, which is also what the
+ * requests after that one do.
+ *
+ */
+void setissue(
+    /** Time meant to send, or 0 */ long long t
+)
+
+{
+
+    qissue = t;
+
+}
+
+/**
+ *
+ * Cancel queued requests
+ *
+ * Requests finish as they are sent, so there is never one in flight to
+ * cancel.
+ *
+ * Returns the number of requests cancelled.
+ *
+ */
+int cancelq(void)
+
+{
+
+    return 0; // nothing to cancel
+
+}
+
+/**
+ *
+ * Set direct access mode
+ *
+ * Turns direct access on or off. The simulated disc has no cache, so this only
+ * records the mode.
+ *
+ * Returns 1 on error, 0 on success.
+ *
+ */
+int setdirect(
+    /** Direct mode on */ int on
+)
+
+{
+
+    directio = !!on;
+
+    return 0;
+
+}
+
+/**
+ *
+ * Get direct access mode
+ *
+ * Returns true if direct access is on.
+ *
+ */
+int getdirect(void)
+
+{
+
+    return directio; // just return
+
+}
+
+/**
+ *
+ * Allocate transfer buffer
+ *
+ * Allocates a buffer aligned to BUFALIGN. ANSI C has no aligned allocation, so
+ * we over allocate, align by hand and keep the original pointer just below the
+ * buffer.
+ *
+ * Returns the buffer, or NULL if there is no memory.
+ *
+ */
+unsigned char *allocbuf(
+    /** Size of buffer in bytes */ long long size
+)
+
+{
+
+    unsigned char *p;
+    unsigned char *a;
+
+    p = (unsigned char *) malloc((size_t) size+BUFALIGN+sizeof(unsigned char *));
+    if (!p) return NULL;
+    // align past room for the original pointer
+    a = p+sizeof(unsigned char *);
+    a += (BUFALIGN-(unsigned long) a % BUFALIGN) % BUFALIGN;
+    ((unsigned char **) a)[-1] = p; // save original for free
+
+    return a;
+
+}
+
+/**
+ *
+ * Free transfer buffer
+ *
+ * Frees a buffer from allocbuf().
+ *
+ */
+void freebuf(
+    /** Buffer to free */         unsigned char *buffer,
+    /** Size of buffer in bytes */ long long size
+)
+
+{
+
+    if (buffer) free(((unsigned char **) buffer)[-1]);
+
+}
+
+/**
+ *
+ * Start worker thread
+ *
+ * The simulated disc is one array with no locking around it, so workers are
+ * not supported here.
+ *
+ * Returns 1 on error, 0 on success.
+ *
+ */
+int newthread(
+    /** Worker slot */       int id,
+    /** Function to run */   void (*fn)(void *),
+    /** Argument to pass */  void *arg
+)
+
+{
+
+    printf("*** Error: Workers are not supported on this system\n");
+
+    return 1;
+
+}
+
+/**
+ *
+ * Wait for worker thread
+ *
+ * No thread can have been started, so there is nothing to wait for.
+ *
+ * Returns 1 on error, 0 on success.
+ *
+ */
+int waitthread(
+    /** Worker slot */ int id
+)
+
+{
+
+    return 1;
+
+}
+
+/**
+ *
+ * Initialize thread I/O state
+ *
+ * Sets up the drive and queue state. There is only the main thread.
+ *
+ */
+void initthread(void)
+
+{
+
+    phydrive = -1; // set no drive is active
+    directio = 0; // set direct mode off
+    qdepth = 1; // set no queueing
+    qcount = 0;
+
+}
+
+/**
+ *
+ * Deinitialize thread I/O state
+ *
+ * Closes any drive that is open.
+ *
+ */
+void deinitthread(void)
+
+{
+
+    closedrive(); // close any active drive
+
+}
+
+/**
+ *
+ * Pin thread
+ *
+ * The simulated disc is in memory, with nothing to place near it, so any CPU
+ * or node is taken and nothing is done.
+ *
+ * Returns 0 for success.
+ *
+ */
+int pinthread(
+    /** CPU number, or -1 for none */  int cpu,
+    /** Node number, or -1 for none */ int node
+)
+
+{
+
+    return 0;
+
+}
+
+/**
+ *
+ * Get drive NUMA node
+ *
+ * The simulated disc is always on node 0.
+ *
+ * Returns the node.
+ *
+ */
+int drivenode(
+    /** Drive number */ int drive
+)
+
+{
+
+    return 0;
+
+}
+
+/**
+ *
+ * Find size of physical disc
+ *
+ * Returns 0 on succeed, 1 on fail.
+ *
+ */
+int physize(
+    /** return size of disc */ long long *size
+)
+
+{
+
+    if (phydrive < 0) {
+
+        printf("*** Error: Physical drive not set\n");
+        return 1;
+
+    }
+
+    // place to caller
+    *size = drvbytes;
+
+    return 0;
+
+}
+
+/**
+ *
+ * Get sector sizes of physical disc
+ *
+ * Gets the logical sector size, which LBAs and transfers are counted in, and
+ * the physical sector size the drive writes in. The simulated disc has 512 byte
+* sectors, unless set otherwise with devopt.
+ *
+ * Returns 0 on succeed, 1 on fail.
+ *
+ */
+int sectorsize(
+    /** return logical sector size */  int *lsize,
+    /** return physical sector size */ int *psize
+)
+
+{
+
+    if (phydrive < 0) {
+
+        printf("*** Error: Physical drive not set\n");
+        return 1;
+
+    }
+    *lsize = drvlsec;
+    *psize = drvpsec;
+
+    return 0;
+
+}
+
+/**
+ *
+ * Set device option
+ *
+ * Sets an option of the simulated disc, or with no name lists them. The
+ * options are:
+ *
+ * size   - Size of the disc in logical sectors.
+ * lsec   - Logical sector size, 512 or 4096.
+ * psec   - Physical sector size, a multiple of the logical up to 4096.
+ * opns   - Nanoseconds to start a transfer.
+ * bytens - Nanoseconds for each byte transferred.
+ * err    - Failed transfers per million.
+ * seed   - Restart the failures from a seed.
+ * clear  - Erase the disc, any value.
+ *
+ * The size and sector sizes are seen when the drive is next set. Changing the
+ * logical sector size keeps the size in bytes. Making the disc smaller drops
+ * what was written past the new end.
+ *
+ * Returns 1 on error, 0 on success.
+ *
+ */
+int devopt(
+    /** Option name, or NULL to list */ const char *name,
+    /** Value to set */                 long long val
+)
+
+{
+
+    if (!name) {
+
+        printf("Simulated disc: size %lld sectors of %d bytes (%d physical)\n",
+               simbytes/simlsec, simlsec, simpsec);
+        printf("Transfer time: %lldns + %lldns/byte, failures: %lld per million\n",
+               simopns, simbytens, simerr);
+        printf("Pages written: %lld of %d bytes\n", pagecount, SIMPAGE);
+
+        return 0;
+
+    }
+    if (!strcmp(name, "size")) {
+
+        if (val < 1) {
+
+            printf("*** Error: Size must be at least 1 sector\n");
+            return 1;
+
+        }
+        if (val*simlsec < simbytes) freepages(val*simlsec);
+        simbytes = val*simlsec;
+
+    } else if (!strcmp(name, "lsec")) {
+
+        if (val != 512 && val != 4096) {
+
+            printf("*** Error: Logical sector size must be 512 or 4096\n");
+            return 1;
+
+        }
+        simlsec = (int) val;
+        if (simpsec < simlsec) simpsec = simlsec;
+        simbytes -= simbytes % simlsec; // whole sectors only
+
+    } else if (!strcmp(name, "psec")) {
+
+        if (val < simlsec || val > SIMPAGE || val % simlsec) {
+
+            printf("*** Error: Physical sector size must be a multiple of %d up to %d\n",
+                   simlsec, SIMPAGE);
+            return 1;
+
+        }
+        simpsec = (int) val;
+
+    } else if (!strcmp(name, "opns") || !strcmp(name, "bytens")) {
+
+        if (val < 0) {
+
+            printf("*** Error: Time must not be negative\n");
+            return 1;
+
+        }
+        if (!strcmp(name, "opns")) simopns = val;
+        else simbytens = val;
+
+    } else if (!strcmp(name, "err")) {
+
+        if (val < 0 || val > 1000000) {
+
+            printf("*** Error: Failures must be 0 to 1000000 per million\n");
+            return 1;
+
+        }
+        simerr = val;
+
+    } else if (!strcmp(name, "seed")) simseed = (unsigned long long) val;
+    else if (!strcmp(name, "clear")) freepages(0);
+    else {
+
+        printf("*** Error: Device option not recognized\n");
+        return 1;
+
+    }
+
+    return 0;
+
+}
+
+/**
+ *
+ * Test size of physical disc
+ *
+ * Same as physize, but works on disks that are not opened.
+ * Takes the number of the disk.
+ *
+ * Returns 0 on succeed, 1 on fail.
+ *
+ */
+int testsize(
+    /** drive number to set */ int drive,
+    /** return size of disc */ long long *size
+)
+
+{
+
+    // place to caller
+    *size = simbytes;
+
+    return 0;
+
+}
+
+/**
+ *
+ * Close out physical disk
+ *
+ * Closes the physical disk prior to exiting the diagnostic.
+ *
+ */
+static void closedrive(void)
+
+{
+
+    // not needed
+
+}
+
+/**
+ *
+ * Get logical drive string
+ *
+ * Gets the name of the drive corresponding to the logical number.
+ * Returns this as a string, or null pointer if no such drive exists.
+ *
+ */
+const char* getdrvstr(int drive)
+
+{
+
+    const char* p;
+
+    p = 0; // set no drive string
+
+    // check drive is valid and set corresponding string
+    if (drive >= 0 && drive < physcount) p = phystr[drive];
+
+    return p;
+
+}
+
+/**
+ *
+ * Add drive
+ *
+ * Gives a name a drive number. Any name will do, since every drive is the
+ * simulated disc. A name that already has a number keeps it.
+ *
+ * Returns the drive number, or -1 on error.
+ *
+ */
+int adddrive(
+    /** Path of device or file */ const char *path
+)
+
+{
+
+    int i;
+
+    for (i = 0; i < physcount; i++)
+        if (!strcmp(phystr[i], path)) return i; // already known
+    if (physcount >= MAXDRIVES) {
+
+        printf("*** Error: No more than %d drives can be known\n", MAXDRIVES);
+        return -1;
+
+    }
+    phystr[physcount] = (char *) malloc(strlen(path)+1);
+    if (!phystr[physcount]) {
+
+        printf("*** Error: Cannot allocate space\n");
+        return -1;
+
+    }
+    strcpy(phystr[physcount], path);
+    physalloc[physcount] = 1;
+
+    return physcount++;
+
+}
+
+/**
+ *
+ * Get high resolution timer
+ *
+ * Returns the simulated clock in nanoseconds. Nothing here ever waits, so the
+ * clock is the processor time we have used, plus the time the simulated
+ * transfers would have taken on a drive.
+ *
+ */
+long long gettim(void)
+
+{
+
+    return (long long) clock()*1000000000LL/CLOCKS_PER_SEC+simtime;
+
+}
+
+/**
+ *
+ * Find elapsed time in seconds
+ *
+ * Finds the seconds passed since the given timer reading. Returns as a floating
+ * point value so that fractional times can be represented.
+ *
+ */
+double elapsed(
+    /** reference time */ long long t
+)
+
+{
+
+    return (gettim()-t)/1000000000.0;
+
+}
+
+/**
+ *
+ * Initialize high resolution timer
+ *
+ * Performs any initialization tasks for the high resolution timer faciltity.
+ *
+ */
+void initim(void)
+
+{
+
+    simtime = 0; // no drive time yet
+
+}
+
+/**
+ *
+ * Initialize I/O package
+ *
+ * Sets up this package.
+ *
+ */
+void initio(void)
+
+{
+
+    initthread(); // set up drive and queue state
+
+    //
+    // Initialize high resolution timer
+    //
+    initim();
+
+}
+
+/**
+ *
+ * Deinitialize I/O package
+ *
+ * Tears down this package.
+ *
+ */
+void deinitio(void)
+
+{
+
+    int i;
+
     closedrive(); // close any active drive
+    freepages(0); // release the simulated disc
+    for (i = 0; i < physcount; i++) // free the names added
+        if (physalloc[i]) free(phystr[i]);
 
 } 
  
@@ -14,15 +14,70 @@
 *
 * writesector - Write one or more sectors to a buffer.
 *
+* trimsector  - Discard one or more sectors.
+*
+* zerosector  - Set one or more sectors to zero.
+*
 * physize     - Get the size of the physical drive in lbas.
 *
+* sectorsize  - Get the logical and physical sector sizes of the drive.
+*
+* devopt      - Set or list device options, of which there are none.
+*
 * testsize    - Get the size of a physical drive in lbas, but takes drive as
 *               parameter.
 *
+* setqd       - Set the asynchronous queue depth.
+*
+* getqd       - Get the asynchronous queue depth.
+*
+* submitread  - Queue a read of one or more sectors to a buffer.
+*
+* submitwrite - Queue a write of one or more sectors from a buffer.
+*
+* submitv     - Queue a batch of reads or writes.
+*
+* reap        - Collect finished queued requests.
+*
+* inflight    - Get the number of queued requests not yet reaped.
+*
+* reapby      - Collect finished queued requests, waiting no later than a
+*               given time.
+*
+* setissue    - Set the time the next queued request was meant to be sent.
+*
+* cancelq     - Cancel queued requests still in flight.
+*
+* setdirect   - Set direct (unbuffered) access mode on or off.
+*
+* getdirect   - Get direct access mode.
+*
+* allocbuf    - Allocate an aligned transfer buffer.
+*
+* freebuf     - Free a transfer buffer.
+*
+* newthread   - Start a worker thread.
+*
+* waitthread  - Wait for a worker thread to finish.
+*
+* initthread  - Set up the I/O state of a new thread.
+*
+* deinitthread - Tear down the I/O state of a thread.
+*
+* pinthread   - Pin the calling thread to a CPU or NUMA node.
+*
+* drivenode   - Get the NUMA node a drive is attached to.
+*
 * closedrive  - Close current drive.
 *
 * getdrvstr   - Gets the string corresponding to a given logical drive.
 *
+* adddrive    - Give a device or image file path a drive number.
+*
+* gettim      - Get the high resolution timer in nanoseconds.
+*
+* elapsed     - Find the seconds passed since a timer reading.
+*
 * initio      - Initializes this module.
 *
 * deinitio    - Deinitializes this module.
@@ -30,6 +85,8 @@
 ******************************************************************************/
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <windows.h>
 #include <winioctl.h>
 #include "discio.h"
@@ -44,9 +101,37 @@ int getdrive(void);
 int testdrive(int drive);
 int readsector(unsigned char *buffer, long long lba, long long numsec);
 int writesector(unsigned char *buffer, long long lba, long long numsec);
+int trimsector(long long lba, long long numsec);
+int zerosector(long long lba, long long numsec);
 int physize(long long *size);
+int sectorsize(int *lsize, int *psize);
+int devopt(const char *name, long long val);
 int testsize(int drive, long long *size);
+int setqd(int depth);
+int getqd(void);
+int submitread(unsigned char *buffer, long long lba, long long numsec, int tag);
+int submitwrite(unsigned char *buffer, long long lba, long long numsec, int tag);
+int submitv(int write, unsigned char **buffers, long long *lbas,
+            long long *numsecs, int n, int tag);
+int reap(iocmp *cmp, int min, int max);
+int inflight(void);
+int reapby(iocmp *cmp, int max, long long t);
+void setissue(long long t);
+int cancelq(void);
+int setdirect(int on);
+int getdirect(void);
+unsigned char *allocbuf(long long size);
+void freebuf(unsigned char *buffer, long long size);
+int newthread(int id, void (*fn)(void *), void *arg);
+int waitthread(int id);
+void initthread(void);
+void deinitthread(void);
+int pinthread(int cpu, int node);
+int drivenode(int drive);
 const char* getdrvstr(int drive);
+int adddrive(const char *path);
+long long gettim(void);
+double elapsed(long long t);
 void initio(void);
 void deinitio(void);
 
@@ -56,13 +141,42 @@ void deinitio(void);
  *
  */
 static void closedrive(void);
+static int getsize(HANDLE h, long long *size);
+static int transfer(int write, unsigned char *buffer, long long lba,
+                    long long numsec);
+
+/**
+ *
+ * Largest piece of a synchronous transfer
+ *
+ * ReadFile and WriteFile take a 32 bit count, so bigger transfers are done in
+ * pieces of this many bytes.
+ *
+ */
+#define XFERMAX 0x40000000
+
+/**
+ *
+ * Spin before a deadline
+ *
+ * A sleep can run over by a timer tick of up to about 16 milliseconds, so waits
+ * for a time sleep until this many nanoseconds before it, and poll the rest of
+ * the way.
+ *
+ */
+#define SLEEPSPIN 20000000
 
 /**
  *
- * String equivalences of the first 10 phy drives
+ * Drive registry
+ *
+ * The path of each drive number. The first 10 are PhysicalDrive0 to 9, as
+ * they always were, then paths given with adddrive, which can be devices or
+ * image files. The registry is only added to from the main thread with no
+ * workers running.
  *
  */
-LPCSTR phystr[10] = {
+LPCSTR phystr[MAXDRIVES] = {
 
     "\\\\.\\PhysicalDrive0",
     "\\\\.\\PhysicalDrive1",
@@ -77,6 +191,9 @@ LPCSTR phystr[10] = {
 
 };
 
+/** Drive numbers in use */               static int physcount = 10;
+/** Path was allocated by adddrive */     static int physalloc[MAXDRIVES];
+
 /**
  *
  * Active drive number
@@ -84,15 +201,73 @@ LPCSTR phystr[10] = {
  * The number of the physical drive to access.
  * -1 indicates drive was never set.
  *
+ * Each thread has its own drive, handle and queue, so workers don't see each
+ * other's state.
+ *
+ */
+static THREAD int phydrive;
+
+/**
+ *
+ * Queued request completions
+ *
+ * The drive handle is not opened for overlapped I/O, so queued requests are
+ * performed when they are submitted, and their completions held here until
+ * reaped.
+ *
  */
-static int phydrive;
+static THREAD iocmp qcmp[QDMAX];
+
+/** Queue depth, or maximum requests in flight */ static THREAD int qdepth;
+/** Number of requests waiting to be reaped */    static THREAD int qcount;
+/** Time next request was meant to go, 0 is now */ static THREAD long long qissue;
 
 /**
  *
  * Windows handle to phy drive
  *
  */
-static HANDLE phydriveh;
+static THREAD HANDLE phydriveh;
+
+/**
+ *
+ * Sector sizes of phy drive
+ *
+ * The logical sector size is the unit of LBAs and transfers. The physical one
+ * is what the drive writes at once, and may be a multiple of it.
+ *
+ */
+/** Logical sector size */  static THREAD int lsecsize = SECSIZE;
+/** Physical sector size */ static THREAD int psecsize = SECSIZE;
+
+/**
+ *
+ * Direct access mode
+ *
+ * When set, the drive is opened without system buffering and with write
+ * through, so that transfers go to the drive instead of the cache.
+ *
+ */
+static THREAD int directio;
+
+/**
+ *
+ * Performance counter ticks per second for high resolution timer
+ *
+ */
+static long long frequency;
+
+/**
+ *
+ * Worker threads
+ *
+ * The handle of the thread in each worker slot, and the function and argument
+ * it runs.
+ *
+ */
+/** Thread for slot */        static HANDLE thrhan[MAXWORKERS];
+/** Function to run */        static void (*thrfn[MAXWORKERS])(void *);
+/** Argument to function */   static void *thrarg[MAXWORKERS];
 
 /**
  *
@@ -108,11 +283,22 @@ int setdrive(
 
 {
 
+    STORAGE_PROPERTY_QUERY spq;
+    STORAGE_ACCESS_ALIGNMENT_DESCRIPTOR aad;
+    DISK_GEOMETRY dg;
+    DWORD rsize;
+
     if (drive < 0) {
 
         printf("*** Error: Physical drive not set\n");
         return 1;
 
+    }
+    if (drive >= physcount) {
+
+        printf("*** Error: There is no drive %d\n", drive);
+        return 1;
+
     }
 
     closedrive(); // close any active drive
@@ -128,7 +314,7 @@ int setdrive(
                      FILE_SHARE_WRITE,
                      NULL,
                      OPEN_EXISTING,
-                     0,
+                     directio ? FILE_FLAG_NO_BUFFERING | FILE_FLAG_WRITE_THROUGH : 0,
                      NULL);
 
     if (phydriveh == INVALID_HANDLE_VALUE)
@@ -150,6 +336,30 @@ int setdrive(
 
     }
 
+    // find the sector sizes, the alignment query gives both
+    memset(&spq, 0, sizeof(spq));
+    spq.PropertyId = StorageAccessAlignmentProperty;
+    spq.QueryType = PropertyStandardQuery;
+    lsecsize = SECSIZE;
+    psecsize = SECSIZE;
+    if (DeviceIoControl(phydriveh, IOCTL_STORAGE_QUERY_PROPERTY, &spq, sizeof(spq),
+                        &aad, sizeof(aad), &rsize, NULL) &&
+        aad.BytesPerLogicalSector >= SECSIZE) {
+
+        lsecsize = (int) aad.BytesPerLogicalSector;
+        psecsize = (int) aad.BytesPerPhysicalSector;
+
+    } else if (DeviceIoControl(phydriveh, IOCTL_DISK_GET_DRIVE_GEOMETRY, NULL, 0,
+                               &dg, sizeof(dg), &rsize, NULL) &&
+               dg.BytesPerSector >= SECSIZE) {
+
+        // older systems only have the one size
+        lsecsize = (int) dg.BytesPerSector;
+        psecsize = lsecsize;
+
+    }
+    if (psecsize < lsecsize) psecsize = lsecsize;
+
     return 0;
 
 }
@@ -173,7 +383,8 @@ int getdrive(void)
  *
  * Test physical drive exists
  *
- * Finds if the physical drive is connected. Accepts drive numbers from 0 - 9.
+ * Finds if the physical drive is connected. Accepts any registered drive
+ * number.
  *
  * returns 0 if good, otherwise 1.
  *
@@ -186,6 +397,7 @@ int testdrive(
 
     HANDLE driveh;
 
+    if (drive < 0 || drive >= physcount) return 1; // no such drive
     //open the physical disk
     driveh = CreateFile(phystr[drive],
                      GENERIC_READ | GENERIC_WRITE,
@@ -208,22 +420,27 @@ int testdrive(
 
 /**
  *
- * Read sector to buffer
+ * Transfer sectors
  *
- * Reads the given number of sectors to the indicated buffer.
+ * Reads or writes the given number of sectors at the given LBA. The offset is
+ * given to each call in an OVERLAPPED block, so there is no seek before it,
+ * and pieces that come up short are carried on from where they stopped.
  * Returns 1 on error, 0 on success.
  *
  */
-int readsector(
-    /** Buffer to read sector to */       unsigned char *buffer, 
-    /** Logical block address to start */ long long lba, 
-    /** Number of sectors to read */      long long numsec
+static int transfer(
+    /** Write, else read */               int write,
+    /** Buffer to transfer */             unsigned char *buffer,
+    /** Logical block address to start */ long long lba,
+    /** Number of sectors to transfer */  long long numsec
 )
 
 {
 
-    long long LongOffset = 0;
-    DWORD     retsize, TmpOffsetHigh, TmpOffsetLow;
+    long long o, left;
+    DWORD     n, retsize;
+    OVERLAPPED ov;
+    BOOL      result;
 
     if (phydrive < 0) {
 
@@ -231,21 +448,27 @@ int readsector(
         return 1;
 
     }
+    o = lba * (long long)lsecsize;
+    left = numsec * (long long)lsecsize;
+    while (left > 0) {
 
-    //seek to the specified LBA
-    LongOffset = lba * (long long)SECSIZE;
-    TmpOffsetLow = (DWORD)LongOffset;
-    TmpOffsetHigh = (DWORD)(LongOffset >> 32);
-    SetFilePointer(phydriveh, TmpOffsetLow, (PLONG)&TmpOffsetHigh, FILE_BEGIN);
+        n = left > XFERMAX ? XFERMAX : (DWORD) left;
+        memset(&ov, 0, sizeof(ov));
+        ov.Offset = (DWORD)o;
+        ov.OffsetHigh = (DWORD)(o >> 32);
+        if (write) result = WriteFile(phydriveh, buffer, n, &retsize, &ov);
+        else result = ReadFile(phydriveh, buffer, n, &retsize, &ov);
+        if (!result || !retsize) {
 
-    //read the sector
-    BOOL result = ReadFile(phydriveh, buffer, (SECSIZE * (int)numsec), &retsize, NULL);
-    if(!result)
-    {
+            printf("*** Error: Could not %s: Error: %d\n",
+                   write ? "write" : "read", result ? 0 : GetLastError());
 
-        printf("*** Error: Could not read: Error: %d\n", GetLastError());
+            return 1;
 
-        return 1;
+        }
+        buffer += retsize;
+        o += retsize;
+        left -= retsize;
 
     }
     
@@ -253,6 +476,26 @@ int readsector(
 
 }
 
+/**
+ *
+ * Read sector to buffer
+ *
+ * Reads the given number of sectors to the indicated buffer.
+ * Returns 1 on error, 0 on success.
+ *
+ */
+int readsector(
+    /** Buffer to read sector to */       unsigned char *buffer, 
+    /** Logical block address to start */ long long lba, 
+    /** Number of sectors to read */      long long numsec
+)
+
+{
+
+    return transfer(0, buffer, lba, numsec);
+
+}
+
 /**
  *
  * Write sector from buffer
@@ -269,53 +512,102 @@ int writesector(
 
 {
 
-    long long LongOffset = 0;
-    DWORD     retsize, TmpOffsetHigh, TmpOffsetLow;
+    return transfer(1, buffer, lba, numsec);
 
-    if (phydrive < 0) {
+}
 
-        printf("*** Error: Physical drive not set\n");
-        return 1;
+/**
+ *
+ * Size of the zero buffer
+ *
+ * Drives that can't zero a span themselves are sent zeros from a buffer of
+ * this many bytes at a time. It is a multiple of any sector size.
+ *
+ */
+#define ZEROBUF 0x100000
 
-    }
+/**
+ *
+ * Trim sectors
+ *
+ * Discards the given number of sectors. Drives take a data set management
+ * trim, and image files a file level trim.
+ * Returns 1 on error, 0 on success.
+ *
+ */
+int trimsector(
+    /** Logical block address to start */ long long lba,
+    /** Number of sectors to discard */   long long numsec
+)
 
-    //seek to the specified LBA
-    LongOffset = lba * (long long)SECSIZE;
-    TmpOffsetLow = (DWORD)LongOffset;
-    TmpOffsetHigh = (DWORD)(LongOffset >> 32);
-    SetFilePointer(phydriveh, TmpOffsetLow, (PLONG)&TmpOffsetHigh, FILE_BEGIN);
+{
 
-    //read the sector
-    BOOL result = WriteFile(phydriveh, buffer, (SECSIZE * (int)numsec), &retsize, NULL);
-    if(!result)
-    {
+    struct {
+
+        DEVICE_MANAGE_DATA_SET_ATTRIBUTES attr;
+        DEVICE_DATA_SET_RANGE range;
+
+    } dsm;
+    struct {
+
+        FILE_LEVEL_TRIM trim;
+        FILE_LEVEL_TRIM_RANGE range;
+
+    } flt;
+    DWORD retsize;
 
-        printf("*** Error: Could not write: Error: %d\n", GetLastError());
+    if (phydrive < 0) {
 
+        printf("*** Error: Physical drive not set\n");
         return 1;
 
     }
-    
-    return 0; // return good
+    memset(&dsm, 0, sizeof(dsm));
+    dsm.attr.Size = sizeof(DEVICE_MANAGE_DATA_SET_ATTRIBUTES);
+    dsm.attr.Action = DeviceDsmAction_Trim;
+    dsm.attr.Flags = DEVICE_DSM_FLAG_TRIM_NOT_FS_ALLOCATED;
+    dsm.attr.DataSetRangesOffset = sizeof(DEVICE_MANAGE_DATA_SET_ATTRIBUTES);
+    dsm.attr.DataSetRangesLength = sizeof(DEVICE_DATA_SET_RANGE);
+    dsm.range.StartingOffset = lba * (long long)lsecsize;
+    dsm.range.LengthInBytes = numsec * (long long)lsecsize;
+    if (DeviceIoControl(phydriveh, IOCTL_STORAGE_MANAGE_DATA_SET_ATTRIBUTES,
+                        &dsm, sizeof(dsm), NULL, 0, &retsize, NULL))
+        return 0; // a drive
+    memset(&flt, 0, sizeof(flt));
+    flt.trim.NumRanges = 1;
+    flt.trim.Ranges[0].Offset = lba * (long long)lsecsize;
+    flt.trim.Ranges[0].Length = numsec * (long long)lsecsize;
+    if (DeviceIoControl(phydriveh, FSCTL_FILE_LEVEL_TRIM, &flt, sizeof(flt),
+                        NULL, 0, &retsize, NULL))
+        return 0; // an image file
+    printf("*** Error: Could not trim: Error: %d\n", GetLastError());
+
+    return 1;
 
 }
 
 /**
  *
- * Find size of physical disc
+ * Zero sectors
  *
- * Returns 0 on succeed, 1 on fail.
+ * Sets the given number of sectors to zero. Image files are zeroed in place,
+ * drives are written with zeros, since Windows has no call to have a drive
+ * zero a span itself.
+ * Returns 1 on error, 0 on success.
  *
  */
-int physize(
-    /** return size of disc */ long long *size
+int zerosector(
+    /** Logical block address to start */ long long lba,
+    /** Number of sectors to zero */      long long numsec
 )
 
 {
 
-    GET_LENGTH_INFORMATION li;
-    BOOL r;
-    DWORD rsize;
+    FILE_ZERO_DATA_INFORMATION fz;
+    DWORD retsize;
+    unsigned char *zbuf;
+    long long n;
+    int r;
 
     if (phydrive < 0) {
 
@@ -323,156 +615,979 @@ int physize(
         return 1;
 
     }
-
-    // get size of disk
-    r = DeviceIoControl(phydriveh, IOCTL_DISK_GET_LENGTH_INFO, NULL, 0, &li, sizeof(li), 
-                        &rsize, NULL);
-    if (r == 0) {
-
-        printf("*** Error: Cannot get size of disk\n");
+    fz.FileOffset.QuadPart = lba * (long long)lsecsize;
+    fz.BeyondFinalZero.QuadPart = (lba+numsec) * (long long)lsecsize;
+    if (DeviceIoControl(phydriveh, FSCTL_SET_ZERO_DATA, &fz, sizeof(fz),
+                        NULL, 0, &retsize, NULL))
+        return 0; // an image file
+    zbuf = allocbuf(ZEROBUF);
+    if (!zbuf) {
+
+        printf("*** Error: Cannot allocate space\n");
         return 1;
 
     }
+    memset(zbuf, 0, ZEROBUF);
+    r = 0;
+    while (!r && numsec > 0) {
 
-    // place to caller
-//    *size = ((long long) li.Length.HighPart << 32)+li.Length.LowPart;
-    *size = li.Length.QuadPart;
+        n = ZEROBUF/lsecsize;
+        if (n > numsec) n = numsec;
+        r = transfer(1, zbuf, lba, n);
+        lba += n;
+        numsec -= n;
 
-    return 0;
+    }
+    freebuf(zbuf, ZEROBUF);
+
+    return r;
 
 }
 
 /**
  *
- * Test size of physical disc
- *
- * Same as physize, but works on disks that are not opened.
- * Takes the number of the disk.
+ * Set queue depth
  *
- * Note: does not print on error.
+ * Sets the maximum number of requests that can be in flight at once. The queue
+ * must be empty.
  *
- * Returns 0 on succeed, 1 on fail.
+ * Returns 1 on error, 0 on success.
  *
  */
-int testsize(
-    /** drive number to set */ int drive,
-    /** return size of disc */ long long *size
+int setqd(
+    /** Depth of queue */ int depth
 )
 
 {
 
-    GET_LENGTH_INFORMATION li;
-    BOOL r;
-    DWORD rsize;
+    if (depth < 1 || depth > QDMAX) {
 
-    HANDLE driveh;
+        printf("*** Error: Queue depth must be 1 to %d\n", QDMAX);
+        return 1;
 
-    //open the physical disk
-    driveh = CreateFile(phystr[drive],
-                     GENERIC_READ | GENERIC_WRITE,
-                     FILE_SHARE_DELETE |
-                     FILE_SHARE_READ |
-                     FILE_SHARE_WRITE,
-                     NULL,
-                     OPEN_EXISTING,
-                     0,
-                     NULL);
+    }
+    if (qcount) {
 
-    if (driveh == INVALID_HANDLE_VALUE) return 1;
+        printf("*** Error: Requests are still in flight\n");
+        return 1;
 
-    // get size of disk
-    r = DeviceIoControl(driveh, IOCTL_DISK_GET_LENGTH_INFO, NULL, 0, &li, sizeof(li), 
-                        &rsize, NULL);
-    if (r == 0) {
+    }
+    qdepth = depth;
 
-        return 1; // just return error
+    return 0;
 
-    }
+}
 
-    // place to caller
-    *size = li.Length.QuadPart;
+/**
+ *
+ * Get queue depth
+ *
+ * Gets the maximum number of requests that can be in flight at once.
+ *
+ */
+int getqd(void)
 
-    //close the disk
-    CloseHandle(driveh);
+{
 
-    return 0;
+    return qdepth; // just return
 
 }
 
 /**
  *
- * Close out physical disk
+ * Submit request
  *
- * Closes the physical disk prior to exiting the diagnostic.
+ * Performs a read or write right away, and files its completion to be reaped.
+ *
+ * Returns 1 on error, 0 on success.
  *
  */
-static void closedrive(void)
+static int submit(
+    /** Request is write */               int write,
+    /** Buffer to transfer */             unsigned char *buffer,
+    /** Logical block address to start */ long long lba,
+    /** Number of sectors to transfer */  long long numsec,
+    /** Tag to return on completion */    int tag
+)
 
 {
 
-    if (phydrive >= 0) { // disk is valid
+    iocmp *cp;
+    int r;
+    long long t, s;
 
-        //close the disk
-        CloseHandle(phydriveh);
+    s = qissue; // take the send time, good for this request only
+    qissue = 0;
+    if (phydrive < 0) {
+
+        printf("*** Error: Physical drive not set\n");
+        return 1;
 
     }
+    if (qcount >= qdepth) {
+
+        printf("*** Error: Queue is full\n");
+        return 1;
+
+    }
+    // perform the transfer now
+    t = gettim();
+    if (write) r = writesector(buffer, lba, numsec);
+    else r = readsector(buffer, lba, numsec);
+    // file the completion
+    cp = &qcmp[qcount++];
+    cp->write = write;
+    cp->lba = lba;
+    cp->numsec = numsec;
+    cp->tag = tag;
+    cp->error = r;
+    cp->lat = gettim()-(s ? s : t); // from when it was meant to go
+
+    return 0; // return good
 
 }
 
 /**
  *
- * Get logical drive string
+ * Submit read
  *
- * Gets the name of the drive corresponding to the logical number.
- * Returns this as a string, or null pointer if no such drive exists.
+ * Queues a read of the given number of sectors to the indicated buffer.
+ * Returns 1 on error, 0 on success.
  *
  */
-const char* getdrvstr(int drive)
+int submitread(
+    /** Buffer to read sector to */       unsigned char *buffer,
+    /** Logical block address to start */ long long lba,
+    /** Number of sectors to read */      long long numsec,
+    /** Tag to return on completion */    int tag
+)
 
 {
 
-    const char* p;
+    return submit(0, buffer, lba, numsec, tag);
 
-    p = 0; // set no drive string
+}
 
-    // check drive is valid and set corresponding string
-    if (drive >= 0 || drive <= 9) p = phystr[drive];
+/**
+ *
+ * Submit write
+ *
+ * Queues a write of the given number of sectors from the indicated buffer.
+ * Returns 1 on error, 0 on success.
+ *
+ */
+int submitwrite(
+    /** Buffer to write sector from */    unsigned char *buffer,
+    /** Logical block address to start */ long long lba,
+    /** Number of sectors to write */     long long numsec,
+    /** Tag to return on completion */    int tag
+)
 
-    return p;
+{
+
+    return submit(1, buffer, lba, numsec, tag);
 
 }
 
 /**
  *
- * Initialize I/O package
+ * Submit batch
  *
- * Sets up this package.
+ * Queues a batch of reads or writes, each with its own buffer and LBA, tagged
+ * from tag up. ReadFileScatter and WriteFileGather move whole pages at one
+ * file offset, so they can't gather scattered LBAs. The drive is not opened
+ * overlapped, so each transfer is done synchronously, in order, and its
+ * completion filed to be reaped.
+ * Returns 1 on error, 0 on success.
  *
  */
-void initio(void)
+int submitv(
+    /** Batch is writes */                 int write,
+    /** Buffer of each transfer */         unsigned char **buffers,
+    /** Logical block address of each */   long long *lbas,
+    /** Number of sectors in each */       long long *numsecs,
+    /** Number of transfers */             int n,
+    /** Tag of first transfer */           int tag
+)
 
 {
 
-    BOOL br;
+    long long t;
+    int i;
 
-    printf("Windows interface\n");
-    printf("\n");
+    t = qissue; // the whole batch was meant to go at once
+    for (i = 0; i < n; i++) {
 
-    phydrive = -1; // set no drive is active
+        qissue = t;
+        if (submit(write, buffers[i], lbas[i], numsecs[i], tag+i)) return 1;
+
+    }
+
+    return 0; // return good
 
 }
- 
+
 /**
  *
- * Deinitialize I/O package
+ * Reap finished requests
  *
- * Tears down this package.
+ * Returns up to max finished requests in the completion array, oldest first.
+ * Since everything queued is already finished, this never waits, and the
+ * minimum is only there to match the other platforms.
+ *
+ * Returns the number of completions, or -1 on error.
  *
  */
-void deinitio(void)
+int reap(
+    /** Completion array */          iocmp *cmp,
+    /** Minimum number to wait for */ int min,
+    /** Maximum number to return */   int max
+)
 
 {
 
+    int i;
+
+    if (max > qcount) max = qcount;
+    for (i = 0; i < max; i++) cmp[i] = qcmp[i];
+    // move any remaining entries down
+    for (i = max; i < qcount; i++) qcmp[i-max] = qcmp[i];
+    qcount -= max;
+
+    return max;
+
+}
+
+/**
+ *
+ * Find requests in flight
+ *
+ * Returns the number of queued requests that have not been reaped.
+ *
+ */
+int inflight(void)
+
+{
+
+    return qcount; // just return
+
+}
+
+/**
+ *
+ * Reap finished requests by a time
+ *
+ * Returns up to max finished requests in the completion array, or if there are
+ * none, waits until the timer reaches the given time. Requests finish as they
+ * are sent, so there is nothing to wait for otherwise. The wait sleeps until
+ * SLEEPSPIN before the time and polls the rest of the way.
+ *
+ * Returns the number of completions, 0 if the time came first, or -1 on error.
+ *
+ */
+int reapby(
+    /** Completion array */          iocmp *cmp,
+    /** Maximum number to return */   int max,
+    /** Time to wait until */         long long t
+)
+
+{
+
+    if (qcount) return reap(cmp, 0, max);
+    while (t-gettim() > SLEEPSPIN) Sleep(1);
+    while (gettim() < t); // poll the rest
+
+    return 0;
+
+}
+
+/**
+ *
+ * Set send time
+ *
+ * Sets the time the next submitread, submitwrite or submitv was meant to be
+ * sent, when that is earlier than it will be. The latency of what it sends is
+ * counted from then, so a request held up behind others is not counted as
+ * faster than it was. 0 counts from when it is sent, which is also what the
+ * requests after that one do.
+ *
+ */
+void setissue(
+    /** Time meant to send, or 0 */ long long t
+)
+
+{
+
+    qissue = t;
+
+}
+
+/**
+ *
+ * Cancel queued requests
+ *
+ * Requests finish as they are sent, so there is never one in flight to
+ * cancel.
+ *
+ * Returns the number of requests cancelled.
+ *
+ */
+int cancelq(void)
+
+{
+
+    return 0; // nothing to cancel
+
+}
+
+/**
+ *
+ * Set direct access mode
+ *
+ * Turns direct access on or off. With it on, the drive is opened with
+ * FILE_FLAG_NO_BUFFERING and FILE_FLAG_WRITE_THROUGH, which bypasses the
+ * system cache, so transfer buffers must come from allocbuf(). If a drive is
+ * open, it is reopened in the new mode.
+ *
+ * Returns 1 on error, 0 on success.
+ *
+ */
+int setdirect(
+    /** Direct mode on */ int on
+)
+
+{
+
+    int old;
+
+    old = directio; // save old mode
+    directio = !!on;
+    if (phydrive >= 0 && directio != old && setdrive(phydrive)) {
+
+        // could not reopen it that way, go back to the old mode
+        directio = old;
+        setdrive(phydrive);
+
+        return 1;
+
+    }
+
+    return 0;
+
+}
+
+/**
+ *
+ * Get direct access mode
+ *
+ * Returns true if direct access is on.
+ *
+ */
+int getdirect(void)
+
+{
+
+    return directio; // just return
+
+}
+
+/**
+ *
+ * Allocate transfer buffer
+ *
+ * Allocates a buffer aligned well enough for unbuffered transfers. VirtualAlloc
+ * always gives whole pages. Large buffers are tried with large pages first,
+ * which only works if the user holds the "lock pages in memory" privilege, so
+ * failing that we fall back to normal pages.
+ *
+ * Returns the buffer, or NULL if there is no memory.
+ *
+ */
+unsigned char *allocbuf(
+    /** Size of buffer in bytes */ long long size
+)
+
+{
+
+    SIZE_T lp;
+    void *p;
+
+    p = NULL;
+    lp = GetLargePageMinimum(); // 0 if not supported
+    if (lp && size >= (long long) lp) { // large, try for large pages
+
+        p = VirtualAlloc(NULL, (SIZE_T) ((size+lp-1)/lp*lp),
+                         MEM_COMMIT | MEM_RESERVE | MEM_LARGE_PAGES,
+                         PAGE_READWRITE);
+
+    }
+    if (!p) p = VirtualAlloc(NULL, (SIZE_T) size, MEM_COMMIT | MEM_RESERVE,
+                             PAGE_READWRITE);
+
+    return (unsigned char *) p;
+
+}
+
+/**
+ *
+ * Free transfer buffer
+ *
+ * Frees a buffer from allocbuf().
+ *
+ */
+void freebuf(
+    /** Buffer to free */         unsigned char *buffer,
+    /** Size of buffer in bytes */ long long size
+)
+
+{
+
+    VirtualFree(buffer, 0, MEM_RELEASE);
+
+}
+
+/**
+ *
+ * Thread start
+ *
+ * Common start for worker threads. Runs the function for the slot.
+ *
+ */
+static DWORD WINAPI thrstart(
+    /** Slot number */ LPVOID p
+)
+
+{
+
+    int id;
+
+    id = (int) (INT_PTR) p;
+    thrfn[id](thrarg[id]);
+
+    return 0;
+
+}
+
+/**
+ *
+ * Start worker thread
+ *
+ * Starts a thread in the given worker slot that runs the function with the
+ * argument. The slot must not have a thread running in it.
+ *
+ * Returns 1 on error, 0 on success.
+ *
+ */
+int newthread(
+    /** Worker slot */       int id,
+    /** Function to run */   void (*fn)(void *),
+    /** Argument to pass */  void *arg
+)
+
+{
+
+    if (id < 0 || id >= MAXWORKERS) {
+
+        printf("*** Error: Invalid worker number\n");
+        return 1;
+
+    }
+    thrfn[id] = fn;
+    thrarg[id] = arg;
+    thrhan[id] = CreateThread(NULL, 0, thrstart, (LPVOID) (INT_PTR) id, 0,
+                              NULL);
+    if (!thrhan[id]) {
+
+        printf("*** Error: Could not start thread: Error: %d\n",
+               GetLastError());
+        return 1;
+
+    }
+
+    return 0;
+
+}
+
+/**
+ *
+ * Wait for worker thread
+ *
+ * Waits for the thread in the given worker slot to finish, then releases its
+ * handle.
+ *
+ * Returns 1 on error, 0 on success.
+ *
+ */
+int waitthread(
+    /** Worker slot */ int id
+)
+
+{
+
+    if (WaitForSingleObject(thrhan[id], INFINITE) != WAIT_OBJECT_0) {
+
+        printf("*** Error: Could not wait for thread: Error: %d\n",
+               GetLastError());
+        return 1;
+
+    }
+    CloseHandle(thrhan[id]);
+    thrhan[id] = NULL;
+
+    return 0;
+
+}
+
+/**
+ *
+ * Initialize thread I/O state
+ *
+ * Sets up the drive and queue state for the calling thread. A new thread
+ * starts with no drive and no queueing.
+ *
+ */
+void initthread(void)
+
+{
+
+    phydrive = -1; // set no drive is active
+    directio = 0; // use the system cache by default
+    qdepth = 1; // set no queueing
+    qcount = 0;
+
+}
+
+/**
+ *
+ * Deinitialize thread I/O state
+ *
+ * Closes any drive the calling thread has open.
+ *
+ */
+void deinitthread(void)
+
+{
+
+    closedrive(); // close any active drive
+
+}
+
+/**
+ *
+ * Pin thread
+ *
+ * Pins the calling thread to a CPU, or if there is none, to the CPUs of a NUMA
+ * node, or if there is neither, lets it run on any CPU of the process again.
+ * Windows takes pages from the node of the CPU that first touches them, so
+ * buffers the thread allocates and fills afterwards are local to it. Only the
+ * first processor group, of up to 64 CPUs, can be used.
+ *
+ * Returns 1 on error, 0 on success.
+ *
+ */
+int pinthread(
+    /** CPU number, or -1 for none */  int cpu,
+    /** Node number, or -1 for none */ int node
+)
+
+{
+
+    DWORD_PTR pmask, smask;
+    ULONGLONG nmask;
+
+    if (cpu >= (int) (8*sizeof(DWORD_PTR)) || node > 255) {
+
+        printf("*** Error: Invalid CPU or node number\n");
+        return 1;
+
+    }
+    if (cpu >= 0) pmask = (DWORD_PTR) 1 << cpu;
+    else if (node >= 0) {
+
+        if (!GetNumaNodeProcessorMask((UCHAR) node, &nmask) || !nmask) {
+
+            printf("*** Error: Cannot find CPUs of NUMA node %d\n", node);
+            return 1;
+
+        }
+        pmask = (DWORD_PTR) nmask;
+
+    } else if (!GetProcessAffinityMask(GetCurrentProcess(), &pmask, &smask)) {
+
+        printf("*** Error: Cannot get process affinity: Error: %d\n",
+               GetLastError());
+        return 1;
+
+    }
+    if (!SetThreadAffinityMask(GetCurrentThread(), pmask)) {
+
+        printf("*** Error: Cannot set CPU affinity: Error: %d\n", GetLastError());
+        return 1;
+
+    }
+
+    return 0;
+
+}
+
+/**
+ *
+ * Get drive NUMA node
+ *
+ * Windows only gives the node of a disc controller through the device setup
+ * tree, which is not searched here, so it is not known.
+ *
+ * Returns -1, not known.
+ *
+ */
+int drivenode(
+    /** Drive number */ int drive
+)
+
+{
+
+    return -1;
+
+}
+
+/**
+ *
+ * Find size of physical disc
+ *
+ * Returns 0 on succeed, 1 on fail.
+ *
+ */
+int physize(
+    /** return size of disc */ long long *size
+)
+
+{
+
+    if (phydrive < 0) {
+
+        printf("*** Error: Physical drive not set\n");
+        return 1;
+
+    }
+
+    // get size of disk
+    if (getsize(phydriveh, size)) {
+
+        printf("*** Error: Cannot get size of disk\n");
+        return 1;
+
+    }
+
+    return 0;
+
+}
+
+/**
+ *
+ * Find size of open drive
+ *
+ * Disks give their size through IOCTL_DISK_GET_LENGTH_INFO. Image files are
+ * the size of the file.
+ *
+ * Returns 0 on succeed, 1 on fail.
+ *
+ */
+static int getsize(
+    /** Open handle */         HANDLE h,
+    /** return size of disc */ long long *size
+)
+
+{
+
+    GET_LENGTH_INFORMATION li;
+    LARGE_INTEGER fs;
+    DWORD rsize;
+
+    if (DeviceIoControl(h, IOCTL_DISK_GET_LENGTH_INFO, NULL, 0, &li, sizeof(li),
+                        &rsize, NULL)) {
+
+        *size = li.Length.QuadPart;
+        return 0;
+
+    }
+    if (GetFileType(h) == FILE_TYPE_DISK && GetFileSizeEx(h, &fs)) {
+
+        *size = fs.QuadPart; // a file, not a device
+        return 0;
+
+    }
+
+    return 1;
+
+}
+
+/**
+ *
+ * Get sector sizes of physical disc
+ *
+ * Gets the logical sector size, which LBAs and transfers are counted in, and
+ * the physical sector size the drive writes in.
+ *
+ * Returns 0 on succeed, 1 on fail.
+ *
+ */
+int sectorsize(
+    /** return logical sector size */  int *lsize,
+    /** return physical sector size */ int *psize
+)
+
+{
+
+    if (phydrive < 0) {
+
+        printf("*** Error: Physical drive not set\n");
+        return 1;
+
+    }
+    *lsize = lsecsize;
+    *psize = psecsize;
+
+    return 0;
+
+}
+
+/**
+ *
+ * Set device option
+ *
+ * Device options are for the simulated disc. There are none for real drives.
+ *
+ * Returns 1 on error, 0 on success.
+ *
+ */
+int devopt(
+    /** Option name, or NULL to list */ const char *name,
+    /** Value to set */                 long long val
+)
+
+{
+
+    if (!name) {
+
+        printf("No device options\n");
+        return 0;
+
+    }
+    printf("*** Error: Device option not recognized\n");
+
+    return 1;
+
+}
+
+/**
+ *
+ * Test size of physical disc
+ *
+ * Same as physize, but works on disks that are not opened.
+ * Takes the number of the disk.
+ *
+ * Note: does not print on error.
+ *
+ * Returns 0 on succeed, 1 on fail.
+ *
+ */
+int testsize(
+    /** drive number to set */ int drive,
+    /** return size of disc */ long long *size
+)
+
+{
+
+    HANDLE driveh;
+    int r;
+
+    if (drive < 0 || drive >= physcount) return 1; // no such drive
+    //open the physical disk
+    driveh = CreateFile(phystr[drive],
+                     GENERIC_READ | GENERIC_WRITE,
+                     FILE_SHARE_DELETE |
+                     FILE_SHARE_READ |
+                     FILE_SHARE_WRITE,
+                     NULL,
+                     OPEN_EXISTING,
+                     0,
+                     NULL);
+
+    if (driveh == INVALID_HANDLE_VALUE) return 1;
+
+    // get size of disk
+    r = getsize(driveh, size);
+
+    //close the disk
+    CloseHandle(driveh);
+
+    return r;
+
+}
+
+/**
+ *
+ * Close out physical disk
+ *
+ * Closes the physical disk prior to exiting the diagnostic.
+ *
+ */
+static void closedrive(void)
+
+{
+
+    if (phydrive >= 0) { // disk is valid
+
+        //close the disk
+        CloseHandle(phydriveh);
+
+    }
+
+}
+
+/**
+ *
+ * Get logical drive string
+ *
+ * Gets the name of the drive corresponding to the logical number.
+ * Returns this as a string, or null pointer if no such drive exists.
+ *
+ */
+const char* getdrvstr(int drive)
+
+{
+
+    const char* p;
+
+    p = 0; // set no drive string
+
+    // check drive is valid and set corresponding string
+    if (drive >= 0 && drive < physcount) p = phystr[drive];
+
+    return p;
+
+}
+
+/**
+ *
+ * Add drive
+ *
+ * Gives a path a drive number, so it can be used like any other drive. The
+ * path can be a device, like \\.\PhysicalDrive12, or an image file. A path
+ * that already has a number keeps it.
+ *
+ * Returns the drive number, or -1 on error.
+ *
+ */
+int adddrive(
+    /** Path of device or file */ const char *path
+)
+
+{
+
+    char *p;
+    int i;
+
+    for (i = 0; i < physcount; i++)
+        if (!strcmp(phystr[i], path)) return i; // already known
+    if (physcount >= MAXDRIVES) {
+
+        printf("*** Error: No more than %d drives can be known\n", MAXDRIVES);
+        return -1;
+
+    }
+    p = (char *) malloc(strlen(path)+1);
+    if (!p) {
+
+        printf("*** Error: Cannot allocate space\n");
+        return -1;
+
+    }
+    strcpy(p, path);
+    phystr[physcount] = p;
+    physalloc[physcount] = 1;
+
+    return physcount++;
+
+}
+
+/**
+ *
+ * Get high resolution timer
+ *
+ * Returns the performance counter in nanoseconds. The counter is split into
+ * whole seconds and the remainder before scaling, so that it can't overflow.
+ *
+ */
+long long gettim(void)
+
+{
+
+    LARGE_INTEGER c;
+
+    QueryPerformanceCounter(&c);
+
+    return c.QuadPart/frequency*1000000000LL+
+           c.QuadPart%frequency*1000000000LL/frequency;
+
+}
+
+/**
+ *
+ * Find elapsed time in seconds
+ *
+ * Finds the seconds passed since the given timer reading. Returns as a floating
+ * point value so that fractional times can be represented.
+ *
+ */
+double elapsed(
+    /** reference time */ long long t
+)
+
+{
+
+    return (gettim()-t)/1000000000.0;
+
+}
+
+/**
+ *
+ * Initialize I/O package
+ *
+ * Sets up this package.
+ *
+ */
+void initio(void)
+
+{
+
+    BOOL br;
+    LARGE_INTEGER f;
+
+    printf("Windows interface\n");
+    printf("\n");
+
+    initthread(); // set up the main thread
+    br = QueryPerformanceFrequency(&f); // get timer rate
+    frequency = br ? f.QuadPart : 1000; // never fails after XP, but be safe
+
+}
+ 
+/**
+ *
+ * Deinitialize I/O package
+ *
+ * Tears down this package.
+ *
+ */
+void deinitio(void)
+
+{
+
+    int i;
+
     closedrive(); // close any active drive
+    for (i = 0; i < physcount; i++) // free the paths added
+        if (physalloc[i]) free((void *) phystr[i]);
 
 } 